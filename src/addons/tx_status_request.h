@@ -261,7 +261,7 @@ static bool saveStateTxStatus(const unsigned int numberOfTransactions, CHAR16* d
     }
 
     static unsigned short CONFIRMED_TX_SNAPSHOT_FILE_NAME[] = L"snapshotConfirmedTx";
-    savedSize = saveLargeFile(CONFIRMED_TX_SNAPSHOT_FILE_NAME, numberOfTransactions*sizeof(ConfirmedTx), (unsigned char*)confirmedTx, directory);
+    savedSize = saveLargeFile(CONFIRMED_TX_SNAPSHOT_FILE_NAME, numberOfTransactions*sizeof(ConfirmedTx), (unsigned char*)confirmedTx, directory, true, SAVE_COMPRESSED_STATE_FILES);
     if (savedSize != numberOfTransactions * sizeof(ConfirmedTx))
     {
         logToConsole(L"Failed to save ConfirmedTx");
@@ -3,9 +3,13 @@
 #include "platform/global_var.h"
 #include "platform/m256.h"
 #include "platform/concurrency.h"
+#include "platform/read_write_lock.h"
 #include "platform/uefi.h"
 #include "platform/file_io.h"
 #include "platform/time_stamp_counter.h"
+#include "platform/parallel_job.h"
+#include "platform/copy_on_write_snapshot.h"
+#include "platform/delta_snapshot.h"
 
 #include "network_messages/assets.h"
 
@@ -18,20 +22,25 @@
 #include "common_buffers.h"
 
 
+// universeLock is a reader/writer lock: functions that only read the universe (share queries, network requests,
+// saving) acquire it for reading and can run in parallel, functions that change records acquire it for writing.
+//
 // CAUTION: Currently, there is no locking of universeLock if contracts use the QPI asset iteration classes directly.
 // This shouldn't be a problem as long as:
 // - write access to assets only happens in contractProcessor(), which runs contract procedures,
 //   or tickProcessor(), which doesn't run in parallel to contractProcessor(),
 //   or during a single-threading phase (node startup); NO WRITING OF ASSETS IN REQUEST PROCESSOR OR MAIN THREAD!
 // - QPI asset iteration classes do not allow writing access to the universe (if this is changed in the future,
-//   note that all write access requires locking universeLock)
+//   note that all write access requires locking universeLock for writing)
 
 // TODO: move this into AssetStorage class
-GLOBAL_VAR_DECL volatile char universeLock GLOBAL_VAR_INIT(0);
+GLOBAL_VAR_DECL ReadWriteLock universeLock;
 GLOBAL_VAR_DECL Asset* assets GLOBAL_VAR_INIT(nullptr);
 GLOBAL_VAR_DECL m256i* assetDigests GLOBAL_VAR_INIT(nullptr);
 static constexpr unsigned long long assetDigestsSizeInBytes = (ASSETS_CAPACITY * 2 - 1) * 32ULL;
 GLOBAL_VAR_DECL unsigned long long* assetChangeFlags GLOBAL_VAR_INIT(nullptr);
+// Asset records changed since the universe file has been saved the last time (for saving deltas)
+GLOBAL_VAR_DECL DeltaSnapshot<Asset, ASSETS_CAPACITY> universeDeltaSnapshot;
 static constexpr char CONTRACT_ASSET_UNIT_OF_MEASUREMENT[7] = { 0, 0, 0, 0, 0, 0, 0 };
 
 static constexpr unsigned int NO_ASSET_INDEX = 0xffffffff;
@@ -54,6 +63,7 @@ public: // TODO: make protected
     // - all issuances,
     // - all ownerships belonging to each issuance
     // - all possessions belonging to each ownership
+    // - all records (issuances, ownerships, and possessions) of each entity
     struct IndexLists
     {
         unsigned int issuancesFirstIdx;
@@ -61,6 +71,27 @@ public: // TODO: make protected
 
         unsigned int nextIdx[ASSETS_CAPACITY];
 
+        // The records of an entity are in the list of the slot the hash map probing for its public key starts at,
+        // which is shared with the (rare) other entities mapped to the same slot.
+        unsigned int entityRecordsFirstIdx[ASSETS_CAPACITY];
+        unsigned int entityRecordsNextIdx[ASSETS_CAPACITY];
+
+        static unsigned int entitySlot(const m256i& publicKey)
+        {
+            return publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
+        }
+
+        // Add newRecordIdx as first element in linked list of all records of the entity (must be called with each
+        // new record)
+        void addEntityRecord(unsigned int newRecordIdx)
+        {
+            ASSERT(newRecordIdx < ASSETS_CAPACITY);
+            ASSERT(assets[newRecordIdx].varStruct.issuance.type != EMPTY);
+            const unsigned int slot = entitySlot(assets[newRecordIdx].varStruct.issuance.publicKey);
+            entityRecordsNextIdx[newRecordIdx] = entityRecordsFirstIdx[slot];
+            entityRecordsFirstIdx[slot] = newRecordIdx;
+        }
+
         void addIssuance(unsigned int newIssuanceIdx)
         {
             // add as first element in linked list of all issuances
@@ -69,6 +100,7 @@ public: // TODO: make protected
             ASSERT(issuancesFirstIdx == NO_ASSET_INDEX || assets[issuancesFirstIdx].varStruct.issuance.type == ISSUANCE);
             nextIdx[newIssuanceIdx] = issuancesFirstIdx;
             issuancesFirstIdx = newIssuanceIdx;
+            addEntityRecord(newIssuanceIdx);
         }
 
         // Add newOwnershipIdx as first element in linked list of all ownerships of issuanceIdx
@@ -81,6 +113,7 @@ public: // TODO: make protected
             ASSERT(ownnershipsPossessionsFirstIdx[issuanceIdx] == NO_ASSET_INDEX || assets[ownnershipsPossessionsFirstIdx[issuanceIdx]].varStruct.issuance.type == OWNERSHIP);
             nextIdx[newOwnershipIdx] = ownnershipsPossessionsFirstIdx[issuanceIdx];
             ownnershipsPossessionsFirstIdx[issuanceIdx] = newOwnershipIdx;
+            addEntityRecord(newOwnershipIdx);
         }
 
         // Add newPossessionIdx as first element in linked list of all possessions of ownershipIdx
@@ -93,6 +126,7 @@ public: // TODO: make protected
             ASSERT(ownnershipsPossessionsFirstIdx[ownershipIdx] == NO_ASSET_INDEX || assets[ownnershipsPossessionsFirstIdx[ownershipIdx]].varStruct.possession.type == POSSESSION);
             nextIdx[newPossessionIdx] = ownnershipsPossessionsFirstIdx[ownershipIdx];
             ownnershipsPossessionsFirstIdx[ownershipIdx] = newPossessionIdx;
+            addEntityRecord(newPossessionIdx);
         }
 
         // Reset lists to empty
@@ -102,6 +136,8 @@ public: // TODO: make protected
             static_assert(NO_ASSET_INDEX == 0xffffffff, "Following setMem() expects NO_ASSET_INDEX == 0xffffffff");
             setMem(ownnershipsPossessionsFirstIdx, sizeof(ownnershipsPossessionsFirstIdx), 0xff);
             setMem(nextIdx, sizeof(nextIdx), 0xff);
+            setMem(entityRecordsFirstIdx, sizeof(entityRecordsFirstIdx), 0xff);
+            setMem(entityRecordsNextIdx, sizeof(entityRecordsNextIdx), 0xff);
         }
 
         // Rebuild lists from assets array (includes reset)
@@ -157,6 +193,13 @@ static unsigned int issuanceIndex(const m256i& issuer, unsigned long long assetN
 
 
 
+// Record change of asset record for updating digests and saving deltas (caller needs to hold universeLock for writing)
+static void markAssetChanged(unsigned int index)
+{
+    assetChangeFlags[index >> 6] |= (1ULL << (index & 63));
+    universeDeltaSnapshot.markChanged(index);
+}
+
 static bool initAssets()
 {
     if (!allocatePool(ASSETS_CAPACITY * sizeof(Asset), (void**)&assets)
@@ -167,6 +210,7 @@ static bool initAssets()
         return false;
     }
     setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0xFF);
+    universeLock.reset();
     return true;
 }
 
@@ -194,11 +238,12 @@ static long long issueAsset(const m256i& issuerPublicKey, const char name[7], ch
 {
     *issuanceIndex = issuerPublicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
 
-    ACQUIRE(universeLock);
+    universeLock.acquireWrite();
 
 iteration:
     if (assets[*issuanceIndex].varStruct.issuance.type == EMPTY)
     {
+        nodeStateSnapshot.beforeWrite(&assets[*issuanceIndex], sizeof(Asset));
         assets[*issuanceIndex].varStruct.issuance.publicKey = issuerPublicKey;
         assets[*issuanceIndex].varStruct.issuance.type = ISSUANCE;
         copyMem(assets[*issuanceIndex].varStruct.issuance.name, name, sizeof(assets[*issuanceIndex].varStruct.issuance.name));
@@ -209,6 +254,7 @@ iteration:
     iteration2:
         if (assets[*ownershipIndex].varStruct.ownership.type == EMPTY)
         {
+            nodeStateSnapshot.beforeWrite(&assets[*ownershipIndex], sizeof(Asset));
             assets[*ownershipIndex].varStruct.ownership.publicKey = issuerPublicKey;
             assets[*ownershipIndex].varStruct.ownership.type = OWNERSHIP;
             assets[*ownershipIndex].varStruct.ownership.managingContractIndex = managingContractIndex;
@@ -219,21 +265,22 @@ iteration:
         iteration3:
             if (assets[*possessionIndex].varStruct.possession.type == EMPTY)
             {
+                nodeStateSnapshot.beforeWrite(&assets[*possessionIndex], sizeof(Asset));
                 assets[*possessionIndex].varStruct.possession.publicKey = issuerPublicKey;
                 assets[*possessionIndex].varStruct.possession.type = POSSESSION;
                 assets[*possessionIndex].varStruct.possession.managingContractIndex = managingContractIndex;
                 assets[*possessionIndex].varStruct.possession.ownershipIndex = *ownershipIndex;
                 assets[*possessionIndex].varStruct.possession.numberOfShares = numberOfShares;
 
-                assetChangeFlags[*issuanceIndex >> 6] |= (1ULL << (*issuanceIndex & 63));
-                assetChangeFlags[*ownershipIndex >> 6] |= (1ULL << (*ownershipIndex & 63));
-                assetChangeFlags[*possessionIndex >> 6] |= (1ULL << (*possessionIndex & 63));
+                markAssetChanged(*issuanceIndex);
+                markAssetChanged(*ownershipIndex);
+                markAssetChanged(*possessionIndex);
 
                 as.indexLists.addIssuance(*issuanceIndex);
                 as.indexLists.addOwnership(*issuanceIndex, *ownershipIndex);
                 as.indexLists.addPossession(*ownershipIndex, *possessionIndex);
 
-                RELEASE(universeLock);
+                universeLock.releaseWrite();
 
                 AssetIssuance assetIssuance;
                 assetIssuance.issuerPublicKey = issuerPublicKey;
@@ -265,7 +312,7 @@ iteration:
             && ((*((unsigned long long*)assets[*issuanceIndex].varStruct.issuance.name)) & 0xFFFFFFFFFFFFFF) == ((*((unsigned long long*)name)) & 0xFFFFFFFFFFFFFF)
             && assets[*issuanceIndex].varStruct.issuance.publicKey == issuerPublicKey)
         {
-            RELEASE(universeLock);
+            universeLock.releaseWrite();
             return 0;
         }
 
@@ -280,7 +327,7 @@ static sint64 numberOfShares(
     const AssetOwnershipSelect& ownership = AssetOwnershipSelect::any(),
     const AssetPossessionSelect& possession = AssetPossessionSelect::any())
 {
-    ACQUIRE(universeLock);
+    universeLock.acquireRead();
 
     sint64 numOfShares = 0;
     if (possession.anyPossessor && possession.anyManagingContract)
@@ -298,7 +345,7 @@ static sint64 numberOfShares(
         }
     }
 
-    RELEASE(universeLock);
+    universeLock.releaseRead();
 
     return numOfShares;
 }
@@ -314,7 +361,7 @@ static bool transferShareOwnershipAndPossession(int sourceOwnershipIndex, int so
 
     if (lock)
     {
-        ACQUIRE(universeLock);
+        universeLock.acquireWrite();
     }
 
     if (assets[sourceOwnershipIndex].varStruct.ownership.type != OWNERSHIP || assets[sourceOwnershipIndex].varStruct.ownership.numberOfShares < numberOfShares
@@ -323,7 +370,7 @@ static bool transferShareOwnershipAndPossession(int sourceOwnershipIndex, int so
     {
         if (lock)
         {
-            RELEASE(universeLock);
+            universeLock.releaseWrite();
         }
 
         return false;
@@ -337,6 +384,8 @@ iteration:
             && assets[*destinationOwnershipIndex].varStruct.ownership.issuanceIndex == assets[sourceOwnershipIndex].varStruct.ownership.issuanceIndex
             && assets[*destinationOwnershipIndex].varStruct.ownership.publicKey == destinationPublicKey))
     {
+        nodeStateSnapshot.beforeWrite(&assets[sourceOwnershipIndex], sizeof(Asset));
+        nodeStateSnapshot.beforeWrite(&assets[*destinationOwnershipIndex], sizeof(Asset));
         assets[sourceOwnershipIndex].varStruct.ownership.numberOfShares -= numberOfShares;
 
         if (assets[*destinationOwnershipIndex].varStruct.ownership.type == EMPTY)
@@ -358,6 +407,8 @@ iteration:
                 && assets[*destinationPossessionIndex].varStruct.possession.ownershipIndex == *destinationOwnershipIndex
                 && assets[*destinationPossessionIndex].varStruct.possession.publicKey == destinationPublicKey))
         {
+            nodeStateSnapshot.beforeWrite(&assets[sourcePossessionIndex], sizeof(Asset));
+            nodeStateSnapshot.beforeWrite(&assets[*destinationPossessionIndex], sizeof(Asset));
             assets[sourcePossessionIndex].varStruct.possession.numberOfShares -= numberOfShares;
 
             if (assets[*destinationPossessionIndex].varStruct.possession.type == EMPTY)
@@ -371,14 +422,14 @@ iteration:
             }
             assets[*destinationPossessionIndex].varStruct.possession.numberOfShares += numberOfShares;
 
-            assetChangeFlags[sourceOwnershipIndex >> 6] |= (1ULL << (sourceOwnershipIndex & 63));
-            assetChangeFlags[sourcePossessionIndex >> 6] |= (1ULL << (sourcePossessionIndex & 63));
-            assetChangeFlags[*destinationOwnershipIndex >> 6] |= (1ULL << (*destinationOwnershipIndex & 63));
-            assetChangeFlags[*destinationPossessionIndex >> 6] |= (1ULL << (*destinationPossessionIndex & 63));
+            markAssetChanged(sourceOwnershipIndex);
+            markAssetChanged(sourcePossessionIndex);
+            markAssetChanged(*destinationOwnershipIndex);
+            markAssetChanged(*destinationPossessionIndex);
 
             if (lock)
             {
-                RELEASE(universeLock);
+                universeLock.releaseWrite();
             }
 
             AssetOwnershipChange assetOwnershipChange;
@@ -420,13 +471,13 @@ iteration:
 
 static long long numberOfPossessedShares(unsigned long long assetName, const m256i& issuer, const m256i& owner, const m256i& possessor, unsigned short ownershipManagingContractIndex, unsigned short possessionManagingContractIndex)
 {
-    ACQUIRE(universeLock);
+    universeLock.acquireRead();
 
     int issuanceIndex = issuer.m256i_u32[0] & (ASSETS_CAPACITY - 1);
 iteration:
     if (assets[issuanceIndex].varStruct.issuance.type == EMPTY)
     {
-        RELEASE(universeLock);
+        universeLock.releaseRead();
 
         return 0;
     }
@@ -440,7 +491,7 @@ iteration:
         iteration2:
             if (assets[ownershipIndex].varStruct.ownership.type == EMPTY)
             {
-                RELEASE(universeLock);
+                universeLock.releaseRead();
 
                 return 0;
             }
@@ -455,7 +506,7 @@ iteration:
                 iteration3:
                     if (assets[possessionIndex].varStruct.possession.type == EMPTY)
                     {
-                        RELEASE(universeLock);
+                        universeLock.releaseRead();
 
                         return 0;
                     }
@@ -468,7 +519,7 @@ iteration:
                         {
                             const long long numberOfPossessedShares = assets[possessionIndex].varStruct.possession.numberOfShares;
 
-                            RELEASE(universeLock);
+                            universeLock.releaseRead();
 
                             return numberOfPossessedShares;
                         }
@@ -505,9 +556,11 @@ static void getUniverseDigest(m256i& digest)
     {
         if (assetChangeFlags[digestIndex >> 6] & (1ULL << (digestIndex & 63)))
         {
+            nodeStateSnapshot.beforeWrite(&assetDigests[digestIndex], sizeof(m256i));
             KangarooTwelve(&assets[digestIndex], sizeof(Asset), &assetDigests[digestIndex], 32);
         }
     }
+    KangarooTwelve64To32Batch batch;
     unsigned int previousLevelBeginning = 0;
     unsigned int numberOfLeafs = ASSETS_CAPACITY;
     while (numberOfLeafs > 1)
@@ -516,12 +569,14 @@ static void getUniverseDigest(m256i& digest)
         {
             if (assetChangeFlags[i >> 6] & (3ULL << (i & 63)))
             {
-                KangarooTwelve64To32(&assetDigests[previousLevelBeginning + i], &assetDigests[digestIndex]);
+                nodeStateSnapshot.beforeWrite(&assetDigests[digestIndex], sizeof(m256i));
+                batch.add(&assetDigests[previousLevelBeginning + i], &assetDigests[digestIndex]);
                 assetChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
                 assetChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
             }
             digestIndex++;
         }
+        batch.flush();
         previousLevelBeginning += numberOfLeafs;
         numberOfLeafs >>= 1;
     }
@@ -530,6 +585,68 @@ static void getUniverseDigest(m256i& digest)
     digest = assetDigests[(ASSETS_CAPACITY * 2 - 1) - 1];
 }
 
+// Number of tasks of parallel universe digest computation (fixed, independent of the number of processors)
+static constexpr unsigned int UNIVERSE_DIGEST_TASKS = 64;
+static_assert(ASSETS_CAPACITY % UNIVERSE_DIGEST_TASKS == 0, "ASSETS_CAPACITY must be multiple of UNIVERSE_DIGEST_TASKS");
+
+// Task of ParallelJob: compute leaf digests of one part of the universe and the subtree of digests above them
+static void computeUniverseDigestsTask(void*, unsigned int taskIndex)
+{
+    unsigned int digestsPerTask = ASSETS_CAPACITY / UNIVERSE_DIGEST_TASKS;
+    for (unsigned int i = taskIndex * digestsPerTask; i < (taskIndex + 1) * digestsPerTask; i++)
+    {
+        KangarooTwelve(&assets[i], sizeof(Asset), &assetDigests[i], 32);
+    }
+
+    unsigned int levelBeginning = 0;
+    unsigned int numberOfLeafs = ASSETS_CAPACITY;
+    while (digestsPerTask > 1)
+    {
+        KangarooTwelve64To32Multiple(&assetDigests[levelBeginning + taskIndex * digestsPerTask],
+            &assetDigests[levelBeginning + numberOfLeafs + taskIndex * (digestsPerTask >> 1)], digestsPerTask >> 1);
+        levelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
+        digestsPerTask >>= 1;
+    }
+}
+
+// Start computing all universe digests from scratch (after loading the universe) with parallelJob. The calling
+// processor can do other work (such as loading files) until it calls finishComputingUniverseDigests().
+static void startComputingUniverseDigests()
+{
+    nodeStateSnapshot.beforeWrite(assetDigests, assetDigestsSizeInBytes);
+    parallelJob.start(computeUniverseDigestsTask, nullptr, UNIVERSE_DIGEST_TASKS);
+}
+
+// Wait for the tasks started by startComputingUniverseDigests(), compute the top levels of the digest tree, and
+// return the universe digest. The result is the same as with getUniverseDigest().
+static void finishComputingUniverseDigests(m256i& digest)
+{
+    parallelJob.finish();
+
+    unsigned int previousLevelBeginning = 0;
+    unsigned int numberOfLeafs = ASSETS_CAPACITY;
+    while (numberOfLeafs > UNIVERSE_DIGEST_TASKS)
+    {
+        previousLevelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
+    }
+    unsigned int digestIndex = previousLevelBeginning + numberOfLeafs;
+    while (numberOfLeafs > 1)
+    {
+        KangarooTwelve64To32Multiple(&assetDigests[previousLevelBeginning], &assetDigests[digestIndex], numberOfLeafs >> 1);
+        digestIndex += numberOfLeafs >> 1;
+
+        previousLevelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
+    }
+
+    // All digests are up to date
+    setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0);
+
+    digest = assetDigests[(ASSETS_CAPACITY * 2 - 1) - 1];
+}
+
 
 static bool saveUniverse(const CHAR16* fileName = UNIVERSE_FILE_NAME, const CHAR16* directory = NULL)
 {
@@ -537,14 +654,17 @@ static bool saveUniverse(const CHAR16* fileName = UNIVERSE_FILE_NAME, const CHAR
 
     const unsigned long long beginningTick = __rdtsc();
 
-    ACQUIRE(universeLock);
-    long long savedSize = save(fileName, ASSETS_CAPACITY * sizeof(Asset), (unsigned char*)assets, directory);
-    RELEASE(universeLock);
+    universeLock.acquireRead();
+#if !SAVE_STATE_DELTA_FILES
+    universeDeltaSnapshot.markAllChanged();
+#endif
+    long long savedSize = universeDeltaSnapshot.save(fileName, assets, directory, SAVE_COMPRESSED_STATE_FILES);
+    universeLock.releaseRead();
 
-    if (savedSize == ASSETS_CAPACITY * sizeof(Asset))
+    if (savedSize >= 0)
     {
         setNumber(message, savedSize, TRUE);
-        appendText(message, L" bytes of the universe data are saved (");
+        appendText(message, (savedSize == ASSETS_CAPACITY * sizeof(Asset)) ? L" bytes of the universe data are saved (" : L" bytes of the universe delta are saved (");
         appendNumber(message, (__rdtsc() - beginningTick) * 1000000 / frequency, TRUE);
         appendText(message, L" microseconds).");
         logToConsole(message);
@@ -555,10 +675,9 @@ static bool saveUniverse(const CHAR16* fileName = UNIVERSE_FILE_NAME, const CHAR
 
 static bool loadUniverse(const CHAR16* fileName = UNIVERSE_FILE_NAME, CHAR16* directory = NULL)
 {
-    long long loadedSize = load(fileName, ASSETS_CAPACITY * sizeof(Asset), (unsigned char*)assets, directory);
-    if (loadedSize != ASSETS_CAPACITY * sizeof(Asset))
+    if (!universeDeltaSnapshot.load(fileName, assets, directory))
     {
-        logStatusToConsole(L"EFI_FILE_PROTOCOL.Read() reads invalid number of bytes", loadedSize, __LINE__);
+        logToConsole(L"Failed to load universe file and its deltas!");
 
         return false;
     }
@@ -568,7 +687,7 @@ static bool loadUniverse(const CHAR16* fileName = UNIVERSE_FILE_NAME, CHAR16* di
 
 static void assetsEndEpoch()
 {
-    ACQUIRE(universeLock);
+    universeLock.acquireWrite();
 
     // rebuild asset hash map, getting rid of all elements with zero shares
     Asset* reorgAssets = (Asset*)reorgBuffer;
@@ -651,11 +770,13 @@ static void assetsEndEpoch()
             }
         }
     }
+    nodeStateSnapshot.beforeWrite(assets, ASSETS_CAPACITY * sizeof(Asset));
     copyMem(assets, reorgAssets, ASSETS_CAPACITY * sizeof(Asset));
 
     setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0xFF);
+    universeDeltaSnapshot.markAllChanged();
 
     as.indexLists.rebuild();
 
-    RELEASE(universeLock);
+    universeLock.releaseWrite();
 }
@@ -10,17 +10,11 @@ static void processRequestIssuedAssets(Peer* peer, RequestResponseHeader* header
 
     RequestIssuedAssets* request = header->getPayload<RequestIssuedAssets>();
 
-    unsigned int universeIndex = request->publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
+    universeLock.acquireRead();
 
-    ACQUIRE(universeLock);
-
-iteration:
-    if (universeIndex >= ASSETS_CAPACITY
-        || assets[universeIndex].varStruct.issuance.type == EMPTY)
-    {
-        enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
-    }
-    else
+    // Only check the records of the entity instead of probing the hash map
+    unsigned int universeIndex = as.indexLists.entityRecordsFirstIdx[AssetStorage::IndexLists::entitySlot(request->publicKey)];
+    while (universeIndex != NO_ASSET_INDEX)
     {
         if (assets[universeIndex].varStruct.issuance.type == ISSUANCE
             && assets[universeIndex].varStruct.issuance.publicKey == request->publicKey)
@@ -33,12 +27,11 @@ iteration:
             enqueueResponse(peer, sizeof(response), RespondIssuedAssets::type, header->dejavu(), &response);
         }
 
-        universeIndex = (universeIndex + 1) & (ASSETS_CAPACITY - 1);
-
-        goto iteration;
+        universeIndex = as.indexLists.entityRecordsNextIdx[universeIndex];
     }
+    enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
 
-    RELEASE(universeLock);
+    universeLock.releaseRead();
 }
 
 static void processRequestOwnedAssets(Peer* peer, RequestResponseHeader* header)
@@ -47,17 +40,11 @@ static void processRequestOwnedAssets(Peer* peer, RequestResponseHeader* header)
 
     RequestOwnedAssets* request = header->getPayload<RequestOwnedAssets>();
 
-    unsigned int universeIndex = request->publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
-
-    ACQUIRE(universeLock);
+    universeLock.acquireRead();
 
-iteration:
-    if (universeIndex >= ASSETS_CAPACITY
-        || assets[universeIndex].varStruct.issuance.type == EMPTY)
-    {
-        enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
-    }
-    else
+    // Only check the records of the entity instead of probing the hash map
+    unsigned int universeIndex = as.indexLists.entityRecordsFirstIdx[AssetStorage::IndexLists::entitySlot(request->publicKey)];
+    while (universeIndex != NO_ASSET_INDEX)
     {
         if (assets[universeIndex].varStruct.issuance.type == OWNERSHIP
             && assets[universeIndex].varStruct.issuance.publicKey == request->publicKey)
@@ -71,12 +58,11 @@ iteration:
             enqueueResponse(peer, sizeof(response), RespondOwnedAssets::type, header->dejavu(), &response);
         }
 
-        universeIndex = (universeIndex + 1) & (ASSETS_CAPACITY - 1);
-
-        goto iteration;
+        universeIndex = as.indexLists.entityRecordsNextIdx[universeIndex];
     }
+    enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
 
-    RELEASE(universeLock);
+    universeLock.releaseRead();
 }
 
 static void processRequestPossessedAssets(Peer* peer, RequestResponseHeader* header)
@@ -85,17 +71,11 @@ static void processRequestPossessedAssets(Peer* peer, RequestResponseHeader* hea
 
     RequestPossessedAssets* request = header->getPayload<RequestPossessedAssets>();
 
-    unsigned int universeIndex = request->publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
-
-    ACQUIRE(universeLock);
+    universeLock.acquireRead();
 
-iteration:
-    if (universeIndex >= ASSETS_CAPACITY
-        || assets[universeIndex].varStruct.issuance.type == EMPTY)
-    {
-        enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
-    }
-    else
+    // Only check the records of the entity instead of probing the hash map
+    unsigned int universeIndex = as.indexLists.entityRecordsFirstIdx[AssetStorage::IndexLists::entitySlot(request->publicKey)];
+    while (universeIndex != NO_ASSET_INDEX)
     {
         if (assets[universeIndex].varStruct.issuance.type == POSSESSION
             && assets[universeIndex].varStruct.issuance.publicKey == request->publicKey)
@@ -110,10 +90,9 @@ iteration:
             enqueueResponse(peer, sizeof(response), RespondPossessedAssets::type, header->dejavu(), &response);
         }
 
-        universeIndex = (universeIndex + 1) & (ASSETS_CAPACITY - 1);
-
-        goto iteration;
+        universeIndex = as.indexLists.entityRecordsNextIdx[universeIndex];
     }
+    enqueueResponse(peer, 0, EndResponse::type, header->dejavu(), NULL);
 
-    RELEASE(universeLock);
+    universeLock.releaseRead();
 }
@@ -229,6 +229,14 @@ constexpr struct ContractDescription
 
 constexpr unsigned int contractCount = sizeof(contractDescriptions) / sizeof(contractDescriptions[0]);
 
+// Contracts whose user procedures only access the state of the contract itself: no QU transfers or burning, no asset
+// management, no calls of other contracts, and no logging. Invocations of these may run in parallel to other
+// transactions of the tick (see contract_procedure_scheduler.h). Only add a contract after checking all of its user
+// procedures, and remove it if a later update of the contract breaks one of the conditions.
+constexpr unsigned int isolatedContractIndices[] = {
+    GQMPROP_CONTRACT_INDEX,
+};
+
 GLOBAL_VAR_DECL EXPAND_PROCEDURE contractExpandProcedures[contractCount];
 
 // TODO: all below are filled very sparsely, so a better data structure could save almost all the memory
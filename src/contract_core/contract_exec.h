@@ -8,6 +8,7 @@
 #include "platform/read_write_lock.h"
 #include "platform/debugging.h"
 #include "platform/memory.h"
+#include "platform/copy_on_write_snapshot.h"
 
 #include "contract_core/contract_def.h"
 #include "contract_core/stack_buffer.h"
@@ -44,8 +45,8 @@ GLOBAL_VAR_DECL unsigned char* contractStates[contractCount];
 GLOBAL_VAR_DECL volatile long long contractTotalExecutionTicks[contractCount];
 GLOBAL_VAR_DECL unsigned int contractError[contractCount];
 
-// TODO: If we ever have parallel procedure calls (of different contracts), we need to make
-// access to contractStateChangeFlags thread-safe
+// Flags of contracts whose state may have changed since the last computer digest. Procedures of different contracts may
+// run in parallel, so flags are only set with setContractStateChanged().
 GLOBAL_VAR_DECL unsigned long long* contractStateChangeFlags GLOBAL_VAR_INIT(nullptr);
 
 GLOBAL_VAR_DECL ContractActionTracker<1024*1024> contractActionTracker;
@@ -91,6 +92,12 @@ static bool initContractExec()
     return true;
 }
 
+// Set flag of contract whose state has been changed (thread-safe)
+static void setContractStateChanged(unsigned int contractIndex)
+{
+    _InterlockedOr64((volatile long long*)&contractStateChangeFlags[contractIndex >> 6], 1LL << (contractIndex & 63));
+}
+
 // Acquire lock of an currently unused stack (may block if all in use)
 // stacksToIgnore > 0 can be passed by low priority tasks to keep some stacks reserved for high prio purposes.
 static void acquireContractLocalsStack(int& stackIdx, unsigned int stacksToIgnore = 0)
@@ -266,6 +273,7 @@ void* QPI::QpiContextProcedureCall::__qpiAcquireStateForWriting(unsigned int con
 {
     ASSERT(contractIndex < contractCount);
     contractStateLock[contractIndex].acquireWrite();
+    nodeStateSnapshot.beforeWrite(contractStates[contractIndex], contractDescriptions[contractIndex].stateSize);
     return contractStates[contractIndex];
 }
 
@@ -274,7 +282,7 @@ void QPI::QpiContextProcedureCall::__qpiReleaseStateForWriting(unsigned int cont
 {
     ASSERT(contractIndex < contractCount);
     contractStateLock[contractIndex].releaseWrite();
-    contractStateChangeFlags[_currentContractIndex >> 6] |= (1ULL << (_currentContractIndex & 63));
+    setContractStateChanged(_currentContractIndex);
 }
 
 // Used to call a special system procedure of another contract from within a contract /for example in asset management rights transfer
@@ -422,6 +430,7 @@ struct QpiContextSystemProcedureCall : public QPI::QpiContextProcedureCall
         QPI::NoData noInOutData;
         // reserve resources for this processor (may block)
         contractStateLock[_currentContractIndex].acquireWrite();
+        nodeStateSnapshot.beforeWrite(contractStates[_currentContractIndex], contractDescriptions[_currentContractIndex].stateSize);
 
         const unsigned long long startTick = __rdtsc();
         unsigned short localsSize = contractSystemProcedureLocalsSizes[_currentContractIndex][systemProcId];
@@ -451,7 +460,7 @@ struct QpiContextSystemProcedureCall : public QPI::QpiContextProcedureCall
 
         // release lock of contract state and set state to changed
         contractStateLock[_currentContractIndex].releaseWrite();
-        contractStateChangeFlags[_currentContractIndex >> 6] |= (1ULL << (_currentContractIndex & 63));
+        setContractStateChanged(_currentContractIndex);
     }
 };
 
@@ -461,11 +470,16 @@ struct QpiContextUserProcedureCall : public QPI::QpiContextProcedureCall
     char* outputBuffer;
     unsigned short outputSize;
 
-    QpiContextUserProcedureCall(unsigned int contractIndex, const m256i& originator, long long invocationReward) : QPI::QpiContextProcedureCall(contractIndex, originator, invocationReward)
+    // Procedures of isolated contracts are run in parallel and don't transfer QU, so they don't use the global
+    // contractActionTracker (trackActions = false).
+    QpiContextUserProcedureCall(unsigned int contractIndex, const m256i& originator, long long invocationReward, bool trackActions = true) : QPI::QpiContextProcedureCall(contractIndex, originator, invocationReward)
     {
-        contractActionTracker.init();
-        if (!contractActionTracker.addQuTransfer(_originator, _currentContractId, _invocationReward))
-            __qpiAbort(ContractErrorTooManyActions);
+        if (trackActions)
+        {
+            contractActionTracker.init();
+            if (!contractActionTracker.addQuTransfer(_originator, _currentContractId, _invocationReward))
+                __qpiAbort(ContractErrorTooManyActions);
+        }
         outputBuffer = nullptr;
         outputSize = 0;
     }
@@ -542,6 +556,7 @@ struct QpiContextUserProcedureCall : public QPI::QpiContextProcedureCall
 
         // acquire lock of contract state for writing (shouldn't block because 1 stack is not used by functions and thus kept free for procedures)
         contractStateLock[_currentContractIndex].acquireWrite();
+        nodeStateSnapshot.beforeWrite(contractStates[_currentContractIndex], contractDescriptions[_currentContractIndex].stateSize);
 
         // run procedure
         const unsigned long long startTick = __rdtsc();
@@ -550,7 +565,7 @@ struct QpiContextUserProcedureCall : public QPI::QpiContextProcedureCall
 
         // release lock of contract state and set state to changed
         contractStateLock[_currentContractIndex].releaseWrite();
-        contractStateChangeFlags[_currentContractIndex >> 6] |= (1ULL << (_currentContractIndex & 63));
+        setContractStateChanged(_currentContractIndex);
     }
 
     // free buffer after output has been copied (or isn't needed anymore)
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <intrin.h>
+
+#include "platform/memory.h"
+#include "platform/assert.h"
+
+// Scheduling of user procedure invocations of the current tick to parallel contract processors, so that invocations
+// of different contracts can run at the same time while the tick processor continues with the next transactions.
+//
+// Only invocations of isolated contracts are run in parallel. The user procedures of an isolated contract access the
+// state of this contract only (no QU transfers or burning, no asset management, no calls of other contracts, no
+// logging). Invocations of different isolated contracts touch disjoint data, so the resulting states don't depend on
+// the order of execution. Invocations of the same contract are run one after the other in tick order.
+// All other contract code (user procedures of other contracts, system procedures) must only be run after
+// waitUntilIdle(), which makes the results the same as with executing all invocations in tick order.
+//
+// The tick processor calls tryStart() and waitUntilIdle(), the main loop starts the contract processors of requested
+// slots, and finish() is called after the invocation has been completed or aborted.
+// Global instances are zero-initialized, which is the initial state (no isolated contract, no slot).
+template <unsigned int maxSlotCount, unsigned int contractCount>
+class ContractProcedureScheduler
+{
+public:
+    // States of slot
+    static constexpr unsigned char FREE = 0;        // no invocation
+    static constexpr unsigned char REQUESTED = 1;   // invocation waiting for start of contract processor
+    static constexpr unsigned char RUNNING = 2;     // contract processor started
+
+    // Set number of parallel contract processors available (call at node startup)
+    void init(unsigned int slotCount)
+    {
+        ASSERT(slotCount <= maxSlotCount);
+        this->slotCount = slotCount;
+    }
+
+    // Mark contract as isolated (call at node startup)
+    void setIsolated(unsigned int contractIndex)
+    {
+        ASSERT(contractIndex < contractCount);
+        isolatedFlags[contractIndex >> 6] |= (1ULL << (contractIndex & 63));
+    }
+
+    bool isIsolated(unsigned int contractIndex) const
+    {
+        ASSERT(contractIndex < contractCount);
+        return (isolatedFlags[contractIndex >> 6] >> (contractIndex & 63)) & 1;
+    }
+
+    // Return true if invocation of contract is run in parallel (after tryStart() succeeds)
+    bool canRunInParallel(unsigned int contractIndex) const
+    {
+        return slotCount && isIsolated(contractIndex);
+    }
+
+    // Request start of invocation of isolated contract in a free slot. The task is passed to the contract processor.
+    // Return slot index, or -1 if an invocation of the same contract is still running or if all slots are busy.
+    int tryStart(unsigned int contractIndex, const void* task)
+    {
+        ASSERT(canRunInParallel(contractIndex));
+        int freeSlot = -1;
+        unsigned int runningCount = 0;
+        for (unsigned int i = 0; i < slotCount; i++)
+        {
+            if (slots[i].state == FREE)
+            {
+                if (freeSlot < 0)
+                    freeSlot = i;
+            }
+            else
+            {
+                // Keep tick order of invocations of same contract
+                if (slots[i].contractIndex == contractIndex)
+                    return -1;
+                runningCount++;
+            }
+        }
+        if (freeSlot < 0)
+            return -1;
+
+        Slot& slot = slots[freeSlot];
+        slot.contractIndex = contractIndex;
+        slot.task = task;
+        _mm_sfence();
+        slot.state = REQUESTED;
+
+        numberOfParallelInvocations++;
+        if (maxRunningInvocations < runningCount + 1)
+            maxRunningInvocations = runningCount + 1;
+        return freeSlot;
+    }
+
+    // Mark slot as started by the main loop
+    void setRunning(unsigned int slot)
+    {
+        ASSERT(slot < slotCount && slots[slot].state == REQUESTED);
+        slots[slot].state = RUNNING;
+    }
+
+    // Mark slot as free after invocation has been completed or aborted
+    void finish(unsigned int slot)
+    {
+        ASSERT(slot < slotCount && slots[slot].state != FREE);
+        _mm_sfence();
+        slots[slot].state = FREE;
+    }
+
+    // Wait until all invocations are finished (tick processor)
+    void waitUntilIdle()
+    {
+        if (isIdle())
+            return;
+        const unsigned long long beginningTick = __rdtsc();
+        while (!isIdle())
+            _mm_pause();
+        numberOfWaits++;
+        waitTicks += __rdtsc() - beginningTick;
+    }
+
+    bool isIdle() const
+    {
+        for (unsigned int i = 0; i < slotCount; i++)
+        {
+            if (slots[i].state != FREE)
+                return false;
+        }
+        return true;
+    }
+
+    unsigned char getState(unsigned int slot) const
+    {
+        ASSERT(slot < slotCount);
+        return slots[slot].state;
+    }
+
+    unsigned int getContractIndex(unsigned int slot) const
+    {
+        ASSERT(slot < slotCount);
+        return slots[slot].contractIndex;
+    }
+
+    const void* getTask(unsigned int slot) const
+    {
+        ASSERT(slot < slotCount);
+        return slots[slot].task;
+    }
+
+    unsigned int getSlotCount() const
+    {
+        return slotCount;
+    }
+
+    // Statistics (totals since start)
+    unsigned long long getNumberOfParallelInvocations() const { return numberOfParallelInvocations; }
+    unsigned long long getNumberOfWaits() const { return numberOfWaits; }
+    unsigned long long getWaitTicks() const { return waitTicks; }
+    unsigned int getMaxRunningInvocations() const { return maxRunningInvocations; }
+
+private:
+    struct Slot
+    {
+        const void* task;
+        volatile unsigned int contractIndex;
+        volatile unsigned char state;
+    };
+
+    Slot slots[maxSlotCount ? maxSlotCount : 1];
+    unsigned int slotCount;
+    unsigned long long isolatedFlags[(contractCount + 63) / 64];
+
+    unsigned long long numberOfParallelInvocations;
+    unsigned long long numberOfWaits;
+    unsigned long long waitTicks;
+    unsigned int maxRunningInvocations;
+};
@@ -0,0 +1,256 @@
+#pragma once
+
+#include "platform/m256.h"
+#include "platform/memory.h"
+#include "platform/console_logging.h"
+
+#include "kangaroo_twelve.h"
+
+// Digest of a contract state computed from fixed-size pages, so that only the pages changed since the last digest
+// have to be hashed again.
+//
+// Definition: each page of the state (the last page may be shorter) is hashed with K12 to a 32 byte leaf. The
+// leafs are padded with zero digests to the next power of 2 and the digest is the root of the binary Merkle tree,
+// with parent = KangarooTwelve64To32(left child, right child). A state of up to one page has the same digest as
+// with K12 of the whole state.
+//
+// Changed pages are found by comparing the state with a copy of the state at the last digest, instead of dirty bits
+// set on write: contract code writes members of its state directly (without write barrier), and the node only knows
+// that a procedure may have changed the whole state (see contractStateChangeFlags and nodeStateSnapshot.beforeWrite()).
+// Marking all pages dirty after each procedure would hash the whole state again. Comparing still reads the whole
+// state of each changed contract per tick and doubles its memory, but it is much faster than hashing it with K12, and
+// it can't miss a change, which would make the digest depend on the history of the node.
+class PagedStateDigest
+{
+public:
+    static constexpr unsigned long long pageSize = 4096;
+
+    // Allocate buffers for state of given size (call before any other function except computeDigest()). The buffers
+    // include a copy of the whole state, so only allocate them if getDigest() is used.
+    bool init(unsigned long long stateSize)
+    {
+        this->stateSize = stateSize;
+        pageCount = (stateSize + pageSize - 1) / pageSize;
+        leafCount = 1;
+        while (leafCount < pageCount)
+            leafCount <<= 1;
+        valid = false;
+        totalRehashedPages = 0;
+        totalUpdates = 0;
+
+        if (!allocatePool(stateSize, (void**)&stateCopy)
+            || !allocatePool((2 * leafCount - 1) * sizeof(m256i), (void**)&tree)
+            || !allocatePool(((leafCount + 63) / 64) * sizeof(unsigned long long), (void**)&changedNodeFlags))
+        {
+            logToConsole(L"Failed to allocate paged state digest memory!");
+            return false;
+        }
+        setMem(changedNodeFlags, ((leafCount + 63) / 64) * sizeof(unsigned long long), 0);
+        _mm_mfence();
+        initialized = true;
+        return true;
+    }
+
+    // Free buffers
+    void deinit()
+    {
+        initialized = false;
+        if (stateCopy)
+            freePool(stateCopy);
+        if (tree)
+            freePool(tree);
+        if (changedNodeFlags)
+            freePool(changedNodeFlags);
+        stateCopy = nullptr;
+        tree = nullptr;
+        changedNodeFlags = nullptr;
+    }
+
+    // Compute digest of state, which must have the size passed to init(). Only pages that differ from the state of
+    // the last call are hashed.
+    void getDigest(const unsigned char* state, m256i& digest)
+    {
+        if (!valid)
+        {
+            computeFull(state);
+        }
+        else
+        {
+            for (unsigned long long page = 0; page < pageCount; page++)
+            {
+                const unsigned long long offset = page * pageSize;
+                const unsigned long long size = (offset + pageSize <= stateSize) ? pageSize : stateSize - offset;
+                if (!isEqual(state + offset, stateCopy + offset, size))
+                {
+                    copyMem(stateCopy + offset, state + offset, size);
+                    KangarooTwelve(state + offset, (unsigned int)size, &tree[page], 32);
+                    changedNodeFlags[page >> 6] |= (1ULL << (page & 63));
+                    totalRehashedPages++;
+                }
+            }
+            updateChangedParents();
+        }
+        totalUpdates++;
+        digest = tree[2 * leafCount - 2];
+    }
+
+    // Compute digest of state from scratch without the buffers of init(), with the same result as getDigest()
+    static void computeDigest(const unsigned char* state, unsigned long long stateSize, m256i& digest)
+    {
+        const unsigned long long pageCount = (stateSize + pageSize - 1) / pageSize;
+        unsigned long long leafCount = 1;
+        unsigned int rootLevel = 0;
+        while (leafCount < pageCount)
+        {
+            leafCount <<= 1;
+            rootLevel++;
+        }
+
+        // Root of the complete subtree of each level that still waits for its right sibling (flagged in waitingLevels)
+        m256i subtreeRoots[64];
+        unsigned long long waitingLevels = 0;
+        for (unsigned long long page = 0; page < leafCount; page++)
+        {
+            m256i pair[2];
+            if (page < pageCount)
+            {
+                const unsigned long long offset = page * pageSize;
+                const unsigned long long size = (offset + pageSize <= stateSize) ? pageSize : stateSize - offset;
+                KangarooTwelve(state + offset, (unsigned int)size, &pair[1], 32);
+            }
+            else
+            {
+                pair[1] = m256i::zero();
+            }
+            unsigned int level = 0;
+            while (waitingLevels & (1ULL << level))
+            {
+                m256i parent;
+                pair[0] = subtreeRoots[level];
+                KangarooTwelve64To32(pair, &parent);
+                pair[1] = parent;
+                waitingLevels &= ~(1ULL << level);
+                level++;
+            }
+            subtreeRoots[level] = pair[1];
+            waitingLevels |= (1ULL << level);
+        }
+        digest = subtreeRoots[rootLevel];
+    }
+
+    // Return true if init() has been successful, so getDigest() can be used
+    bool isInitialized() const
+    {
+        return initialized;
+    }
+
+    // Hash all pages with the next call of getDigest()
+    void invalidate()
+    {
+        valid = false;
+    }
+
+    unsigned long long getPageCount() const
+    {
+        return pageCount;
+    }
+
+    // Statistics (totals since init)
+    unsigned long long getNumberOfRehashedPages() const
+    {
+        return totalRehashedPages;
+    }
+
+    unsigned long long getNumberOfUpdates() const
+    {
+        return totalUpdates;
+    }
+
+private:
+    unsigned long long stateSize;
+    unsigned long long pageCount;
+    unsigned long long leafCount;
+
+    // Copy of the state at the last digest computation
+    unsigned char* stateCopy;
+
+    // Nodes of Merkle tree: leafCount leafs, followed by the nodes of the next levels (root is last)
+    m256i* tree;
+
+    // Flags of nodes of the current level whose digest has changed (one bit per node, leafCount bits)
+    unsigned long long* changedNodeFlags;
+
+    volatile bool initialized;
+    bool valid;
+    unsigned long long totalRehashedPages;
+    unsigned long long totalUpdates;
+
+    static bool isEqual(const unsigned char* a, const unsigned char* b, unsigned long long size)
+    {
+        unsigned long long i = 0;
+        for (; i + 32 <= size; i += 32)
+        {
+            const __m256i diff = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+            if (!_mm256_testz_si256(diff, diff))
+                return false;
+        }
+        for (; i < size; i++)
+        {
+            if (a[i] != b[i])
+                return false;
+        }
+        return true;
+    }
+
+    void computeFull(const unsigned char* state)
+    {
+        copyMem(stateCopy, state, stateSize);
+        for (unsigned long long page = 0; page < pageCount; page++)
+        {
+            const unsigned long long offset = page * pageSize;
+            const unsigned long long size = (offset + pageSize <= stateSize) ? pageSize : stateSize - offset;
+            KangarooTwelve(state + offset, (unsigned int)size, &tree[page], 32);
+        }
+        setMem(&tree[pageCount], (leafCount - pageCount) * sizeof(m256i), 0);
+        totalRehashedPages += pageCount;
+
+        unsigned long long levelBeginning = 0;
+        for (unsigned long long nodeCount = leafCount; nodeCount > 1; nodeCount >>= 1)
+        {
+            KangarooTwelve64To32Multiple(&tree[levelBeginning], &tree[levelBeginning + nodeCount], nodeCount / 2);
+            levelBeginning += nodeCount;
+        }
+        setMem(changedNodeFlags, ((leafCount + 63) / 64) * sizeof(unsigned long long), 0);
+        valid = true;
+    }
+
+    // Update the parents of all nodes flagged in changedNodeFlags, level by level up to the root
+    void updateChangedParents()
+    {
+        unsigned long long levelBeginning = 0;
+        for (unsigned long long nodeCount = leafCount; nodeCount > 1; nodeCount >>= 1)
+        {
+            // The flag of parent i / 2 is stored in place of the flags of its children i and i + 1. Flags words are
+            // processed in ascending order, so only already processed words (or the current one) get parent flags.
+            const unsigned long long parentsBeginning = levelBeginning + nodeCount;
+            for (unsigned long long word = 0; word < (nodeCount + 63) / 64; word++)
+            {
+                const unsigned long long flags = changedNodeFlags[word];
+                if (!flags)
+                    continue;
+                changedNodeFlags[word] = 0;
+                for (unsigned long long bit = 0; bit < 64; bit += 2)
+                {
+                    if (flags & (3ULL << bit))
+                    {
+                        const unsigned long long node = word * 64 + bit;
+                        KangarooTwelve64To32(&tree[levelBeginning + node], &tree[parentsBeginning + (node >> 1)]);
+                        changedNodeFlags[node >> 7] |= (1ULL << ((node >> 1) & 63));
+                    }
+                }
+            }
+            levelBeginning = parentsBeginning;
+        }
+        changedNodeFlags[0] = 0;
+    }
+};
@@ -316,7 +316,7 @@ bool QPI::QpiContextProcedureCall::distributeDividends(long long amountPerShare)
 
     if (decreaseEnergy(index, amountPerShare * NUMBER_OF_COMPUTORS))
     {
-        ACQUIRE(universeLock);
+        universeLock.acquireRead();
 
         for (int issuanceIndex = 0; issuanceIndex < ASSETS_CAPACITY; issuanceIndex++)
         {
@@ -359,7 +359,7 @@ bool QPI::QpiContextProcedureCall::distributeDividends(long long amountPerShare)
             }
         }
 
-        RELEASE(universeLock);
+        universeLock.releaseRead();
     }
 
     return true;
@@ -452,13 +452,13 @@ long long QPI::QpiContextProcedureCall::transferShareOwnershipAndPossession(unsi
         return -((long long)(MAX_AMOUNT + 1));
     }
 
-    ACQUIRE(universeLock);
+    universeLock.acquireWrite();
 
     int issuanceIndex = issuer.m256i_u32[0] & (ASSETS_CAPACITY - 1);
 iteration:
     if (assets[issuanceIndex].varStruct.issuance.type == EMPTY)
     {
-        RELEASE(universeLock);
+        universeLock.releaseWrite();
 
         return -numberOfShares;
     }
@@ -472,7 +472,7 @@ iteration:
         iteration2:
             if (assets[ownershipIndex].varStruct.ownership.type == EMPTY)
             {
-                RELEASE(universeLock);
+                universeLock.releaseWrite();
 
                 return -numberOfShares;
             }
@@ -487,7 +487,7 @@ iteration:
                 iteration3:
                     if (assets[possessionIndex].varStruct.possession.type == EMPTY)
                     {
-                        RELEASE(universeLock);
+                        universeLock.releaseWrite();
 
                         return -numberOfShares;
                     }
@@ -504,20 +504,20 @@ iteration:
                                     int destinationOwnershipIndex, destinationPossessionIndex;
                                     ::transferShareOwnershipAndPossession(ownershipIndex, possessionIndex, newOwnerAndPossessor, numberOfShares, &destinationOwnershipIndex, &destinationPossessionIndex, false);
 
-                                    RELEASE(universeLock);
+                                    universeLock.releaseWrite();
 
                                     return assets[possessionIndex].varStruct.possession.numberOfShares;
                                 }
                                 else
                                 {
-                                    RELEASE(universeLock);
+                                    universeLock.releaseWrite();
 
                                     return assets[possessionIndex].varStruct.possession.numberOfShares - numberOfShares;
                                 }
                             }
                             else
                             {
-                                RELEASE(universeLock);
+                                universeLock.releaseWrite();
 
                                 return -numberOfShares;
                             }
@@ -36,7 +36,7 @@ bool QPI::QpiContextFunctionCall::getEntity(const m256i& id, QPI::Entity& entity
 // Return reference to fee reserve of contract for changing its value (data stored in state of contract 0)
 static long long& contractFeeReserve(unsigned int contractIndex)
 {
-    contractStateChangeFlags[0] |= 1ULL;
+    setContractStateChanged(0);
     return ((Contract0State*)contractStates[0])->contractFeeReserves[contractIndex];
 }
 
@@ -64,6 +64,7 @@ long long QPI::QpiContextProcedureCall::burn(long long amount) const
     if (decreaseEnergy(index, amount))
     {
         contractStateLock[0].acquireWrite();
+        nodeStateSnapshot.beforeWrite(contractStates[0], contractDescriptions[0].stateSize);
         contractFeeReserve(_currentContractIndex) += amount;
         contractStateLock[0].releaseWrite();
 
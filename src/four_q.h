@@ -5,6 +5,8 @@
 #include "platform/common_types.h"
 #include "platform/memory.h"
 #include "platform/m256.h"
+#include "platform/concurrency.h"
+#include "platform/global_var.h"
 
 #include "kangaroo_twelve.h"
 
@@ -1288,16 +1290,10 @@ static void ecc_precomp_double(point_extproj_t P, point_extproj_precomp_t* Table
     R1_to_R2(Q, Table[3]);                  // Converting from (X,Y,Z,Ta,Tb) to (X+Y,Y-X,2Z,2dT)
 }
 
-static bool ecc_mul_double(unsigned long long* k, unsigned long long* l, point_t Q)
-{ // Double scalar multiplication R = k*G + l*Q, where the G is the generator
-  // Uses DOUBLE_SCALAR_TABLE, which contains multiples of G, Phi(G), Psi(G) and Phi(Psi(G))
-  // The function uses wNAF with interleaving.
-    char digits_k1[65], digits_k2[65], digits_k3[65], digits_k4[65];
-    char digits_l1[65], digits_l2[65], digits_l3[65], digits_l4[65];
-    point_precomp_t V;
-    point_extproj_t Q1, Q2, Q3, Q4, T;
-    point_extproj_precomp_t U, Q_table1[4], Q_table2[4], Q_table3[4], Q_table4[4];
-    unsigned long long k_scalars[4], l_scalars[4];
+static bool ecc_precomp_double_tables(point_t Q, point_extproj_precomp_t Q_tables[4][4])
+{ // Generation of the precomputation tables of Q, phi(Q), psi(Q) and psi(phi(Q)) used by ecc_mul_double_tables()
+  // Returns false if Q does not lie on the curve
+    point_extproj_t Q1, Q2, Q3, Q4;
 
     point_setup(Q, Q1);                                             // Convert to representation (X,Y,1,Ta,Tb)
 
@@ -1326,6 +1322,30 @@ static bool ecc_mul_double(unsigned long long* k, unsigned long long* l, point_t
     *((__m256i*) & Q4->tb) = *((__m256i*) & Q2->tb);
     ecc_psi(Q4);
 
+    ecc_precomp_double(Q1, Q_tables[0]);
+    ecc_precomp_double(Q2, Q_tables[1]);
+    ecc_precomp_double(Q3, Q_tables[2]);
+    ecc_precomp_double(Q4, Q_tables[3]);
+
+    return true;
+}
+
+static void ecc_mul_double_tables(unsigned long long* k, unsigned long long* l, point_extproj_precomp_t Q_tables[4][4], point_t Q)
+{ // Double scalar multiplication Q = k*G + l*P, where the G is the generator and P is given by its precomputation
+  // tables generated with ecc_precomp_double_tables()
+  // Uses DOUBLE_SCALAR_TABLE, which contains multiples of G, Phi(G), Psi(G) and Phi(Psi(G))
+  // The function uses wNAF with interleaving.
+    char digits_k1[65], digits_k2[65], digits_k3[65], digits_k4[65];
+    char digits_l1[65], digits_l2[65], digits_l3[65], digits_l4[65];
+    point_precomp_t V;
+    point_extproj_t T;
+    point_extproj_precomp_t U;
+    point_extproj_precomp_t* Q_table1 = Q_tables[0];
+    point_extproj_precomp_t* Q_table2 = Q_tables[1];
+    point_extproj_precomp_t* Q_table3 = Q_tables[2];
+    point_extproj_precomp_t* Q_table4 = Q_tables[3];
+    unsigned long long k_scalars[4], l_scalars[4];
+
     decompose((unsigned long long*)k, k_scalars);                   // Scalar decomposition
     decompose((unsigned long long*)l, l_scalars);
     wNAF_recode(k_scalars[0], 8, digits_k1);                        // Scalar recoding
@@ -1336,10 +1356,6 @@ static bool ecc_mul_double(unsigned long long* k, unsigned long long* l, point_t
     wNAF_recode(l_scalars[1], 4, digits_l2);
     wNAF_recode(l_scalars[2], 4, digits_l3);
     wNAF_recode(l_scalars[3], 4, digits_l4);
-    ecc_precomp_double(Q1, Q_table1);
-    ecc_precomp_double(Q2, Q_table2);
-    ecc_precomp_double(Q3, Q_table3);
-    ecc_precomp_double(Q4, Q_table4);
 
     T->x[0][0] = 0; T->x[0][1] = 0; T->x[1][0] = 0; T->x[1][1] = 0; // Initialize T as the neutral point (0:1:1)
     T->y[0][0] = 1; T->y[0][1] = 0; T->y[1][0] = 0; T->y[1][1] = 0;
@@ -1431,6 +1447,18 @@ static bool ecc_mul_double(unsigned long long* k, unsigned long long* l, point_t
     }
 
     eccnorm(T, Q);
+}
+
+static bool ecc_mul_double(unsigned long long* k, unsigned long long* l, point_t Q)
+{ // Double scalar multiplication R = k*G + l*Q, where the G is the generator
+    point_extproj_precomp_t Q_tables[4][4];
+
+    if (!ecc_precomp_double_tables(Q, Q_tables))
+    {
+        return false;
+    }
+
+    ecc_mul_double_tables(k, l, Q_tables, Q);
 
     return true;
 }
@@ -1834,3 +1862,380 @@ static bool verify(const unsigned char* publicKey, const unsigned char* messageD
 
     return *((__m256i*)A) == *((__m256i*)signature);
 }
+
+// Decoded public key with precomputed tables for SchnorrQ signature verification
+struct FourQVerificationKey
+{
+    point_extproj_precomp_t tables[4][4];
+};
+
+static bool precomputeVerificationKey(const unsigned char* publicKey, FourQVerificationKey& key)
+{ // Decode public key and generate precomputation tables for verifyWithVerificationKey()
+  // Output: FALSE if public key is invalid
+    point_t A;
+
+    if (publicKey[15] & 0x80)
+    {
+        return false;
+    }
+
+    if (!decode(publicKey, A))
+    {
+        return false;
+    }
+
+    return ecc_precomp_double_tables(A, key.tables);
+}
+
+static bool verifyWithVerificationKey(const unsigned char* publicKey, FourQVerificationKey& key, const unsigned char* messageDigest, const unsigned char* signature)
+{ // SchnorrQ signature verification like verify(), but using key precomputed from publicKey with precomputeVerificationKey()
+    point_t A;
+    unsigned char temp[32 + 64], h[64];
+
+    if ((signature[15] & 0x80) || (signature[62] & 0xC0) || signature[63])
+    {
+        return false;
+    }
+
+    *((__m256i*)temp) = *((__m256i*)signature);
+    *((__m256i*)(temp + 32)) = *((__m256i*)publicKey);
+    *((__m256i*)(temp + 64)) = *((__m256i*)messageDigest);
+
+    KangarooTwelve(temp, 32 + 64, h, 64);
+
+    ecc_mul_double_tables((unsigned long long*)(signature + 32), (unsigned long long*)h, key.tables, A);
+
+    encode(A, (unsigned char*)A);
+
+    return *((__m256i*)A) == *((__m256i*)signature);
+}
+
+static void add_mod_order(const unsigned long long* a, const unsigned long long* b, unsigned long long* c)
+{ // Addition modulo the curve order, c = a+b mod order, where a,b,c in [0, order-1]
+    unsigned long long temp[4];
+    _addcarry_u64(_addcarry_u64(_addcarry_u64(_addcarry_u64(0, a[0], b[0], &c[0]), a[1], b[1], &c[1]), a[2], b[2], &c[2]), a[3], b[3], &c[3]);
+    if (!_subborrow_u64(_subborrow_u64(_subborrow_u64(_subborrow_u64(0, c[0], CURVE_ORDER_0, &temp[0]), c[1], CURVE_ORDER_1, &temp[1]), c[2], CURVE_ORDER_2, &temp[2]), c[3], CURVE_ORDER_3, &temp[3]))
+    {
+        *((__m256i*)c) = *((__m256i*)temp);
+    }
+}
+
+static void multiply_mod_order(const unsigned long long* a, const unsigned long long* b, unsigned long long* c)
+{ // Multiplication modulo the curve order, c = a*b mod order, where a,b < 2^256 and c in [0, order-1]
+    unsigned long long temp[4];
+    Montgomery_multiply_mod_order(a, Montgomery_Rprime, temp);      // temp = a*2^256 mod order
+    Montgomery_multiply_mod_order(temp, b, c);                      // c = a*b mod order
+}
+
+// Maximum number of signatures combined in one multi-scalar multiplication by verifyBatch()
+#define FOURQ_BATCH_VERIFY_MAX_SIZE 32
+
+// Work memory of verifyBatch() (about 94 KB), which is too large for the stack of the processors. Threads calling
+// verifyBatch() concurrently need separate buffers, for example one buffer per processor allocated at startup.
+struct FourQBatchVerificationBuffer
+{
+    struct Item
+    {
+        point_extproj_precomp_t A_tables[4][4];
+        point_extproj_precomp_t R_table[4];
+        char digits_A[4][65];
+        char digits_R[2][65];
+    } items[FOURQ_BATCH_VERIFY_MAX_SIZE];
+};
+
+static bool rdrand64(unsigned long long* value)
+{ // RDRAND with the 10 retries recommended by Intel, fails only if the random number generator is broken
+    for (unsigned int i = 0; i < 10; i++)
+    {
+        if (_rdrand64_step(value))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool verifyBatchCombined(const unsigned char* const* publicKeys, const unsigned char* const* messageDigests, const unsigned char* const* signatures, unsigned int count, FourQBatchVerificationBuffer& buffer)
+{ // Check sum_i z_i*(s_i*G + h_i*A_i - R_i) = 0 with random 128-bit weights z_i for count <= FOURQ_BATCH_VERIFY_MAX_SIZE signatures
+  // The terms z_i*A_i and s*G use scalar decomposition and are processed in the lower 65 iterations of the interleaved loop.
+  // The terms z_i*(-R_i) use a plain table of -R_i with z_i split into 64-bit halves (z_i = z_i0 + 2^64*z_i1), so no
+  // endomorphisms of R_i are required and the additional doublings are shared by all signatures of the batch.
+  // Returns FALSE if no random weights are available, so the signatures are verified one by one.
+    FourQBatchVerificationBuffer::Item* items = buffer.items;
+    char digits_G[4][65];
+    point_t A, R;
+    point_precomp_t V;
+    point_extproj_t T;
+    point_extproj_precomp_t U;
+    unsigned char temp[32 + 64], h[64];
+    unsigned long long z[4], l[4], zs[4], sumS[4] = { 0, 0, 0, 0 }, scalars[4];
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        const unsigned char* publicKey = publicKeys[i];
+        const unsigned char* signature = signatures[i];
+        if ((publicKey[15] & 0x80) || (signature[15] & 0x80) || (signature[62] & 0xC0) || signature[63])
+        {
+            return false;
+        }
+
+        // Decode public key A and commitment R (R has to be encoded canonically, because verify() compares encodings)
+        if (!decode(publicKey, A) || !decode(signature, R))
+        {
+            return false;
+        }
+        encode(R, temp);
+        if (*((m256i*)temp) != *((m256i*)signature))
+        {
+            return false;
+        }
+
+        *((__m256i*)temp) = *((__m256i*)signature);
+        *((__m256i*)(temp + 32)) = *((__m256i*)publicKey);
+        *((__m256i*)(temp + 64)) = *((__m256i*)messageDigests[i]);
+
+        KangarooTwelve(temp, 32 + 64, h, 64);
+
+        // Random nonzero 128-bit weight z
+        do
+        {
+            if (!rdrand64(&z[0]) || !rdrand64(&z[1]))
+            {
+                return false;
+            }
+        } while (!z[0] && !z[1]);
+        z[2] = 0;
+        z[3] = 0;
+
+        multiply_mod_order(z, (unsigned long long*)h, l);                   // l = z*h
+        multiply_mod_order(z, (unsigned long long*)(signature + 32), zs);   // sumS += z*s
+        add_mod_order(sumS, zs, sumS);
+
+        if (!ecc_precomp_double_tables(A, items[i].A_tables))
+        {
+            return false;
+        }
+        decompose(l, scalars);
+        for (unsigned int j = 0; j < 4; j++)
+        {
+            wNAF_recode(scalars[j], 4, items[i].digits_A[j]);
+        }
+
+        fp2neg1271(R->x);                                                   // R = -R
+        point_setup(R, T);
+        ecc_precomp_double(T, items[i].R_table);
+        wNAF_recode(z[0], 4, items[i].digits_R[0]);
+        wNAF_recode(z[1], 4, items[i].digits_R[1]);
+    }
+
+    decompose(sumS, scalars);
+    for (unsigned int j = 0; j < 4; j++)
+    {
+        wNAF_recode(scalars[j], 8, digits_G[j]);
+    }
+
+    T->x[0][0] = 0; T->x[0][1] = 0; T->x[1][0] = 0; T->x[1][1] = 0; // Initialize T as the neutral point (0:1:1)
+    T->y[0][0] = 1; T->y[0][1] = 0; T->y[1][0] = 0; T->y[1][1] = 0;
+    T->z[0][0] = 1; T->z[0][1] = 0; T->z[1][0] = 0; T->z[1][1] = 0;
+
+    for (unsigned int bit = 64 + 65; bit--; )
+    {
+        eccdouble(T);
+
+        for (unsigned int i = 0; i < count; i++)
+        {
+            // Digit of z_i1 (weighted with 2^64) and of z_i0
+            for (unsigned int half = 0; half < 2; half++)
+            {
+                const unsigned int digitIndex = (half) ? bit - 64 : bit;
+                if (digitIndex >= 65)
+                {
+                    continue;
+                }
+                const int digitR = items[i].digits_R[half][digitIndex];
+                if (digitR < 0)
+                {
+                    eccneg_extproj_precomp(items[i].R_table[(-digitR) >> 1], U);
+                    eccadd(U, T);
+                }
+                else if (digitR > 0)
+                {
+                    eccadd(items[i].R_table[digitR >> 1], T);
+                }
+            }
+
+            if (bit >= 65)
+            {
+                continue;
+            }
+            for (unsigned int j = 0; j < 4; j++)
+            {
+                const int digitA = items[i].digits_A[j][bit];
+                if (digitA < 0)
+                {
+                    eccneg_extproj_precomp(items[i].A_tables[j][(-digitA) >> 1], U);
+                    eccadd(U, T);
+                }
+                else if (digitA > 0)
+                {
+                    eccadd(items[i].A_tables[j][digitA >> 1], T);
+                }
+            }
+        }
+
+        if (bit >= 65)
+        {
+            continue;
+        }
+        for (unsigned int j = 0; j < 4; j++)
+        {
+            const int digitG = digits_G[j][bit];
+            if (digitG < 0)
+            {
+                eccneg_precomp(((point_precomp_t*)&DOUBLE_SCALAR_TABLE)[j * 64 + ((-digitG) >> 1)], V);
+                eccmadd(V, T);
+            }
+            else if (digitG > 0)
+            {
+                eccmadd(((point_precomp_t*)&DOUBLE_SCALAR_TABLE)[j * 64 + (digitG >> 1)], T);
+            }
+        }
+    }
+
+    eccnorm(T, A);                                                  // Check if T is the neutral point (0,1)
+    return !A->x[0][0] && !A->x[0][1] && !A->x[1][0] && !A->x[1][1]
+        && A->y[0][0] == 1 && !A->y[0][1] && !A->y[1][0] && !A->y[1][1];
+}
+
+static bool verifyBatch(const unsigned char* const* publicKeys, const unsigned char* const* messageDigests, const unsigned char* const* signatures, unsigned int count, bool* results, FourQBatchVerificationBuffer& buffer)
+{ // Batch SchnorrQ signature verification of count signatures (signature i of messageDigests[i] by publicKeys[i])
+  // Groups of up to FOURQ_BATCH_VERIFY_MAX_SIZE signatures are checked with a randomized linear combination. If the
+  // check of a group fails, the signatures of the group are verified one by one with verify() to find the invalid ones.
+  // buffer is work memory that must not be used by other threads during the call (see FourQBatchVerificationBuffer).
+  // Output: results[i] is TRUE if signature i is valid; returns TRUE if all signatures are valid
+  // For signatures whose commitment point R and public key are in the prime order subgroup (such as all signatures
+  // created by sign()), results are identical to verify(). Invalid signatures constructed with small-order components
+  // may pass the combined check with non-negligible probability, so verifyBatch() must not be used if such results
+  // have to be rejected deterministically.
+    bool allValid = true;
+    for (unsigned int begin = 0; begin < count; begin += FOURQ_BATCH_VERIFY_MAX_SIZE)
+    {
+        const unsigned int groupSize = (count - begin < FOURQ_BATCH_VERIFY_MAX_SIZE) ? count - begin : FOURQ_BATCH_VERIFY_MAX_SIZE;
+        if (verifyBatchCombined(publicKeys + begin, messageDigests + begin, signatures + begin, groupSize, buffer))
+        {
+            for (unsigned int i = begin; i < begin + groupSize; i++)
+            {
+                results[i] = true;
+            }
+        }
+        else
+        {
+            for (unsigned int i = begin; i < begin + groupSize; i++)
+            {
+                results[i] = verify(publicKeys[i], messageDigests[i], signatures[i]);
+                allValid &= results[i];
+            }
+        }
+    }
+
+    return allValid;
+}
+
+// Cache of verification keys of frequent signers, such as the computors and the arbitrator, which sign ticks, tick
+// data, and computor lists during the whole epoch. Keys are added on first use and are only removed by reset().
+class FourQVerificationKeyCache
+{
+public:
+    static constexpr unsigned int capacity = 1024;
+    static constexpr unsigned int maxNumberOfEntries = capacity * 3 / 4;
+    static_assert((capacity & (capacity - 1)) == 0, "capacity must be power of 2");
+
+    // Remove all entries. Must not be called concurrently with verify() (call at beginning of epoch).
+    void reset()
+    {
+        ACQUIRE(insertLock);
+        setMem(entries, sizeof(entries), 0);
+        numberOfEntries = 0;
+        RELEASE(insertLock);
+    }
+
+    // Same result as ::verify(), but reuses decoded public key if it is in the cache (and adds it if not)
+    bool verify(const unsigned char* publicKey, const unsigned char* messageDigest, const unsigned char* signature)
+    {
+        const m256i& key = *((const m256i*)publicKey);
+        Entry* entry = find(key);
+        if (entry)
+        {
+            return verifyWithVerificationKey(publicKey, entry->verificationKey, messageDigest, signature);
+        }
+
+        // Not in cache (or being added by other processor) -> decode and try to add
+        FourQVerificationKey verificationKey;
+        if (!precomputeVerificationKey(publicKey, verificationKey))
+        {
+            return false;
+        }
+        add(key, verificationKey);
+        return verifyWithVerificationKey(publicKey, verificationKey, messageDigest, signature);
+    }
+
+    // Return if verification key of public key is in the cache
+    bool contains(const m256i& publicKey)
+    {
+        return find(publicKey) != nullptr;
+    }
+
+    unsigned int size() const
+    {
+        return numberOfEntries;
+    }
+
+private:
+    struct Entry
+    {
+        FourQVerificationKey verificationKey;
+        m256i publicKey;
+        volatile long state; // 0 = empty, 1 = being written, 2 = ready
+    };
+
+    Entry* find(const m256i& publicKey)
+    {
+        for (unsigned int i = publicKey.m256i_u32[0] & (capacity - 1); entries[i].state; i = (i + 1) & (capacity - 1))
+        {
+            if (entries[i].state == 2 && entries[i].publicKey == publicKey)
+            {
+                return &entries[i];
+            }
+        }
+        return nullptr;
+    }
+
+    void add(const m256i& publicKey, const FourQVerificationKey& verificationKey)
+    {
+        ACQUIRE(insertLock);
+        if (numberOfEntries < maxNumberOfEntries)
+        {
+            unsigned int i = publicKey.m256i_u32[0] & (capacity - 1);
+            while (entries[i].state && entries[i].publicKey != publicKey)
+            {
+                i = (i + 1) & (capacity - 1);
+            }
+            if (!entries[i].state)
+            {
+                // Readers skip entries until they are complete (interlocked exchange is memory barrier)
+                _InterlockedExchange(&entries[i].state, 1);
+                entries[i].publicKey = publicKey;
+                copyMem(&entries[i].verificationKey, &verificationKey, sizeof(verificationKey));
+                _InterlockedExchange(&entries[i].state, 2);
+                numberOfEntries++;
+            }
+        }
+        RELEASE(insertLock);
+    }
+
+    Entry entries[capacity];
+    unsigned int numberOfEntries;
+    volatile char insertLock;
+};
+
+GLOBAL_VAR_DECL FourQVerificationKeyCache verificationKeyCache;
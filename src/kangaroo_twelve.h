@@ -2494,6 +2494,290 @@ static void KangarooTwelve64To32(const void* input, void* output)
     KangarooTwelve64To32((const unsigned char*)input, (unsigned char*)output);
 }
 
+
+////////// KangarooTwelve64To32 with multiple lanes \\\\\\\\\\
+
+// Each vector holds the same Keccak lane of 4 (AVX2) or 8 (AVX-512) independent states, so one permutation
+// processes 4 or 8 independent 64-byte inputs. Results are identical to KangarooTwelve64To32().
+// The vector operations xorMultiLane, rolMultiLane, andnMultiLane, and constMultiLane need to be defined
+// before using roundMultiLane.
+
+#define declareMultiLane(type) \
+    type Aba, Abe, Abi, Abo, Abu; \
+    type Aga, Age, Agi, Ago, Agu; \
+    type Aka, Ake, Aki, Ako, Aku; \
+    type Ama, Ame, Ami, Amo, Amu; \
+    type Asa, Ase, Asi, Aso, Asu; \
+    type Bba, Bbe, Bbi, Bbo, Bbu; \
+    type Bga, Bge, Bgi, Bgo, Bgu; \
+    type Bka, Bke, Bki, Bko, Bku; \
+    type Bma, Bme, Bmi, Bmo, Bmu; \
+    type Bsa, Bse, Bsi, Bso, Bsu; \
+    type Ca, Ce, Ci, Co, Cu; \
+    type Da, De, Di, Do, Du;
+
+// Initialize state with 64 byte input lanes (Aba to Agi) and K12 padding for 64 byte input and 32 byte output
+#define initStateMultiLane \
+    Ago = constMultiLane(0x0700); \
+    Agu = constMultiLane(0); \
+    Aka = Agu; Ake = Agu; Aki = Agu; Ako = Agu; Aku = Agu; \
+    Ama = Agu; Ame = Agu; Ami = Agu; Amo = Agu; Amu = Agu; \
+    Asa = constMultiLane(0x8000000000000000); \
+    Ase = Agu; Asi = Agu; Aso = Agu; Asu = Agu;
+
+#define roundMultiLane(rc) \
+    Ca = xorMultiLane(xorMultiLane(xorMultiLane(Aba, Aga), xorMultiLane(Aka, Ama)), Asa);  \
+    Ce = xorMultiLane(xorMultiLane(xorMultiLane(Abe, Age), xorMultiLane(Ake, Ame)), Ase);  \
+    Ci = xorMultiLane(xorMultiLane(xorMultiLane(Abi, Agi), xorMultiLane(Aki, Ami)), Asi);  \
+    Co = xorMultiLane(xorMultiLane(xorMultiLane(Abo, Ago), xorMultiLane(Ako, Amo)), Aso);  \
+    Cu = xorMultiLane(xorMultiLane(xorMultiLane(Abu, Agu), xorMultiLane(Aku, Amu)), Asu);  \
+    Da = xorMultiLane(Cu, rolMultiLane(Ce, 1));                                            \
+    De = xorMultiLane(Ca, rolMultiLane(Ci, 1));                                            \
+    Di = xorMultiLane(Ce, rolMultiLane(Co, 1));                                            \
+    Do = xorMultiLane(Ci, rolMultiLane(Cu, 1));                                            \
+    Du = xorMultiLane(Co, rolMultiLane(Ca, 1));                                            \
+    Bba = xorMultiLane(Aba, Da);                                                           \
+    Bka = rolMultiLane(xorMultiLane(Abe, De), 1);                                          \
+    Bsa = rolMultiLane(xorMultiLane(Abi, Di), 62);                                         \
+    Bga = rolMultiLane(xorMultiLane(Abo, Do), 28);                                         \
+    Bma = rolMultiLane(xorMultiLane(Abu, Du), 27);                                         \
+    Bme = rolMultiLane(xorMultiLane(Aga, Da), 36);                                         \
+    Bbe = rolMultiLane(xorMultiLane(Age, De), 44);                                         \
+    Bke = rolMultiLane(xorMultiLane(Agi, Di), 6);                                          \
+    Bse = rolMultiLane(xorMultiLane(Ago, Do), 55);                                         \
+    Bge = rolMultiLane(xorMultiLane(Agu, Du), 20);                                         \
+    Bgi = rolMultiLane(xorMultiLane(Aka, Da), 3);                                          \
+    Bmi = rolMultiLane(xorMultiLane(Ake, De), 10);                                         \
+    Bbi = rolMultiLane(xorMultiLane(Aki, Di), 43);                                         \
+    Bki = rolMultiLane(xorMultiLane(Ako, Do), 25);                                         \
+    Bsi = rolMultiLane(xorMultiLane(Aku, Du), 39);                                         \
+    Bso = rolMultiLane(xorMultiLane(Ama, Da), 41);                                         \
+    Bgo = rolMultiLane(xorMultiLane(Ame, De), 45);                                         \
+    Bmo = rolMultiLane(xorMultiLane(Ami, Di), 15);                                         \
+    Bbo = rolMultiLane(xorMultiLane(Amo, Do), 21);                                         \
+    Bko = rolMultiLane(xorMultiLane(Amu, Du), 8);                                          \
+    Bku = rolMultiLane(xorMultiLane(Asa, Da), 18);                                         \
+    Bsu = rolMultiLane(xorMultiLane(Ase, De), 2);                                          \
+    Bgu = rolMultiLane(xorMultiLane(Asi, Di), 61);                                         \
+    Bmu = rolMultiLane(xorMultiLane(Aso, Do), 56);                                         \
+    Bbu = rolMultiLane(xorMultiLane(Asu, Du), 14);                                         \
+    Aba = xorMultiLane(Bba, andnMultiLane(Bbe, Bbi));                                      \
+    Abe = xorMultiLane(Bbe, andnMultiLane(Bbi, Bbo));                                      \
+    Abi = xorMultiLane(Bbi, andnMultiLane(Bbo, Bbu));                                      \
+    Abo = xorMultiLane(Bbo, andnMultiLane(Bbu, Bba));                                      \
+    Abu = xorMultiLane(Bbu, andnMultiLane(Bba, Bbe));                                      \
+    Aga = xorMultiLane(Bga, andnMultiLane(Bge, Bgi));                                      \
+    Age = xorMultiLane(Bge, andnMultiLane(Bgi, Bgo));                                      \
+    Agi = xorMultiLane(Bgi, andnMultiLane(Bgo, Bgu));                                      \
+    Ago = xorMultiLane(Bgo, andnMultiLane(Bgu, Bga));                                      \
+    Agu = xorMultiLane(Bgu, andnMultiLane(Bga, Bge));                                      \
+    Aka = xorMultiLane(Bka, andnMultiLane(Bke, Bki));                                      \
+    Ake = xorMultiLane(Bke, andnMultiLane(Bki, Bko));                                      \
+    Aki = xorMultiLane(Bki, andnMultiLane(Bko, Bku));                                      \
+    Ako = xorMultiLane(Bko, andnMultiLane(Bku, Bka));                                      \
+    Aku = xorMultiLane(Bku, andnMultiLane(Bka, Bke));                                      \
+    Ama = xorMultiLane(Bma, andnMultiLane(Bme, Bmi));                                      \
+    Ame = xorMultiLane(Bme, andnMultiLane(Bmi, Bmo));                                      \
+    Ami = xorMultiLane(Bmi, andnMultiLane(Bmo, Bmu));                                      \
+    Amo = xorMultiLane(Bmo, andnMultiLane(Bmu, Bma));                                      \
+    Amu = xorMultiLane(Bmu, andnMultiLane(Bma, Bme));                                      \
+    Asa = xorMultiLane(Bsa, andnMultiLane(Bse, Bsi));                                      \
+    Ase = xorMultiLane(Bse, andnMultiLane(Bsi, Bso));                                      \
+    Asi = xorMultiLane(Bsi, andnMultiLane(Bso, Bsu));                                      \
+    Aso = xorMultiLane(Bso, andnMultiLane(Bsu, Bsa));                                      \
+    Asu = xorMultiLane(Bsu, andnMultiLane(Bsa, Bse));                                      \
+    Aba = xorMultiLane(Aba, constMultiLane(rc));                                          
+
+#define rounds12MultiLane \
+    roundMultiLane(KeccakF1600RoundConstant0) \
+    roundMultiLane(KeccakF1600RoundConstant1) \
+    roundMultiLane(KeccakF1600RoundConstant2) \
+    roundMultiLane(KeccakF1600RoundConstant3) \
+    roundMultiLane(KeccakF1600RoundConstant4) \
+    roundMultiLane(KeccakF1600RoundConstant5) \
+    roundMultiLane(KeccakF1600RoundConstant6) \
+    roundMultiLane(KeccakF1600RoundConstant7) \
+    roundMultiLane(KeccakF1600RoundConstant8) \
+    roundMultiLane(KeccakF1600RoundConstant9) \
+    roundMultiLane(KeccakF1600RoundConstant10) \
+    roundMultiLane(0x8000000080008008ULL)
+
+// Transpose 4x4 matrix of 64-bit values (rows to columns and vice versa)
+static inline void transpose4x4(__m256i& r0, __m256i& r1, __m256i& r2, __m256i& r3)
+{
+    const __m256i t0 = _mm256_unpacklo_epi64(r0, r1);
+    const __m256i t1 = _mm256_unpackhi_epi64(r0, r1);
+    const __m256i t2 = _mm256_unpacklo_epi64(r2, r3);
+    const __m256i t3 = _mm256_unpackhi_epi64(r2, r3);
+    r0 = _mm256_permute2x128_si256(t0, t2, 0x20);
+    r1 = _mm256_permute2x128_si256(t1, t3, 0x20);
+    r2 = _mm256_permute2x128_si256(t0, t2, 0x31);
+    r3 = _mm256_permute2x128_si256(t1, t3, 0x31);
+}
+
+// Load first 4 or second 4 lanes of 4 inputs into vectors with one lane of all inputs each
+static inline void loadLanes4x4(const void* const input[4], unsigned int offset, __m256i& l0, __m256i& l1, __m256i& l2, __m256i& l3)
+{
+    l0 = _mm256_loadu_si256((const __m256i*)((const unsigned char*)input[0] + offset));
+    l1 = _mm256_loadu_si256((const __m256i*)((const unsigned char*)input[1] + offset));
+    l2 = _mm256_loadu_si256((const __m256i*)((const unsigned char*)input[2] + offset));
+    l3 = _mm256_loadu_si256((const __m256i*)((const unsigned char*)input[3] + offset));
+    transpose4x4(l0, l1, l2, l3);
+}
+
+// Store vectors with one lane of all 4 outputs each as 32 byte outputs
+static inline void storeLanes4x4(void* const output[4], __m256i l0, __m256i l1, __m256i l2, __m256i l3)
+{
+    transpose4x4(l0, l1, l2, l3);
+    _mm256_storeu_si256((__m256i*)output[0], l0);
+    _mm256_storeu_si256((__m256i*)output[1], l1);
+    _mm256_storeu_si256((__m256i*)output[2], l2);
+    _mm256_storeu_si256((__m256i*)output[3], l3);
+}
+
+#define xorMultiLane(a, b) _mm256_xor_si256(a, b)
+#define rolMultiLane(a, offset) _mm256_or_si256(_mm256_slli_epi64(a, offset), _mm256_srli_epi64(a, 64 - (offset)))
+#define andnMultiLane(a, b) _mm256_andnot_si256(a, b)
+#define constMultiLane(c) _mm256_set1_epi64x(c)
+
+// Hash 4 independent 64 byte inputs to 32 byte outputs using AVX2 (same result as 4 calls of KangarooTwelve64To32)
+static void KangarooTwelve64To32x4(const void* const input[4], void* const output[4])
+{
+    declareMultiLane(__m256i)
+
+    loadLanes4x4(input, 0, Aba, Abe, Abi, Abo);
+    loadLanes4x4(input, 32, Abu, Aga, Age, Agi);
+    initStateMultiLane
+
+    rounds12MultiLane
+
+    storeLanes4x4(output, Aba, Abe, Abi, Abo);
+}
+
+#undef xorMultiLane
+#undef rolMultiLane
+#undef andnMultiLane
+#undef constMultiLane
+
+#if defined (__AVX512F__)
+
+#define xorMultiLane(a, b) _mm512_xor_si512(a, b)
+#define rolMultiLane(a, offset) _mm512_rol_epi64(a, offset)
+#define andnMultiLane(a, b) _mm512_andnot_si512(a, b)
+#define constMultiLane(c) _mm512_set1_epi64(c)
+
+// Hash 8 independent 64 byte inputs to 32 byte outputs using AVX-512 (same result as 8 calls of KangarooTwelve64To32)
+static void KangarooTwelve64To32x8(const void* const input[8], void* const output[8])
+{
+    declareMultiLane(__m512i)
+
+    __m256i l0, l1, l2, l3, h0, h1, h2, h3;
+    loadLanes4x4(input, 0, l0, l1, l2, l3);
+    loadLanes4x4(input + 4, 0, h0, h1, h2, h3);
+    Aba = _mm512_inserti64x4(_mm512_castsi256_si512(l0), h0, 1);
+    Abe = _mm512_inserti64x4(_mm512_castsi256_si512(l1), h1, 1);
+    Abi = _mm512_inserti64x4(_mm512_castsi256_si512(l2), h2, 1);
+    Abo = _mm512_inserti64x4(_mm512_castsi256_si512(l3), h3, 1);
+    loadLanes4x4(input, 32, l0, l1, l2, l3);
+    loadLanes4x4(input + 4, 32, h0, h1, h2, h3);
+    Abu = _mm512_inserti64x4(_mm512_castsi256_si512(l0), h0, 1);
+    Aga = _mm512_inserti64x4(_mm512_castsi256_si512(l1), h1, 1);
+    Age = _mm512_inserti64x4(_mm512_castsi256_si512(l2), h2, 1);
+    Agi = _mm512_inserti64x4(_mm512_castsi256_si512(l3), h3, 1);
+    initStateMultiLane
+
+    rounds12MultiLane
+
+    storeLanes4x4(output, _mm512_castsi512_si256(Aba), _mm512_castsi512_si256(Abe), _mm512_castsi512_si256(Abi), _mm512_castsi512_si256(Abo));
+    storeLanes4x4(output + 4, _mm512_extracti64x4_epi64(Aba, 1), _mm512_extracti64x4_epi64(Abe, 1), _mm512_extracti64x4_epi64(Abi, 1), _mm512_extracti64x4_epi64(Abo, 1));
+}
+
+#undef xorMultiLane
+#undef rolMultiLane
+#undef andnMultiLane
+#undef constMultiLane
+
+#else
+
+// Hash 8 independent 64 byte inputs to 32 byte outputs (same result as 8 calls of KangarooTwelve64To32)
+static void KangarooTwelve64To32x8(const void* const input[8], void* const output[8])
+{
+    KangarooTwelve64To32x4(input, output);
+    KangarooTwelve64To32x4(input + 4, output + 4);
+}
+
+#endif
+
+// Collects independent KangarooTwelve64To32 jobs and processes them 8 at a time. Inputs must not be
+// outputs of jobs that are still pending, so call flush() before starting the next tree level.
+struct KangarooTwelve64To32Batch
+{
+    const void* input[8];
+    void* output[8];
+    unsigned int count = 0;
+
+    void add(const void* in, void* out)
+    {
+        input[count] = in;
+        output[count] = out;
+        if (++count == 8)
+        {
+            KangarooTwelve64To32x8(input, output);
+            count = 0;
+        }
+    }
+
+    void flush()
+    {
+        unsigned int i = 0;
+        if (count >= 4)
+        {
+            KangarooTwelve64To32x4(input, output);
+            i = 4;
+        }
+        for (; i < count; i++)
+        {
+            KangarooTwelve64To32(input[i], output[i]);
+        }
+        count = 0;
+    }
+};
+
+// Hash count consecutive 64 byte blocks of input to count consecutive 32 byte digests in output
+// (for example all nodes of one Merkle tree level). Input and output must not overlap.
+static void KangarooTwelve64To32Multiple(const void* input, void* output, unsigned long long count)
+{
+    const unsigned char* in = (const unsigned char*)input;
+    unsigned char* out = (unsigned char*)output;
+    const void* inputs[8];
+    void* outputs[8];
+    for (; count >= 8; count -= 8, in += 8 * 64, out += 8 * 32)
+    {
+        for (unsigned int i = 0; i < 8; i++)
+        {
+            inputs[i] = in + i * 64;
+            outputs[i] = out + i * 32;
+        }
+        KangarooTwelve64To32x8(inputs, outputs);
+    }
+    if (count >= 4)
+    {
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            inputs[i] = in + i * 64;
+            outputs[i] = out + i * 32;
+        }
+        KangarooTwelve64To32x4(inputs, outputs);
+        count -= 4;
+        in += 4 * 64;
+        out += 4 * 32;
+    }
+    for (; count > 0; count--, in += 64, out += 32)
+    {
+        KangarooTwelve64To32(in, out);
+    }
+}
+
 static void random(const unsigned char* publicKey, const unsigned char* nonce, unsigned char* output, unsigned long long outputSize)
 {
     unsigned char state[200];
@@ -0,0 +1,154 @@
+// Filter for suppressing duplicate requests received from different peers (dejavu filter)
+
+#pragma once
+
+#include "platform/memory.h"
+#include "platform/assert.h"
+#include "platform/console_logging.h"
+
+
+// Set-associative table of fingerprints of request IDs, each tagged with the generation in which it was inserted.
+// A generation ends after generationLength insertions. IDs inserted in the current or the previous generation are
+// reported as duplicates, older entries are expired lazily (by comparing tags) and their slots are reused by later
+// insertions, so the table never has to be cleared in bulk. Tags wrap around, but stale entries are cleared whenever
+// their bucket is inserted into, which happens long before a tag can come around again.
+//
+// The ID is a 64-bit hash of the request. Its low bits select a bucket of slotsPerBucket slots, its high bits are
+// the fingerprint. Each slot is 32 bits: fingerprint (fingerprintBits) and generation tag (32 - fingerprintBits).
+// An ID that hasn't been inserted is reported as duplicate (false positive) if an entry of the bucket has the same
+// fingerprint, so the false-positive rate is about (live entries per bucket) / 2^fingerprintBits.
+// The capacity should be at least 4 * generationLength, so live entries are almost never evicted.
+template <unsigned int fingerprintBits>
+class DuplicateFilter
+{
+public:
+    static_assert(fingerprintBits >= 8 && fingerprintBits <= 28, "Generation tag needs at least 4 bits");
+    static constexpr unsigned int slotsPerBucket = 16; // one cache line
+    static constexpr unsigned int generationBits = 32 - fingerprintBits;
+    static constexpr unsigned int generationMask = (1 << generationBits) - 1;
+
+    // Allocate table with capacity slots (power of 2, at least slotsPerBucket). Call at node startup.
+    bool init(unsigned long long capacity, unsigned int generationLength)
+    {
+        ASSERT(capacity >= slotsPerBucket && (capacity & (capacity - 1)) == 0);
+        ASSERT(generationLength > 0);
+        if (!allocatePool(capacity * sizeof(unsigned int), (void**)&slots))
+        {
+            logToConsole(L"Failed to allocate duplicate filter memory!");
+            return false;
+        }
+        setMem(slots, capacity * sizeof(unsigned int), 0);
+        bucketMask = capacity / slotsPerBucket - 1;
+        this->generationLength = generationLength;
+        generation = 0;
+        generationInsertions = 0;
+        previousGenerationInsertions = 0;
+        numberOfInsertions = 0;
+        numberOfEvictions = 0;
+        return true;
+    }
+
+    // Free table
+    void deinit()
+    {
+        if (slots)
+            freePool(slots);
+        slots = nullptr;
+    }
+
+    // Return true if id has been inserted in the current or previous generation (or on fingerprint collision)
+    bool contains(unsigned long long id) const
+    {
+        const unsigned int* bucket = slots + (id & bucketMask) * slotsPerBucket;
+        const unsigned int fingerprint = getFingerprint(id);
+        for (unsigned int i = 0; i < slotsPerBucket; i++)
+        {
+            if ((bucket[i] >> generationBits) == fingerprint && isLive(bucket[i]))
+                return true;
+        }
+        return false;
+    }
+
+    // Insert id in current generation. Expired slots of the bucket are cleared on the way. If all slots of the
+    // bucket are live, the oldest entry is evicted.
+    void insert(unsigned long long id)
+    {
+        unsigned int* bucket = slots + (id & bucketMask) * slotsPerBucket;
+        const unsigned int fingerprint = getFingerprint(id);
+        unsigned int freeSlot = slotsPerBucket, oldestSlot = 0, oldestAge = 0;
+        for (unsigned int i = 0; i < slotsPerBucket; i++)
+        {
+            if (!isLive(bucket[i]))
+            {
+                bucket[i] = 0;
+                if (freeSlot == slotsPerBucket)
+                    freeSlot = i;
+            }
+            else if ((bucket[i] >> generationBits) == fingerprint)
+            {
+                // Already known -> refresh tag
+                freeSlot = i;
+                break;
+            }
+            else if (getAge(bucket[i]) > oldestAge)
+            {
+                oldestAge = getAge(bucket[i]);
+                oldestSlot = i;
+            }
+        }
+        if (freeSlot == slotsPerBucket)
+        {
+            freeSlot = oldestSlot;
+            numberOfEvictions++;
+        }
+        bucket[freeSlot] = (fingerprint << generationBits) | (generation & generationMask);
+
+        numberOfInsertions++;
+        if (++generationInsertions == generationLength)
+        {
+            // Start next generation: entries of the previous one expire
+            generation++;
+            previousGenerationInsertions = generationInsertions;
+            generationInsertions = 0;
+        }
+    }
+
+    // Expected number of false positives per billion lookups of new IDs with the current number of live entries
+    unsigned long long getExpectedFalsePositivesPerBillion() const
+    {
+        const unsigned long long liveEntries = generationInsertions + previousGenerationInsertions;
+        return liveEntries * 1000000000ULL / ((bucketMask + 1) << fingerprintBits);
+    }
+
+    // Statistics (totals since init)
+    unsigned long long getNumberOfInsertions() const { return numberOfInsertions; }
+    unsigned long long getNumberOfEvictions() const { return numberOfEvictions; }
+    unsigned int getGeneration() const { return generation; }
+
+private:
+    unsigned int* slots;
+    unsigned long long bucketMask;
+    unsigned int generationLength;
+    unsigned int generation;
+    unsigned int generationInsertions;
+    unsigned int previousGenerationInsertions;
+    unsigned long long numberOfInsertions;
+    unsigned long long numberOfEvictions;
+
+    // Fingerprint is never 0, so empty slots (0) don't match
+    static unsigned int getFingerprint(unsigned long long id)
+    {
+        const unsigned int fingerprint = (unsigned int)(id >> (64 - fingerprintBits));
+        return fingerprint ? fingerprint : 1;
+    }
+
+    unsigned int getAge(unsigned int entry) const
+    {
+        return (generation - entry) & generationMask;
+    }
+
+    bool isLive(unsigned int entry) const
+    {
+        return entry && getAge(entry) <= 1;
+    }
+};
@@ -0,0 +1,95 @@
+// Set of peers that are suitable for disseminating messages
+// (maintained incrementally instead of scanning all peers for each message)
+
+#pragma once
+
+#include "platform/assert.h"
+#include "platform/random.h"
+
+
+// Set of peer indices with constant-time insertion, removal and random selection. Members are stored densely in
+// members[0, count), positions[peerIndex] is the position of the peer in members plus 1 (0 = not contained), so the
+// zero-initialized global instance is an empty set. Not thread-safe (used by main thread only).
+template <unsigned int capacity>
+class PeerIndexSet
+{
+public:
+    void reset()
+    {
+        for (unsigned int i = 0; i < capacity; i++)
+            positions[i] = 0;
+        count = 0;
+    }
+
+    bool contains(unsigned int peerIndex) const
+    {
+        ASSERT(peerIndex < capacity);
+        return positions[peerIndex] != 0;
+    }
+
+    void add(unsigned int peerIndex)
+    {
+        if (!contains(peerIndex))
+        {
+            members[count] = peerIndex;
+            positions[peerIndex] = ++count;
+        }
+    }
+
+    void remove(unsigned int peerIndex)
+    {
+        if (contains(peerIndex))
+        {
+            // Move last member into the gap
+            const unsigned int position = positions[peerIndex] - 1;
+            const unsigned short lastMember = members[--count];
+            members[position] = lastMember;
+            positions[lastMember] = position + 1;
+            positions[peerIndex] = 0;
+        }
+    }
+
+    // Add or remove peer depending on whether it is suitable
+    void update(unsigned int peerIndex, bool isMember)
+    {
+        if (isMember)
+            add(peerIndex);
+        else
+            remove(peerIndex);
+    }
+
+    unsigned int size() const
+    {
+        return count;
+    }
+
+    // Return random member (set must not be empty)
+    unsigned int getRandom() const
+    {
+        ASSERT(count);
+        return members[random(count)];
+    }
+
+    // Select up to maxCount distinct random members, return number of selected members. The order of the members
+    // doesn't matter, so a partial Fisher-Yates shuffle is done in place.
+    unsigned int selectRandom(unsigned short* selected, unsigned int maxCount)
+    {
+        const unsigned int selectedCount = (maxCount < count) ? maxCount : count;
+        for (unsigned int i = 0; i < selectedCount; i++)
+        {
+            const unsigned int j = i + random(count - i);
+            const unsigned short member = members[j];
+            members[j] = members[i];
+            positions[members[j]] = j + 1;
+            members[i] = member;
+            positions[member] = i + 1;
+            selected[i] = member;
+        }
+        return selectedCount;
+    }
+
+private:
+    unsigned short members[capacity];
+    unsigned short positions[capacity];
+    unsigned int count;
+};
@@ -10,6 +10,12 @@
 #include "network_messages/common_def.h"
 #include "network_messages/header.h"
 #include "network_messages/common_response.h"
+#include "network_messages/all.h"
+
+#include "duplicate_filter.h"
+#include "peer_set.h"
+#include "receive_buffer.h"
+#include "request_queue.h"
 
 #include "tcp4.h"
 #include "kangaroo_twelve.h"
@@ -17,13 +23,14 @@
 #include "text_output.h"
 
 
-#define DEJAVU_SWAP_LIMIT 1000000
+#define DEJAVU_SWAP_LIMIT 1000000 // Number of insertions per generation of the dejavu filter
+#define DEJAVU_FILTER_CAPACITY 8388608
+#define DEJAVU_FINGERPRINT_BITS 24
 #define DISSEMINATION_MULTIPLIER 6
 #define NUMBER_OF_OUTGOING_CONNECTIONS 8
 #define NUMBER_OF_INCOMING_CONNECTIONS 88
 #define MAX_NUMBER_OF_PUBLIC_PEERS 1024
 #define REQUEST_QUEUE_BUFFER_SIZE 1073741824
-#define REQUEST_QUEUE_LENGTH 65536 // Must be 65536
 #define RESPONSE_QUEUE_BUFFER_SIZE 1073741824
 #define RESPONSE_QUEUE_LENGTH 65536 // Must be 65536
 #define NUMBER_OF_PUBLIC_PEERS_TO_KEEP 10
@@ -40,6 +47,7 @@ struct Peer
     EFI_TCP4_LISTEN_TOKEN connectAcceptToken;
     IPv4Address address;
     void* receiveBuffer;
+    unsigned int receiveBufferReadOffset; // begin of data in receiveBuffer that hasn't been parsed yet
     EFI_TCP4_RECEIVE_DATA receiveData;
     EFI_TCP4_IO_TOKEN receiveToken;
     EFI_TCP4_TRANSMIT_DATA transmitData;
@@ -62,6 +70,7 @@ typedef struct
 } PublicPeer;
 
 static Peer peers[NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS];
+static PeerIndexSet<NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS> suitablePeers; // peers used by pushToAny() and pushToSeveral()
 static volatile long long numberOfReceivedBytes = 0, prevNumberOfReceivedBytes = 0;
 static volatile long long numberOfTransmittedBytes = 0, prevNumberOfTransmittedBytes = 0;
 static int numberOfAcceptedIncommingConnection = 0;
@@ -70,9 +79,7 @@ static volatile char publicPeersLock = 0;
 static unsigned int numberOfPublicPeers = 0;
 static PublicPeer publicPeers[MAX_NUMBER_OF_PUBLIC_PEERS];
 
-static unsigned long long* dejavu0 = NULL;
-static unsigned long long* dejavu1 = NULL;
-static unsigned int dejavuSwapCounter = DEJAVU_SWAP_LIMIT;
+static DuplicateFilter<DEJAVU_FINGERPRINT_BITS> dejavuFilter;
 
 static volatile long long numberOfProcessedRequests = 0, prevNumberOfProcessedRequests = 0;
 static volatile long long numberOfDiscardedRequests = 0, prevNumberOfDiscardedRequests = 0;
@@ -82,11 +89,16 @@ static volatile long long numberOfDisseminatedRequests = 0, prevNumberOfDissemin
 static unsigned char* requestQueueBuffer = NULL;
 static unsigned char* responseQueueBuffer = NULL;
 
-static struct Request
-{
-    Peer* peer;
-    unsigned int offset;
-} requestQueueElements[REQUEST_QUEUE_LENGTH];
+// Priority lanes of the request queue. Request processors take the next request from the first lane that isn't
+// empty, so consensus messages aren't delayed by floods of transactions or queries. Each lane has its own part of
+// requestQueueBuffer and drops requests (answered with TryAgain) only if the lane itself is full.
+#define REQUEST_QUEUE_CONSENSUS_LANE 0
+#define REQUEST_QUEUE_TRANSACTION_LANE 1
+#define REQUEST_QUEUE_QUERY_LANE 2
+#define NUMBER_OF_REQUEST_QUEUE_LANES 3
+static constexpr unsigned int requestQueueLaneBufferSizes[NUMBER_OF_REQUEST_QUEUE_LANES] = { 134217728, 536870912, 402653184 };
+static_assert(134217728 + 536870912 + 402653184 == REQUEST_QUEUE_BUFFER_SIZE, "Lane buffers must fill request queue buffer");
+static RequestQueue requestQueueLanes[NUMBER_OF_REQUEST_QUEUE_LANES];
 
 static struct Response
 {
@@ -94,15 +106,35 @@ static struct Response
     unsigned int offset;
 } responseQueueElements[RESPONSE_QUEUE_LENGTH];
 
-static volatile unsigned int requestQueueBufferHead = 0, requestQueueBufferTail = 0;
 static volatile unsigned int responseQueueBufferHead = 0, responseQueueBufferTail = 0;
-static volatile unsigned short requestQueueElementHead = 0, requestQueueElementTail = 0;
 static volatile unsigned short responseQueueElementHead = 0, responseQueueElementTail = 0;
-static volatile char requestQueueTailLock = 0;
 static volatile char responseQueueHeadLock = 0;
 static volatile unsigned long long queueProcessingNumerator = 0, queueProcessingDenominator = 0;
 static volatile unsigned long long tickerLoopNumerator = 0, tickerLoopDenominator = 0;
 
+// Return lane of the request queue for requests of given message type
+static unsigned int getRequestQueueLane(unsigned char type)
+{
+    switch (type)
+    {
+    case BroadcastTick::type:
+    case BroadcastFutureTickData::type:
+    case BroadcastComputors::type:
+    case RequestComputors::type:
+    case RequestQuorumTick::type:
+    case RequestTickData::type:
+        return REQUEST_QUEUE_CONSENSUS_LANE;
+
+    case BROADCAST_TRANSACTION:
+    case BroadcastMessage::type:
+    case REQUEST_TICK_TRANSACTIONS:
+        return REQUEST_QUEUE_TRANSACTION_LANE;
+
+    default:
+        return REQUEST_QUEUE_QUERY_LANE;
+    }
+}
+
 static bool isWhiteListPeer(unsigned char address[4])
 {
     for (unsigned int i = 0; i < NUMBER_OF_WHITE_LIST_PEERS; i++)
@@ -119,8 +151,23 @@ static bool isWhiteListPeer(unsigned char address[4])
     return false;
 }
 
+// Return true if messages can be disseminated to peer (connected and public peers exchanged)
+static bool isSuitablePeer(const Peer& peer)
+{
+    return peer.tcp4Protocol && peer.isConnectedAccepted && peer.exchangedPublicPeers && !peer.isClosing;
+}
+
+// Update set of suitable peers after state of peer has changed, can only called from main thread (not thread-safe).
+// Also called for each peer in each round of the main loop, because exchangedPublicPeers is set by request processors.
+static void updateSuitablePeer(unsigned int i)
+{
+    suitablePeers.update(i, isSuitablePeer(peers[i]));
+}
+
 static void closePeer(Peer* peer)
 {
+    suitablePeers.remove((unsigned int)(peer - peers));
+
     if (((unsigned long long)peer->tcp4Protocol) > 1)
     {
         if (!peer->isClosing)
@@ -181,43 +228,48 @@ static void push(Peer* peer, RequestResponseHeader* requestResponseHeader)
     }
 }
 
-// Add message to sending buffer of random peer, can only called from main thread (not thread-safe).
-static void pushToAny(RequestResponseHeader* requestResponseHeader)
+// Add message to sending buffers of several peers (batched version of push() that reads the message size and
+// updates the statistics once), can only called from main thread (not thread-safe).
+static void pushToPeers(const unsigned short* peerIndices, unsigned int numberOfPeers, RequestResponseHeader* requestResponseHeader)
 {
-    unsigned short suitablePeerIndices[NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS];
-    unsigned short numberOfSuitablePeers = 0;
-    for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
+    const unsigned int size = requestResponseHeader->size();
+    long long numberOfPushes = 0;
+    for (unsigned int k = 0; k < numberOfPeers; k++)
     {
-        if (peers[i].tcp4Protocol && peers[i].isConnectedAccepted && peers[i].exchangedPublicPeers && !peers[i].isClosing)
+        Peer* peer = &peers[peerIndices[k]];
+        if (peer->tcp4Protocol && peer->isConnectedAccepted && !peer->isClosing)
         {
-            suitablePeerIndices[numberOfSuitablePeers++] = i;
+            if (peer->dataToTransmitSize + size > BUFFER_SIZE)
+            {
+                // Buffer is full, which indicates a problem
+                closePeer(peer);
+            }
+            else
+            {
+                bs->CopyMem(&peer->dataToTransmit[peer->dataToTransmitSize], requestResponseHeader, size);
+                peer->dataToTransmitSize += size;
+                numberOfPushes++;
+            }
         }
     }
-    if (numberOfSuitablePeers)
+    _InterlockedExchangeAdd64(&numberOfDisseminatedRequests, numberOfPushes);
+}
+
+// Add message to sending buffer of random peer, can only called from main thread (not thread-safe).
+static void pushToAny(RequestResponseHeader* requestResponseHeader)
+{
+    if (suitablePeers.size())
     {
-        push(&peers[suitablePeerIndices[random(numberOfSuitablePeers)]], requestResponseHeader);
+        push(&peers[suitablePeers.getRandom()], requestResponseHeader);
     }
 }
 
 // Add message to sending buffer of some random peers, can only called from main thread (not thread-safe).
 static void pushToSeveral(RequestResponseHeader* requestResponseHeader)
 {
-    unsigned short suitablePeerIndices[NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS];
-    unsigned short numberOfSuitablePeers = 0;
-    for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
-    {
-        if (peers[i].tcp4Protocol && peers[i].isConnectedAccepted && peers[i].exchangedPublicPeers && !peers[i].isClosing)
-        {
-            suitablePeerIndices[numberOfSuitablePeers++] = i;
-        }
-    }
-    unsigned short numberOfRemainingSuitablePeers = DISSEMINATION_MULTIPLIER;
-    while (numberOfRemainingSuitablePeers-- && numberOfSuitablePeers)
-    {
-        const unsigned short index = random(numberOfSuitablePeers);
-        push(&peers[suitablePeerIndices[index]], requestResponseHeader);
-        suitablePeerIndices[index] = suitablePeerIndices[--numberOfSuitablePeers];
-    }
+    unsigned short selectedPeerIndices[DISSEMINATION_MULTIPLIER];
+    const unsigned int numberOfSelectedPeers = suitablePeers.selectRandom(selectedPeerIndices, DISSEMINATION_MULTIPLIER);
+    pushToPeers(selectedPeerIndices, numberOfSelectedPeers, requestResponseHeader);
 }
 
 // Add message to response queue of specific peer. If peer is NULL, it will be sent to random peers. Can be called from any thread.
@@ -517,6 +569,8 @@ static void peerReceiveAndTransmit(unsigned int i, unsigned int salt)
 {
     EFI_STATUS status;
 
+    updateSuitablePeer(i);
+
     // poll to receive incoming data and transmit outgoing segments
     if (((unsigned long long)peers[i].tcp4Protocol) > 1)
     {
@@ -546,82 +600,56 @@ static void peerReceiveAndTransmit(unsigned int i, unsigned int salt)
                     numberOfReceivedBytes += peers[i].receiveData.DataLength;
                     *((unsigned long long*) & peers[i].receiveData.FragmentTable[0].FragmentBuffer) += peers[i].receiveData.DataLength;
 
-                iteration:
-                    unsigned int receivedDataSize = (unsigned int)(((unsigned long long)peers[i].receiveData.FragmentTable[0].FragmentBuffer) - ((unsigned long long)peers[i].receiveBuffer));
-
-                    if (receivedDataSize >= sizeof(RequestResponseHeader))
+                    // parse complete messages in place (see receive_buffer.h)
+                    unsigned char* receiveBuffer = (unsigned char*)peers[i].receiveBuffer;
+                    unsigned int receivedDataEnd = (unsigned int)(((unsigned long long)peers[i].receiveData.FragmentTable[0].FragmentBuffer) - ((unsigned long long)receiveBuffer));
+                    bool invalidHeader = false;
+                    RequestResponseHeader* requestResponseHeader;
+                    while (requestResponseHeader = getReceivedMessage(receiveBuffer, peers[i].receiveBufferReadOffset, receivedDataEnd, invalidHeader))
                     {
-                        RequestResponseHeader* requestResponseHeader = (RequestResponseHeader*)peers[i].receiveBuffer;
-                        if (requestResponseHeader->size() < sizeof(RequestResponseHeader))
+                        unsigned long long saltedId;
+
+                        const unsigned int header = *((unsigned int*)requestResponseHeader);
+                        *((unsigned int*)requestResponseHeader) = salt;
+                        KangarooTwelve(requestResponseHeader, header & 0xFFFFFF, &saltedId, sizeof(saltedId));
+                        *((unsigned int*)requestResponseHeader) = header;
+
+                        // Initiate transfer of already received packet to processing thread
+                        // (or drop it without processing if Dejavu filter tells to ignore it)
+                        if (!dejavuFilter.contains(saltedId))
                         {
-                            // protocol violation -> forget peer
-                            setText(message, L"Forgetting ");
-                            appendIPv4Address(message, peers[i].address);
-                            appendText(message, L"...");
-                            forgetPublicPeer(peers[i].address);
-                            closePeer(&peers[i]);
+                            if (requestQueueLanes[getRequestQueueLane(requestResponseHeader->type())].tryEnqueue(&peers[i], requestResponseHeader))
+                            {
+                                dejavuFilter.insert(saltedId);
+                            }
+                            else
+                            {
+                                _InterlockedIncrement64(&numberOfDiscardedRequests);
+
+                                enqueueResponse(&peers[i], 0, TryAgain::type, requestResponseHeader->dejavu(), NULL);
+                            }
                         }
                         else
                         {
-                            if (receivedDataSize >= requestResponseHeader->size())
-                            {
-                                unsigned int saltedId;
-
-                                const unsigned int header = *((unsigned int*)requestResponseHeader);
-                                *((unsigned int*)requestResponseHeader) = salt;
-                                KangarooTwelve(requestResponseHeader, header & 0xFFFFFF, &saltedId, sizeof(saltedId));
-                                *((unsigned int*)requestResponseHeader) = header;
-
-                                // Initiate transfer of already received packet to processing thread
-                                // (or drop it without processing if Dejavu filter tells to ignore it)
-                                if (!((dejavu0[saltedId >> 6] | dejavu1[saltedId >> 6]) & (1ULL << (saltedId & 63))))
-                                {
-                                    if ((requestQueueBufferHead >= requestQueueBufferTail || requestQueueBufferHead + requestResponseHeader->size() < requestQueueBufferTail)
-                                        && (unsigned short)(requestQueueElementHead + 1) != requestQueueElementTail)
-                                    {
-                                        dejavu0[saltedId >> 6] |= (1ULL << (saltedId & 63));
-
-                                        ASSERT(requestQueueElementHead < REQUEST_QUEUE_LENGTH);
-                                        ASSERT(requestQueueBufferHead < REQUEST_QUEUE_BUFFER_SIZE);
-                                        ASSERT(requestQueueBufferHead + requestResponseHeader->size() < REQUEST_QUEUE_BUFFER_SIZE);
-
-                                        requestQueueElements[requestQueueElementHead].offset = requestQueueBufferHead;
-                                        bs->CopyMem(&requestQueueBuffer[requestQueueBufferHead], peers[i].receiveBuffer, requestResponseHeader->size());
-                                        requestQueueBufferHead += requestResponseHeader->size();
-                                        requestQueueElements[requestQueueElementHead].peer = &peers[i];
-                                        if (requestQueueBufferHead > REQUEST_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
-                                        {
-                                            requestQueueBufferHead = 0;
-                                        }
-                                        // TODO: Place a fence
-                                        requestQueueElementHead++;
-
-                                        if (!(--dejavuSwapCounter))
-                                        {
-                                            unsigned long long* tmp = dejavu1;
-                                            dejavu1 = dejavu0;
-                                            bs->SetMem(dejavu0 = tmp, 536870912, 0);
-                                            dejavuSwapCounter = DEJAVU_SWAP_LIMIT;
-                                        }
-                                    }
-                                    else
-                                    {
-                                        _InterlockedIncrement64(&numberOfDiscardedRequests);
-
-                                        enqueueResponse(&peers[i], 0, TryAgain::type, requestResponseHeader->dejavu(), NULL);
-                                    }
-                                }
-                                else
-                                {
-                                    _InterlockedIncrement64(&numberOfDuplicateRequests);
-                                }
+                            _InterlockedIncrement64(&numberOfDuplicateRequests);
+                        }
 
-                                bs->CopyMem(peers[i].receiveBuffer, ((char*)peers[i].receiveBuffer) + requestResponseHeader->size(), receivedDataSize -= requestResponseHeader->size());
-                                peers[i].receiveData.FragmentTable[0].FragmentBuffer = ((char*)peers[i].receiveBuffer) + receivedDataSize;
+                        peers[i].receiveBufferReadOffset += requestResponseHeader->size();
+                    }
 
-                                goto iteration;
-                            }
-                        }
+                    if (invalidHeader)
+                    {
+                        // protocol violation -> forget peer
+                        setText(message, L"Forgetting ");
+                        appendIPv4Address(message, peers[i].address);
+                        appendText(message, L"...");
+                        forgetPublicPeer(peers[i].address);
+                        closePeer(&peers[i]);
+                    }
+                    else
+                    {
+                        receivedDataEnd = compactReceiveBuffer(receiveBuffer, BUFFER_SIZE, peers[i].receiveBufferReadOffset, receivedDataEnd);
+                        peers[i].receiveData.FragmentTable[0].FragmentBuffer = receiveBuffer + receivedDataEnd;
                     }
                 }
             }
@@ -742,6 +770,7 @@ static void peerReconnectIfInactive(unsigned int i, unsigned short port)
                 if (peers[i].connectAcceptToken.NewChildHandle = getTcp4Protocol(peers[i].address.u8, port, &peers[i].tcp4Protocol))
                 {
                     peers[i].receiveData.FragmentTable[0].FragmentBuffer = peers[i].receiveBuffer;
+                    peers[i].receiveBufferReadOffset = 0;
                     peers[i].dataToTransmitSize = 0;
                     peers[i].isReceiving = FALSE;
                     peers[i].isTransmitting = FALSE;
@@ -775,6 +804,7 @@ static void peerReconnectIfInactive(unsigned int i, unsigned short port)
             {
                 peers[i].isIncommingConnection = TRUE;
                 peers[i].receiveData.FragmentTable[0].FragmentBuffer = peers[i].receiveBuffer;
+                peers[i].receiveBufferReadOffset = 0;
                 peers[i].dataToTransmitSize = 0;
                 peers[i].isReceiving = FALSE;
                 peers[i].isTransmitting = FALSE;
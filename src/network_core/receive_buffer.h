@@ -0,0 +1,71 @@
+// Parsing of messages in the receive buffer of a peer connection
+// (messages are parsed in place, the buffer is compacted only rarely)
+
+#pragma once
+
+#include "platform/memory.h"
+#include "platform/assert.h"
+
+#include "network_messages/header.h"
+
+
+// The received data of a peer is buffer[readOffset, writeOffset). TCP data is appended at writeOffset and complete
+// messages are passed on directly from the buffer, advancing readOffset past each message. This avoids moving the
+// rest of the buffer to the front after each message, which is quadratic in the number of buffered messages.
+//
+// After parsing, compactReceiveBuffer() resets both offsets to 0 if all data has been parsed (the usual case).
+// The unparsed rest of an incomplete message is only moved to the beginning if the free space at the end isn't
+// sufficient to complete the message or if more than half of the buffer is in front of readOffset.
+
+// Statistics (totals since start)
+static unsigned long long numberOfReceiveBufferCompactions = 0;
+static unsigned long long numberOfReceiveBufferCompactedBytes = 0;
+
+// Return the complete message at readOffset, or nullptr if no complete message is in the buffer. If the header
+// at readOffset is invalid (protocol violation), nullptr is returned and invalidHeader is set to true.
+static RequestResponseHeader* getReceivedMessage(unsigned char* buffer, unsigned int readOffset, unsigned int writeOffset, bool& invalidHeader)
+{
+    ASSERT(readOffset <= writeOffset);
+    const unsigned int receivedDataSize = writeOffset - readOffset;
+    if (receivedDataSize < sizeof(RequestResponseHeader))
+        return nullptr;
+
+    RequestResponseHeader* header = (RequestResponseHeader*)(buffer + readOffset);
+    if (header->size() < sizeof(RequestResponseHeader))
+    {
+        invalidHeader = true;
+        return nullptr;
+    }
+    if (receivedDataSize < header->size())
+        return nullptr;
+
+    return header;
+}
+
+// Move unparsed data to the beginning of the buffer if needed (see above). Call after all complete messages have been
+// parsed. Updates readOffset and returns the new writeOffset.
+static unsigned int compactReceiveBuffer(unsigned char* buffer, unsigned int bufferSize, unsigned int& readOffset, unsigned int writeOffset)
+{
+    ASSERT(readOffset <= writeOffset && writeOffset <= bufferSize);
+    const unsigned int receivedDataSize = writeOffset - readOffset;
+    if (!receivedDataSize)
+    {
+        readOffset = 0;
+        return 0;
+    }
+    if (!readOffset)
+        return writeOffset;
+
+    // Size of the incomplete message if its header has been received already
+    const unsigned int messageSize = (receivedDataSize >= sizeof(RequestResponseHeader))
+        ? ((RequestResponseHeader*)(buffer + readOffset))->size() : (unsigned int)sizeof(RequestResponseHeader);
+    if (readOffset + messageSize > bufferSize || readOffset >= bufferSize / 2)
+    {
+        copyMem(buffer, buffer + readOffset, receivedDataSize);
+        readOffset = 0;
+        ++numberOfReceiveBufferCompactions;
+        numberOfReceiveBufferCompactedBytes += receivedDataSize;
+        return receivedDataSize;
+    }
+    return writeOffset;
+}
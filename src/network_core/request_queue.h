@@ -0,0 +1,239 @@
+// Lock-free queue of received requests waiting for the request processors
+// (one queue per priority lane, see peers.h for the lanes)
+
+#pragma once
+
+#include <intrin.h>
+
+#include "platform/memory.h"
+#include "platform/assert.h"
+
+#include "network_messages/header.h"
+
+
+// Bounded multi-producer/multi-consumer queue of requests. Elements are claimed with a sequence number per element
+// (as in D. Vyukov's bounded MPMC queue), so neither enqueuing nor dequeuing needs a lock. Requests are copied into
+// a ring buffer in the order of their positions. The buffer space of an element is reclaimed after the request has
+// been copied out and all older elements have been reclaimed, which may be done by any producer or consumer.
+//
+// Sequence number of the element at position pos (modulo length):
+// - pos: free for the producer of pos
+// - pos + 1: request published, waiting for consumer
+// - pos + 2: request dequeued and copied, buffer space not reclaimed yet
+// - pos + length: reclaimed, free for the producer of pos + length
+//
+// Element indices are positions modulo 65536, as used by SignaturePreVerifier. Call init() before use.
+class RequestQueue
+{
+public:
+    static constexpr unsigned int length = 65536;
+
+    // Set buffer for the requests and empty the queue. Requests are stored at offsets up to
+    // bufferSize - maxRequestSize, so the buffer should be much larger than maxRequestSize.
+    void init(unsigned char* buffer, unsigned int bufferSize, unsigned int maxRequestSize)
+    {
+        setMem(this, sizeof(*this), 0);
+        this->buffer = buffer;
+        this->bufferSize = bufferSize;
+        this->maxRequestSize = maxRequestSize;
+        for (unsigned int i = 0; i < length; i++)
+        {
+            elements[i].sequence = i;
+        }
+    }
+
+    // Copy request into the queue. Return false if the queue or its buffer is full (request is dropped).
+    bool tryEnqueue(void* peer, const RequestResponseHeader* request)
+    {
+        const unsigned int size = request->size();
+        ASSERT(size >= sizeof(RequestResponseHeader) && size <= maxRequestSize);
+
+        reclaim();
+
+        unsigned int pos, bufferHead;
+        while (1)
+        {
+            const long long state = producerState;
+            pos = (unsigned int)state;
+            bufferHead = (unsigned int)(state >> 32);
+            if (elements[pos & (length - 1)].sequence != pos)
+            {
+                // Element still used by request of previous round
+                _InterlockedIncrement64(&numberOfDroppedRequests);
+                return false;
+            }
+
+            // Check free buffer space from bufferHead to bufferTail (buffer is empty if all elements are reclaimed)
+            const long long reclaimed = reclaimState;
+            const unsigned int bufferTail = (unsigned int)(reclaimed >> 32);
+            if ((unsigned int)reclaimed != pos && bufferHead <= bufferTail && bufferHead + size >= bufferTail)
+            {
+                _InterlockedIncrement64(&numberOfDroppedRequests);
+                return false;
+            }
+
+            const long long newState = ((long long)nextBufferOffset(bufferHead, size) << 32) | (unsigned int)(pos + 1);
+            if (_InterlockedCompareExchange64(&producerState, newState, state) == state)
+            {
+                break;
+            }
+        }
+
+        Element& element = elements[pos & (length - 1)];
+        copyMem(buffer + bufferHead, request, size);
+        element.peer = peer;
+        element.offset = bufferHead;
+        element.size = size;
+
+        // Publish and advance publishedPosition past all published elements (without waiting for producers of older
+        // elements, the last of them advances it past ours). The fence orders our store before the loads in
+        // advancePublishedPosition(), so concurrent producers can't both miss the other's element.
+        _mm_sfence();
+        element.sequence = pos + 1;
+        _mm_mfence();
+        advancePublishedPosition();
+
+        _InterlockedIncrement64(&numberOfEnqueuedRequests);
+        return true;
+    }
+
+    // Claim the oldest request. Return false if the queue is empty. After copying the request (see getRequest()),
+    // release(pos) has to be called.
+    bool tryDequeue(unsigned int& pos)
+    {
+        while (1)
+        {
+            pos = (unsigned int)dequeuePosition;
+            const int diff = (int)(elements[pos & (length - 1)].sequence - (pos + 1));
+            if (diff < 0)
+            {
+                // Not published yet
+                return false;
+            }
+            if (diff == 0 && _InterlockedCompareExchange(&dequeuePosition, (long)(pos + 1), (long)pos) == (long)pos)
+            {
+                return true;
+            }
+            // Dequeued by other consumer -> retry with next position
+        }
+    }
+
+    RequestResponseHeader* getRequest(unsigned int pos) const
+    {
+        return (RequestResponseHeader*)(buffer + elements[pos & (length - 1)].offset);
+    }
+
+    void* getPeer(unsigned int pos) const
+    {
+        return elements[pos & (length - 1)].peer;
+    }
+
+    // Make element and buffer space of dequeued request available again
+    void release(unsigned int pos)
+    {
+        _mm_sfence();
+        elements[pos & (length - 1)].sequence = pos + 2;
+        reclaim();
+    }
+
+    // Positions of oldest not dequeued and of next not published element (for SignaturePreVerifier)
+    const volatile long& tail() const
+    {
+        return dequeuePosition;
+    }
+
+    const volatile long& head() const
+    {
+        return publishedPosition;
+    }
+
+    // Number of requests waiting in the queue
+    unsigned int depth() const
+    {
+        const unsigned int tail = (unsigned int)dequeuePosition;
+        const unsigned int head = (unsigned int)publishedPosition;
+        return (head - tail <= length) ? head - tail : 0;
+    }
+
+    // Number of bytes used in the buffer by queued requests and requests not reclaimed yet
+    unsigned int bufferUsage() const
+    {
+        const unsigned int bufferHead = (unsigned int)(producerState >> 32);
+        const unsigned int bufferTail = (unsigned int)(reclaimState >> 32);
+        return (bufferHead >= bufferTail) ? bufferHead - bufferTail : bufferSize - (bufferTail - bufferHead);
+    }
+
+    // Statistics (totals since init)
+    long long getNumberOfEnqueuedRequests() const { return numberOfEnqueuedRequests; }
+    long long getNumberOfDroppedRequests() const { return numberOfDroppedRequests; }
+
+private:
+    struct Element
+    {
+        void* peer;
+        unsigned int offset;
+        unsigned int size;
+        volatile unsigned int sequence;
+    };
+
+    Element elements[length];
+
+    unsigned char* buffer;
+    unsigned int bufferSize;
+    unsigned int maxRequestSize;
+
+    // Position of next element to enqueue (low 32 bits) and buffer offset of next request (high 32 bits)
+    volatile long long producerState;
+
+    // Position of next element to dequeue
+    volatile long dequeuePosition;
+
+    // All elements before this position have been published
+    volatile long publishedPosition;
+
+    // Position of next element to reclaim (low 32 bits) and buffer offset of its request (high 32 bits)
+    volatile long long reclaimState;
+
+    volatile long long numberOfEnqueuedRequests;
+    volatile long long numberOfDroppedRequests;
+
+    unsigned int nextBufferOffset(unsigned int offset, unsigned int size) const
+    {
+        offset += size;
+        return (offset > bufferSize - maxRequestSize) ? 0 : offset;
+    }
+
+    void advancePublishedPosition()
+    {
+        while (1)
+        {
+            const unsigned int published = (unsigned int)publishedPosition;
+            if ((int)(elements[published & (length - 1)].sequence - published) <= 0)
+            {
+                // Not published yet
+                return;
+            }
+            _InterlockedCompareExchange(&publishedPosition, (long)(published + 1), (long)published);
+        }
+    }
+
+    // Reclaim buffer space of dequeued requests in order of positions
+    void reclaim()
+    {
+        while (1)
+        {
+            const long long state = reclaimState;
+            const unsigned int pos = (unsigned int)state;
+            Element& element = elements[pos & (length - 1)];
+            if (element.sequence != pos + 2)
+            {
+                return;
+            }
+            const long long newState = ((long long)nextBufferOffset(element.offset, element.size) << 32) | (unsigned int)(pos + 1);
+            if (_InterlockedCompareExchange64(&reclaimState, newState, state) == state)
+            {
+                element.sequence = pos + length;
+            }
+        }
+    }
+};
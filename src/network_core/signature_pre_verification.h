@@ -0,0 +1,221 @@
+// Pre-verification of signatures of queued requests
+// (runs ahead of the request processing, so the stateful request handlers get messages with known signature state)
+
+#pragma once
+
+#include <intrin.h>
+
+#include "platform/m256.h"
+#include "platform/memory.h"
+#include "platform/concurrency.h"
+#include "platform/assert.h"
+
+#include "network_messages/header.h"
+
+
+// Result of the signature pre-verification of a request, passed from the request processor to the handler
+struct PreVerifiedSignature
+{
+    // Public key that the signature has been verified with
+    m256i publicKey;
+
+    // One of the states below
+    unsigned char state;
+
+    static constexpr unsigned char notVerified = 0;
+    static constexpr unsigned char valid = 1;
+    static constexpr unsigned char invalid = 2;
+
+    // Return true if the signature has been pre-verified with publicKey. If false is returned, the handler has to
+    // verify the signature itself (for example if the signer key has changed after the pre-verification).
+    bool isVerifiedWith(const m256i& key) const
+    {
+        return state != notVerified && publicKey == key;
+    }
+
+    // Result of pre-verification, only meaningful if isVerifiedWith() returned true
+    bool isValid() const
+    {
+        return state == valid;
+    }
+};
+
+// Function returning the request stored in the given element of the request queue
+typedef RequestResponseHeader* (*PreVerificationRequestGetter)(unsigned short elementIndex);
+
+// Function verifying the signature of the request. Return false if the request has no signature that can be
+// pre-verified (unsigned message type, invalid size, unknown signer). Otherwise set publicKey to the key the
+// signature has been checked with and valid to the result. May temporarily modify the request in place.
+typedef bool (*PreVerificationSignatureCheck)(RequestResponseHeader* request, m256i& publicKey, bool& valid);
+
+// Pipeline stage verifying the signatures of requests in the request queue (elements between tail and head)
+// before they are dequeued. Idle request processors call tryPreVerify(), the processor dequeuing an element calls
+// takeElement() and releaseElement(). Processing order of requests is not changed by pre-verification.
+// The queue must have 65536 elements (indices wrap around as unsigned short).
+// Global instances are zero-initialized, which is the initial state.
+class SignaturePreVerifier
+{
+public:
+    static constexpr unsigned int queueLength = 65536;
+
+    // Set initial state (queue must be empty)
+    void reset()
+    {
+        setMem(this, sizeof(*this), 0);
+    }
+
+    // Pre-verify up to maxCount not yet processed requests in the queue, skipping the next element to be dequeued
+    // (which is going to be processed right now anyway). Return number of requests pre-verified.
+    // Queue positions may be wider than 16 bits, only the lower 16 bits are used as element index.
+    template <typename QueuePosition>
+    unsigned int tryPreVerify(const volatile QueuePosition& queueTail, const volatile QueuePosition& queueHead,
+        PreVerificationRequestGetter getRequest, PreVerificationSignatureCheck checkSignature, unsigned int maxCount)
+    {
+        unsigned int count = 0;
+        while (count < maxCount)
+        {
+            // Claim next element (one at a time, so a processor waiting in takeElement() waits for one check at most)
+            ACQUIRE(cursorLock);
+            const unsigned short tail = (unsigned short)queueTail;
+            const unsigned short head = (unsigned short)queueHead;
+            if ((unsigned short)(cursor - tail) > (unsigned short)(head - tail) || cursor == tail)
+            {
+                // Cursor fell behind the tail
+                cursor = tail + 1;
+            }
+            unsigned short elementIndex = cursor;
+            bool claimed = false;
+            while ((unsigned short)(elementIndex - tail) < (unsigned short)(head - tail))
+            {
+                claimed = _InterlockedCompareExchange(&elements[elementIndex].state, CLAIMED, FREE) == FREE;
+                elementIndex++;
+                if (claimed)
+                {
+                    break;
+                }
+            }
+            cursor = elementIndex;
+            RELEASE(cursorLock);
+
+            if (!claimed)
+            {
+                break;
+            }
+            elementIndex--;
+
+            // Element may have been dequeued between reading the tail and claiming it
+            const unsigned short currentTail = (unsigned short)queueTail;
+            if ((unsigned short)(elementIndex - currentTail) >= (unsigned short)((unsigned short)queueHead - currentTail))
+            {
+                _InterlockedExchange(&elements[elementIndex].state, FREE);
+                continue;
+            }
+
+            Element& element = elements[elementIndex];
+            const unsigned long long beginningTick = __rdtsc();
+            bool valid = false;
+            element.result.state = PreVerifiedSignature::notVerified;
+            if (checkSignature(getRequest(elementIndex), element.result.publicKey, valid))
+            {
+                element.result.state = (valid) ? PreVerifiedSignature::valid : PreVerifiedSignature::invalid;
+                _InterlockedIncrement64(&numberOfVerifiedRequests);
+                if (!valid)
+                {
+                    _InterlockedIncrement64(&numberOfInvalidRequests);
+                }
+                _InterlockedExchangeAdd64(&verificationTicks, __rdtsc() - beginningTick);
+            }
+            _InterlockedExchange(&element.state, DONE);
+            count++;
+        }
+
+        return count;
+    }
+
+    // Take element at the tail of the queue for processing, waiting if it is being pre-verified right now.
+    // Has to be called before reading the request from the queue. The element must be released with
+    // releaseElement() after the request has been copied and the tail has been moved.
+    // With a lock-free queue, the tail may already have been moved when this is called. A running pre-verification
+    // may then be abandoned, in which case the result is notVerified.
+    void takeElement(unsigned short elementIndex, PreVerifiedSignature& result)
+    {
+        Element& element = elements[elementIndex];
+        if (_InterlockedCompareExchange(&element.state, TAKEN, FREE) == FREE)
+        {
+            result.state = PreVerifiedSignature::notVerified;
+            return;
+        }
+
+        if (element.state == CLAIMED)
+        {
+            const unsigned long long beginningTick = __rdtsc();
+            while (element.state == CLAIMED)
+            {
+                _mm_pause();
+            }
+            _InterlockedIncrement64(&numberOfWaits);
+            _InterlockedExchangeAdd64(&waitTicks, __rdtsc() - beginningTick);
+        }
+
+        if (element.state == DONE)
+        {
+            result = element.result;
+            if (result.state != PreVerifiedSignature::notVerified)
+            {
+                _InterlockedIncrement64(&numberOfUsedResults);
+            }
+        }
+        else
+        {
+            result.state = PreVerifiedSignature::notVerified;
+        }
+        _InterlockedExchange(&element.state, TAKEN);
+    }
+
+    // Make element available for pre-verification of the next request stored in it
+    void releaseElement(unsigned short elementIndex)
+    {
+        _InterlockedExchange(&elements[elementIndex].state, FREE);
+    }
+
+    // Number of elements between tail and cursor, which have been pre-verified or are being pre-verified
+    unsigned int queueDepth(unsigned short queueTail, unsigned short queueHead) const
+    {
+        const unsigned short ahead = cursor - queueTail;
+        return (ahead <= (unsigned short)(queueHead - queueTail)) ? ahead : 0;
+    }
+
+    // Statistics (totals since start)
+    long long getNumberOfVerifiedRequests() const { return numberOfVerifiedRequests; }
+    long long getNumberOfInvalidRequests() const { return numberOfInvalidRequests; }
+    long long getNumberOfUsedResults() const { return numberOfUsedResults; }
+    long long getNumberOfWaits() const { return numberOfWaits; }
+    long long getVerificationTicks() const { return verificationTicks; }
+    long long getWaitTicks() const { return waitTicks; }
+
+private:
+    // States of element
+    static constexpr long FREE = 0;     // not pre-verified (yet)
+    static constexpr long CLAIMED = 1;  // pre-verification running
+    static constexpr long DONE = 2;     // pre-verification done, result available
+    static constexpr long TAKEN = 3;    // dequeued by request processor
+
+    struct Element
+    {
+        PreVerifiedSignature result;
+        volatile long state;
+    };
+
+    Element elements[queueLength];
+
+    // Next element to check for pre-verification
+    volatile unsigned short cursor;
+    volatile char cursorLock;
+
+    volatile long long numberOfVerifiedRequests;
+    volatile long long numberOfInvalidRequests;
+    volatile long long numberOfUsedResults;
+    volatile long long numberOfWaits;
+    volatile long long verificationTicks;
+    volatile long long waitTicks;
+};
@@ -0,0 +1,247 @@
+#pragma once
+
+#include "network_messages/common_def.h"
+
+#include "platform/m256.h"
+#include "platform/memory.h"
+#include "platform/concurrency.h"
+#include "platform/console_logging.h"
+#include "platform/debugging.h"
+
+#include "public_settings.h"
+
+// Index of the pending transaction pool by target tick.
+//
+// The pending transactions are stored in fixed slots (computorPendingTransactions followed by
+// entityPendingTransactions, which are indexed by spectrum index). This index keeps one doubly linked list of
+// slots per tick of the current epoch, so the transactions scheduled for a tick can be found without scanning
+// all slots.
+//
+// This is a kind of singleton class with only static members (so all instances refer to the same data).
+class PendingTransactionIndex
+{
+public:
+    static constexpr unsigned int computorSlotCount = NUMBER_OF_COMPUTORS * MAX_NUMBER_OF_PENDING_TRANSACTIONS_PER_COMPUTOR;
+    static constexpr unsigned int slotCount = computorSlotCount + SPECTRUM_CAPACITY;
+    static constexpr unsigned int tickCount = MAX_NUMBER_OF_TICKS_PER_EPOCH;
+    static constexpr unsigned int noSlot = 0xffffffff;
+
+private:
+    // Per slot: tick - tickBegin + 1 if slot is in list of a tick, 0 otherwise
+    inline static unsigned int* slotTickOffsetsPtr = nullptr;
+
+    // Per slot: next and previous slot in list of the same tick (noSlot marks end)
+    inline static unsigned int* nextSlotsPtr = nullptr;
+    inline static unsigned int* prevSlotsPtr = nullptr;
+
+    // Per tick: first slot of list and number of slots in list
+    inline static unsigned int* firstSlotsPtr = nullptr;
+    inline static unsigned int* slotCountsPtr = nullptr;
+
+    // First tick of the current epoch
+    inline static unsigned int tickBegin = 0;
+
+    // Lock for securing all data of the index
+    inline static volatile char lock = 0;
+
+    static void unlink(unsigned int slot)
+    {
+        const unsigned int tickOffset = slotTickOffsetsPtr[slot];
+        if (!tickOffset)
+            return;
+
+        const unsigned int tickIndex = tickOffset - 1;
+        const unsigned int next = nextSlotsPtr[slot];
+        const unsigned int prev = prevSlotsPtr[slot];
+        if (prev == noSlot)
+            firstSlotsPtr[tickIndex] = next;
+        else
+            nextSlotsPtr[prev] = next;
+        if (next != noSlot)
+            prevSlotsPtr[next] = prev;
+
+        ASSERT(slotCountsPtr[tickIndex] > 0);
+        slotCountsPtr[tickIndex]--;
+        slotTickOffsetsPtr[slot] = 0;
+    }
+
+public:
+    // Slot of pending transaction of entity with given spectrum index
+    static constexpr unsigned int entitySlot(unsigned int spectrumIndex)
+    {
+        return computorSlotCount + spectrumIndex;
+    }
+
+    // Init at node startup
+    static bool init()
+    {
+        if (!allocatePool(slotCount * sizeof(unsigned int), (void**)&slotTickOffsetsPtr)
+            || !allocatePool(slotCount * sizeof(unsigned int), (void**)&nextSlotsPtr)
+            || !allocatePool(slotCount * sizeof(unsigned int), (void**)&prevSlotsPtr)
+            || !allocatePool(tickCount * sizeof(unsigned int), (void**)&firstSlotsPtr)
+            || !allocatePool(tickCount * sizeof(unsigned int), (void**)&slotCountsPtr))
+        {
+            logToConsole(L"Failed to allocate pending transaction index memory!");
+            return false;
+        }
+
+        lock = 0;
+        tickBegin = 0;
+        setMem(slotTickOffsetsPtr, slotCount * sizeof(unsigned int), 0);
+        setMem(firstSlotsPtr, tickCount * sizeof(unsigned int), 0xff);
+        setMem(slotCountsPtr, tickCount * sizeof(unsigned int), 0);
+
+        return true;
+    }
+
+    // Cleanup at node shutdown
+    static void deinit()
+    {
+        if (slotTickOffsetsPtr)
+            freePool(slotTickOffsetsPtr);
+        if (nextSlotsPtr)
+            freePool(nextSlotsPtr);
+        if (prevSlotsPtr)
+            freePool(prevSlotsPtr);
+        if (firstSlotsPtr)
+            freePool(firstSlotsPtr);
+        if (slotCountsPtr)
+            freePool(slotCountsPtr);
+        slotTickOffsetsPtr = nextSlotsPtr = prevSlotsPtr = firstSlotsPtr = slotCountsPtr = nullptr;
+    }
+
+    // Remove all slots from index and set tick range of new epoch. Cost is O(number of indexed slots + tickCount).
+    static void beginEpoch(unsigned int newInitialTick)
+    {
+        ACQUIRE(lock);
+
+        for (unsigned int tickIndex = 0; tickIndex < tickCount; tickIndex++)
+        {
+            for (unsigned int slot = firstSlotsPtr[tickIndex]; slot != noSlot; slot = nextSlotsPtr[slot])
+                slotTickOffsetsPtr[slot] = 0;
+            firstSlotsPtr[tickIndex] = noSlot;
+            slotCountsPtr[tickIndex] = 0;
+        }
+        tickBegin = newInitialTick;
+
+        RELEASE(lock);
+    }
+
+    // Set target tick of transaction stored in slot (replaces previous transaction of slot). Ticks outside of the
+    // current epoch are not indexed.
+    static void set(unsigned int slot, unsigned int tick)
+    {
+        ASSERT(slot < slotCount);
+
+        ACQUIRE(lock);
+
+        unlink(slot);
+        if (tick >= tickBegin && tick - tickBegin < tickCount)
+        {
+            const unsigned int tickIndex = tick - tickBegin;
+            const unsigned int first = firstSlotsPtr[tickIndex];
+            nextSlotsPtr[slot] = first;
+            prevSlotsPtr[slot] = noSlot;
+            if (first != noSlot)
+                prevSlotsPtr[first] = slot;
+            firstSlotsPtr[tickIndex] = slot;
+            slotCountsPtr[tickIndex]++;
+            slotTickOffsetsPtr[slot] = tickIndex + 1;
+        }
+
+        RELEASE(lock);
+    }
+
+    // Remove slot from index
+    static void remove(unsigned int slot)
+    {
+        ASSERT(slot < slotCount);
+
+        ACQUIRE(lock);
+        unlink(slot);
+        RELEASE(lock);
+    }
+
+    // Return number of slots with target tick
+    static unsigned int count(unsigned int tick)
+    {
+        if (tick < tickBegin || tick - tickBegin >= tickCount)
+            return 0;
+        return slotCountsPtr[tick - tickBegin];
+    }
+
+    // Return number of slots with target tick >= tick
+    static unsigned long long countFromTick(unsigned int tick)
+    {
+        unsigned long long result = 0;
+        for (unsigned int tickIndex = (tick > tickBegin) ? tick - tickBegin : 0; tickIndex < tickCount; tickIndex++)
+            result += slotCountsPtr[tickIndex];
+        return result;
+    }
+
+    // Copy slots with target tick to array (at most maxSlots). Return number of slots copied.
+    static unsigned int getSlots(unsigned int tick, unsigned int* slots, unsigned int maxSlots)
+    {
+        if (tick < tickBegin || tick - tickBegin >= tickCount)
+            return 0;
+
+        ACQUIRE(lock);
+
+        unsigned int n = 0;
+        for (unsigned int slot = firstSlotsPtr[tick - tickBegin]; slot != noSlot && n < maxSlots; slot = nextSlotsPtr[slot])
+            slots[n++] = slot;
+
+        RELEASE(lock);
+
+        return n;
+    }
+};
+
+// Lookup of tick data transaction digests that are not available yet, indexed by digest. Replaces comparing
+// each pending transaction with all digests of the tick data.
+template <unsigned int digestCount>
+class TransactionDigestLookup
+{
+    static constexpr unsigned int tableSize = digestCount * 2;
+    static_assert((tableSize & (tableSize - 1)) == 0, "digestCount must be power of 2");
+
+    // Index + 1 of digest, 0 marks empty entry
+    unsigned short table[tableSize];
+    static_assert(digestCount < 0xffff, "digestCount too large for table type");
+
+    const m256i* digests;
+    const unsigned long long* unknownFlags;
+
+public:
+    // Build lookup of all digests[i] with bit i set in unknownFlags. The digests and flags have to stay valid and
+    // digests must not change while using the lookup. The flags may be cleared by the caller after a match.
+    void build(const m256i* digests, const unsigned long long* unknownFlags)
+    {
+        this->digests = digests;
+        this->unknownFlags = unknownFlags;
+        setMem(table, sizeof(table), 0);
+        for (unsigned int i = 0; i < digestCount; i++)
+        {
+            if (unknownFlags[i >> 6] & (1ULL << (i & 63)))
+            {
+                unsigned int pos = digests[i].m256i_u32[0] & (tableSize - 1);
+                while (table[pos])
+                    pos = (pos + 1) & (tableSize - 1);
+                table[pos] = i + 1;
+            }
+        }
+    }
+
+    // Return lowest index of digest that equals given digest and is still flagged as unknown, or -1 if none is found
+    int find(const m256i& digest) const
+    {
+        int result = -1;
+        for (unsigned int pos = digest.m256i_u32[0] & (tableSize - 1); table[pos]; pos = (pos + 1) & (tableSize - 1))
+        {
+            const unsigned int i = table[pos] - 1;
+            if ((unknownFlags[i >> 6] & (1ULL << (i & 63))) && digests[i] == digest && (result < 0 || (int)i < result))
+                result = i;
+        }
+        return result;
+    }
+};
@@ -0,0 +1,224 @@
+// Dependency-free block compression for large, mostly sparse state files
+// (zero-run encoding, used by saveCompressed() / load() in platform/file_io.h)
+
+#pragma once
+
+#include "platform/memory.h"
+#include "platform/assert.h"
+
+
+// Compressed file: CompressedFileHeader, then one block for each COMPRESSION_BLOCK_SIZE bytes of uncompressed data
+// (the last block may be shorter). Each block starts with a 32-bit block header: the payload size in the lower bits
+// and COMPRESSED_BLOCK_STORED_FLAG if the payload is the uncompressed data (if encoding wouldn't make it smaller).
+//
+// Encoded payload: sequence of tokens (literal length, literal bytes, zero run length), lengths stored as LEB128
+// varints. Zero runs shorter than COMPRESSION_MIN_ZERO_RUN are kept in the literals, so tokens don't cost more than
+// they save.
+static constexpr unsigned int COMPRESSION_BLOCK_SIZE = 65536;
+static constexpr unsigned int COMPRESSION_MIN_ZERO_RUN = 8;
+static constexpr unsigned int COMPRESSED_BLOCK_STORED_FLAG = 0x80000000;
+static constexpr unsigned long long COMPRESSED_FILE_MAGIC = 0x3130524d4f434251ULL; // "QBCOMR01"
+
+struct CompressedFileHeader
+{
+    unsigned long long magic;
+    unsigned long long uncompressedSize;
+    unsigned int blockSize;
+    unsigned int reserved;
+};
+
+// Return true if header is the header of a compressed file with totalSize bytes of uncompressed data
+static bool isCompressedFileHeader(const CompressedFileHeader& header, unsigned long long totalSize)
+{
+    return header.magic == COMPRESSED_FILE_MAGIC && header.uncompressedSize == totalSize
+        && header.blockSize == COMPRESSION_BLOCK_SIZE && header.reserved == 0;
+}
+
+static unsigned int writeCompressionVarint(unsigned char* dst, unsigned int value)
+{
+    unsigned int size = 0;
+    while (value >= 0x80)
+    {
+        dst[size++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    dst[size++] = (unsigned char)value;
+    return size;
+}
+
+static bool readCompressionVarint(const unsigned char* src, unsigned int srcSize, unsigned int& offset, unsigned int& value)
+{
+    value = 0;
+    for (unsigned int shift = 0; shift < 28; shift += 7)
+    {
+        if (offset >= srcSize)
+        {
+            return false;
+        }
+        const unsigned char byte = src[offset++];
+        value |= (unsigned int)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Encode block of size bytes (at most COMPRESSION_BLOCK_SIZE) to dst, which needs space for 4 + size bytes.
+// Return number of bytes written (block header and payload).
+static unsigned int compressBlock(const unsigned char* src, unsigned int size, unsigned char* dst)
+{
+    ASSERT(size <= COMPRESSION_BLOCK_SIZE);
+    unsigned char* payload = dst + sizeof(unsigned int);
+    unsigned int payloadSize = 0;
+    unsigned int literalBegin = 0;
+    unsigned int position = 0;
+    while (position < size)
+    {
+        if (src[position])
+        {
+            position++;
+            continue;
+        }
+
+        // Measure zero run, 8 bytes at a time where possible
+        unsigned int runEnd = position + 1;
+        while (runEnd + 8 <= size && *((const unsigned long long*)(src + runEnd)) == 0)
+        {
+            runEnd += 8;
+        }
+        while (runEnd < size && !src[runEnd])
+        {
+            runEnd++;
+        }
+        if (runEnd - position < COMPRESSION_MIN_ZERO_RUN && runEnd < size)
+        {
+            position = runEnd;
+            continue;
+        }
+
+        // Emit token, falling back to storing the block if encoding doesn't save space
+        const unsigned int literalSize = position - literalBegin;
+        if (payloadSize + literalSize + 6 >= size)
+        {
+            payloadSize = size;
+            break;
+        }
+        payloadSize += writeCompressionVarint(payload + payloadSize, literalSize);
+        copyMem(payload + payloadSize, src + literalBegin, literalSize);
+        payloadSize += literalSize;
+        payloadSize += writeCompressionVarint(payload + payloadSize, runEnd - position);
+        literalBegin = position = runEnd;
+    }
+    if (payloadSize < size && literalBegin < size)
+    {
+        const unsigned int literalSize = size - literalBegin;
+        if (payloadSize + literalSize + 4 >= size)
+        {
+            payloadSize = size;
+        }
+        else
+        {
+            payloadSize += writeCompressionVarint(payload + payloadSize, literalSize);
+            copyMem(payload + payloadSize, src + literalBegin, literalSize);
+            payloadSize += literalSize;
+            payloadSize += writeCompressionVarint(payload + payloadSize, 0);
+        }
+    }
+
+    unsigned int blockHeader = payloadSize;
+    if (payloadSize == size)
+    {
+        copyMem(payload, src, size);
+        blockHeader |= COMPRESSED_BLOCK_STORED_FLAG;
+    }
+    copyMem(dst, &blockHeader, sizeof(blockHeader));
+    return sizeof(blockHeader) + payloadSize;
+}
+
+// Decode payload of block with given block header to dst, which receives exactly dstSize bytes. Return false if the
+// payload is invalid.
+static bool decompressBlock(unsigned int blockHeader, const unsigned char* payload, unsigned char* dst, unsigned int dstSize)
+{
+    const unsigned int payloadSize = blockHeader & ~COMPRESSED_BLOCK_STORED_FLAG;
+    if (blockHeader & COMPRESSED_BLOCK_STORED_FLAG)
+    {
+        if (payloadSize != dstSize)
+        {
+            return false;
+        }
+        copyMem(dst, payload, dstSize);
+        return true;
+    }
+
+    unsigned int in = 0, out = 0;
+    while (in < payloadSize)
+    {
+        unsigned int literalSize, zeroRunSize;
+        if (!readCompressionVarint(payload, payloadSize, in, literalSize)
+            || literalSize > payloadSize - in || literalSize > dstSize - out)
+        {
+            return false;
+        }
+        copyMem(dst + out, payload + in, literalSize);
+        in += literalSize;
+        out += literalSize;
+        if (!readCompressionVarint(payload, payloadSize, in, zeroRunSize) || zeroRunSize > dstSize - out)
+        {
+            return false;
+        }
+        setMem(dst + out, zeroRunSize, 0);
+        out += zeroRunSize;
+    }
+    return out == dstSize;
+}
+
+// Compress totalSize bytes provided by dataSource.read(offset, size, buffer) (read in consecutive blocks of
+// COMPRESSION_BLOCK_SIZE bytes) and pass the compressed file to writer.write(size, buffer), which returns false on
+// error. Not thread-safe (uses static buffers).
+template <typename DataSource, typename Writer>
+static bool compressStream(const DataSource& dataSource, unsigned long long totalSize, Writer& writer)
+{
+    static unsigned char block[COMPRESSION_BLOCK_SIZE];
+    static unsigned char compressedBlock[sizeof(unsigned int) + COMPRESSION_BLOCK_SIZE];
+
+    const CompressedFileHeader header = { COMPRESSED_FILE_MAGIC, totalSize, COMPRESSION_BLOCK_SIZE, 0 };
+    if (!writer.write(sizeof(header), (const unsigned char*)&header))
+    {
+        return false;
+    }
+    for (unsigned long long offset = 0; offset < totalSize; offset += COMPRESSION_BLOCK_SIZE)
+    {
+        const unsigned int size = (unsigned int)((totalSize - offset < COMPRESSION_BLOCK_SIZE) ? totalSize - offset : COMPRESSION_BLOCK_SIZE);
+        dataSource.read(offset, size, block);
+        if (!writer.write(compressBlock(block, size, compressedBlock), compressedBlock))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Decompress blocks of compressed file (after the CompressedFileHeader) to buffer, which receives totalSize bytes.
+// The compressed data is requested with reader.read(size, buffer), which returns false on error. Not thread-safe
+// (uses static buffer).
+template <typename Reader>
+static bool decompressStream(Reader& reader, unsigned long long totalSize, unsigned char* buffer)
+{
+    static unsigned char payload[COMPRESSION_BLOCK_SIZE];
+
+    for (unsigned long long offset = 0; offset < totalSize; offset += COMPRESSION_BLOCK_SIZE)
+    {
+        const unsigned int size = (unsigned int)((totalSize - offset < COMPRESSION_BLOCK_SIZE) ? totalSize - offset : COMPRESSION_BLOCK_SIZE);
+        unsigned int blockHeader;
+        if (!reader.read(sizeof(blockHeader), (unsigned char*)&blockHeader)
+            || (blockHeader & ~COMPRESSED_BLOCK_STORED_FLAG) > size
+            || !reader.read(blockHeader & ~COMPRESSED_BLOCK_STORED_FLAG, payload)
+            || !decompressBlock(blockHeader, payload, buffer + offset, size))
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,289 @@
+// Copy-on-write snapshot of memory regions
+// (used for saving the node state while tick processing continues)
+
+#pragma once
+
+#include <intrin.h>
+
+#include "platform/global_var.h"
+#include "platform/memory.h"
+#include "platform/assert.h"
+#include "platform/console_logging.h"
+
+
+// Snapshot of a set of memory regions at a point in time (the cut-over, see activate()). The regions are split into
+// pages, counted from the beginning of each region, so regions don't need to be page-aligned.
+//
+// While the snapshot is active, all code changing memory of a region has to call beforeWrite() first. The first
+// time a page is about to be changed after the cut-over, it is copied to a shadow page. The reader (usually the
+// thread writing the snapshot to disk) calls read(), which takes pages that haven't been changed directly from the
+// region and changed pages from their shadow copies. Each page is read at most once. Pages that have been read
+// aren't copied anymore, so only pages changed before the reader gets to them need shadow memory. If all shadow pages
+// are used, the writer waits until the reader has read the page.
+//
+// Page states:
+// - UNCHANGED: not read and not changed since the cut-over
+// - READING: reader copies page from the region, writers wait
+// - READ: reader is done with the page, writers may change it
+// - COPYING: writer copies page to shadow page, reader waits
+// - COPIED: shadow page contains page content of the cut-over, writers may change the page
+//
+// Call init() once, then for each snapshot: reset(), addRegion() for each region, activate(), read() all regions,
+// deactivate(). The zero-initialized global instance is inactive, so beforeWrite() returns immediately.
+class CopyOnWriteSnapshot
+{
+public:
+    static constexpr unsigned long long pageSize = 4096;
+    static constexpr unsigned int maxRegions = 64;
+
+    // Reader of one region of the snapshot, providing read(offset, size, buffer) for saveFromDataSource()
+    struct RegionDataSource
+    {
+        CopyOnWriteSnapshot* snapshot;
+        unsigned int regionIndex;
+
+        void read(unsigned long long offset, unsigned long long size, unsigned char* buffer) const
+        {
+            snapshot->read(regionIndex, offset, size, buffer);
+        }
+    };
+
+    // Allocate page states for up to maxPageCount pages of all regions and a pool of shadowPageCount shadow pages.
+    // Call at node startup.
+    bool init(unsigned long long maxPageCount, unsigned long long shadowPageCount)
+    {
+        ASSERT(shadowPageCount <= 0xffffffff);
+        if (!allocatePool(maxPageCount, (void**)&pageStates)
+            || !allocatePool(maxPageCount * sizeof(unsigned int), (void**)&shadowPageIndices)
+            || !allocatePool(shadowPageCount * pageSize, (void**)&shadowPages))
+        {
+            logToConsole(L"Failed to allocate copy-on-write snapshot memory!");
+            deinit();
+            return false;
+        }
+        this->maxPageCount = maxPageCount;
+        this->shadowPageCount = shadowPageCount;
+        reset();
+        return true;
+    }
+
+    // Free memory (snapshot must be inactive)
+    void deinit()
+    {
+        ASSERT(!active);
+        if (pageStates)
+            freePool((void*)pageStates);
+        if (shadowPageIndices)
+            freePool(shadowPageIndices);
+        if (shadowPages)
+            freePool(shadowPages);
+        pageStates = nullptr;
+        shadowPageIndices = nullptr;
+        shadowPages = nullptr;
+    }
+
+    // Remove all regions (snapshot must be inactive)
+    void reset()
+    {
+        ASSERT(!active);
+        regionCount = 0;
+        pageCount = 0;
+    }
+
+    // Add region of memory to the snapshot. Return region index for read() or -1 if there are too many regions
+    // or pages.
+    int addRegion(const void* address, unsigned long long size)
+    {
+        ASSERT(!active);
+        const unsigned long long regionPageCount = (size + pageSize - 1) / pageSize;
+        if (regionCount == maxRegions || pageCount + regionPageCount > maxPageCount)
+        {
+            return -1;
+        }
+        Region& region = regions[regionCount];
+        region.address = (unsigned char*)address;
+        region.size = size;
+        region.firstPage = pageCount;
+        pageCount += regionPageCount;
+        return regionCount++;
+    }
+
+    // Cut-over: from now on, the snapshot keeps the current content of the regions. Must not run in parallel to
+    // changes of the regions.
+    void activate()
+    {
+        ASSERT(!active);
+        setMem((void*)pageStates, pageCount, UNCHANGED);
+        usedShadowPages = 0;
+        numberOfCopiedPages = 0;
+        numberOfWaits = 0;
+        _mm_mfence();
+        active = 1;
+    }
+
+    // End snapshot, waiting for beforeWrite() calls in progress. After this, writers don't need to wait anymore.
+    void deactivate()
+    {
+        active = 0;
+        _mm_mfence();
+        while (activeWriters)
+        {
+            _mm_pause();
+        }
+    }
+
+    bool isActive() const
+    {
+        return active != 0;
+    }
+
+    // Preserve snapshot content of memory range before it is changed. Cheap if the snapshot is inactive or the
+    // range isn't part of a region.
+    void beforeWrite(const void* address, unsigned long long size)
+    {
+        if (!active)
+            return;
+
+        // Interlocked increment is full memory barrier, so deactivate() either sees us or we see inactive state
+        _InterlockedIncrement(&activeWriters);
+        if (active)
+        {
+            const unsigned char* begin = (const unsigned char*)address;
+            for (unsigned int i = 0; i < regionCount; i++)
+            {
+                const Region& region = regions[i];
+                if (begin >= region.address && begin < region.address + region.size)
+                {
+                    const unsigned long long beginOffset = begin - region.address;
+                    const unsigned long long endOffset = (beginOffset + size < region.size) ? beginOffset + size : region.size;
+                    for (unsigned long long pageOffset = beginOffset - beginOffset % pageSize; pageOffset < endOffset; pageOffset += pageSize)
+                    {
+                        const unsigned long long pageBytes = (region.size - pageOffset < pageSize) ? region.size - pageOffset : pageSize;
+                        preservePage(region.firstPage + pageOffset / pageSize, region.address + pageOffset, pageBytes);
+                    }
+                    break;
+                }
+            }
+        }
+        _InterlockedDecrement(&activeWriters);
+    }
+
+    // Copy snapshot content of region to destination. The offset has to be a multiple of pageSize and the size too,
+    // unless the range ends at the end of the region. Each page can only be read once per snapshot.
+    void read(unsigned int regionIndex, unsigned long long offset, unsigned long long size, void* destination)
+    {
+        ASSERT(active && regionIndex < regionCount);
+        const Region& region = regions[regionIndex];
+        ASSERT(offset % pageSize == 0 && offset + size <= region.size);
+        ASSERT(size % pageSize == 0 || offset + size == region.size);
+
+        unsigned char* dest = (unsigned char*)destination;
+        const unsigned long long endOffset = offset + size;
+        for (unsigned long long pageOffset = offset; pageOffset < endOffset; pageOffset += pageSize)
+        {
+            const unsigned long long page = region.firstPage + pageOffset / pageSize;
+            const unsigned long long copySize = (endOffset - pageOffset < pageSize) ? endOffset - pageOffset : pageSize;
+            while (1)
+            {
+                const char state = pageStates[page];
+                if (state == COPIED)
+                {
+                    // Changed after cut-over -> take shadow copy
+                    copyMem(dest, shadowPages + shadowPageIndices[page] * pageSize, copySize);
+                    break;
+                }
+                if (state == UNCHANGED && _InterlockedCompareExchange8(&pageStates[page], READING, UNCHANGED) == UNCHANGED)
+                {
+                    copyMem(dest, region.address + pageOffset, copySize);
+                    _ReadWriteBarrier();
+                    pageStates[page] = READ;
+                    break;
+                }
+                // Writer is copying the page. If it gets no shadow page, it sets the page back to UNCHANGED and waits
+                // until the page is read from the region.
+                ASSERT(state == COPYING || state == UNCHANGED);
+                _mm_pause();
+            }
+            dest += copySize;
+        }
+    }
+
+    // Statistics (of the current or last snapshot)
+    unsigned long long getNumberOfPages() const { return pageCount; }
+    unsigned long long getNumberOfCopiedPages() const { return numberOfCopiedPages; }
+    unsigned long long getNumberOfWaits() const { return numberOfWaits; }
+    unsigned long long getShadowPageCount() const { return shadowPageCount; }
+
+private:
+    enum PageState : char
+    {
+        UNCHANGED = 0,
+        READING = 1,
+        READ = 2,
+        COPYING = 3,
+        COPIED = 4,
+    };
+
+    struct Region
+    {
+        unsigned char* address;
+        unsigned long long size;
+        unsigned long long firstPage;
+    };
+
+    Region regions[maxRegions];
+    unsigned int regionCount;
+    unsigned long long pageCount;
+    unsigned long long maxPageCount;
+
+    volatile char* pageStates;
+    unsigned int* shadowPageIndices;
+    unsigned char* shadowPages;
+    unsigned long long shadowPageCount;
+    volatile long long usedShadowPages;
+
+    volatile char active;
+    volatile long activeWriters;
+
+    volatile long long numberOfCopiedPages;
+    volatile long long numberOfWaits;
+
+    void preservePage(unsigned long long page, const unsigned char* pageAddress, unsigned long long pageBytes)
+    {
+        while (1)
+        {
+            const char state = pageStates[page];
+            if (state == READ || state == COPIED)
+            {
+                return;
+            }
+            if (state == UNCHANGED && _InterlockedCompareExchange8(&pageStates[page], COPYING, UNCHANGED) == UNCHANGED)
+            {
+                const long long shadowPage = _InterlockedIncrement64(&usedShadowPages) - 1;
+                if (shadowPage < (long long)shadowPageCount)
+                {
+                    copyMem(shadowPages + shadowPage * pageSize, pageAddress, pageBytes);
+                    shadowPageIndices[page] = (unsigned int)shadowPage;
+                    _mm_sfence();
+                    pageStates[page] = COPIED;
+                    _InterlockedIncrement64(&numberOfCopiedPages);
+                    return;
+                }
+
+                // No shadow page left -> let the reader take the page from the region and wait until it is done
+                pageStates[page] = UNCHANGED;
+                _InterlockedIncrement64(&numberOfWaits);
+                while (pageStates[page] != READ && active)
+                {
+                    _mm_pause();
+                }
+                return;
+            }
+            // Page is being read or copied by another writer
+            _mm_pause();
+        }
+    }
+};
+
+// Snapshot of the node state that is being saved (see beginSavingAllNodeStates() in qubic.cpp)
+GLOBAL_VAR_DECL CopyOnWriteSnapshot nodeStateSnapshot;
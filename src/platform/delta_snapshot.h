@@ -0,0 +1,331 @@
+// Incremental saving of large tables of fixed-size records, such as spectrum and universe
+// (delta files with the changed records, periodically compacted into a full image)
+
+#pragma once
+
+#include <intrin.h>
+
+#include "platform/file_io.h"
+#include "platform/memory.h"
+#include "platform/assert.h"
+#include "platform/console_logging.h"
+
+
+// Tracks which records of a table have changed since the table has been saved the last time, so that a save only
+// needs to write the changed records to a delta file. Deltas are chained: delta k contains the records that changed
+// between save k - 1 and save k. The full table (base file) is written with save() or saveCompressed(), so it can be
+// loaded with load() like any other state file.
+//
+// A full save (compaction) is done instead of a delta if the table hasn't been loaded from or saved to the same file
+// before, if markAllChanged() has been called (for example after reorganizing a hash map), if maxDeltaCount deltas
+// have been written since the last full save, or if more than capacity / maxChangedRecordsDivisor records have
+// changed. Loading reads the base file and applies all deltas in order.
+//
+// Files for fileName "spectrum.000":
+// - spectrum.000: base file with the full table
+// - spectrum.000.delta.001, spectrum.000.delta.002, ...: delta files (DeltaFileHeader, then numberOfRecords entries
+//   of record index (unsigned int) and record)
+// - spectrum.000.delta: number of valid delta files (DeltaManifest). It is reset before the base file is written and
+//   updated after each delta file, so stale delta files of an older chain are never applied.
+//
+// Changes must be recorded with markChanged() / markAllChanged() while holding the lock of the table, which also
+// needs to be held during save(). The zero-initialized global instance requires a full save first.
+template <typename RecordType, unsigned int capacity>
+class DeltaSnapshot
+{
+public:
+    static_assert(capacity % 64 == 0, "Capacity must be a multiple of 64");
+    static constexpr unsigned int maxDeltaCount = 16;
+    static constexpr unsigned int maxChangedRecordsDivisor = 16;
+    static constexpr unsigned long long fullSize = capacity * sizeof(RecordType);
+    static constexpr unsigned long long entrySize = sizeof(unsigned int) + sizeof(RecordType);
+    static constexpr unsigned long long deltaMagic = 0x313041544c454451ULL; // "QDELTA01"
+
+    struct DeltaFileHeader
+    {
+        unsigned long long magic;
+        unsigned int sequence;
+        unsigned int numberOfRecords;
+    };
+
+    struct DeltaManifest
+    {
+        unsigned long long magic;
+        unsigned int numberOfDeltas;
+        unsigned int reserved;
+    };
+
+    // Serializes the delta of the changed records, providing read(offset, size, buffer) for saveFromDataSource().
+    // The delta has to be read sequentially from offset 0 (as saveFromDataSource() does).
+    struct DeltaDataSource
+    {
+        DeltaSnapshot* owner;
+        const RecordType* records;
+
+        void read(unsigned long long offset, unsigned long long size, unsigned char* buffer) const
+        {
+            owner->readDelta(records, offset, size, buffer);
+        }
+    };
+
+    // Record change of record index since last save (caller needs to hold lock of the table)
+    void markChanged(unsigned int index)
+    {
+        ASSERT(index < capacity);
+        const unsigned long long bit = 1ULL << (index & 63);
+        if (!(changedFlags[index >> 6] & bit))
+        {
+            changedFlags[index >> 6] |= bit;
+            numberOfChangedRecords++;
+        }
+    }
+
+    // Record change of (potentially) all records, so the next save is a full save
+    void markAllChanged()
+    {
+        baselineValid = false;
+    }
+
+    // Return true if the next save of the table to fileName in directory will write the full table
+    bool isFullSaveRequired(const CHAR16* fileName, const CHAR16* directory) const
+    {
+        return !baselineValid
+            || !isSameText(fileName, baselineFileName)
+            || !isSameText(directory ? directory : L"", baselineDirectory)
+            || numberOfDeltas >= maxDeltaCount
+            || numberOfChangedRecords > capacity / maxChangedRecordsDivisor;
+    }
+
+    // Save table as delta if possible, otherwise as full base file (compressed with saveCompressed() if compressed is
+    // true). Return number of bytes written (uncompressed) or -1 on error. Can only be called from main thread (file I/O).
+    long long save(const CHAR16* fileName, const RecordType* records, const CHAR16* directory = NULL, bool compressed = false)
+    {
+        CHAR16 deltaFileName[64];
+        setDeltaFileName(deltaFileName, fileName, 0);
+        DeltaManifest manifest = { deltaMagic, 0, 0 };
+
+        if (isFullSaveRequired(fileName, directory))
+        {
+            // Invalidate delta chain before base file is overwritten
+            baselineValid = false;
+            if (::save(deltaFileName, sizeof(manifest), (const unsigned char*)&manifest, directory) != sizeof(manifest))
+            {
+                return -1;
+            }
+            const long long savedSize = compressed ? saveCompressed(fileName, fullSize, (const unsigned char*)records, directory)
+                : ::save(fileName, fullSize, (const unsigned char*)records, directory);
+            if (savedSize != fullSize)
+            {
+                return -1;
+            }
+            setBaseline(fileName, directory, 0);
+            numberOfFullSaves++;
+            return fullSize;
+        }
+
+        // Files are up to date if nothing has changed
+        if (!numberOfChangedRecords)
+        {
+            return 0;
+        }
+
+        // Write delta file, then make it part of the chain
+        const unsigned long long deltaSize = getDeltaSize();
+        setDeltaFileName(deltaFileName, fileName, numberOfDeltas + 1);
+        const DeltaDataSource dataSource = { this, records };
+        if (saveFromDataSource(deltaFileName, deltaSize, dataSource, directory) != deltaSize)
+        {
+            return -1;
+        }
+        manifest.numberOfDeltas = numberOfDeltas + 1;
+        setDeltaFileName(deltaFileName, fileName, 0);
+        if (::save(deltaFileName, sizeof(manifest), (const unsigned char*)&manifest, directory) != sizeof(manifest))
+        {
+            return -1;
+        }
+        setBaseline(fileName, directory, numberOfDeltas + 1);
+        numberOfDeltaSaves++;
+        return deltaSize;
+    }
+
+    // Load base file and apply all deltas of the chain. Return false on error.
+    // Can only be called from main thread (file I/O).
+    bool load(const CHAR16* fileName, RecordType* records, const CHAR16* directory = NULL)
+    {
+        baselineValid = false;
+        if (::load(fileName, fullSize, (unsigned char*)records, directory) != fullSize)
+        {
+            return false;
+        }
+
+        // No valid manifest -> base file without deltas (for example written by save())
+        CHAR16 deltaFileName[64];
+        setDeltaFileName(deltaFileName, fileName, 0);
+        DeltaManifest manifest;
+        if (::load(deltaFileName, sizeof(manifest), (unsigned char*)&manifest, directory) != sizeof(manifest)
+            || manifest.magic != deltaMagic)
+        {
+            manifest.numberOfDeltas = 0;
+        }
+
+        for (unsigned int sequence = 1; sequence <= manifest.numberOfDeltas; sequence++)
+        {
+            setDeltaFileName(deltaFileName, fileName, sequence);
+            const long long deltaSize = getFileSize(deltaFileName, (CHAR16*)directory);
+            unsigned char* delta;
+            if (deltaSize < (long long)sizeof(DeltaFileHeader) || !allocatePool(deltaSize, (void**)&delta))
+            {
+                logToConsole(L"Failed to load delta file!");
+                return false;
+            }
+            const bool ok = ::load(deltaFileName, deltaSize, delta, directory) == deltaSize
+                && applyDelta(delta, deltaSize, sequence, records);
+            freePool(delta);
+            if (!ok)
+            {
+                logToConsole(L"Invalid delta file!");
+                return false;
+            }
+        }
+
+        setBaseline(fileName, directory, manifest.numberOfDeltas);
+        return true;
+    }
+
+    // Apply delta (content of delta file) to records. Return false if delta is invalid.
+    static bool applyDelta(const unsigned char* delta, unsigned long long deltaSize, unsigned int sequence, RecordType* records)
+    {
+        const DeltaFileHeader* header = (const DeltaFileHeader*)delta;
+        if (deltaSize < sizeof(DeltaFileHeader) || header->magic != deltaMagic || header->sequence != sequence
+            || deltaSize != sizeof(DeltaFileHeader) + header->numberOfRecords * entrySize)
+        {
+            return false;
+        }
+        const unsigned char* entry = delta + sizeof(DeltaFileHeader);
+        for (unsigned int i = 0; i < header->numberOfRecords; i++, entry += entrySize)
+        {
+            unsigned int index;
+            copyMem(&index, entry, sizeof(index));
+            if (index >= capacity)
+            {
+                return false;
+            }
+            copyMem(&records[index], entry + sizeof(index), sizeof(RecordType));
+        }
+        return true;
+    }
+
+    // Size of the delta file that the next delta save would write
+    unsigned long long getDeltaSize() const
+    {
+        return sizeof(DeltaFileHeader) + numberOfChangedRecords * entrySize;
+    }
+
+    // Record that the table has been saved to or loaded from fileName in directory, with numberOfDeltas deltas
+    // following the base file. Removes all recorded changes.
+    void setBaseline(const CHAR16* fileName, const CHAR16* directory, unsigned int numberOfDeltas)
+    {
+        setText(baselineFileName, fileName);
+        setText(baselineDirectory, directory ? directory : L"");
+        baselineValid = true;
+        this->numberOfDeltas = numberOfDeltas;
+        setMem(changedFlags, sizeof(changedFlags), 0);
+        numberOfChangedRecords = 0;
+    }
+
+    unsigned int getNumberOfChangedRecords() const { return numberOfChangedRecords; }
+    unsigned int getNumberOfDeltas() const { return numberOfDeltas; }
+
+    // Statistics (totals since start)
+    unsigned long long getNumberOfFullSaves() const { return numberOfFullSaves; }
+    unsigned long long getNumberOfDeltaSaves() const { return numberOfDeltaSaves; }
+
+private:
+    unsigned long long changedFlags[capacity / 64];
+    unsigned int numberOfChangedRecords;
+    unsigned int numberOfDeltas;
+    bool baselineValid;
+    CHAR16 baselineFileName[64];
+    CHAR16 baselineDirectory[64];
+    unsigned long long numberOfFullSaves;
+    unsigned long long numberOfDeltaSaves;
+
+    // State of sequential delta serialization (see readDelta())
+    unsigned long long deltaReadOffset;
+    unsigned int deltaScanWord;
+    unsigned long long deltaScanBits;
+    unsigned char deltaPending[sizeof(DeltaFileHeader) + entrySize];
+    unsigned int deltaPendingSize;
+    unsigned int deltaPendingOffset;
+
+    static bool isSameText(const CHAR16* a, const CHAR16* b)
+    {
+        while (*a && *a == *b)
+        {
+            a++;
+            b++;
+        }
+        return *a == *b;
+    }
+
+    // Set fileName + ".delta" (sequence 0, manifest) or fileName + ".delta.###"
+    static void setDeltaFileName(CHAR16* deltaFileName, const CHAR16* fileName, unsigned int sequence)
+    {
+        setText(deltaFileName, fileName);
+        if (sequence)
+        {
+            appendText(deltaFileName, L".delta.XXX");
+            addEpochToFileName(deltaFileName, getTextSize(deltaFileName, 64) + 1, sequence);
+        }
+        else
+        {
+            appendText(deltaFileName, L".delta");
+        }
+    }
+
+    // Write next part of the serialized delta. Changed records are found by scanning the changed flags.
+    void readDelta(const RecordType* records, unsigned long long offset, unsigned long long size, unsigned char* buffer)
+    {
+        if (offset == 0)
+        {
+            // Start with header
+            DeltaFileHeader header = { deltaMagic, numberOfDeltas + 1, numberOfChangedRecords };
+            copyMem(deltaPending, &header, sizeof(header));
+            deltaPendingSize = sizeof(header);
+            deltaPendingOffset = 0;
+            deltaReadOffset = 0;
+            deltaScanWord = 0;
+            deltaScanBits = changedFlags[0];
+        }
+        ASSERT(offset == deltaReadOffset);
+
+        while (size)
+        {
+            if (deltaPendingOffset == deltaPendingSize)
+            {
+                // Serialize next changed record
+                while (!deltaScanBits)
+                {
+                    ASSERT(deltaScanWord + 1 < capacity / 64);
+                    deltaScanBits = changedFlags[++deltaScanWord];
+                }
+                const unsigned int index = deltaScanWord * 64 + (unsigned int)_tzcnt_u64(deltaScanBits);
+                deltaScanBits &= deltaScanBits - 1;
+                copyMem(deltaPending, &index, sizeof(index));
+                copyMem(deltaPending + sizeof(index), &records[index], sizeof(RecordType));
+                deltaPendingSize = (unsigned int)entrySize;
+                deltaPendingOffset = 0;
+            }
+            unsigned long long copySize = deltaPendingSize - deltaPendingOffset;
+            if (copySize > size)
+            {
+                copySize = size;
+            }
+            copyMem(buffer, deltaPending + deltaPendingOffset, copySize);
+            deltaPendingOffset += (unsigned int)copySize;
+            buffer += copySize;
+            size -= copySize;
+            deltaReadOffset += copySize;
+        }
+    }
+};
@@ -8,6 +8,7 @@
 
 #include "uefi.h"
 #include "console_logging.h"
+#include "block_compression.h"
 
 // If you get an error reading and writing files, set the chunk sizes below to
 // the cluster size set for formatting you disk. If you have no idea about the
@@ -117,6 +118,79 @@ static bool createDir(const CHAR16* dirName)
 #endif
 }
 
+#ifdef NO_UEFI
+// Reader of file opened with _wfopen_s()
+struct StdioFileReader
+{
+    FILE* file;
+
+    bool read(unsigned long long size, unsigned char* buffer)
+    {
+        return fread(buffer, 1, size, file) == size;
+    }
+};
+#else
+// Reader of file opened with EFI_FILE_PROTOCOL, reading in chunks of up to READING_CHUNK_SIZE bytes
+struct EfiFileReader
+{
+    EFI_FILE_PROTOCOL* file;
+
+    bool read(unsigned long long totalSize, unsigned char* buffer)
+    {
+        unsigned long long readSize = 0;
+        while (readSize < totalSize)
+        {
+            unsigned long long size = (READING_CHUNK_SIZE <= (totalSize - readSize) ? READING_CHUNK_SIZE : (totalSize - readSize));
+            EFI_STATUS status = file->Read(file, &size, &buffer[readSize]);
+            if (status
+                || size != (READING_CHUNK_SIZE <= (totalSize - readSize) ? READING_CHUNK_SIZE : (totalSize - readSize)))
+            {
+                // If this error occurs, see the definition of READING_CHUNK_SIZE above.
+                logStatusToConsole(L"EFI_FILE_PROTOCOL.Read() fails", status, __LINE__);
+                return false;
+            }
+            readSize += size;
+        }
+        return true;
+    }
+};
+#endif
+
+// Read totalSize bytes of file content from reader to buffer. Files saved with saveCompressed() are detected by their
+// header and decompressed.
+template <typename Reader>
+static bool loadFromReader(Reader& reader, unsigned long long totalSize, unsigned char* buffer)
+{
+    unsigned long long readSize = 0;
+    if (totalSize >= sizeof(CompressedFileHeader))
+    {
+        CompressedFileHeader header;
+        if (!reader.read(sizeof(header), (unsigned char*)&header))
+        {
+            return false;
+        }
+        if (isCompressedFileHeader(header, totalSize))
+        {
+            if (!decompressStream(reader, totalSize, buffer))
+            {
+                logToConsole(L"Invalid compressed file!");
+                return false;
+            }
+            return true;
+        }
+        if (header.magic == COMPRESSED_FILE_MAGIC)
+        {
+            // Compressed file with other size or format, don't load compressed data as raw file
+            logToConsole(L"Compressed file doesn't match expected size or format!");
+            return false;
+        }
+        copyMem(buffer, &header, sizeof(header));
+        readSize = sizeof(header);
+    }
+    return reader.read(totalSize - readSize, buffer + readSize);
+}
+
+// Load file with totalSize bytes of content (raw or saved with saveCompressed()). Return totalSize or -1 on error.
 static long long load(const CHAR16* fileName, unsigned long long totalSize, unsigned char* buffer, const CHAR16* directory = NULL)
 {
 #ifdef NO_UEFI
@@ -131,9 +205,11 @@ static long long load(const CHAR16* fileName, unsigned long long totalSize, unsi
         wprintf(L"Error opening file %s!\n", fileName);
         return -1;
     }
-    if (fread(buffer, 1, totalSize, file) != totalSize)
+    StdioFileReader reader = { file };
+    if (!loadFromReader(reader, totalSize, buffer))
     {
         wprintf(L"Error reading %llu bytes from %s!\n", totalSize, fileName);
+        fclose(file);
         return -1;
     }
     fclose(file);
@@ -173,40 +249,18 @@ static long long load(const CHAR16* fileName, unsigned long long totalSize, unsi
         }
     }
 
-    
-    if (EFI_SUCCESS == status)
-    {
-        unsigned long long readSize = 0;
-        while (readSize < totalSize)
-        {
-            unsigned long long size = (READING_CHUNK_SIZE <= (totalSize - readSize) ? READING_CHUNK_SIZE : (totalSize - readSize));
-            status = file->Read(file, &size, &buffer[readSize]);
-            if (status
-                || size != (READING_CHUNK_SIZE <= (totalSize - readSize) ? READING_CHUNK_SIZE : (totalSize - readSize)))
-            {
-                // If this error occurs, see the definition of READING_CHUNK_SIZE above.
-                logStatusToConsole(L"EFI_FILE_PROTOCOL.Read() fails", status, __LINE__);
-
-                file->Close(file);
-
-                return -1;
-            }
-            readSize += size;
-        }
-        file->Close(file);
+    EfiFileReader reader = { file };
+    const bool loaded = loadFromReader(reader, totalSize, buffer);
+    file->Close(file);
 
-        return readSize;
-    }
-    return -1;
+    return loaded ? totalSize : -1;
 #endif
 }
 
-static long long save(const CHAR16* fileName, unsigned long long totalSize, const unsigned char* buffer, const CHAR16* directory = NULL)
+#ifndef NO_UEFI
+// Open file for writing (creating directory and file if needed), return NULL on error
+static EFI_FILE_PROTOCOL* openFileForSaving(const CHAR16* fileName, const CHAR16* directory)
 {
-#ifdef NO_UEFI
-    logToConsole(L"NO_UEFI implementation of save() is missing! No file saved!");
-    return 0;
-#else
     EFI_STATUS status;
     EFI_FILE_PROTOCOL* file = NULL;
     EFI_FILE_PROTOCOL* directoryProtocol = NULL;
@@ -221,13 +275,13 @@ static long long save(const CHAR16* fileName, unsigned long long totalSize, cons
         if (status = root->Open(root, (void**)&directoryProtocol, (CHAR16*)directory, EFI_FILE_MODE_READ, 0))
         {
             logStatusToConsole(L"FileIOSave:OpenDir EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
-            return -1;
+            return NULL;
         }
 
         if (NULL == directoryProtocol)
         {
             logStatusToConsole(L"FileIOSave:OpenDir directory protocols is NULL", status, __LINE__);
-            return -1;
+            return NULL;
         }
 
         // Open the file from the directory.
@@ -235,7 +289,7 @@ static long long save(const CHAR16* fileName, unsigned long long totalSize, cons
         {
             logStatusToConsole(L"FileIOSave:OpenDir::OpenFile EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
             directoryProtocol->Close(directoryProtocol);
-            return -1;
+            return NULL;
         }
         directoryProtocol->Close(directoryProtocol);
     }
@@ -244,37 +298,179 @@ static long long save(const CHAR16* fileName, unsigned long long totalSize, cons
         if (status = root->Open(root, (void**)&file, (CHAR16*)fileName, EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE, 0))
         {
             logStatusToConsole(L"FileIOSave:OpenFile EFI_FILE_PROTOCOL.Open() fails", status, __LINE__);
-            return -1;
+            return NULL;
+        }
+    }
+
+    // Truncate existing file, so no stale data remains behind shorter content (such as compressed data)
+    EFI_GUID fileInfoId = EFI_FILE_INFO_ID;
+    unsigned char fileInfo[1024];
+    unsigned long long fileInfoSize = sizeof(fileInfo);
+    if (status = file->GetInfo(file, &fileInfoId, &fileInfoSize, fileInfo))
+    {
+        logStatusToConsole(L"FileIOSave:GetInfo EFI_FILE_PROTOCOL.GetInfo() fails", status, __LINE__);
+        file->Close(file);
+        return NULL;
+    }
+    unsigned long long fileSize;
+    copyMem(&fileSize, fileInfo + 8, 8);
+    if (fileSize)
+    {
+        fileSize = 0;
+        copyMem(fileInfo + 8, &fileSize, 8);
+        if (status = file->SetInfo(file, &fileInfoId, fileInfoSize, fileInfo))
+        {
+            logStatusToConsole(L"FileIOSave:SetInfo EFI_FILE_PROTOCOL.SetInfo() fails", status, __LINE__);
+            file->Close(file);
+            return NULL;
         }
     }
-    
-    if (EFI_SUCCESS == status)
+
+    return file;
+}
+
+// Writer of file opened with EFI_FILE_PROTOCOL, writing in chunks of up to WRITING_CHUNK_SIZE bytes
+struct EfiFileWriter
+{
+    EFI_FILE_PROTOCOL* file;
+
+    // Open file for writing (see openFileForSaving()), return false on error
+    bool open(const CHAR16* fileName, const CHAR16* directory)
+    {
+        file = openFileForSaving(fileName, directory);
+        return file != NULL;
+    }
+
+    void close()
+    {
+        file->Close(file);
+        file = NULL;
+    }
+
+    bool write(unsigned long long totalSize, const unsigned char* buffer)
     {
         unsigned long long writtenSize = 0;
         while (writtenSize < totalSize)
         {
             unsigned long long size = (WRITING_CHUNK_SIZE <= (totalSize - writtenSize) ? WRITING_CHUNK_SIZE : (totalSize - writtenSize));
-            status = file->Write(file, &size, (void*)&buffer[writtenSize]);
+            EFI_STATUS status = file->Write(file, &size, (void*)&buffer[writtenSize]);
             if (status
                 || size != (WRITING_CHUNK_SIZE <= (totalSize - writtenSize) ? WRITING_CHUNK_SIZE : (totalSize - writtenSize)))
             {
                 // If this error occurs, see the definition of WRITING_CHUNK_SIZE above.
                 logStatusToConsole(L"EFI_FILE_PROTOCOL.Write() fails", status, __LINE__);
-
-                file->Close(file);
-
-                return -1;
+                return false;
             }
             writtenSize += size;
         }
+        return true;
+    }
+};
+#endif
+
+static long long save(const CHAR16* fileName, unsigned long long totalSize, const unsigned char* buffer, const CHAR16* directory = NULL)
+{
+#ifdef NO_UEFI
+    logToConsole(L"NO_UEFI implementation of save() is missing! No file saved!");
+    return 0;
+#else
+    EFI_FILE_PROTOCOL* file = openFileForSaving(fileName, directory);
+    if (NULL != file)
+    {
+        EfiFileWriter writer = { file };
+        const bool saved = writer.write(totalSize, buffer);
         file->Close(file);
 
-        return writtenSize;
+        return saved ? totalSize : -1;
     }
     return -1;
 #endif
 }
 
+// Save data that isn't available in one contiguous buffer, such as a region of a CopyOnWriteSnapshot.
+// The data is requested with dataSource.read(offset, size, buffer) in consecutive chunks of up to WRITING_CHUNK_SIZE
+// bytes. Can only be called from the main thread, like save().
+template <typename DataSource>
+static long long saveFromDataSource(const CHAR16* fileName, unsigned long long totalSize, const DataSource& dataSource, const CHAR16* directory = NULL)
+{
+#ifdef NO_UEFI
+    logToConsole(L"NO_UEFI implementation of saveFromDataSource() is missing! No file saved!");
+    return 0;
+#else
+    static unsigned char chunkBuffer[WRITING_CHUNK_SIZE];
+
+    EFI_FILE_PROTOCOL* file = openFileForSaving(fileName, directory);
+    if (NULL == file)
+    {
+        return -1;
+    }
+
+    EFI_STATUS status;
+    unsigned long long writtenSize = 0;
+    while (writtenSize < totalSize)
+    {
+        const unsigned long long chunkSize = (WRITING_CHUNK_SIZE <= (totalSize - writtenSize) ? WRITING_CHUNK_SIZE : (totalSize - writtenSize));
+        dataSource.read(writtenSize, chunkSize, chunkBuffer);
+        unsigned long long size = chunkSize;
+        status = file->Write(file, &size, chunkBuffer);
+        if (status || size != chunkSize)
+        {
+            // If this error occurs, see the definition of WRITING_CHUNK_SIZE above.
+            logStatusToConsole(L"EFI_FILE_PROTOCOL.Write() fails", status, __LINE__);
+
+            file->Close(file);
+
+            return -1;
+        }
+        writtenSize += size;
+    }
+    file->Close(file);
+
+    return writtenSize;
+#endif
+}
+
+// Data source reading from a contiguous buffer (see saveFromDataSource())
+struct BufferDataSource
+{
+    const unsigned char* buffer;
+
+    void read(unsigned long long offset, unsigned long long size, unsigned char* destination) const
+    {
+        copyMem(destination, buffer + offset, size);
+    }
+};
+
+// Save data provided by dataSource (see saveFromDataSource()) in block-compressed format (see
+// platform/block_compression.h). The compressed file is detected by load(). Return totalSize (number of uncompressed
+// bytes) or -1 on error. Can only be called from the main thread, like save().
+template <typename DataSource>
+static long long saveCompressedFromDataSource(const CHAR16* fileName, unsigned long long totalSize, const DataSource& dataSource, const CHAR16* directory = NULL)
+{
+#ifdef NO_UEFI
+    logToConsole(L"NO_UEFI implementation of saveCompressedFromDataSource() is missing! No file saved!");
+    return 0;
+#else
+    EFI_FILE_PROTOCOL* file = openFileForSaving(fileName, directory);
+    if (NULL == file)
+    {
+        return -1;
+    }
+    EfiFileWriter writer = { file };
+    const bool saved = compressStream(dataSource, totalSize, writer);
+    file->Close(file);
+
+    return saved ? totalSize : -1;
+#endif
+}
+
+// Save buffer in block-compressed format, see saveCompressedFromDataSource()
+static long long saveCompressed(const CHAR16* fileName, unsigned long long totalSize, const unsigned char* buffer, const CHAR16* directory = NULL)
+{
+    const BufferDataSource dataSource = { buffer };
+    return saveCompressedFromDataSource(fileName, totalSize, dataSource, directory);
+}
+
 
 static bool initFilesystem()
 {
@@ -405,11 +601,12 @@ static unsigned int getTextSize(CHAR16* text, int maximumSize)
 
 // Break the large file to many chunks to write if the size is greater or equal FILE_CHUNK_SIZE
 // - skipWriteEqualChunkSize: skip write the chunk file if the size of existed file match with buffer data. Set false if need the write always happens
-static long long saveLargeFile(CHAR16* fileName, unsigned long long totalSize, unsigned char* buffer, CHAR16* directory = NULL, bool skipWriteEqualChunkSize = true)
+// - compressed: save file / chunk files with saveCompressed() (chunk files are always written in this case)
+static long long saveLargeFile(CHAR16* fileName, unsigned long long totalSize, unsigned char* buffer, CHAR16* directory = NULL, bool skipWriteEqualChunkSize = true, bool compressed = false)
 {
     const unsigned long long maxWriteSizePerChunk = FILE_CHUNK_SIZE;
     if (totalSize < maxWriteSizePerChunk) {
-        return save(fileName, totalSize, buffer, directory);
+        return compressed ? saveCompressed(fileName, totalSize, buffer, directory) : save(fileName, totalSize, buffer, directory);
     }
     int chunkId = 0;
     unsigned long long totalWriteSize = 0;
@@ -419,9 +616,9 @@ static long long saveLargeFile(CHAR16* fileName, unsigned long long totalSize, u
         appendText(fileNameWithChunkId, L".XXX");
         addEpochToFileName(fileNameWithChunkId, getTextSize(fileNameWithChunkId, 64) + 1, chunkId);
         const unsigned long long writeSize = maxWriteSizePerChunk < totalSize ? maxWriteSizePerChunk : totalSize;
-        long long existFileSize = getFileSize(fileNameWithChunkId, directory);
+        long long existFileSize = compressed ? -1 : getFileSize(fileNameWithChunkId, directory);
         if (!skipWriteEqualChunkSize || (existFileSize != writeSize)) {
-            unsigned long long res = save(fileNameWithChunkId, writeSize, buffer, directory);
+            unsigned long long res = compressed ? saveCompressed(fileNameWithChunkId, writeSize, buffer, directory) : save(fileNameWithChunkId, writeSize, buffer, directory);
             if (res != writeSize) {
                 return totalWriteSize;
             }
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <intrin.h>
+
+#include "platform/file_io.h"
+#include "platform/block_compression.h"
+#include "platform/memory.h"
+
+
+// Writer saving a queue of files in bounded steps, so the main loop can keep servicing peers while several GB are
+// written. Files are added with add() and written by calling step() in each main loop iteration until isBusy()
+// returns false. Each step writes at least one chunk and returns when its tick budget is used up, the file that is
+// currently written stays open between steps. The files are identical to the ones written by saveFromDataSource()
+// or saveCompressedFromDataSource().
+//
+// The data of each file is requested with dataSource.read(offset, size, buffer) (see saveFromDataSource()) and must
+// not change until the file is complete, for example a region of a CopyOnWriteSnapshot. FileWriter is the file
+// layer providing open(fileName, directory), write(size, buffer), and close() (see EfiFileWriter). Like all file
+// I/O, writing is only possible from the main thread.
+template <typename FileWriter, typename DataSource, unsigned int maxNumberOfFiles>
+class IncrementalFileWriter
+{
+public:
+    static constexpr unsigned int maxNameLength = 64;
+
+    // Stop writing (closing the file that is currently written) and remove all files from the queue
+    void reset()
+    {
+        if (fileIsOpen)
+        {
+            fileWriter.close();
+            fileIsOpen = false;
+        }
+        numberOfFiles = 0;
+        currentFile = 0;
+        offset = 0;
+        failed = false;
+        numberOfSteps = 0;
+        numberOfWrittenBytes = 0;
+    }
+
+    // Add file with size bytes to the queue. Return false if the queue is full or a name is too long.
+    bool add(const CHAR16* fileName, const CHAR16* directory, unsigned long long size, const DataSource& dataSource, bool compressed = false)
+    {
+        if (numberOfFiles >= maxNumberOfFiles)
+        {
+            return false;
+        }
+        QueuedFile& file = files[numberOfFiles];
+        if (!copyName(file.fileName, fileName) || !copyName(file.directory, directory ? directory : L""))
+        {
+            return false;
+        }
+        file.hasDirectory = (directory != NULL);
+        file.size = size;
+        file.dataSource = dataSource;
+        file.compressed = compressed;
+        numberOfFiles++;
+        return true;
+    }
+
+    // Write queued files until at least one chunk has been written and maxTicks have passed, or all files are
+    // written. Return false on error, in which case the remaining files are dropped (see hasFailed()).
+    bool step(unsigned long long maxTicks)
+    {
+        if (!isBusy())
+        {
+            return !failed;
+        }
+
+        const unsigned long long beginningTick = __rdtsc();
+        numberOfSteps++;
+        while (isBusy())
+        {
+            if (!writeNextChunk())
+            {
+                if (fileIsOpen)
+                {
+                    fileWriter.close();
+                    fileIsOpen = false;
+                }
+                currentFile = numberOfFiles;
+                failed = true;
+                return false;
+            }
+            if (__rdtsc() - beginningTick >= maxTicks)
+            {
+                break;
+            }
+        }
+        return true;
+    }
+
+    // Return true if there are files in the queue that haven't been written completely
+    bool isBusy() const
+    {
+        return currentFile < numberOfFiles;
+    }
+
+    // Return true if writing failed since the last reset()
+    bool hasFailed() const
+    {
+        return failed;
+    }
+
+    // Statistics (since last reset())
+    unsigned int getNumberOfWrittenFiles() const
+    {
+        return failed ? 0 : currentFile;
+    }
+
+    // Number of bytes of data written (uncompressed size)
+    unsigned long long getNumberOfWrittenBytes() const
+    {
+        return numberOfWrittenBytes;
+    }
+
+    unsigned long long getNumberOfSteps() const
+    {
+        return numberOfSteps;
+    }
+
+private:
+    struct QueuedFile
+    {
+        CHAR16 fileName[maxNameLength];
+        CHAR16 directory[maxNameLength];
+        bool hasDirectory;
+        bool compressed;
+        unsigned long long size;
+        DataSource dataSource;
+    };
+
+    static bool copyName(CHAR16* destination, const CHAR16* name)
+    {
+        unsigned int length = 0;
+        while (name[length])
+        {
+            if (++length >= maxNameLength)
+            {
+                return false;
+            }
+        }
+        copyMem(destination, name, (length + 1) * sizeof(CHAR16));
+        return true;
+    }
+
+    // Write next chunk of the current file (opening it first if needed), return false on error
+    bool writeNextChunk()
+    {
+        QueuedFile& file = files[currentFile];
+        if (!fileIsOpen)
+        {
+            if (!fileWriter.open(file.fileName, file.hasDirectory ? file.directory : NULL))
+            {
+                return false;
+            }
+            fileIsOpen = true;
+            offset = 0;
+
+            if (file.compressed)
+            {
+                const CompressedFileHeader header = { COMPRESSED_FILE_MAGIC, file.size, COMPRESSION_BLOCK_SIZE, 0 };
+                if (!fileWriter.write(sizeof(header), (const unsigned char*)&header))
+                {
+                    return false;
+                }
+            }
+        }
+
+        if (offset < file.size)
+        {
+            // Compressed files are written in blocks like compressStream() does
+            const unsigned long long maxChunkSize = file.compressed ? COMPRESSION_BLOCK_SIZE : WRITING_CHUNK_SIZE;
+            const unsigned int size = (unsigned int)((file.size - offset < maxChunkSize) ? file.size - offset : maxChunkSize);
+            file.dataSource.read(offset, size, chunkBuffer);
+            const bool written = file.compressed ? fileWriter.write(compressBlock(chunkBuffer, size, compressedChunkBuffer), compressedChunkBuffer)
+                : fileWriter.write(size, chunkBuffer);
+            if (!written)
+            {
+                return false;
+            }
+            offset += size;
+            numberOfWrittenBytes += size;
+        }
+
+        if (offset >= file.size)
+        {
+            fileWriter.close();
+            fileIsOpen = false;
+            currentFile++;
+        }
+        return true;
+    }
+
+    QueuedFile files[maxNumberOfFiles];
+    unsigned int numberOfFiles;
+    unsigned int currentFile;
+    unsigned long long offset;
+    bool fileIsOpen;
+    bool failed;
+    FileWriter fileWriter;
+
+    unsigned long long numberOfSteps;
+    unsigned long long numberOfWrittenBytes;
+
+    unsigned char chunkBuffer[COMPRESSION_BLOCK_SIZE];
+    unsigned char compressedChunkBuffer[sizeof(unsigned int) + COMPRESSION_BLOCK_SIZE];
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <intrin.h>
+
+#include "concurrency.h"
+#include "assert.h"
+#include "global_var.h"
+
+// Function processing one task of a parallel job. Context is passed through from ParallelJob::run().
+typedef void (*ParallelJobTaskFunction)(void* context, unsigned int taskIndex);
+
+// Job split into independent tasks that are processed by the processor calling run() and by idle processors
+// calling tryHelp() in their loops. Running is also possible without any helper (run() processes all tasks).
+// In order to get deterministic results, tasks must be independent of each other and the split into tasks
+// must not depend on the number of processors.
+// Global instances are zero-initialized, which is the idle state. Only one job runs at a time.
+class ParallelJob
+{
+public:
+    // Set idle state.
+    void reset()
+    {
+        function = nullptr;
+        context = nullptr;
+        numberOfTasks = 0;
+        nextTask = 0;
+        finishedTasks = 0;
+        activeHelpers = 0;
+        runLock = 0;
+    }
+
+    // Run tasks 0 to taskCount - 1 of job and return when all are finished.
+    void run(ParallelJobTaskFunction taskFunction, void* taskContext, unsigned int taskCount)
+    {
+        start(taskFunction, taskContext, taskCount);
+        finish();
+    }
+
+    // Start job with tasks 0 to taskCount - 1 and return immediately, so the calling processor can do other work
+    // (such as file I/O) while helpers process the tasks. Must be followed by finish() on the same processor.
+    void start(ParallelJobTaskFunction taskFunction, void* taskContext, unsigned int taskCount)
+    {
+        ACQUIRE(runLock);
+
+        // Setup job while numberOfTasks is 0, so no helper starts processing
+        function = taskFunction;
+        context = taskContext;
+        nextTask = 0;
+        finishedTasks = 0;
+        _InterlockedExchange(&numberOfTasks, taskCount);
+    }
+
+    // Process remaining tasks of the job started by start() and return when all are finished.
+    void finish()
+    {
+        const long taskCount = numberOfTasks;
+        while (processTask())
+        {
+        }
+        while (finishedTasks < taskCount)
+        {
+            _mm_pause();
+        }
+
+        // Stop job and wait until no helper accesses job data anymore (exchange acts as memory barrier)
+        _InterlockedExchange(&numberOfTasks, 0);
+        while (activeHelpers)
+        {
+            _mm_pause();
+        }
+
+        RELEASE(runLock);
+    }
+
+    // Process tasks of the current job if there is any. Return true if at least one task has been processed.
+    bool tryHelp()
+    {
+        if (!numberOfTasks)
+        {
+            return false;
+        }
+
+        _InterlockedIncrement(&activeHelpers);
+        bool processedTask = false;
+        while (processTask())
+        {
+            processedTask = true;
+        }
+        _InterlockedDecrement(&activeHelpers);
+
+        return processedTask;
+    }
+
+private:
+    bool processTask()
+    {
+        const long taskCount = numberOfTasks;
+        if (nextTask >= taskCount)
+        {
+            return false;
+        }
+        const long taskIndex = _InterlockedIncrement(&nextTask) - 1;
+        if (taskIndex >= taskCount)
+        {
+            return false;
+        }
+
+        ASSERT(function);
+        function(context, (unsigned int)taskIndex);
+
+        _InterlockedIncrement(&finishedTasks);
+        return true;
+    }
+
+    ParallelJobTaskFunction volatile function;
+    void* volatile context;
+    volatile long numberOfTasks;
+    volatile long nextTask;
+    volatile long finishedTasks;
+    volatile long activeHelpers;
+    volatile char runLock;
+};
+
+// Job shared by all modules, idle processors (request processors) help by calling parallelJob.tryHelp()
+GLOBAL_VAR_DECL ParallelJob parallelJob;
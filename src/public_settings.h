@@ -16,13 +16,42 @@
 // is MAX_NUMBER_OF_PROCESSORS - 1.
 #define NUMBER_OF_CONTRACT_EXECUTION_BUFFERS 10
 
+// Number of additional contract processors running user procedures of isolated contracts (see contract_def.h) in parallel
+// to the other transactions of a tick. These processors are taken from the request processors. Set to 0 to run all
+// contract procedures in the contract processor one after the other.
+#define NUMBER_OF_PARALLEL_CONTRACT_PROCESSORS 2
+
+// Contract procedures and system procedure phases with an average execution time below this threshold (in microseconds)
+// are run directly in the tick processor instead of handing them over to the contract processor. Set to 0 to always use
+// the contract processor.
+#define CONTRACT_INLINE_EXECUTION_THRESHOLD 1000
+
 #define USE_SCORE_CACHE 1
 #define SCORE_CACHE_SIZE 2000000 // the larger the better
 #define SCORE_CACHE_COLLISION_RETRIES 20 // number of retries to find entry in cache in case of hash collision
 
+// Save large state files (spectrum, universe, contract states, tick storage snapshots) in block-compressed format
+// (see platform/block_compression.h), which is much smaller for sparse data. Loading detects the format, so files of
+// both formats can be loaded with either setting. Set to 0 if the files are read by tools that expect raw files.
+#define SAVE_COMPRESSED_STATE_FILES 0
+
+// Save spectrum and universe as delta files of the changed entries if possible (see platform/delta_snapshot.h). The
+// base file (for example spectrum.000) is then only complete together with its deltas (spectrum.000.delta.001, ...,
+// the number of valid deltas is stored in spectrum.000.delta), which the node applies when loading. Set to 0 to always
+// write the full files, for example if the files are read by tools.
+#define SAVE_STATE_DELTA_FILES 1
+
 // Number of ticks from prior epoch that are kept after seamless epoch transition. These can be requested after transition.
 #define TICKS_TO_KEEP_FROM_PRIOR_EPOCH 100
 
+// First epoch in which the digests of contract states larger than one page are computed as Merkle tree of state pages
+// (see contract_core/contract_state_digest.h), which only rehashes changed pages. Before, the whole state is hashed.
+// Changes the computer digest, so all nodes need to switch in the same epoch. Disabled by default (65535), set to the
+// agreed epoch to enable it. Costs: PagedStateDigest::init() allocates a full copy of each large contract state, and
+// getDigest() compares the whole state with this copy to find changed pages (per-page dirty tracking of contract
+// state writes would avoid both).
+#define PAGED_CONTRACT_STATE_DIGEST_EPOCH 65535
+
 #define TARGET_TICK_DURATION 1000
 #define TRANSACTION_SPARSENESS 1
 
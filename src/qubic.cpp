@@ -3,6 +3,8 @@
 // contract_def.h needs to be included first to make sure that contracts have minimal access
 #include "contract_core/contract_def.h"
 #include "contract_core/contract_exec.h"
+#include "contract_core/contract_state_digest.h"
+#include "contract_core/contract_procedure_scheduler.h"
 
 #include <intrin.h>
 
@@ -26,6 +28,8 @@
 #include "platform/time_stamp_counter.h"
 
 #include "platform/custom_stack.h"
+#include "platform/copy_on_write_snapshot.h"
+#include "platform/incremental_file_writer.h"
 
 #include "text_output.h"
 
@@ -35,6 +39,7 @@
 
 #include "network_core/tcp4.h"
 #include "network_core/peers.h"
+#include "network_core/signature_pre_verification.h"
 
 #include "system.h"
 #include "contract_core/qpi_system_impl.h"
@@ -51,6 +56,7 @@
 
 #include "tick_storage.h"
 #include "vote_counter.h"
+#include "pending_transaction_index.h"
 
 #include "addons/tx_status_request.h"
 
@@ -76,6 +82,14 @@
 #define TICK_VOTE_COUNTER_PUBLICATION_OFFSET 4 // Must be at least 3+: 1+ for tx propagration + 1 for tickData propagration + 1 for vote propagration
 #define MIN_MINING_SOLUTIONS_PUBLICATION_OFFSET 3 // Must be 3+
 #define TIME_ACCURACY 5000
+// Copies of pages changed while the node state is saved. Reorganizing the spectrum (anti-dust burn) changes all pages
+// of the spectrum and exhausts the pool, so the tick processor waits until the main loop has written the pages it
+// changes. The epoch transition doesn't start before the snapshot is saved (the main loop aborts saving).
+#define NODE_STATE_SNAPSHOT_SHADOW_MEMORY_SIZE 1073741824ULL
+// In milliseconds, max time of writing node state files per main loop iteration. If the shadow memory is exhausted,
+// the tick processor stalls until the main loop steps reach the page it changes, which may take as long as writing
+// the spectrum and universe files.
+#define NODE_STATE_WRITING_STEP_DURATION 20
 
 
 struct Processor : public CustomStack
@@ -127,6 +141,8 @@ static unsigned short ownComputorIndicesMapping[sizeof(computorSeeds) / sizeof(c
 
 static TickStorage ts;
 static VoteCounter voteCounter;
+static PendingTransactionIndex pendingTransactionIndex;
+static SignaturePreVerifier signaturePreVerifiers[NUMBER_OF_REQUEST_QUEUE_LANES];
 static Tick etalonTick;
 static TickData nextTickData;
 
@@ -139,19 +155,27 @@ static unsigned int numberOfTransactions = 0;
 static volatile char entityPendingTransactionsLock = 0;
 static unsigned char* entityPendingTransactions = NULL;
 static unsigned char* entityPendingTransactionDigests = NULL;
-static unsigned int entityPendingTransactionIndices[SPECTRUM_CAPACITY]; // [SPECTRUM_CAPACITY] must be >= than [NUMBER_OF_COMPUTORS * MAX_NUMBER_OF_PENDING_TRANSACTIONS_PER_COMPUTOR]
+static unsigned int entityPendingTransactionIndices[PendingTransactionIndex::slotCount]; // slots of pending transactions of one tick (computor and entity slots)
 static volatile char computorPendingTransactionsLock = 0;
 static unsigned char* computorPendingTransactions = NULL;
 static unsigned char* computorPendingTransactionDigests = NULL;
-static unsigned long long spectrumChangeFlags[SPECTRUM_CAPACITY / (sizeof(unsigned long long) * 8)];
 
 static unsigned long long mainLoopNumerator = 0, mainLoopDenominator = 0;
-static unsigned char contractProcessorState = 0;
+static volatile unsigned char contractProcessorState = 0;
 static unsigned int contractProcessorPhase;
 static const Transaction* contractProcessorTransaction = 0;
 static int contractProcessorTransactionMoneyflew = 0;
+static unsigned long long contractProcessorExecutionTicks = 0;
+static unsigned long long contractProcessorPhaseAverageTicks[USER_PROCEDURE_CALL + contractCount];
+static unsigned long long numberOfInlineContractProcessorPhases = 0, inlineContractProcessorPhaseTicks = 0;
+static unsigned long long numberOfHandedOffContractProcessorPhases = 0, contractProcessorHandoffTicks = 0;
 static EFI_EVENT contractProcessorEvent;
+static ContractProcedureScheduler<NUMBER_OF_PARALLEL_CONTRACT_PROCESSORS, contractCount> contractProcedureScheduler;
+static EFI_EVENT parallelContractProcessorEvents[NUMBER_OF_PARALLEL_CONTRACT_PROCESSORS ? NUMBER_OF_PARALLEL_CONTRACT_PROCESSORS : 1];
+static unsigned int parallelContractProcessorNumbers[NUMBER_OF_PARALLEL_CONTRACT_PROCESSORS ? NUMBER_OF_PARALLEL_CONTRACT_PROCESSORS : 1];
 static m256i contractStateDigests[MAX_NUMBER_OF_CONTRACTS * 2 - 1];
+static PagedStateDigest contractStatePagedDigests[contractCount];
+static bool contractStatePagedDigestsInitialized = false;
 const unsigned long long contractStateDigestsSizeInBytes = sizeof(contractStateDigests);
 
 // targetNextTickDataDigestIsKnown == true signals that we need to fetch TickData (update the version in this node)
@@ -234,6 +258,25 @@ struct
     unsigned int numberOfTransactions;
     unsigned long long lastLogId;
 } nodeStateBuffer;
+
+// Regions of nodeStateSnapshot and small state copied at the cut-over (see beginNodeStateSnapshot())
+static struct
+{
+    CHAR16 directory[16];
+    int spectrum;
+    int universe;
+    int spectrumDigests;
+    int universeDigests;
+    int minerSolutionFlags;
+    int contractStates[contractCount];
+    System system;
+    m256i contractStateDigests[MAX_NUMBER_OF_CONTRACTS * 2 - 1];
+} nodeStateSnapshotData;
+static_assert(contractCount + 5 <= CopyOnWriteSnapshot::maxRegions, "Too many regions for nodeStateSnapshot");
+
+// Writes the regions of nodeStateSnapshot in steps between main loop iterations (see beginSavingAllNodeStates())
+static IncrementalFileWriter<EfiFileWriter, CopyOnWriteSnapshot::RegionDataSource, contractCount + 5> nodeStateFileWriter;
+static unsigned long long nodeStateSavingBeginningTick = 0;
 #endif
 static bool saveComputer(CHAR16* directory = NULL);
 static bool saveSystem(CHAR16* directory = NULL);
@@ -366,8 +409,69 @@ static void enableAVX()
         ));
 }
 
+// Compute contractStateDigests[contractIndex] from the contract state and return the number of ticks it took
+static unsigned long long computeContractStateDigest(unsigned int contractIndex)
+{
+    const unsigned long long size = contractDescriptions[contractIndex].stateSize;
+    contractStateLock[contractIndex].acquireRead();
+
+    const unsigned long long startTick = __rdtsc();
+    if (system.epoch >= PAGED_CONTRACT_STATE_DIGEST_EPOCH && size > PagedStateDigest::pageSize)
+    {
+        if (contractStatePagedDigests[contractIndex].isInitialized())
+        {
+            contractStatePagedDigests[contractIndex].getDigest(contractStates[contractIndex], contractStateDigests[contractIndex]);
+        }
+        else
+        {
+            // Buffers aren't allocated yet (see initContractStatePagedDigests())
+            PagedStateDigest::computeDigest(contractStates[contractIndex], size, contractStateDigests[contractIndex]);
+        }
+    }
+    else
+    {
+        KangarooTwelve(contractStates[contractIndex], (unsigned int)size, &contractStateDigests[contractIndex], 32);
+    }
+    const unsigned long long executionTicks = __rdtsc() - startTick;
+
+    contractStateLock[contractIndex].releaseRead();
+
+    // K12 of state is included in contract execution time
+    _interlockedadd64(&contractTotalExecutionTicks[contractIndex], executionTicks);
+
+    return executionTicks;
+}
+
+// Allocate buffers of the incremental paged digests of large contract states, which include a copy of each state.
+// Only done once the node reaches PAGED_CONTRACT_STATE_DIGEST_EPOCH (at startup or by the main loop after the epoch
+// transition), before digests are computed from scratch. Can only be called from main thread.
+static void initContractStatePagedDigests()
+{
+    contractStatePagedDigestsInitialized = true;
+    for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
+    {
+        const unsigned long long size = contractDescriptions[contractIndex].stateSize;
+        if (size > PagedStateDigest::pageSize && !contractStatePagedDigests[contractIndex].init(size))
+        {
+            // Digests are still correct, but computed from scratch
+            contractStatePagedDigests[contractIndex].deinit();
+        }
+    }
+}
+
+// Task of ParallelJob: compute state digest of changed contract (used at startup before getComputerDigest(digest, true))
+static void computeContractStateDigestTask(void*, unsigned int contractIndex)
+{
+    if ((contractStateChangeFlags[contractIndex >> 6] & (1ULL << (contractIndex & 63))) && contractDescriptions[contractIndex].stateSize)
+    {
+        computeContractStateDigest(contractIndex);
+    }
+}
+
 // Should only be called from tick processor to avoid concurrent state changes, which can cause race conditions as detailed in FIXME below.
-static void getComputerDigest(m256i& digest)
+// If contractStateDigestsUpToDate, the state digests of all changed contracts have already been computed (for example
+// in parallel with computeContractStateDigestTask()) and only the tree is updated.
+static void getComputerDigest(m256i& digest, bool contractStateDigestsUpToDate = false)
 {
     unsigned int digestIndex;
     for (digestIndex = 0; digestIndex < MAX_NUMBER_OF_CONTRACTS; digestIndex++)
@@ -379,23 +483,14 @@ static void getComputerDigest(m256i& digest)
             {
                 contractStateDigests[digestIndex] = m256i::zero();
             }
-            else
+            else if (!contractStateDigestsUpToDate)
             {
                 // FIXME: We may have a race condition here if a digest is computed here by thread A, the state is changed
                 // + contractStateChangeFlags set afterwards by thread B and contractStateChangeFlags cleared below below
                 // by thread A. We then have a changed state but a cleared contractStateChangeFlags flag leading to wrong
                 // digest.
                 // This is currently avoided by calling getComputerDigest() from tick processor only (and in non-concurrent init)
-                contractStateLock[digestIndex].acquireRead();
-
-                const unsigned long long startTick = __rdtsc();
-                KangarooTwelve(contractStates[digestIndex], (unsigned int)size, &contractStateDigests[digestIndex], 32);
-                const unsigned long long executionTicks = __rdtsc() - startTick;
-
-                contractStateLock[digestIndex].releaseRead();
-
-                // K12 of state is included in contract execution time
-                _interlockedadd64(&contractTotalExecutionTicks[digestIndex], executionTicks);
+                const unsigned long long executionTicks = computeContractStateDigest(digestIndex);
 
                 // Gather data for comparing different versions of K12
                 if (K12MeasurementsCount < 500)
@@ -460,7 +555,7 @@ static void processExchangePublicPeers(Peer* peer, RequestResponseHeader* header
     }
 }
 
-static void processBroadcastMessage(const unsigned long long processorNumber, RequestResponseHeader* header)
+static void processBroadcastMessage(const unsigned long long processorNumber, RequestResponseHeader* header, const PreVerifiedSignature& preVerifiedSignature)
 {
     BroadcastMessage* request = header->getPayload<BroadcastMessage>();
     if (header->size() <= sizeof(RequestResponseHeader) + sizeof(BroadcastMessage) + MAX_MESSAGE_PAYLOAD_SIZE + SIGNATURE_SIZE
@@ -473,6 +568,10 @@ static void processBroadcastMessage(const unsigned long long processorNumber, Re
         {
             ok = true;
         }
+        else if (preVerifiedSignature.isVerifiedWith(request->sourcePublicKey))
+        {
+            ok = preVerifiedSignature.isValid();
+        }
         else
         {
             m256i digest;
@@ -605,7 +704,7 @@ static void processBroadcastComputors(Peer* peer, RequestResponseHeader* header)
         // Verify that list is signed by Arbitrator
         unsigned char digest[32];
         KangarooTwelve(request, sizeof(BroadcastComputors) - SIGNATURE_SIZE, digest, sizeof(digest));
-        if (verify((unsigned char*)&arbitratorPublicKey, digest, request->computors.signature))
+        if (verificationKeyCache.verify((unsigned char*)&arbitratorPublicKey, digest, request->computors.signature))
         {
             if (header->isDejavuZero())
             {
@@ -641,7 +740,7 @@ static void processBroadcastComputors(Peer* peer, RequestResponseHeader* header)
     }
 }
 
-static void processBroadcastTick(Peer* peer, RequestResponseHeader* header)
+static void processBroadcastTick(Peer* peer, RequestResponseHeader* header, const PreVerifiedSignature& preVerifiedSignature)
 {
     BroadcastTick* request = header->getPayload<BroadcastTick>();
     if (request->tick.computorIndex < NUMBER_OF_COMPUTORS
@@ -655,11 +754,21 @@ static void processBroadcastTick(Peer* peer, RequestResponseHeader* header)
         && request->tick.second <= 59
         && request->tick.millisecond <= 999)
     {
-        unsigned char digest[32];
-        request->tick.computorIndex ^= BroadcastTick::type;
-        KangarooTwelve(&request->tick, sizeof(Tick) - SIGNATURE_SIZE, digest, sizeof(digest));
-        request->tick.computorIndex ^= BroadcastTick::type;
-        if (verify(broadcastedComputors.computors.publicKeys[request->tick.computorIndex].m256i_u8, digest, request->tick.signature))
+        bool ok;
+        const m256i& computorPublicKey = broadcastedComputors.computors.publicKeys[request->tick.computorIndex];
+        if (preVerifiedSignature.isVerifiedWith(computorPublicKey))
+        {
+            ok = preVerifiedSignature.isValid();
+        }
+        else
+        {
+            unsigned char digest[32];
+            request->tick.computorIndex ^= BroadcastTick::type;
+            KangarooTwelve(&request->tick, sizeof(Tick) - SIGNATURE_SIZE, digest, sizeof(digest));
+            request->tick.computorIndex ^= BroadcastTick::type;
+            ok = verificationKeyCache.verify(computorPublicKey.m256i_u8, digest, request->tick.signature);
+        }
+        if (ok)
         {
             if (header->isDejavuZero())
             {
@@ -697,7 +806,7 @@ static void processBroadcastTick(Peer* peer, RequestResponseHeader* header)
     }
 }
 
-static void processBroadcastFutureTickData(Peer* peer, RequestResponseHeader* header)
+static void processBroadcastFutureTickData(Peer* peer, RequestResponseHeader* header, const PreVerifiedSignature& preVerifiedSignature)
 {
     BroadcastFutureTickData* request = header->getPayload<BroadcastFutureTickData>();
     if (request->tickData.epoch == system.epoch
@@ -730,11 +839,20 @@ static void processBroadcastFutureTickData(Peer* peer, RequestResponseHeader* he
         }
         if (ok)
         {
-            unsigned char digest[32];
-            request->tickData.computorIndex ^= BroadcastFutureTickData::type;
-            KangarooTwelve(&request->tickData, sizeof(TickData) - SIGNATURE_SIZE, digest, sizeof(digest));
-            request->tickData.computorIndex ^= BroadcastFutureTickData::type;
-            if (verify(broadcastedComputors.computors.publicKeys[request->tickData.computorIndex].m256i_u8, digest, request->tickData.signature))
+            const m256i& computorPublicKey = broadcastedComputors.computors.publicKeys[request->tickData.computorIndex];
+            if (preVerifiedSignature.isVerifiedWith(computorPublicKey))
+            {
+                ok = preVerifiedSignature.isValid();
+            }
+            else
+            {
+                unsigned char digest[32];
+                request->tickData.computorIndex ^= BroadcastFutureTickData::type;
+                KangarooTwelve(&request->tickData, sizeof(TickData) - SIGNATURE_SIZE, digest, sizeof(digest));
+                request->tickData.computorIndex ^= BroadcastFutureTickData::type;
+                ok = verificationKeyCache.verify(computorPublicKey.m256i_u8, digest, request->tickData.signature);
+            }
+            if (ok)
             {
                 if (header->isDejavuZero())
                 {
@@ -791,15 +909,24 @@ static void processBroadcastFutureTickData(Peer* peer, RequestResponseHeader* he
     }
 }
 
-static void processBroadcastTransaction(Peer* peer, RequestResponseHeader* header)
+static void processBroadcastTransaction(Peer* peer, RequestResponseHeader* header, const PreVerifiedSignature& preVerifiedSignature)
 {
     Transaction* request = header->getPayload<Transaction>();
     const unsigned int transactionSize = request->totalSize();
     if (request->checkValidity() && transactionSize == header->size() - sizeof(RequestResponseHeader))
     {
         unsigned char digest[32];
-        KangarooTwelve(request, transactionSize - SIGNATURE_SIZE, digest, sizeof(digest));
-        if (verify(request->sourcePublicKey.m256i_u8, digest, request->signaturePtr()))
+        bool ok;
+        if (preVerifiedSignature.isVerifiedWith(request->sourcePublicKey))
+        {
+            ok = preVerifiedSignature.isValid();
+        }
+        else
+        {
+            KangarooTwelve(request, transactionSize - SIGNATURE_SIZE, digest, sizeof(digest));
+            ok = verify(request->sourcePublicKey.m256i_u8, digest, request->signaturePtr());
+        }
+        if (ok)
         {
             if (header->isDejavuZero())
             {
@@ -817,6 +944,7 @@ static void processBroadcastTransaction(Peer* peer, RequestResponseHeader* heade
                 {
                     bs->CopyMem(&computorPendingTransactions[computorIndex * offset * MAX_TRANSACTION_SIZE], request, transactionSize);
                     KangarooTwelve(request, transactionSize, &computorPendingTransactionDigests[computorIndex * offset * 32ULL], 32);
+                    pendingTransactionIndex.set(computorIndex * offset, request->tick);
                 }
 
                 RELEASE(computorPendingTransactionsLock);
@@ -837,6 +965,7 @@ static void processBroadcastTransaction(Peer* peer, RequestResponseHeader* heade
                     {
                         bs->CopyMem(&entityPendingTransactions[spectrumIndex * MAX_TRANSACTION_SIZE], request, transactionSize);
                         KangarooTwelve(request, transactionSize, &entityPendingTransactionDigests[spectrumIndex * 32ULL], 32);
+                        pendingTransactionIndex.set(PendingTransactionIndex::entitySlot(spectrumIndex), request->tick);
                     }
 
                     RELEASE(entityPendingTransactionsLock);
@@ -1054,7 +1183,7 @@ static void processRequestEntity(Peer* peer, RequestResponseHeader* header)
 
     RequestedEntity* request = header->getPayload<RequestedEntity>();
     respondedEntity.entity.publicKey = request->publicKey;
-    // Inside spectrumIndex already have acquire/release lock
+    // Lookup is lock-free (spectrumIndex() does not block on spectrumLock)
     respondedEntity.spectrumIndex = spectrumIndex(respondedEntity.entity.publicKey);
     respondedEntity.tick = system.tick;
     if (respondedEntity.spectrumIndex < 0)
@@ -1193,7 +1322,7 @@ static void processSpecialCommand(Peer* peer, RequestResponseHeader* header)
             case SPECIAL_COMMAND_TOGGLE_MAIN_MODE_REQUEST:
             {
                 SpecialCommandToggleMainModeRequestAndResponse* _request = header->getPayload<SpecialCommandToggleMainModeRequestAndResponse>();
-                if (requestPersistingNodeState == 1 || persistingNodeStateTickProcWaiting == 1)
+                if (requestPersistingNodeState == 1 || persistingNodeStateTickProcWaiting == 1 || nodeStateSnapshot.isActive())
                 {
                     //logToConsole(L"Unable to switch mode because node is saving states.");
                 }
@@ -1316,6 +1445,94 @@ static void checkAndSwitchMiningPhase()
     }
 }
 
+// Return request stored in element of request queue lane (used by signature pre-verification)
+template <unsigned int lane>
+static RequestResponseHeader* getQueuedRequest(unsigned short elementIndex)
+{
+    return requestQueueLanes[lane].getRequest(elementIndex);
+}
+
+static constexpr PreVerificationRequestGetter getQueuedRequestOfLane[NUMBER_OF_REQUEST_QUEUE_LANES] = {
+    getQueuedRequest<REQUEST_QUEUE_CONSENSUS_LANE>, getQueuedRequest<REQUEST_QUEUE_TRANSACTION_LANE>, getQueuedRequest<REQUEST_QUEUE_QUERY_LANE>
+};
+
+// Verify signature of queued request in the signature pre-verification stage. Digests and public keys are the
+// same as in the request handlers, which only use the result if the signer key has not changed in between.
+static bool checkQueuedRequestSignature(RequestResponseHeader* header, m256i& publicKey, bool& valid)
+{
+    switch (header->type())
+    {
+    case BroadcastMessage::type:
+    {
+        BroadcastMessage* request = header->getPayload<BroadcastMessage>();
+        if (header->size() > sizeof(RequestResponseHeader) + sizeof(BroadcastMessage) + MAX_MESSAGE_PAYLOAD_SIZE + SIGNATURE_SIZE
+            || header->size() < sizeof(RequestResponseHeader) + sizeof(BroadcastMessage) + SIGNATURE_SIZE
+            || isZero(request->sourcePublicKey))
+        {
+            return false;
+        }
+        const unsigned int messageSize = header->size() - sizeof(RequestResponseHeader);
+        m256i digest;
+        KangarooTwelve(request, messageSize - SIGNATURE_SIZE, &digest, sizeof(digest));
+        publicKey = request->sourcePublicKey;
+        valid = verify(publicKey.m256i_u8, digest.m256i_u8, (((const unsigned char*)request) + (messageSize - SIGNATURE_SIZE)));
+        return true;
+    }
+
+    case BroadcastTick::type:
+    {
+        BroadcastTick* request = header->getPayload<BroadcastTick>();
+        if (header->size() < sizeof(RequestResponseHeader) + sizeof(BroadcastTick)
+            || request->tick.computorIndex >= NUMBER_OF_COMPUTORS)
+        {
+            return false;
+        }
+        unsigned char digest[32];
+        request->tick.computorIndex ^= BroadcastTick::type;
+        KangarooTwelve(&request->tick, sizeof(Tick) - SIGNATURE_SIZE, digest, sizeof(digest));
+        request->tick.computorIndex ^= BroadcastTick::type;
+        publicKey = broadcastedComputors.computors.publicKeys[request->tick.computorIndex];
+        valid = verificationKeyCache.verify(publicKey.m256i_u8, digest, request->tick.signature);
+        return true;
+    }
+
+    case BroadcastFutureTickData::type:
+    {
+        BroadcastFutureTickData* request = header->getPayload<BroadcastFutureTickData>();
+        if (header->size() < sizeof(RequestResponseHeader) + sizeof(BroadcastFutureTickData)
+            || request->tickData.computorIndex >= NUMBER_OF_COMPUTORS)
+        {
+            return false;
+        }
+        unsigned char digest[32];
+        request->tickData.computorIndex ^= BroadcastFutureTickData::type;
+        KangarooTwelve(&request->tickData, sizeof(TickData) - SIGNATURE_SIZE, digest, sizeof(digest));
+        request->tickData.computorIndex ^= BroadcastFutureTickData::type;
+        publicKey = broadcastedComputors.computors.publicKeys[request->tickData.computorIndex];
+        valid = verificationKeyCache.verify(publicKey.m256i_u8, digest, request->tickData.signature);
+        return true;
+    }
+
+    case BROADCAST_TRANSACTION:
+    {
+        Transaction* request = header->getPayload<Transaction>();
+        if (header->size() < sizeof(RequestResponseHeader) + sizeof(Transaction)
+            || !request->checkValidity()
+            || request->totalSize() != header->size() - sizeof(RequestResponseHeader))
+        {
+            return false;
+        }
+        unsigned char digest[32];
+        KangarooTwelve(request, request->totalSize() - SIGNATURE_SIZE, digest, sizeof(digest));
+        publicKey = request->sourcePublicKey;
+        valid = verify(publicKey.m256i_u8, digest, request->signaturePtr());
+        return true;
+    }
+    }
+
+    return false;
+}
+
 // Disabling the optimizer for requestProcessor() is a workaround introduced to solve an issue
 // that has been observed in testnets/2024-11-23-release-227-qvault.
 // In this test, the processors calling requestProcessor() were stuck before entering the function.
@@ -1340,7 +1557,11 @@ static void requestProcessor(void* ProcedureArgument)
             _InterlockedIncrement(&epochTransitionWaitingRequestProcessors);
             while (epochTransitionState)
             {
-                _mm_pause();
+                // help with parallel parts of epoch transition, such as spectrum reorganization
+                if (!parallelJob.tryHelp())
+                {
+                    _mm_pause();
+                }
             }
             _InterlockedDecrement(&epochTransitionWaitingRequestProcessors);
         }
@@ -1350,194 +1571,207 @@ static void requestProcessor(void* ProcedureArgument)
         {
             score->tryProcessSolution(processorNumber);
         }
-        
-        if (requestQueueElementTail == requestQueueElementHead)
+
+        // help with parallel job if any is running (for example spectrum reorganization)
+        parallelJob.tryHelp();
+
+        // pre-verify signature of a request waiting behind the next one to be processed, so the crypto work
+        // is done before the request reaches the handler (lanes with signed requests in priority order)
+        if (!signaturePreVerifiers[REQUEST_QUEUE_CONSENSUS_LANE].tryPreVerify(requestQueueLanes[REQUEST_QUEUE_CONSENSUS_LANE].tail(), requestQueueLanes[REQUEST_QUEUE_CONSENSUS_LANE].head(),
+            getQueuedRequestOfLane[REQUEST_QUEUE_CONSENSUS_LANE], checkQueuedRequestSignature, 1))
+        {
+            signaturePreVerifiers[REQUEST_QUEUE_TRANSACTION_LANE].tryPreVerify(requestQueueLanes[REQUEST_QUEUE_TRANSACTION_LANE].tail(), requestQueueLanes[REQUEST_QUEUE_TRANSACTION_LANE].head(),
+                getQueuedRequestOfLane[REQUEST_QUEUE_TRANSACTION_LANE], checkQueuedRequestSignature, 1);
+        }
+
+        // take request from first lane that isn't empty
+        unsigned int lane, queuePosition;
+        for (lane = 0; lane < NUMBER_OF_REQUEST_QUEUE_LANES; lane++)
+        {
+            if (requestQueueLanes[lane].tryDequeue(queuePosition))
+            {
+                break;
+            }
+        }
+
+        if (lane == NUMBER_OF_REQUEST_QUEUE_LANES)
         {
             _mm_pause();
         }
         else
         {
-            ACQUIRE(requestQueueTailLock);
+            const unsigned long long beginningTick = __rdtsc();
+
+            // wait if signature of request is pre-verified right now
+            const unsigned short elementIndex = (unsigned short)queuePosition;
+            PreVerifiedSignature preVerifiedSignature;
+            signaturePreVerifiers[lane].takeElement(elementIndex, preVerifiedSignature);
 
-            if (requestQueueElementTail == requestQueueElementHead)
             {
-                RELEASE(requestQueueTailLock);
+                RequestResponseHeader* requestHeader = requestQueueLanes[lane].getRequest(queuePosition);
+                bs->CopyMem(header, requestHeader, requestHeader->size());
             }
-            else
-            {
-                const unsigned long long beginningTick = __rdtsc();
-
-                {
-                    RequestResponseHeader* requestHeader = (RequestResponseHeader*)&requestQueueBuffer[requestQueueElements[requestQueueElementTail].offset];
-                    bs->CopyMem(header, requestHeader, requestHeader->size());
-                    requestQueueBufferTail += requestHeader->size();
-                }
 
-                Peer* peer = requestQueueElements[requestQueueElementTail].peer;
+            Peer* peer = (Peer*)requestQueueLanes[lane].getPeer(queuePosition);
 
-                if (requestQueueBufferTail > REQUEST_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
-                {
-                    requestQueueBufferTail = 0;
-                }
-                requestQueueElementTail++;
+            signaturePreVerifiers[lane].releaseElement(elementIndex);
+            requestQueueLanes[lane].release(queuePosition);
 
-                RELEASE(requestQueueTailLock);
-                switch (header->type())
-                {
-                case ExchangePublicPeers::type:
-                {
-                    processExchangePublicPeers(peer, header);
-                }
-                break;
+            switch (header->type())
+            {
+            case ExchangePublicPeers::type:
+            {
+                processExchangePublicPeers(peer, header);
+            }
+            break;
 
-                case BroadcastMessage::type:
-                {
-                    processBroadcastMessage(processorNumber, header);
-                }
-                break;
+            case BroadcastMessage::type:
+            {
+                processBroadcastMessage(processorNumber, header, preVerifiedSignature);
+            }
+            break;
 
-                case BroadcastComputors::type:
-                {
-                    processBroadcastComputors(peer, header);
-                }
-                break;
+            case BroadcastComputors::type:
+            {
+                processBroadcastComputors(peer, header);
+            }
+            break;
 
-                case BroadcastTick::type:
-                {
-                    processBroadcastTick(peer, header);
-                }
-                break;
+            case BroadcastTick::type:
+            {
+                processBroadcastTick(peer, header, preVerifiedSignature);
+            }
+            break;
 
-                case BroadcastFutureTickData::type:
-                {
-                    processBroadcastFutureTickData(peer, header);
-                }
-                break;
+            case BroadcastFutureTickData::type:
+            {
+                processBroadcastFutureTickData(peer, header, preVerifiedSignature);
+            }
+            break;
 
-                case BROADCAST_TRANSACTION:
-                {
-                    processBroadcastTransaction(peer, header);
-                }
-                break;
+            case BROADCAST_TRANSACTION:
+            {
+                processBroadcastTransaction(peer, header, preVerifiedSignature);
+            }
+            break;
 
-                case RequestComputors::type:
-                {
-                    processRequestComputors(peer, header);
-                }
-                break;
+            case RequestComputors::type:
+            {
+                processRequestComputors(peer, header);
+            }
+            break;
 
-                case RequestQuorumTick::type:
-                {
-                    processRequestQuorumTick(peer, header);
-                }
-                break;
+            case RequestQuorumTick::type:
+            {
+                processRequestQuorumTick(peer, header);
+            }
+            break;
 
-                case RequestTickData::type:
-                {
-                    processRequestTickData(peer, header);
-                }
-                break;
+            case RequestTickData::type:
+            {
+                processRequestTickData(peer, header);
+            }
+            break;
 
-                case REQUEST_TICK_TRANSACTIONS:
-                {
-                    processRequestTickTransactions(peer, header);
-                }
-                break;
+            case REQUEST_TICK_TRANSACTIONS:
+            {
+                processRequestTickTransactions(peer, header);
+            }
+            break;
 
-                case REQUEST_TRANSACTION_INFO:
-                {
-                    processRequestTransactionInfo(peer, header);
-                }
-                break;
+            case REQUEST_TRANSACTION_INFO:
+            {
+                processRequestTransactionInfo(peer, header);
+            }
+            break;
 
-                case REQUEST_CURRENT_TICK_INFO:
-                {
-                    processRequestCurrentTickInfo(peer, header);
-                }
-                break;
+            case REQUEST_CURRENT_TICK_INFO:
+            {
+                processRequestCurrentTickInfo(peer, header);
+            }
+            break;
 
-                case REQUEST_ENTITY:
-                {
-                    processRequestEntity(peer, header);
-                }
-                break;
+            case REQUEST_ENTITY:
+            {
+                processRequestEntity(peer, header);
+            }
+            break;
 
-                case RequestContractIPO::type:
-                {
-                    processRequestContractIPO(peer, header);
-                }
-                break;
+            case RequestContractIPO::type:
+            {
+                processRequestContractIPO(peer, header);
+            }
+            break;
 
-                case RequestIssuedAssets::type:
-                {
-                    processRequestIssuedAssets(peer, header);
-                }
-                break;
+            case RequestIssuedAssets::type:
+            {
+                processRequestIssuedAssets(peer, header);
+            }
+            break;
 
-                case RequestOwnedAssets::type:
-                {
-                    processRequestOwnedAssets(peer, header);
-                }
-                break;
+            case RequestOwnedAssets::type:
+            {
+                processRequestOwnedAssets(peer, header);
+            }
+            break;
 
-                case RequestPossessedAssets::type:
-                {
-                    processRequestPossessedAssets(peer, header);
-                }
-                break;
+            case RequestPossessedAssets::type:
+            {
+                processRequestPossessedAssets(peer, header);
+            }
+            break;
 
-                case RequestContractFunction::type:
-                {
-                    processRequestContractFunction(peer, processorNumber, header);
-                }
-                break;
+            case RequestContractFunction::type:
+            {
+                processRequestContractFunction(peer, processorNumber, header);
+            }
+            break;
 
-                case RequestLog::type:
-                {
-                    logger.processRequestLog(peer, header);
-                }
-                break;
+            case RequestLog::type:
+            {
+                logger.processRequestLog(peer, header);
+            }
+            break;
 
-                case RequestLogIdRangeFromTx::type:
-                {
-                    logger.processRequestTxLogInfo(peer, header);
-                }
-                break;
+            case RequestLogIdRangeFromTx::type:
+            {
+                logger.processRequestTxLogInfo(peer, header);
+            }
+            break;
 
-                case RequestAllLogIdRangesFromTick::type:
-                {
-                    logger.processRequestTickTxLogInfo(peer, header);
-                }
-                break;
+            case RequestAllLogIdRangesFromTick::type:
+            {
+                logger.processRequestTickTxLogInfo(peer, header);
+            }
+            break;
 
-                case REQUEST_SYSTEM_INFO:
-                {
-                    processRequestSystemInfo(peer, header);
-                }
-                break;
+            case REQUEST_SYSTEM_INFO:
+            {
+                processRequestSystemInfo(peer, header);
+            }
+            break;
 
-                case SpecialCommand::type:
-                {
-                    processSpecialCommand(peer, header);
-                }
-                break;
+            case SpecialCommand::type:
+            {
+                processSpecialCommand(peer, header);
+            }
+            break;
 
 #if ADDON_TX_STATUS_REQUEST
-                /* qli: process RequestTxStatus message */
-                case REQUEST_TX_STATUS:
-                {
-                    processRequestConfirmedTx(processorNumber, peer, header);
-                }
-                break;
+            /* qli: process RequestTxStatus message */
+            case REQUEST_TX_STATUS:
+            {
+                processRequestConfirmedTx(processorNumber, peer, header);
+            }
+            break;
 #endif
 
-                }
+            }
 
-                queueProcessingNumerator += __rdtsc() - beginningTick;
-                queueProcessingDenominator++;
+            queueProcessingNumerator += __rdtsc() - beginningTick;
+            queueProcessingDenominator++;
 
-                _InterlockedIncrement64(&numberOfProcessedRequests);
-            }
+            _InterlockedIncrement64(&numberOfProcessedRequests);
         }
     }
 }
@@ -1614,13 +1848,9 @@ m256i QPI::QpiContextFunctionCall::K12(const T& data) const
     return digest;
 }
 
-static void contractProcessor(void*)
+// Run contract code of contractProcessorPhase, called by the contract processor or inline by the tick processor
+static void executeContractProcessorPhase()
 {
-    enableAVX();
-
-    unsigned long long processorNumber;
-    mpServicesProtocol->WhoAmI(mpServicesProtocol, &processorNumber);
-
     unsigned int executedContractIndex;
     switch (contractProcessorPhase)
     {
@@ -1718,6 +1948,64 @@ static void contractProcessor(void*)
     }
 }
 
+static void contractProcessor(void*)
+{
+    enableAVX();
+
+    const unsigned long long startTick = __rdtsc();
+    executeContractProcessorPhase();
+    contractProcessorExecutionTicks = __rdtsc() - startTick;
+}
+
+// Run contractProcessorPhase and wait for completion. If the average execution time of the phase (or of the user
+// procedures of the contract invoked) is below CONTRACT_INLINE_EXECUTION_THRESHOLD, the phase is run inline in the
+// tick processor, saving the round trip of starting the contract processor from the main loop. Code run in the tick
+// processor cannot be stopped, so inline execution is only used as long as the contract processor has no timeout.
+static void runContractProcessorPhase(unsigned int phase, unsigned int contractIndex = 0)
+{
+    ASSERT(phase <= USER_PROCEDURE_CALL && contractIndex < contractCount);
+    unsigned long long& averageTicks = contractProcessorPhaseAverageTicks[(phase == USER_PROCEDURE_CALL) ? USER_PROCEDURE_CALL + contractIndex : phase];
+    unsigned long long executionTicks;
+    const unsigned long long startTick = __rdtsc();
+    contractProcessorPhase = phase;
+    if (MAX_CONTRACT_ITERATION_DURATION == 0 && averageTicks < frequency / 1000000 * CONTRACT_INLINE_EXECUTION_THRESHOLD)
+    {
+        executeContractProcessorPhase();
+        executionTicks = __rdtsc() - startTick;
+        numberOfInlineContractProcessorPhases++;
+        inlineContractProcessorPhaseTicks += executionTicks;
+    }
+    else
+    {
+        contractProcessorExecutionTicks = 0;
+        contractProcessorState = 1;
+        while (contractProcessorState)
+        {
+            _mm_pause();
+        }
+        executionTicks = contractProcessorExecutionTicks;
+        numberOfHandedOffContractProcessorPhases++;
+        contractProcessorHandoffTicks += __rdtsc() - startTick - executionTicks;
+    }
+    averageTicks = (averageTicks * 7 + executionTicks) / 8;
+}
+
+// Run user procedure of isolated contract requested by the tick processor in slot of contractProcedureScheduler
+static void parallelContractProcessor(void* slot)
+{
+    enableAVX();
+
+    const unsigned int slotIndex = (unsigned int)(unsigned long long)slot;
+    const Transaction* transaction = (const Transaction*)contractProcedureScheduler.getTask(slotIndex);
+    const unsigned int contractIndex = contractProcedureScheduler.getContractIndex(slotIndex);
+    ASSERT(transaction && transaction->checkValidity());
+    ASSERT(contractIndex == (unsigned int)transaction->destinationPublicKey.m256i_u64[0]);
+    ASSERT(contractUserProcedures[contractIndex][transaction->inputType]);
+
+    QpiContextUserProcedureCall qpiContext(contractIndex, transaction->sourcePublicKey, transaction->amount, false);
+    qpiContext.call(transaction->inputType, transaction->inputPtr(), transaction->inputSize);
+}
+
 static void processTickTransactionContractIPO(const Transaction* transaction, const int spectrumIndex, const unsigned int contractIndex)
 {
     ASSERT(nextTickData.epoch == system.epoch);
@@ -1741,6 +2029,7 @@ static void processTickTransactionContractIPO(const Transaction* transaction, co
 
             numberOfReleasedEntities = 0;
             contractStateLock[contractIndex].acquireWrite();
+            nodeStateSnapshot.beforeWrite(contractStates[contractIndex], contractDescriptions[contractIndex].stateSize);
             IPO* ipo = (IPO*)contractStates[contractIndex];
             for (unsigned int i = 0; i < contractIPOBid->quantity; i++)
             {
@@ -1798,7 +2087,7 @@ static void processTickTransactionContractIPO(const Transaction* transaction, co
                         ipo->prices[j--] = tmpPrice;
                     }
 
-                    contractStateChangeFlags[contractIndex >> 6] |= (1ULL << (contractIndex & 63));
+                    setContractStateChanged(contractIndex);
                 }
             }
             contractStateLock[contractIndex].releaseWrite();
@@ -1827,15 +2116,26 @@ static bool processTickTransactionContractProcedure(const Transaction* transacti
 
     if (contractUserProcedures[contractIndex][transaction->inputType])
     {
+        if (contractProcedureScheduler.canRunInParallel(contractIndex))
+        {
+            // Run user procedure of isolated contract in parallel contract processor and continue with next
+            // transaction without waiting (only waits if the contract is still running a previous invocation)
+            while (contractProcedureScheduler.tryStart(contractIndex, transaction) < 0)
+            {
+                _mm_pause();
+            }
+
+            // Isolated contracts don't transfer QU, so money only flew if there is an invocation reward
+            return transaction->amount > 0;
+        }
+
+        // Other procedures may access the states changed by running invocations
+        contractProcedureScheduler.waitUntilIdle();
+
         // Run user procedure call of transaction in contract processor
         // and wait for completion
         contractProcessorTransaction = transaction;
-        contractProcessorPhase = USER_PROCEDURE_CALL;
-        contractProcessorState = 1;
-        while (contractProcessorState)
-        {
-            _mm_pause();
-        }
+        runContractProcessorPhase(USER_PROCEDURE_CALL, contractIndex);
 
         return contractProcessorTransactionMoneyflew;
     }
@@ -1861,6 +2161,7 @@ static void processTickTransactionSolution(const MiningSolutionTransaction* tran
     KangarooTwelve(data, sizeof(data), &flagIndex, sizeof(flagIndex));
     if (!(minerSolutionFlags[flagIndex >> 6] & (1ULL << (flagIndex & 63))))
     {
+        nodeStateSnapshot.beforeWrite(&minerSolutionFlags[flagIndex >> 6], sizeof(minerSolutionFlags[0]));
         minerSolutionFlags[flagIndex >> 6] |= (1ULL << (flagIndex & 63));
 
         unsigned int solutionScore = (*::score)(processorNumber, transaction->sourcePublicKey, transaction->miningSeed, transaction->nonce);
@@ -2275,29 +2576,14 @@ static void processTick(unsigned long long processorNumber)
     {
         logger.reset(system.initialTick); // clear logs here to give more time for querying and persisting the data when we do seamless transition
         logger.registerNewTx(system.tick, logger.SC_INITIALIZE_TX);
-        contractProcessorPhase = INITIALIZE;
-        contractProcessorState = 1;
-        while (contractProcessorState)
-        {
-            _mm_pause();
-        }
+        runContractProcessorPhase(INITIALIZE);
 
         logger.registerNewTx(system.tick, logger.SC_BEGIN_EPOCH_TX);
-        contractProcessorPhase = BEGIN_EPOCH;
-        contractProcessorState = 1;
-        while (contractProcessorState)
-        {
-            _mm_pause();
-        }
+        runContractProcessorPhase(BEGIN_EPOCH);
     }
 
     logger.registerNewTx(system.tick, logger.SC_BEGIN_TICK_TX);
-    contractProcessorPhase = BEGIN_TICK;
-    contractProcessorState = 1;
-    while (contractProcessorState)
-    {
-        _mm_pause();
-    }
+    runContractProcessorPhase(BEGIN_TICK);
 
     unsigned int tickIndex = ts.tickToIndexCurrentEpoch(system.tick);
     ts.tickData.acquireLock();
@@ -2383,42 +2669,13 @@ static void processTick(unsigned long long processorNumber)
         }
     }
 
+    contractProcedureScheduler.waitUntilIdle();
+
     logger.registerNewTx(system.tick, logger.SC_END_TICK_TX);
-    contractProcessorPhase = END_TICK;
-    contractProcessorState = 1;
-    while (contractProcessorState)
-    {
-        _mm_pause();
-    }
+    runContractProcessorPhase(END_TICK);
 
-    unsigned int digestIndex;
     ACQUIRE(spectrumLock);
-    for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
-    {
-        if (spectrum[digestIndex].latestIncomingTransferTick == system.tick || spectrum[digestIndex].latestOutgoingTransferTick == system.tick)
-        {
-            KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
-            spectrumChangeFlags[digestIndex >> 6] |= (1ULL << (digestIndex & 63));
-        }
-    }
-    unsigned int previousLevelBeginning = 0;
-    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-    while (numberOfLeafs > 1)
-    {
-        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-        {
-            if (spectrumChangeFlags[i >> 6] & (3ULL << (i & 63)))
-            {
-                KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex]);
-                spectrumChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
-                spectrumChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
-            }
-            digestIndex++;
-        }
-        previousLevelBeginning += numberOfLeafs;
-        numberOfLeafs >>= 1;
-    }
-    spectrumChangeFlags[0] = 0;
+    updateSpectrumDigests();
 
     etalonTick.saltedSpectrumDigest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
     RELEASE(spectrumLock);
@@ -2455,11 +2712,20 @@ static void processTick(unsigned long long processorNumber)
 
                     unsigned int j = 0;
 
-                    unsigned int numberOfEntityPendingTransactionIndices;
-                    for (numberOfEntityPendingTransactionIndices = 0; numberOfEntityPendingTransactionIndices < NUMBER_OF_COMPUTORS * MAX_NUMBER_OF_PENDING_TRANSACTIONS_PER_COMPUTOR; numberOfEntityPendingTransactionIndices++)
+                    // Get slots of pending transactions with target tick from index and move computor slots to the front
+                    const unsigned int numberOfPendingTransactionSlots = pendingTransactionIndex.getSlots(system.tick + TICK_TRANSACTIONS_PUBLICATION_OFFSET, entityPendingTransactionIndices, PendingTransactionIndex::slotCount);
+                    unsigned int numberOfComputorPendingTransactionSlots = 0;
+                    for (unsigned int k = 0; k < numberOfPendingTransactionSlots; k++)
                     {
-                        entityPendingTransactionIndices[numberOfEntityPendingTransactionIndices] = numberOfEntityPendingTransactionIndices;
+                        if (entityPendingTransactionIndices[k] < PendingTransactionIndex::computorSlotCount)
+                        {
+                            const unsigned int slot = entityPendingTransactionIndices[k];
+                            entityPendingTransactionIndices[k] = entityPendingTransactionIndices[numberOfComputorPendingTransactionSlots];
+                            entityPendingTransactionIndices[numberOfComputorPendingTransactionSlots++] = slot;
+                        }
                     }
+
+                    unsigned int numberOfEntityPendingTransactionIndices = numberOfComputorPendingTransactionSlots;
                     while (j < NUMBER_OF_TRANSACTIONS_PER_TICK && numberOfEntityPendingTransactionIndices)
                     {
                         const unsigned int index = random(numberOfEntityPendingTransactionIndices);
@@ -2487,15 +2753,18 @@ static void processTick(unsigned long long processorNumber)
                         entityPendingTransactionIndices[index] = entityPendingTransactionIndices[--numberOfEntityPendingTransactionIndices];
                     }
 
-                    for (numberOfEntityPendingTransactionIndices = 0; numberOfEntityPendingTransactionIndices < SPECTRUM_CAPACITY; numberOfEntityPendingTransactionIndices++)
+                    // Entity slots are stored after computor slots, convert to spectrum index
+                    unsigned int* const entityPendingTransactionSpectrumIndices = &entityPendingTransactionIndices[numberOfComputorPendingTransactionSlots];
+                    numberOfEntityPendingTransactionIndices = numberOfPendingTransactionSlots - numberOfComputorPendingTransactionSlots;
+                    for (unsigned int k = 0; k < numberOfEntityPendingTransactionIndices; k++)
                     {
-                        entityPendingTransactionIndices[numberOfEntityPendingTransactionIndices] = numberOfEntityPendingTransactionIndices;
+                        entityPendingTransactionSpectrumIndices[k] -= PendingTransactionIndex::computorSlotCount;
                     }
                     while (j < NUMBER_OF_TRANSACTIONS_PER_TICK && numberOfEntityPendingTransactionIndices)
                     {
                         const unsigned int index = random(numberOfEntityPendingTransactionIndices);
 
-                        const Transaction* pendingTransaction = ((Transaction*)&entityPendingTransactions[entityPendingTransactionIndices[index] * MAX_TRANSACTION_SIZE]);
+                        const Transaction* pendingTransaction = ((Transaction*)&entityPendingTransactions[entityPendingTransactionSpectrumIndices[index] * MAX_TRANSACTION_SIZE]);
                         if (pendingTransaction->tick == system.tick + TICK_TRANSACTIONS_PUBLICATION_OFFSET)
                         {
                             ASSERT(pendingTransaction->checkValidity());
@@ -2507,7 +2776,7 @@ static void processTick(unsigned long long processorNumber)
                                 {
                                     ts.tickTransactionOffsets(pendingTransaction->tick, j) = ts.nextTickTransactionOffset;
                                     bs->CopyMem(ts.tickTransactions(ts.nextTickTransactionOffset), (void*)pendingTransaction, transactionSize);
-                                    broadcastedFutureTickData.tickData.transactionDigests[j] = &entityPendingTransactionDigests[entityPendingTransactionIndices[index] * 32ULL];
+                                    broadcastedFutureTickData.tickData.transactionDigests[j] = &entityPendingTransactionDigests[entityPendingTransactionSpectrumIndices[index] * 32ULL];
                                     j++;
                                     ts.nextTickTransactionOffset += transactionSize;
                                 }
@@ -2515,7 +2784,7 @@ static void processTick(unsigned long long processorNumber)
                             }
                         }
 
-                        entityPendingTransactionIndices[index] = entityPendingTransactionIndices[--numberOfEntityPendingTransactionIndices];
+                        entityPendingTransactionSpectrumIndices[index] = entityPendingTransactionSpectrumIndices[--numberOfEntityPendingTransactionIndices];
                     }
 
                     for (; j < NUMBER_OF_TRANSACTIONS_PER_TICK; j++)
@@ -2686,6 +2955,7 @@ static void beginEpoch()
 #endif
     ts.beginEpoch(system.initialTick);
     voteCounter.init();
+    verificationKeyCache.reset();
 #ifndef NDEBUG
     ts.checkStateConsistencyWithAssert();
 #endif
@@ -2701,6 +2971,7 @@ static void beginEpoch()
     {
         ((Transaction*)&entityPendingTransactions[i * MAX_TRANSACTION_SIZE])->tick = 0;
     }
+    pendingTransactionIndex.beginEpoch(system.initialTick);
 
     bs->SetMem(solutionPublicationTicks, sizeof(solutionPublicationTicks), 0);
     bs->SetMem(faultyComputorFlags, sizeof(faultyComputorFlags), 0);
@@ -2753,12 +3024,7 @@ static void beginEpoch()
 static void endEpoch()
 {
     logger.registerNewTx(system.tick, logger.SC_END_EPOCH_TX);
-    contractProcessorPhase = END_EPOCH;
-    contractProcessorState = 1;
-    while (contractProcessorState)
-    {
-        _mm_pause();
-    }
+    runContractProcessorPhase(END_EPOCH);
 
     // treating endEpoch as a tick, start updating etalonTick:
     // this is the last tick of an epoch, should we set prevResourceTestingDigest to zero? nodes that start from scratch (for the new epoch)
@@ -2822,6 +3088,7 @@ static void endEpoch()
             contractStateLock[contractIndex].releaseRead();
 
             contractStateLock[0].acquireWrite();
+            nodeStateSnapshot.beforeWrite(contractStates[0], contractDescriptions[0].stateSize);
             contractFeeReserve(contractIndex) = finalPrice * NUMBER_OF_COMPUTORS;
             contractStateLock[0].releaseWrite();
         }
@@ -3109,73 +3376,48 @@ static bool invalidateNodeStates(CHAR16* directory)
     return ts.saveInvalidateData(system.epoch, directory);
 }
 
-// can only called from main thread
-static bool saveAllNodeStates()
+// Cut-over of saving the node state: start the copy-on-write snapshot of the large state and copy the small state.
+// Can only be called from main thread while the tick processor waits (persistingNodeStateTickProcWaiting). Afterwards,
+// tick processing can continue while beginSavingAllNodeStates() and the main loop write the snapshot.
+static bool beginNodeStateSnapshot()
 {
-    CHAR16 directory[16];
-    setText(directory, L"ep");
-    appendNumber(directory, system.epoch, false);
-
-    logToConsole(L"Start saving node states from main thread");
+    setText(nodeStateSnapshotData.directory, L"ep");
+    appendNumber(nodeStateSnapshotData.directory, system.epoch, false);
 
     // Mark current snapshot metadata as invalid at the beginning.
     // Any reasons make the valid metadata can not be overwritten at the final step will keep this invalid file
     // and make the loadAllNodeStates see this saving as an invalid save.
-    if (!invalidateNodeStates(directory))
+    if (!invalidateNodeStates(nodeStateSnapshotData.directory))
     {
         logToConsole(L"Failed to init snapshot metadata");
         return false;
     }
 
-    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 4] = L'0';
-    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 3] = L'0';
-    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 2] = L'0';
-    setText(message, L"Saving spectrum to ");
-    appendText(message, directory); appendText(message, L"/");
-    appendText(message, SPECTRUM_FILE_NAME);
-    logToConsole(message);
-    if (!saveSpectrum(SPECTRUM_FILE_NAME, directory))
+#if ADDON_TX_STATUS_REQUEST
+    // Not part of the snapshot, so save it before tick processing continues
+    if (!saveStateTxStatus(numberOfTransactions, nodeStateSnapshotData.directory))
     {
-        logToConsole(L"Failed to save spectrum");
+        logToConsole(L"Failed to save tx status");
         return false;
     }
+#endif
 
-    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 4] = L'0';
-    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 3] = L'0';
-    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 2] = L'0';
-    setText(message, L"Saving universe to ");
-    appendText(message, directory); appendText(message, L"/");
-    appendText(message, UNIVERSE_FILE_NAME);
-    logToConsole(message);
-    if (!saveUniverse(UNIVERSE_FILE_NAME, directory))
+    nodeStateSnapshot.reset();
+    nodeStateSnapshotData.spectrum = nodeStateSnapshot.addRegion(spectrum, spectrumSizeInBytes);
+    nodeStateSnapshotData.universe = nodeStateSnapshot.addRegion(assets, ASSETS_CAPACITY * sizeof(Asset));
+    nodeStateSnapshotData.spectrumDigests = nodeStateSnapshot.addRegion(spectrumDigests, spectrumDigestsSizeInByte);
+    nodeStateSnapshotData.universeDigests = nodeStateSnapshot.addRegion(assetDigests, assetDigestsSizeInBytes);
+    nodeStateSnapshotData.minerSolutionFlags = nodeStateSnapshot.addRegion(minerSolutionFlags, NUMBER_OF_MINER_SOLUTION_FLAGS / 8);
+    for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
     {
-        logToConsole(L"Failed to save universe");
-        return false;
+        nodeStateSnapshotData.contractStates[contractIndex] = nodeStateSnapshot.addRegion(contractStates[contractIndex], contractDescriptions[contractIndex].stateSize);
+        ASSERT(nodeStateSnapshotData.contractStates[contractIndex] >= 0);
     }
+    ASSERT(nodeStateSnapshotData.minerSolutionFlags >= 0);
 
-    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 4] = L'0';
-    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 3] = L'0';
-    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 2] = L'0';
-    setText(message, L"Saving computer files");
-    logToConsole(message);
-    if (!saveComputer(directory))
-    {
-        logToConsole(L"Failed to save computer");
-        return false;
-    }
-    setText(message, L"Saving system to system.snp");
-    logToConsole(message);
+    copyMem(&nodeStateSnapshotData.system, &system, sizeof(system));
+    copyMem(nodeStateSnapshotData.contractStateDigests, contractStateDigests, contractStateDigestsSizeInBytes);
 
-    static unsigned short SYSTEM_SNAPSHOT_FILE_NAME[] = L"system.snp";
-    long long savedSize = save(SYSTEM_SNAPSHOT_FILE_NAME, sizeof(system), (unsigned char*)&system, directory);
-    if (savedSize != sizeof(system))
-    {
-        logToConsole(L"Failed to save system");
-        return false;
-    }
-    
-    score->saveScoreCache(system.epoch, directory);
-    
     copyMem(&nodeStateBuffer.etalonTick, &etalonTick, sizeof(etalonTick));
     copyMem(nodeStateBuffer.minerPublicKeys, (void*)minerPublicKeys, sizeof(minerPublicKeys));
     copyMem(nodeStateBuffer.minerScores, (void*)minerScores, sizeof(minerScores));
@@ -3192,35 +3434,117 @@ static bool saveAllNodeStates()
     nodeStateBuffer.lastLogId = logger.logId;
     voteCounter.saveAllDataToArray(nodeStateBuffer.voteCounterData);
 
-    CHAR16 NODE_STATE_FILE_NAME[] = L"snapshotNodeMiningState";
-    savedSize = save(NODE_STATE_FILE_NAME, sizeof(nodeStateBuffer), (unsigned char*)&nodeStateBuffer, directory);
-    logToConsole(L"Saving mining states");
-    if (savedSize != sizeof(nodeStateBuffer))
+    nodeStateSnapshot.activate();
+
+    return true;
+}
+
+// Add region of nodeStateSnapshot to the files written by nodeStateFileWriter
+static bool addNodeStateSnapshotRegion(int regionIndex, const CHAR16* fileName, unsigned long long size, const CHAR16* directory, const CHAR16* dataName)
+{
+    setText(message, L"Saving ");
+    appendText(message, dataName);
+    appendText(message, L" to ");
+    appendText(message, directory); appendText(message, L"/");
+    appendText(message, fileName);
+    logToConsole(message);
+
+    const CopyOnWriteSnapshot::RegionDataSource dataSource = { &nodeStateSnapshot, (unsigned int)regionIndex };
+    return nodeStateFileWriter.add(fileName, directory, size, dataSource, SAVE_COMPRESSED_STATE_FILES);
+}
+
+// Start writing the node state snapshot taken by beginNodeStateSnapshot(), can only called from main thread.
+// The large regions of the snapshot are written by nodeStateFileWriter.step() in the main loop, so peers are serviced
+// while the files are written. Tick processing continues in parallel, changes after the cut-over are not saved.
+static bool beginSavingAllNodeStates()
+{
+    CHAR16* directory = nodeStateSnapshotData.directory;
+
+    logToConsole(L"Start saving node states from main thread");
+    nodeStateSavingBeginningTick = __rdtsc();
+    nodeStateFileWriter.reset();
+
+    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 4] = L'0';
+    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 3] = L'0';
+    SPECTRUM_FILE_NAME[sizeof(SPECTRUM_FILE_NAME) / sizeof(SPECTRUM_FILE_NAME[0]) - 2] = L'0';
+    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 4] = L'0';
+    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 3] = L'0';
+    UNIVERSE_FILE_NAME[sizeof(UNIVERSE_FILE_NAME) / sizeof(UNIVERSE_FILE_NAME[0]) - 2] = L'0';
+    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 4] = L'0';
+    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 3] = L'0';
+    CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 2] = L'0';
+    CHAR16 SPECTRUM_DIGEST_FILE_NAME[] = L"snapshotSpectrumDigest";
+    CHAR16 UNIVERSE_DIGEST_FILE_NAME[] = L"snapshotUniverseDigest";
+    CHAR16 MINER_SOL_FLAG_FILE_NAME[] = L"snapshotMinerSolutionFlag";
+
+    bool ok = addNodeStateSnapshotRegion(nodeStateSnapshotData.spectrum, SPECTRUM_FILE_NAME, spectrumSizeInBytes, directory, L"spectrum")
+        && addNodeStateSnapshotRegion(nodeStateSnapshotData.universe, UNIVERSE_FILE_NAME, ASSETS_CAPACITY * sizeof(Asset), directory, L"universe");
+    for (unsigned int contractIndex = 0; ok && contractIndex < contractCount; contractIndex++)
+    {
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 9] = contractIndex / 1000 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 8] = (contractIndex % 1000) / 100 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 7] = (contractIndex % 100) / 10 + L'0';
+        CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 6] = contractIndex % 10 + L'0';
+        const CopyOnWriteSnapshot::RegionDataSource dataSource = { &nodeStateSnapshot, (unsigned int)nodeStateSnapshotData.contractStates[contractIndex] };
+        ok = nodeStateFileWriter.add(CONTRACT_FILE_NAME, directory, contractDescriptions[contractIndex].stateSize, dataSource, SAVE_COMPRESSED_STATE_FILES);
+    }
+    ok = ok
+        && addNodeStateSnapshotRegion(nodeStateSnapshotData.spectrumDigests, SPECTRUM_DIGEST_FILE_NAME, spectrumDigestsSizeInByte, directory, L"spectrum digests")
+        && addNodeStateSnapshotRegion(nodeStateSnapshotData.universeDigests, UNIVERSE_DIGEST_FILE_NAME, assetDigestsSizeInBytes, directory, L"universe digests")
+        && addNodeStateSnapshotRegion(nodeStateSnapshotData.minerSolutionFlags, MINER_SOL_FLAG_FILE_NAME, NUMBER_OF_MINER_SOLUTION_FLAGS / 8, directory, L"miner solution flags");
+    if (!ok)
+    {
+        logToConsole(L"Failed to queue node state files");
+        nodeStateFileWriter.reset();
+    }
+    return ok;
+}
+
+// Save the small part of the node state and the tick storage after nodeStateFileWriter has written all regions of
+// nodeStateSnapshot. Can only called from main thread.
+static bool finishSavingAllNodeStates()
+{
+    CHAR16* directory = nodeStateSnapshotData.directory;
+
+    if (nodeStateFileWriter.hasFailed())
     {
-        logToConsole(L"Failed to save etalon tick and other states");
+        logToConsole(L"Failed to save node state files");
         return false;
     }
-    
-    CHAR16 SPECTRUM_DIGEST_FILE_NAME[] = L"snapshotSpectrumDigest";
-    savedSize = save(SPECTRUM_DIGEST_FILE_NAME, spectrumDigestsSizeInByte, (unsigned char*)spectrumDigests, directory);
-    logToConsole(L"Saving spectrum digests");
-    if (savedSize != spectrumDigestsSizeInByte)
+    setNumber(message, nodeStateFileWriter.getNumberOfWrittenBytes(), TRUE);
+    appendText(message, L" bytes of ");
+    appendNumber(message, nodeStateFileWriter.getNumberOfWrittenFiles(), TRUE);
+    appendText(message, L" node state files are saved in ");
+    appendNumber(message, nodeStateFileWriter.getNumberOfSteps(), TRUE);
+    appendText(message, L" steps (");
+    appendNumber(message, (__rdtsc() - nodeStateSavingBeginningTick) * 1000000 / frequency, TRUE);
+    appendText(message, L" microseconds).");
+    logToConsole(message);
+
+    setText(message, L"Saving system to system.snp");
+    logToConsole(message);
+
+    static unsigned short SYSTEM_SNAPSHOT_FILE_NAME[] = L"system.snp";
+    long long savedSize = save(SYSTEM_SNAPSHOT_FILE_NAME, sizeof(system), (unsigned char*)&nodeStateSnapshotData.system, directory);
+    if (savedSize != sizeof(system))
     {
-        logToConsole(L"Failed to save spectrum digest");
+        logToConsole(L"Failed to save system");
         return false;
     }
+    
+    score->saveScoreCache(nodeStateSnapshotData.system.epoch, directory);
 
-    CHAR16 UNIVERSE_DIGEST_FILE_NAME[] = L"snapshotUniverseDigest";
-    savedSize = save(UNIVERSE_DIGEST_FILE_NAME, assetDigestsSizeInBytes, (unsigned char*)assetDigests, directory);
-    logToConsole(L"Saving universe digests");
-    if (savedSize != assetDigestsSizeInBytes)
+    CHAR16 NODE_STATE_FILE_NAME[] = L"snapshotNodeMiningState";
+    savedSize = save(NODE_STATE_FILE_NAME, sizeof(nodeStateBuffer), (unsigned char*)&nodeStateBuffer, directory);
+    logToConsole(L"Saving mining states");
+    if (savedSize != sizeof(nodeStateBuffer))
     {
-        logToConsole(L"Failed to save universe digest");
+        logToConsole(L"Failed to save etalon tick and other states");
         return false;
     }
 
     CHAR16 COMPUTER_DIGEST_FILE_NAME[] = L"snapshotComputerDigest";
-    savedSize = save(COMPUTER_DIGEST_FILE_NAME, contractStateDigestsSizeInBytes, (unsigned char*)contractStateDigests, directory);
+    savedSize = save(COMPUTER_DIGEST_FILE_NAME, contractStateDigestsSizeInBytes, (unsigned char*)nodeStateSnapshotData.contractStateDigests, directory);
     logToConsole(L"Saving computer digests");
     if (savedSize != contractStateDigestsSizeInBytes)
     {
@@ -3228,31 +3552,16 @@ static bool saveAllNodeStates()
         return false;
     }
 
-    CHAR16 MINER_SOL_FLAG_FILE_NAME[] = L"snapshotMinerSolutionFlag";
-    logToConsole(L"Saving miner solution flags");
-    savedSize = save(MINER_SOL_FLAG_FILE_NAME, NUMBER_OF_MINER_SOLUTION_FLAGS / 8, (unsigned char*)minerSolutionFlags, directory);
-    if (savedSize != NUMBER_OF_MINER_SOLUTION_FLAGS / 8)
-    {
-        logToConsole(L"Failed to save miner solution flag");
-        return false;
-    }
-
+    // Tick storage is saved up to the tick of the cut-over. It is saved last, because all pages of the snapshot
+    // have been read at this point, so the tick processor can't wait for the main thread anymore.
     setText(message, L"Saving tick storage ");
     logToConsole(message);
-    if (ts.trySaveToFile(system.epoch, system.tick, directory) != 0)
+    if (ts.trySaveToFile(nodeStateSnapshotData.system.epoch, nodeStateSnapshotData.system.tick, directory) != 0)
     {
         logToConsole(L"Failed to save tick storage");
         return false;
     }
 
-#if ADDON_TX_STATUS_REQUEST
-    if (!saveStateTxStatus(numberOfTransactions, directory))
-    {
-        logToConsole(L"Failed to save tx status");
-        return false;
-    }
-#endif
-
     return true;
 }
 
@@ -3355,6 +3664,7 @@ static bool loadAllNodeStates()
 
     setMem(assetChangeFlags, sizeof(assetChangeFlags), 0);
     setMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), 0);
+    resetSpectrumChangeJournal();
     CHAR16 SPECTRUM_DIGEST_FILE_NAME[] = L"snapshotSpectrumDigest";
     loadedSize = load(SPECTRUM_DIGEST_FILE_NAME, spectrumDigestsSizeInByte, (unsigned char*)spectrumDigests, directory);
     logToConsole(L"Loading spectrum digests");
@@ -3623,82 +3933,46 @@ static void prepareNextTickTransactions()
         
     if (numberOfKnownNextTickTransactions != numberOfNextTickTransactions)
     {
-        for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS * MAX_NUMBER_OF_PENDING_TRANSACTIONS_PER_COMPUTOR; i++)
+        // Only check pending transactions with target tick nextTick (from index) and look up their digests in
+        // the unknown digests of nextTickData
+        static TransactionDigestLookup<NUMBER_OF_TRANSACTIONS_PER_TICK> unknownTransactionDigests;
+        unknownTransactionDigests.build(nextTickData.transactionDigests, unknownTransactions);
+        const unsigned int numberOfPendingTransactionSlots = pendingTransactionIndex.getSlots(nextTick, entityPendingTransactionIndices, PendingTransactionIndex::slotCount);
+        for (unsigned int k = 0; k < numberOfPendingTransactionSlots; k++)
         {
-            Transaction* pendingTransaction = (Transaction*)&computorPendingTransactions[i * MAX_TRANSACTION_SIZE];
+            const unsigned int slot = entityPendingTransactionIndices[k];
+            const bool isComputorSlot = slot < PendingTransactionIndex::computorSlotCount;
+            const unsigned int i = isComputorSlot ? slot : slot - PendingTransactionIndex::computorSlotCount;
+            volatile char* pendingTransactionsLock = isComputorSlot ? &computorPendingTransactionsLock : &entityPendingTransactionsLock;
+            Transaction* pendingTransaction = (Transaction*)&(isComputorSlot ? computorPendingTransactions : entityPendingTransactions)[i * MAX_TRANSACTION_SIZE];
+            const m256i* pendingTransactionDigest = (const m256i*)&(isComputorSlot ? computorPendingTransactionDigests : entityPendingTransactionDigests)[i * 32ULL];
             if (pendingTransaction->tick == nextTick)
             {
-                ACQUIRE(computorPendingTransactionsLock);
+                ACQUIRE(*pendingTransactionsLock);
 
                 ASSERT(pendingTransaction->checkValidity());
-                auto* tsPendingTransactionOffsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(pendingTransaction->tick);
-                for (unsigned int j = 0; j < NUMBER_OF_TRANSACTIONS_PER_TICK; j++)
+                const int j = unknownTransactionDigests.find(*pendingTransactionDigest);
+                if (j >= 0)
                 {
-                    if (unknownTransactions[j >> 6] & (1ULL << (j & 63)))
+                    auto* tsPendingTransactionOffsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(pendingTransaction->tick);
+                    ts.tickTransactions.acquireLock();
+                    if (!tsPendingTransactionOffsets[j])
                     {
-                        if (&computorPendingTransactionDigests[i * 32ULL] == nextTickData.transactionDigests[j])
+                        const unsigned int transactionSize = pendingTransaction->totalSize();
+                        if (ts.nextTickTransactionOffset + transactionSize <= ts.tickTransactions.storageSpaceCurrentEpoch)
                         {
-                            ts.tickTransactions.acquireLock();
-                            if (!tsPendingTransactionOffsets[j])
-                            {
-                                const unsigned int transactionSize = pendingTransaction->totalSize();
-                                if (ts.nextTickTransactionOffset + transactionSize <= ts.tickTransactions.storageSpaceCurrentEpoch)
-                                {
-                                    tsPendingTransactionOffsets[j] = ts.nextTickTransactionOffset;
-                                    bs->CopyMem(ts.tickTransactions(ts.nextTickTransactionOffset), pendingTransaction, transactionSize);
-                                    ts.nextTickTransactionOffset += transactionSize;
-                                }
-                            }
-                            ts.tickTransactions.releaseLock();
-
-                            numberOfKnownNextTickTransactions++;
-                            unknownTransactions[j >> 6] &= ~(1ULL << (j & 63));
-
-                            break;
+                            tsPendingTransactionOffsets[j] = ts.nextTickTransactionOffset;
+                            bs->CopyMem(ts.tickTransactions(ts.nextTickTransactionOffset), pendingTransaction, transactionSize);
+                            ts.nextTickTransactionOffset += transactionSize;
                         }
                     }
-                }
-
-                RELEASE(computorPendingTransactionsLock);
-            }
-        }
-        for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
-        {
-            Transaction* pendingTransaction = (Transaction*)&entityPendingTransactions[i * MAX_TRANSACTION_SIZE];
-            if (pendingTransaction->tick == nextTick)
-            {
-                ACQUIRE(entityPendingTransactionsLock);
-
-                ASSERT(pendingTransaction->checkValidity());
-                auto* tsPendingTransactionOffsets = ts.tickTransactionOffsets.getByTickInCurrentEpoch(pendingTransaction->tick);
-                for (unsigned int j = 0; j < NUMBER_OF_TRANSACTIONS_PER_TICK; j++)
-                {
-                    if (unknownTransactions[j >> 6] & (1ULL << (j & 63)))
-                    {
-                        if (&entityPendingTransactionDigests[i * 32ULL] == nextTickData.transactionDigests[j])
-                        {
-                            ts.tickTransactions.acquireLock();
-                            if (!tsPendingTransactionOffsets[j])
-                            {
-                                const unsigned int transactionSize = pendingTransaction->totalSize();
-                                if (ts.nextTickTransactionOffset + transactionSize <= ts.tickTransactions.storageSpaceCurrentEpoch)
-                                {
-                                    tsPendingTransactionOffsets[j] = ts.nextTickTransactionOffset;
-                                    bs->CopyMem(ts.tickTransactions(ts.nextTickTransactionOffset), pendingTransaction, transactionSize);
-                                    ts.nextTickTransactionOffset += transactionSize;
-                                }
-                            }
-                            ts.tickTransactions.releaseLock();
+                    ts.tickTransactions.releaseLock();
 
-                            numberOfKnownNextTickTransactions++;
-                            unknownTransactions[j >> 6] &= ~(1ULL << (j & 63));
-
-                            break;
-                        }
-                    }
+                    numberOfKnownNextTickTransactions++;
+                    unknownTransactions[j >> 6] &= ~(1ULL << (j & 63));
                 }
 
-                RELEASE(entityPendingTransactionsLock);
+                RELEASE(*pendingTransactionsLock);
             }
         }
 
@@ -4209,6 +4483,13 @@ static void tickProcessor(void*)
                                         _mm_pause();
                                     }
 
+                                    // wait until the node state snapshot is saved, because the epoch transition changes whole regions
+                                    // of the snapshot (more than fits into the shadow memory) and state not covered by beforeWrite()
+                                    while (nodeStateSnapshot.isActive())
+                                    {
+                                        _mm_pause();
+                                    }
+
                                     // end current epoch
                                     endEpoch();
 
@@ -4312,6 +4593,13 @@ static void contractProcessorShutdownCallback(EFI_EVENT Event, void* Context)
     contractProcessorState = 0;
 }
 
+static void parallelContractProcessorShutdownCallback(EFI_EVENT Event, void* Context)
+{
+    bs->CloseEvent(Event);
+
+    contractProcedureScheduler.finish((unsigned int)(unsigned long long)Context);
+}
+
 // directory: source directory to load the file. Default: NULL - load from root dir /
 // forceLoadFromFile: when loading node states from file, we want to make sure it load from file and ignore constructionEpoch == system.epoch case
 static bool loadComputer(CHAR16* directory, bool forceLoadFromFile)
@@ -4373,7 +4661,8 @@ static bool saveComputer(CHAR16* directory)
         CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 7] = (contractIndex % 100) / 10 + L'0';
         CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 6] = contractIndex % 10 + L'0';
         contractStateLock[contractIndex].acquireRead();
-        long long savedSize = save(CONTRACT_FILE_NAME, contractDescriptions[contractIndex].stateSize, contractStates[contractIndex], directory);
+        long long savedSize = SAVE_COMPRESSED_STATE_FILES ? saveCompressed(CONTRACT_FILE_NAME, contractDescriptions[contractIndex].stateSize, contractStates[contractIndex], directory)
+            : save(CONTRACT_FILE_NAME, contractDescriptions[contractIndex].stateSize, contractStates[contractIndex], directory);
         contractStateLock[contractIndex].releaseRead();
         totalSize += savedSize;
         if (savedSize != contractDescriptions[contractIndex].stateSize)
@@ -4415,6 +4704,114 @@ static bool saveSystem(CHAR16* directory)
     return false;
 }
 
+// Idle processors help with parallelJob during initialize(), before efi_main() assigns their functions
+static EFI_EVENT startupHelperEvents[MAX_NUMBER_OF_PROCESSORS];
+static unsigned int numberOfStartupHelpers = 0;
+static volatile char startupHelpersShouldStop = 0;
+
+static void startupHelperProcessor(void*)
+{
+    enableAVX();
+
+    while (!startupHelpersShouldStop)
+    {
+        if (!parallelJob.tryHelp())
+        {
+            _mm_pause();
+        }
+    }
+}
+
+// Start all enabled application processors as helpers of parallelJob (file I/O stays on the main processor)
+static void startStartupHelpers()
+{
+    EFI_GUID mpServiceProtocolGuid = EFI_MP_SERVICES_PROTOCOL_GUID;
+    if (bs->LocateProtocol(&mpServiceProtocolGuid, NULL, (void**)&mpServicesProtocol))
+    {
+        return;
+    }
+    unsigned long long numberOfAllProcessors, numberOfEnabledProcessors;
+    mpServicesProtocol->GetNumberOfProcessors(mpServicesProtocol, &numberOfAllProcessors, &numberOfEnabledProcessors);
+
+    startupHelpersShouldStop = 0;
+    for (unsigned int i = 0; i < numberOfAllProcessors && numberOfStartupHelpers < MAX_NUMBER_OF_PROCESSORS; i++)
+    {
+        EFI_PROCESSOR_INFORMATION processorInformation;
+        mpServicesProtocol->GetProcessorInfo(mpServicesProtocol, i, &processorInformation);
+        if (processorInformation.StatusFlag == (PROCESSOR_ENABLED_BIT | PROCESSOR_HEALTH_STATUS_BIT)
+            && !bs->CreateEvent(0, 0, NULL, NULL, &startupHelperEvents[numberOfStartupHelpers]))
+        {
+            if (mpServicesProtocol->StartupThisAP(mpServicesProtocol, startupHelperProcessor, i, startupHelperEvents[numberOfStartupHelpers], 0, NULL, NULL))
+            {
+                bs->CloseEvent(startupHelperEvents[numberOfStartupHelpers]);
+            }
+            else
+            {
+                numberOfStartupHelpers++;
+            }
+        }
+    }
+
+    setNumber(message, numberOfStartupHelpers, TRUE);
+    appendText(message, L" processors help with computing digests during startup.");
+    logToConsole(message);
+}
+
+// Stop helpers started by startStartupHelpers() and wait until their processors are free for their functions
+static void stopStartupHelpers()
+{
+    startupHelpersShouldStop = 1;
+    for (unsigned int i = 0; i < numberOfStartupHelpers; i++)
+    {
+        while (bs->CheckEvent(startupHelperEvents[i]) == EFI_NOT_READY)
+        {
+            _mm_pause();
+        }
+        bs->CloseEvent(startupHelperEvents[i]);
+    }
+    numberOfStartupHelpers = 0;
+}
+
+// Breakdown of startup time, logged at the end of initialize()
+static constexpr unsigned int MAX_NUMBER_OF_STARTUP_PHASES = 16;
+static const CHAR16* startupPhaseNames[MAX_NUMBER_OF_STARTUP_PHASES];
+static unsigned long long startupPhaseTicks[MAX_NUMBER_OF_STARTUP_PHASES];
+static unsigned int numberOfStartupPhases = 0;
+static unsigned long long startupPhaseBeginningTick = 0;
+
+// Record duration of the startup phase that began at the end of the previous one
+static void endStartupPhase(const CHAR16* name)
+{
+    const unsigned long long now = __rdtsc();
+    if (numberOfStartupPhases < MAX_NUMBER_OF_STARTUP_PHASES)
+    {
+        startupPhaseNames[numberOfStartupPhases] = name;
+        startupPhaseTicks[numberOfStartupPhases] = now - startupPhaseBeginningTick;
+        numberOfStartupPhases++;
+    }
+    startupPhaseBeginningTick = now;
+}
+
+static void logStartupPhases()
+{
+    unsigned long long totalTicks = 0;
+    logToConsole(L"Startup phases:");
+    for (unsigned int i = 0; i < numberOfStartupPhases; i++)
+    {
+        setText(message, L"  ");
+        appendText(message, startupPhaseNames[i]);
+        appendText(message, L": ");
+        appendNumber(message, startupPhaseTicks[i] * 1000000 / frequency, TRUE);
+        appendText(message, L" microseconds");
+        logToConsole(message);
+        totalTicks += startupPhaseTicks[i];
+    }
+    setText(message, L"  total: ");
+    appendNumber(message, totalTicks * 1000000 / frequency, TRUE);
+    appendText(message, L" microseconds");
+    logToConsole(message);
+}
+
 static bool initialize()
 {
     enableAVX();
@@ -4445,6 +4842,7 @@ static bool initialize()
     getPublicKeyFromIdentity((const unsigned char*)ARBITRATOR, (unsigned char*)&arbitratorPublicKey);
 
     initTimeStampCounter();
+    startupPhaseBeginningTick = __rdtsc();
 
     bs->SetMem(&tickTicks, sizeof(tickTicks), 0);
 
@@ -4469,6 +4867,8 @@ static bool initialize()
     {
         if (!ts.init())
             return false;
+        if (!pendingTransactionIndex.init())
+            return false;
         if (status = bs->AllocatePool(EfiRuntimeServicesData, SPECTRUM_CAPACITY * MAX_TRANSACTION_SIZE, (void**)&entityPendingTransactions))
         {
             logStatusAndMemInfoToConsole(L"EFI_BOOT_SERVICES.AllocatePool() fails", status, __LINE__, SPECTRUM_CAPACITY * MAX_TRANSACTION_SIZE);
@@ -4491,8 +4891,6 @@ static bool initialize()
 
             return false;
         }
-        bs->SetMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), 0);
-
         if (!initSpectrum())
             return false;
 
@@ -4543,6 +4941,8 @@ static bool initialize()
         }
 #endif
 
+        endStartupPhase(L"allocating state memory");
+
         logToConsole(L"Loading system file ...");
         bs->SetMem(&system, sizeof(system), 0);
         load(SYSTEM_FILE_NAME, sizeof(system), (unsigned char*)&system);
@@ -4558,9 +4958,16 @@ static bool initialize()
         }
         system.tick = system.initialTick;
 
+        if (system.epoch >= PAGED_CONTRACT_STATE_DIGEST_EPOCH)
+        {
+            initContractStatePagedDigests();
+        }
+
         beginEpoch();
+        endStartupPhase(L"loading system file");
 #if TICK_STORAGE_AUTOSAVE_MODE
         bool canLoadFromFile = loadAllNodeStates();
+        endStartupPhase(L"loading node state snapshot");
 #else
         bool canLoadFromFile = false;
 #endif
@@ -4578,37 +4985,34 @@ static bool initialize()
             etalonTick.month = system.initialMonth;
             etalonTick.year = system.initialYear;
 
-            loadSpectrum();
-            {
-                const unsigned long long beginningTick = __rdtsc();
+            // File I/O is only possible on the main processor, so the files are loaded one after another. The digests of
+            // each file are computed by the other processors while the main processor loads the next file.
+            startStartupHelpers();
 
-                unsigned int digestIndex;
-                for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
-                {
-                    KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
-                }
-                unsigned int previousLevelBeginning = 0;
-                unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-                while (numberOfLeafs > 1)
-                {
-                    for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-                    {
-                        KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex++]);
-                    }
+            loadSpectrum();
+            endStartupPhase(L"loading spectrum file");
+            const unsigned long long spectrumHashingBeginningTick = __rdtsc();
+            startComputingSpectrumDigests();
 
-                    previousLevelBeginning += numberOfLeafs;
-                    numberOfLeafs >>= 1;
-                }
+            logToConsole(L"Loading universe file ...");
+            if (!loadUniverse())
+            {
+                finishComputingSpectrumDigests();
+                return false;
+            }
+            endStartupPhase(L"loading universe file");
+            {
+                finishComputingSpectrumDigests();
+                endStartupPhase(L"waiting for spectrum digests");
 
                 setNumber(message, SPECTRUM_CAPACITY * sizeof(::Entity), TRUE);
                 appendText(message, L" bytes of the spectrum data are hashed (");
-                appendNumber(message, (__rdtsc() - beginningTick) * 1000000 / frequency, TRUE);
-                appendText(message, L" microseconds).");
+                appendNumber(message, (__rdtsc() - spectrumHashingBeginningTick) * 1000000 / frequency, TRUE);
+                appendText(message, L" microseconds, partially while loading the universe).");
                 logToConsole(message);
 
                 CHAR16 digestChars[60 + 1];
                 getIdentity((unsigned char*)&spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1], digestChars, true);
-                updateSpectrumInfo();
 
                 setNumber(message, spectrumInfo.totalAmount, TRUE);
                 appendText(message, L" qus in ");
@@ -4618,24 +5022,27 @@ static bool initialize()
                 appendText(message, L").");
                 logToConsole(message);
             }
-            logToConsole(L"Loading universe file ...");
-            if (!loadUniverse())
-                return false;
+            startComputingUniverseDigests();
+
+            loadComputer();
+            endStartupPhase(L"loading contract files");
             m256i universeDigest;
             {
                 setText(message, L"Universe digest = ");
-                getUniverseDigest(universeDigest);
+                finishComputingUniverseDigests(universeDigest);
+                endStartupPhase(L"waiting for universe digests");
                 CHAR16 digestChars[60 + 1];
                 getIdentity(universeDigest.m256i_u8, digestChars, true);
                 appendText(message, digestChars);
                 appendText(message, L".");
                 logToConsole(message);
             }
-            loadComputer();
             m256i computerDigest;
             {
                 setText(message, L"Computer digest = ");
-                getComputerDigest(computerDigest);
+                parallelJob.run(computeContractStateDigestTask, nullptr, contractCount);
+                getComputerDigest(computerDigest, true);
+                endStartupPhase(L"computing computer digest");
                 CHAR16 digestChars[60 + 1];
                 getIdentity(computerDigest.m256i_u8, digestChars, true);
                 appendText(message, digestChars);
@@ -4643,6 +5050,8 @@ static bool initialize()
                 logToConsole(message);
             }
 
+            stopStartupHelpers();
+
             // initialize salted digests of etalonTick, otherwise F2 key would output invalid digests
             // before ticking begins
             etalonTick.saltedSpectrumDigest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
@@ -4657,6 +5066,7 @@ static bool initialize()
     }
 
     initializeContracts();
+    endStartupPhase(L"initializing contracts");
 
     if (loadMiningSeedFromFile)
     {
@@ -4668,17 +5078,28 @@ static bool initialize()
         setNewMiningSeed();
     }    
     score->loadScoreCache(system.epoch);
+    endStartupPhase(L"loading score cache");
 
     logToConsole(L"Allocating buffers ...");
-    if ((status = bs->AllocatePool(EfiRuntimeServicesData, 536870912, (void**)&dejavu0))
-        || (status = bs->AllocatePool(EfiRuntimeServicesData, 536870912, (void**)&dejavu1)))
+    if (!dejavuFilter.init(DEJAVU_FILTER_CAPACITY, DEJAVU_SWAP_LIMIT))
     {
-        logStatusAndMemInfoToConsole(L"EFI_BOOT_SERVICES.AllocatePool() fails", status, __LINE__, 536870912);
+        return false;
+    }
 
+#if TICK_STORAGE_AUTOSAVE_MODE
+    // Page states for all regions of the node state snapshot (see beginNodeStateSnapshot()), 1 extra page per region
+    // for partial pages at the end
+    unsigned long long nodeStateSnapshotPageCount = (spectrumSizeInBytes + spectrumDigestsSizeInByte + ASSETS_CAPACITY * sizeof(Asset)
+        + assetDigestsSizeInBytes + NUMBER_OF_MINER_SOLUTION_FLAGS / 8) / CopyOnWriteSnapshot::pageSize + 5;
+    for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
+    {
+        nodeStateSnapshotPageCount += contractDescriptions[contractIndex].stateSize / CopyOnWriteSnapshot::pageSize + 1;
+    }
+    if (!nodeStateSnapshot.init(nodeStateSnapshotPageCount, NODE_STATE_SNAPSHOT_SHADOW_MEMORY_SIZE / CopyOnWriteSnapshot::pageSize))
+    {
         return false;
     }
-    bs->SetMem((void*)dejavu0, 536870912, 0);
-    bs->SetMem((void*)dejavu1, 536870912, 0);
+#endif
 
     if (status = bs->AllocatePool(EfiRuntimeServicesData, REQUEST_QUEUE_BUFFER_SIZE, (void**)&requestQueueBuffer))
     {
@@ -4691,6 +5112,12 @@ static bool initialize()
 
         return false;
     }
+    unsigned int requestQueueLaneBufferOffset = 0;
+    for (unsigned int lane = 0; lane < NUMBER_OF_REQUEST_QUEUE_LANES; lane++)
+    {
+        requestQueueLanes[lane].init(requestQueueBuffer + requestQueueLaneBufferOffset, requestQueueLaneBufferSizes[lane], BUFFER_SIZE);
+        requestQueueLaneBufferOffset += requestQueueLaneBufferSizes[lane];
+    }
 
     for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
     {
@@ -4756,12 +5183,17 @@ static bool initialize()
     emptyTickResolver.clock = 0;
     emptyTickResolver.tick = 0;
     emptyTickResolver.lastTryClock = 0;
+    endStartupPhase(L"allocating buffers and network");
+    logStartupPhases();
     
     return true;
 }
 
 static void deinitialize()
 {
+    // Helpers may still run if initialize() failed
+    stopStartupHelpers();
+
     deinitTcp4();
 
     bs->SetMem(computorSeeds, sizeof(computorSeeds), 0);
@@ -4794,6 +5226,7 @@ static void deinitialize()
         {
             bs->FreePool(contractStates[contractIndex]);
         }
+        contractStatePagedDigests[contractIndex].deinit();
     }
 
     if (computorPendingTransactionDigests)
@@ -4813,6 +5246,7 @@ static void deinitialize()
         bs->FreePool(entityPendingTransactions);
     }
     ts.deinit();
+    pendingTransactionIndex.deinit();
 
     if (score)
     {
@@ -4823,14 +5257,10 @@ static void deinitialize()
         bs->FreePool(minerSolutionFlags);
     }
 
-    if (dejavu0)
-    {
-        bs->FreePool((void*)dejavu0);
-    }
-    if (dejavu1)
-    {
-        bs->FreePool((void*)dejavu1);
-    }
+    dejavuFilter.deinit();
+#if TICK_STORAGE_AUTOSAVE_MODE
+    nodeStateSnapshot.deinit();
+#endif
 
     if (requestQueueBuffer)
     {
@@ -4979,21 +5409,7 @@ static void logInfo()
     }
     logToConsole(message);
 
-    unsigned int numberOfPendingTransactions = 0;
-    for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS * MAX_NUMBER_OF_PENDING_TRANSACTIONS_PER_COMPUTOR; i++)
-    {
-        if (((Transaction*)&computorPendingTransactions[i * MAX_TRANSACTION_SIZE])->tick > system.tick)
-        {
-            numberOfPendingTransactions++;
-        }
-    }
-    for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
-    {
-        if (((Transaction*)&entityPendingTransactions[i * MAX_TRANSACTION_SIZE])->tick > system.tick)
-        {
-            numberOfPendingTransactions++;
-        }
-    }
+    const unsigned long long numberOfPendingTransactions = pendingTransactionIndex.countFromTick(system.tick + 1);
     if (nextTickTransactionsSemaphore)
     {
         setText(message, L"?");
@@ -5043,9 +5459,13 @@ static void logInfo()
     appendText(message, L" pending transactions.");
     logToConsole(message);
 
-    unsigned int filledRequestQueueBufferSize = (requestQueueBufferHead >= requestQueueBufferTail) ? (requestQueueBufferHead - requestQueueBufferTail) : (REQUEST_QUEUE_BUFFER_SIZE - (requestQueueBufferTail - requestQueueBufferHead));
+    unsigned int filledRequestQueueBufferSize = 0, filledRequestQueueLength = 0;
+    for (unsigned int lane = 0; lane < NUMBER_OF_REQUEST_QUEUE_LANES; lane++)
+    {
+        filledRequestQueueBufferSize += requestQueueLanes[lane].bufferUsage();
+        filledRequestQueueLength += requestQueueLanes[lane].depth();
+    }
     unsigned int filledResponseQueueBufferSize = (responseQueueBufferHead >= responseQueueBufferTail) ? (responseQueueBufferHead - responseQueueBufferTail) : (RESPONSE_QUEUE_BUFFER_SIZE - (responseQueueBufferTail - responseQueueBufferHead));
-    unsigned int filledRequestQueueLength = (requestQueueElementHead >= requestQueueElementTail) ? (requestQueueElementHead - requestQueueElementTail) : (REQUEST_QUEUE_LENGTH - (requestQueueElementTail - requestQueueElementHead));
     unsigned int filledResponseQueueLength = (responseQueueElementHead >= responseQueueElementTail) ? (responseQueueElementHead - responseQueueElementTail) : (RESPONSE_QUEUE_LENGTH - (responseQueueElementTail - responseQueueElementHead));
     setNumber(message, filledRequestQueueBufferSize, TRUE);
     appendText(message, L" (");
@@ -5067,9 +5487,43 @@ static void logInfo()
     appendNumber(message, contractTotalExecutionTicks[QX_CONTRACT_INDEX] * 1000 / frequency, TRUE);
     appendText(message, L" ms | Solution process time = ");
     appendNumber(message, solutionTotalExecutionTicks * 1000 / frequency, TRUE);
-    appendText(message, L" ms | Spectrum reorg time = ");
+    appendText(message, L" ms (");
+    appendNumber(message, score->getNumberOfStolenTasks(), TRUE);
+    appendText(message, L" stolen, ");
+    appendNumber(message, score->getNumberOfDroppedTasks(), TRUE);
+    appendText(message, L" dropped tasks) | Spectrum reorg time = ");
     appendNumber(message, spectrumReorgTotalExecutionTicks * 1000 / frequency, TRUE);
-    appendText(message, L" ms.");
+    appendText(message, L" ms | Spectrum digest update time = ");
+    appendNumber(message, spectrumDigestUpdateTotalExecutionTicks * 1000 / frequency, TRUE);
+    appendText(message, L" ms (");
+    appendNumber(message, spectrumDigestUpdateFullScanCount, TRUE);
+    appendText(message, L" full scans).");
+    logToConsole(message);
+
+    setText(message, L"Request queue lanes: ");
+    const CHAR16* requestQueueLaneNames[NUMBER_OF_REQUEST_QUEUE_LANES] = { L"consensus ", L" | transaction ", L" | query " };
+    for (unsigned int lane = 0; lane < NUMBER_OF_REQUEST_QUEUE_LANES; lane++)
+    {
+        appendText(message, requestQueueLaneNames[lane]);
+        appendNumber(message, requestQueueLanes[lane].depth(), TRUE);
+        appendText(message, L" queued (");
+        appendNumber(message, requestQueueLanes[lane].getNumberOfEnqueuedRequests(), TRUE);
+        appendText(message, L" enqueued, ");
+        appendNumber(message, requestQueueLanes[lane].getNumberOfDroppedRequests(), TRUE);
+        appendText(message, L" dropped)");
+    }
+    appendText(message, L".");
+    logToConsole(message);
+
+    setText(message, L"Dejavu filter: generation ");
+    appendNumber(message, dejavuFilter.getGeneration(), TRUE);
+    appendText(message, L" | ");
+    appendNumber(message, dejavuFilter.getNumberOfInsertions(), TRUE);
+    appendText(message, L" insertions (");
+    appendNumber(message, dejavuFilter.getNumberOfEvictions(), TRUE);
+    appendText(message, L" evictions) | Expected false positives per billion = ");
+    appendNumber(message, dejavuFilter.getExpectedFalsePositivesPerBillion(), TRUE);
+    appendText(message, L".");
     logToConsole(message);
 }
 
@@ -5117,6 +5571,56 @@ static void logHealthStatus()
     }
     logToConsole(message);
 
+    // Print status of signature pre-verification stage
+    unsigned int preVerificationQueueDepth = 0, queuedRequests = 0;
+    long long numberOfPreVerifiedRequests = 0, numberOfInvalidRequests = 0, numberOfUsedResults = 0, numberOfPreVerificationWaits = 0;
+    long long preVerificationTicks = 0, preVerificationWaitTicks = 0;
+    for (unsigned int lane = 0; lane < NUMBER_OF_REQUEST_QUEUE_LANES; lane++)
+    {
+        const SignaturePreVerifier& preVerifier = signaturePreVerifiers[lane];
+        const unsigned int requestQueueTail = (unsigned int)requestQueueLanes[lane].tail(), requestQueueHead = (unsigned int)requestQueueLanes[lane].head();
+        preVerificationQueueDepth += preVerifier.queueDepth(requestQueueTail, requestQueueHead);
+        queuedRequests += (unsigned short)(requestQueueHead - requestQueueTail);
+        numberOfPreVerifiedRequests += preVerifier.getNumberOfVerifiedRequests();
+        numberOfInvalidRequests += preVerifier.getNumberOfInvalidRequests();
+        numberOfUsedResults += preVerifier.getNumberOfUsedResults();
+        numberOfPreVerificationWaits += preVerifier.getNumberOfWaits();
+        preVerificationTicks += preVerifier.getVerificationTicks();
+        preVerificationWaitTicks += preVerifier.getWaitTicks();
+    }
+    setText(message, L"Signature pre-verification: queue depth ");
+    appendNumber(message, preVerificationQueueDepth, TRUE);
+    appendText(message, L" of ");
+    appendNumber(message, queuedRequests, TRUE);
+    appendText(message, L" queued requests | ");
+    appendNumber(message, numberOfPreVerifiedRequests, TRUE);
+    appendText(message, L" verified (");
+    appendNumber(message, numberOfInvalidRequests, TRUE);
+    appendText(message, L" invalid, ");
+    appendNumber(message, numberOfUsedResults, TRUE);
+    appendText(message, L" used by handlers) | Average verification latency = ");
+    if (numberOfPreVerifiedRequests)
+    {
+        appendNumber(message, preVerificationTicks / numberOfPreVerifiedRequests * 1000000 / frequency, TRUE);
+    }
+    else
+    {
+        appendText(message, L"?");
+    }
+    appendText(message, L" mcs | ");
+    appendNumber(message, numberOfPreVerificationWaits, TRUE);
+    appendText(message, L" processor waits (average ");
+    if (numberOfPreVerificationWaits)
+    {
+        appendNumber(message, preVerificationWaitTicks / numberOfPreVerificationWaits * 1000000 / frequency, TRUE);
+    }
+    else
+    {
+        appendText(message, L"?");
+    }
+    appendText(message, L" mcs).");
+    logToConsole(message);
+
     // Print used function call stack size
     setText(message, L"Function call stack usage: ");
     unsigned int maxStackUsageTick = 0;
@@ -5213,6 +5717,30 @@ static void logHealthStatus()
     appendText(message, L" | max processors waiting ");
     appendNumber(message, contractLocalsStackLockWaitingCountMax, TRUE);
     logToConsole(message);
+
+    setText(message, L"Parallel contract procedure invocations: ");
+    appendNumber(message, contractProcedureScheduler.getNumberOfParallelInvocations(), TRUE);
+    appendText(message, L" in ");
+    appendNumber(message, contractProcedureScheduler.getSlotCount(), TRUE);
+    appendText(message, L" processors (max ");
+    appendNumber(message, contractProcedureScheduler.getMaxRunningInvocations(), TRUE);
+    appendText(message, L" at once) | waits for completion ");
+    appendNumber(message, contractProcedureScheduler.getNumberOfWaits(), TRUE);
+    appendText(message, L" (");
+    appendNumber(message, contractProcedureScheduler.getWaitTicks() * 1000 / frequency, TRUE);
+    appendText(message, L" ms)");
+    logToConsole(message);
+
+    setText(message, L"Contract processor phases: ");
+    appendNumber(message, numberOfInlineContractProcessorPhases, TRUE);
+    appendText(message, L" run inline (avg ");
+    appendNumber(message, numberOfInlineContractProcessorPhases ? inlineContractProcessorPhaseTicks * 1000000 / frequency / numberOfInlineContractProcessorPhases : 0, TRUE);
+    appendText(message, L" mcs) | ");
+    appendNumber(message, numberOfHandedOffContractProcessorPhases, TRUE);
+    appendText(message, L" handed off to contract processor (avg handoff overhead ");
+    appendNumber(message, numberOfHandedOffContractProcessorPhases ? contractProcessorHandoffTicks * 1000000 / frequency / numberOfHandedOffContractProcessorPhases : 0, TRUE);
+    appendText(message, L" mcs)");
+    logToConsole(message);
 }
 
 static void processKeyPresses()
@@ -5366,6 +5894,25 @@ static void processKeyPresses()
             appendNumber(message, QPI::div(K12MeasurementsSum, K12MeasurementsCount), TRUE);
             appendText(message, L" ticks.");
             logToConsole(message);
+
+            if (system.epoch >= PAGED_CONTRACT_STATE_DIGEST_EPOCH)
+            {
+                unsigned long long pageCount = 0, rehashedPages = 0, updates = 0;
+                for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
+                {
+                    pageCount += contractStatePagedDigests[contractIndex].getPageCount();
+                    rehashedPages += contractStatePagedDigests[contractIndex].getNumberOfRehashedPages();
+                    updates += contractStatePagedDigests[contractIndex].getNumberOfUpdates();
+                }
+                setText(message, L"Paged contract state digests: ");
+                appendNumber(message, rehashedPages, TRUE);
+                appendText(message, L" pages rehashed in ");
+                appendNumber(message, updates, TRUE);
+                appendText(message, L" digest computations (");
+                appendNumber(message, pageCount, TRUE);
+                appendText(message, L" pages in total).");
+                logToConsole(message);
+            }
         }
         break;
 
@@ -5425,6 +5972,7 @@ static void processKeyPresses()
         * F6 Key
         * By Pressing the F6 Key the current state of Qubic is saved to the disk.
         * The files generated will be appended by .000
+        * With SAVE_STATE_DELTA_FILES, spectrum and universe may be saved as deltas of the .000 files
         */
         case 0x10:
         {
@@ -5443,6 +5991,9 @@ static void processKeyPresses()
             CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 3] = L'0';
             CONTRACT_FILE_NAME[sizeof(CONTRACT_FILE_NAME) / sizeof(CONTRACT_FILE_NAME[0]) - 2] = L'0';
             saveComputer();
+#if SAVE_STATE_DELTA_FILES
+            logToConsole(L"Spectrum and universe files are only complete with their delta files (*.delta, *.delta.001, ...).");
+#endif
         }
         break;
 
@@ -5466,7 +6017,14 @@ static void processKeyPresses()
         case 0x12:
         {
             logToConsole(L"Pressed F8 key");
-            requestPersistingNodeState = 1;
+            if (nodeStateSnapshot.isActive())
+            {
+                logToConsole(L"Node state is still being saved, try again later.");
+            }
+            else
+            {
+                requestPersistingNodeState = 1;
+            }
         }
         break;
 
@@ -5615,6 +6173,15 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                     computingProcessorNumber = numberOfProcessors;
                     contractProcessorIDs[nContractProcessorIDs++] = i;
                 }
+                else if (numberOfProcessors > 2 && numberOfProcessors <= 2 + NUMBER_OF_PARALLEL_CONTRACT_PROCESSORS)
+                {
+                    // Parallel contract processors are started by main loop when contractProcedureScheduler requests
+                    const unsigned long long slot = numberOfProcessors - 3;
+                    processors[numberOfProcessors].type = Processor::ContractProcessor;
+                    processors[numberOfProcessors].setupFunction(parallelContractProcessor, (void*)slot);
+                    parallelContractProcessorNumbers[slot] = numberOfProcessors;
+                    contractProcessorIDs[nContractProcessorIDs++] = i;
+                }
                 else
                 {
                     if (numberOfProcessors == 1)
@@ -5687,6 +6254,22 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
             }
             logToConsole(message);
 
+            setText(message, L"Contract processors: ");
+            for (int i = 0; i < nContractProcessorIDs; i++)
+            {
+                appendText(message, L"Processor #");
+                appendNumber(message, contractProcessorIDs[i], false);
+                if (i != nContractProcessorIDs - 1) appendText(message, L" | ");
+            }
+            logToConsole(message);
+
+            // First contract processor runs all contract code that is not run in parallel
+            contractProcedureScheduler.init(nContractProcessorIDs - 1);
+            for (unsigned int i = 0; i < sizeof(isolatedContractIndices) / sizeof(isolatedContractIndices[0]); i++)
+            {
+                contractProcedureScheduler.setIsolated(isolatedContractIndices[i]);
+            }
+
             if (NUMBER_OF_SOLUTION_PROCESSORS * 2 > numberOfProcessors)
             {
                 logToConsole(L"WARNING: NUMBER_OF_SOLUTION_PROCESSORS should not be greater than half of the total processor number!");
@@ -5747,6 +6330,15 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                     bs->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_NOTIFY, contractProcessorShutdownCallback, NULL, &contractProcessorEvent);
                     mpServicesProtocol->StartupThisAP(mpServicesProtocol, Processor::runFunction, contractProcessorIDs[0], contractProcessorEvent, MAX_CONTRACT_ITERATION_DURATION * 1000, &processors[computingProcessorNumber], NULL);
                 }
+                for (unsigned int slot = 0; slot < contractProcedureScheduler.getSlotCount(); slot++)
+                {
+                    if (contractProcedureScheduler.getState(slot) == contractProcedureScheduler.REQUESTED)
+                    {
+                        contractProcedureScheduler.setRunning(slot);
+                        bs->CreateEvent(EVT_NOTIFY_SIGNAL, TPL_NOTIFY, parallelContractProcessorShutdownCallback, (void*)(unsigned long long)slot, &parallelContractProcessorEvents[slot]);
+                        mpServicesProtocol->StartupThisAP(mpServicesProtocol, Processor::runFunction, contractProcessorIDs[1 + slot], parallelContractProcessorEvents[slot], MAX_CONTRACT_ITERATION_DURATION * 1000, &processors[parallelContractProcessorNumbers[slot]], NULL);
+                    }
+                }
                 /*if (!computationProcessorState && (computation || __computation))
                 {
                     numberOfAllSCs++;
@@ -5967,6 +6559,10 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                     saveComputer();
                     computerMustBeSaved = false;
                 }
+                if (system.epoch >= PAGED_CONTRACT_STATE_DIGEST_EPOCH && !contractStatePagedDigestsInitialized)
+                {
+                    initContractStatePagedDigests();
+                }
 
                 if (forceRefreshPeerList)
                 {
@@ -5995,8 +6591,9 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                     // AUX mode
                     if (system.tick > ts.getPreloadTick()) // check the last saved tick
                     {
-                        // Start auto save if nextAutoSaveTick == system.tick (or if the main loop has missed nextAutoSaveTick)
-                        if (system.tick >= nextPersistingNodeStateTick)
+                        // Start auto save if nextAutoSaveTick == system.tick (or if the main loop has missed nextAutoSaveTick),
+                        // postponed while the previous node state is still being written
+                        if (system.tick >= nextPersistingNodeStateTick && !nodeStateSnapshot.isActive())
                         {
                             requestPersistingNodeState = 1;
                             while (system.tick >= nextPersistingNodeStateTick)
@@ -6007,19 +6604,52 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
                         }
                     }
                 }
-                if (requestPersistingNodeState == 1 && persistingNodeStateTickProcWaiting == 1)
+                if (requestPersistingNodeState == 1 && persistingNodeStateTickProcWaiting == 1 && !nodeStateSnapshot.isActive())
                 {
-                    // Saving node state takes a lot of time -> Close peer connections before to signal that
-                    // the peers should connect to another node.
-                    for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
+                    logToConsole(L"Saving node state...");
+                    const bool snapshotTaken = beginNodeStateSnapshot();
+
+                    // Tick processor continues while the snapshot is written (changes are copied on write)
+                    requestPersistingNodeState = 0;
+                    if (!snapshotTaken || !beginSavingAllNodeStates())
                     {
-                        closePeer(&peers[i]);
+                        nodeStateSnapshot.deactivate();
                     }
+                }
+                if (nodeStateSnapshot.isActive() && epochTransitionState)
+                {
+                    // Abort saving, because the epoch transition waits for the snapshot to be inactive and changes the
+                    // tick storage. The node state files stay invalid (see invalidateNodeStates()).
+                    logToConsole(L"Saving node state is aborted because of the epoch transition.");
+                    nodeStateFileWriter.reset();
+                    nodeStateSnapshot.deactivate();
+                }
+                if (nodeStateSnapshot.isActive())
+                {
+                    // Write large files in steps, so peers are serviced in the main loop iterations in between
+                    nodeStateFileWriter.step(frequency * NODE_STATE_WRITING_STEP_DURATION / 1000);
+                    if (!nodeStateFileWriter.isBusy())
+                    {
+                        // Saving the tick storage takes a lot of time -> Close peer connections before to signal
+                        // that the peers should connect to another node.
+                        for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
+                        {
+                            closePeer(&peers[i]);
+                        }
 
-                    logToConsole(L"Saving node state...");
-                    saveAllNodeStates();
-                    requestPersistingNodeState = 0;
-                    logToConsole(L"Complete saving all node states");
+                        if (finishSavingAllNodeStates())
+                        {
+                            setText(message, L"Complete saving all node states (");
+                            appendNumber(message, nodeStateSnapshot.getNumberOfCopiedPages(), TRUE);
+                            appendText(message, L" of ");
+                            appendNumber(message, nodeStateSnapshot.getNumberOfPages(), TRUE);
+                            appendText(message, L" pages copied on write, ");
+                            appendNumber(message, nodeStateSnapshot.getNumberOfWaits(), TRUE);
+                            appendText(message, L" waits).");
+                            logToConsole(message);
+                        }
+                        nodeStateSnapshot.deactivate();
+                    }
                 }
                 if (nextAutoSaveTickUpdated)
                 {
@@ -6096,6 +6726,12 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
 #endif
             }
 
+#if TICK_STORAGE_AUTOSAVE_MODE
+            // Node state that is still being written stays invalid (see invalidateNodeStates())
+            nodeStateFileWriter.reset();
+            nodeStateSnapshot.deactivate();
+#endif
+
             saveSystem();
             score->saveScoreCache(system.epoch);
 
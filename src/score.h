@@ -33,9 +33,7 @@ struct ScoreFunction
     static constexpr unsigned long long synapseSignsCount = (dataLength + numberOfHiddenNeurons + dataLength) * numberOfNeighborNeurons / 64;
     static constexpr unsigned long long synapseInputCount = synapseSignsCount + maxDuration;
 
-    static constexpr const unsigned char candidateSkipTickMaskBits = 2;
-    static constexpr const unsigned char skippedTickMaskBits = 1;
-    static constexpr const unsigned char clearSkippedTickMaskBits = ~skippedTickMaskBits;
+    static constexpr unsigned long long candidateSkipTicksCount = numberOfOptimizationSteps - 1;
 
     static_assert(allNeuronsCount < 0xFFFFFFFF, "Current implementation only support MAX_UINT32 neuron");
     static_assert(numberOfNeighborNeurons < 0x7FFFFFFF, "Current implementation only support MAX_UINT32 number of neighbors");
@@ -165,14 +163,25 @@ struct ScoreFunction
         // Save skipped ticks
         long long* _skipTicks;
 
-        // Map of skipped ticks
-        unsigned char * _skipTicksMap;
+        // Candidate skip ticks in ascending order and position of each entry of _skipTicks in this order.
+        // The per candidate data below is indexed by the position in ascending order.
+        long long _sortedSkipTicks[numberOfOptimizationSteps];
+        unsigned int _sortedSkipTickPositions[numberOfOptimizationSteps];
 
-        // Contained all ticks possible value
-        long long* _ticksNumbers;
+        // Positions of the tick numbers replaced while choosing the skip ticks and their new values
+        long long _replacedTickPositions[numberOfOptimizationSteps];
+        long long _replacedTickNumbers[numberOfOptimizationSteps];
 
-        unsigned char* _prvCachedNeurons;
-        unsigned char* _curCachedNeurons;
+        // Flag if candidate tick is skipped
+        unsigned char _skippedTicks[numberOfOptimizationSteps];
+
+        // Flag if candidate tick did not change the neuron value, in the last accepted run and in the current run
+        unsigned char _prvCachedNeurons[numberOfOptimizationSteps];
+        unsigned char _curCachedNeurons[numberOfOptimizationSteps];
+
+        // Neuron values before processing each candidate tick, in the last accepted run and in the current run
+        char _prvNeuronSnapshots[numberOfOptimizationSteps][allNeuronsCount];
+        char _curNeuronSnapshots[numberOfOptimizationSteps][allNeuronsCount];
 
     } *_computeBuffer = nullptr;
     m256i currentRandomSeed;
@@ -232,18 +241,6 @@ struct ScoreFunction
                     _computeBuffer[i]._skipTicks = nullptr;
                 }
 
-                if (_computeBuffer[i]._ticksNumbers)
-                {
-                    freePool(_computeBuffer[i]._ticksNumbers);
-                    _computeBuffer[i]._ticksNumbers = nullptr;
-                }
-
-                if (_computeBuffer[i]._skipTicksMap)
-                {
-                    freePool(_computeBuffer[i]._skipTicksMap);
-                    _computeBuffer[i]._skipTicksMap = nullptr;
-                }
-
                 if (_computeBuffer[i]._poolSynapseTickData)
                 {
                     freePool(_computeBuffer[i]._poolSynapseTickData);
@@ -255,18 +252,6 @@ struct ScoreFunction
                     freePool(_computeBuffer[i]._poolSynapseData);
                     _computeBuffer[i]._poolSynapseData = nullptr;
                 }
-
-                if (_computeBuffer[i]._prvCachedNeurons)
-                {
-                    freePool(_computeBuffer[i]._prvCachedNeurons);
-                    _computeBuffer[i]._prvCachedNeurons = nullptr;
-                }
-
-                if (_computeBuffer[i]._curCachedNeurons)
-                {
-                    freePool(_computeBuffer[i]._curCachedNeurons);
-                    _computeBuffer[i]._curCachedNeurons = nullptr;
-                }
             }
 
             freePool(_computeBuffer);
@@ -323,30 +308,6 @@ struct ScoreFunction
                     logToConsole(L"Failed to allocate memory for skip ticks buffer!");
                     return false;
                 }
-
-                if (!allocatePool(maxDuration * sizeof(long long), (void**)&(cb._ticksNumbers)))
-                {
-                    logToConsole(L"Failed to allocate memory for ticks number buffer!");
-                    return false;
-                }
-
-                if (!allocatePool(maxDuration, (void**)&(cb._skipTicksMap)))
-                {
-                    logToConsole(L"Failed to allocate memory for ticks map buffer!");
-                    return false;
-                }
-
-                if (!allocatePool(maxDuration, (void**)&(cb._prvCachedNeurons)))
-                {
-                    logToConsole(L"Failed to allocate memory for prev cached neurons!");
-                    return false;
-                }
-
-                if (!allocatePool(maxDuration, (void**)&(cb._curCachedNeurons)))
-                {
-                    logToConsole(L"Failed to allocate memory for cur cached neurons!");
-                    return false;
-                }
             }
         }
 
@@ -355,11 +316,7 @@ struct ScoreFunction
             setMem(_computeBuffer[i]._poolSynapseData, sizeof(_computeBuffer[i]._poolSynapseData[0]) * RANDOM2_POOL_SIZE, 0);
             setMem(_computeBuffer[i]._poolSynapseTickData, sizeof(_computeBuffer[i]._poolSynapseTickData[0]) * maxDuration, 0);
             setMem(_computeBuffer[i]._neurons.input, sizeof(_computeBuffer[i]._neurons.input[0]) * allNeuronsCount, 0);
-            setMem(_computeBuffer[i]._ticksNumbers, sizeof(_computeBuffer[i]._ticksNumbers[0]) * maxDuration, 0);
             setMem(_computeBuffer[i]._skipTicks, sizeof(_computeBuffer[i]._skipTicks[0]) * numberOfOptimizationSteps, 0);
-            setMem(_computeBuffer[i]._skipTicksMap, sizeof(_computeBuffer[i]._skipTicksMap[0]) * maxDuration, 0);
-            setMem(_computeBuffer[i]._prvCachedNeurons, sizeof(_computeBuffer[i]._prvCachedNeurons[0]) * maxDuration, 0);
-            setMem(_computeBuffer[i]._curCachedNeurons, sizeof(_computeBuffer[i]._curCachedNeurons[0]) * maxDuration, 0);
             solutionEngineLock[i] = 0;
         }
 
@@ -467,8 +424,54 @@ struct ScoreFunction
             pPoolSynapseData[i].supplierIndexWithSign = ((unsigned int)supplierNeuronIndex << 1) | isPositive;
         }
 
+        // Gather the synapse data of all ticks. The random sequence is split into interleaved lanes, which are
+        // advanced independently by jumping over the values of the other lanes.
+#if defined (__AVX512F__)
+        constexpr unsigned int laneCount = 16;
+#else
+        constexpr unsigned int laneCount = 8;
+#endif
         unsigned int random2XVal = randomXNeuronStart;
-        for (long long tick = 0; tick < maxDuration; tick++)
+        unsigned int laneStartValues[laneCount];
+        unsigned int laneMultiplier = 1, laneIncrement = 0;
+        for (unsigned int lane = 0; lane < laneCount; lane++)
+        {
+            laneStartValues[lane] = random2XVal;
+            random2XVal = random2XVal * 1664525 + 1013904223;
+            laneMultiplier = laneMultiplier * 1664525;
+            laneIncrement = laneIncrement * 1664525 + 1013904223;
+        }
+
+        const long long vectorizedTicks = maxDuration - maxDuration % laneCount;
+        const long long* poolData = (const long long*)pPoolSynapseData;
+#if defined (__AVX512F__)
+        __m512i x = _mm512_loadu_si512(laneStartValues);
+        const __m512i multiplier = _mm512_set1_epi32(laneMultiplier);
+        const __m512i increment = _mm512_set1_epi32(laneIncrement);
+        const __m512i poolMask = _mm512_set1_epi32(RANDOM2_POOL_ACTUAL_SIZE - 1);
+        for (long long tick = 0; tick < vectorizedTicks; tick += laneCount)
+        {
+            const __m512i poolIdx = _mm512_and_si512(x, poolMask);
+            _mm512_storeu_si512(&pPoolSynapseTick[tick], _mm512_i32gather_epi64(_mm512_castsi512_si256(poolIdx), poolData, 8));
+            _mm512_storeu_si512(&pPoolSynapseTick[tick + 8], _mm512_i32gather_epi64(_mm512_extracti64x4_epi64(poolIdx, 1), poolData, 8));
+            x = _mm512_add_epi32(_mm512_mullo_epi32(x, multiplier), increment);
+        }
+        random2XVal = _mm_cvtsi128_si32(_mm512_castsi512_si128(x));
+#else
+        __m256i x = _mm256_loadu_si256((const __m256i*)laneStartValues);
+        const __m256i multiplier = _mm256_set1_epi32(laneMultiplier);
+        const __m256i increment = _mm256_set1_epi32(laneIncrement);
+        const __m256i poolMask = _mm256_set1_epi32(RANDOM2_POOL_ACTUAL_SIZE - 1);
+        for (long long tick = 0; tick < vectorizedTicks; tick += laneCount)
+        {
+            const __m256i poolIdx = _mm256_and_si256(x, poolMask);
+            _mm256_storeu_si256((__m256i*)&pPoolSynapseTick[tick], _mm256_i32gather_epi64(poolData, _mm256_castsi256_si128(poolIdx), 8));
+            _mm256_storeu_si256((__m256i*)&pPoolSynapseTick[tick + 4], _mm256_i32gather_epi64(poolData, _mm256_extracti128_si256(poolIdx, 1), 8));
+            x = _mm256_add_epi32(_mm256_mullo_epi32(x, multiplier), increment);
+        }
+        random2XVal = _mm_cvtsi128_si32(_mm256_castsi256_si128(x));
+#endif
+        for (long long tick = vectorizedTicks; tick < maxDuration; tick++)
         {
             PoolSynapseData data = pPoolSynapseData[random2XVal & (RANDOM2_POOL_ACTUAL_SIZE - 1)];
             pPoolSynapseTick[tick] = data;
@@ -476,41 +479,48 @@ struct ScoreFunction
         }
     }
 
-    unsigned int computeFullNeurons(
-        const PoolSynapseData* pPoolSynapseTick,
-        const unsigned char* skipTicksMap,
-        unsigned char* curCachedNeurons,
-        computeBuffer::Neuron& neurons)
+    // Process the ticks in range [beginTick, endTick) without any skipping
+    void computeNeuronTicks(const PoolSynapseData* pPoolSynapseTick, long long beginTick, long long endTick, char* neurons)
     {
-        setMem(neurons.input, sizeof(neurons.input[0]) * allNeuronsCount, 0);
-        for (int i = 0; i < dataLength; i++)
+        for (long long tick = beginTick; tick < endTick; tick++)
         {
-            neurons.input[i] = (char)miningData[i];
-        }
-        for (long long tick = 0; tick < maxDuration; tick++)
-        {
-            PoolSynapseData data = pPoolSynapseTick[tick];
-            unsigned int neuronIndex = data.neuronIndex;
-            unsigned int supplierNeuronIndex = (data.supplierIndexWithSign >> 1);
-            unsigned int sign = (data.supplierIndexWithSign & 1U);
+            const PoolSynapseData data = pPoolSynapseTick[tick];
+            char nnV = neurons[data.supplierIndexWithSign >> 1];
+            nnV = (data.supplierIndexWithSign & 1U) ? nnV : -nnV;
 
-            char nnV = neurons.input[supplierNeuronIndex];
-            nnV = sign ? nnV : -nnV;
+            char neuronValue = neurons[data.neuronIndex] + nnV;
+            clampNeuron(neuronValue);
+            neurons[data.neuronIndex] = neuronValue;
+        }
+    }
 
-            char oldNeuronValue = neurons.input[neuronIndex];
-            neurons.input[neuronIndex] += nnV;
-            clampNeuron(neurons.input[neuronIndex]);
+    void initNeurons(char* neurons)
+    {
+        setMem(neurons, sizeof(neurons[0]) * allNeuronsCount, 0);
+        for (int i = 0; i < dataLength; i++)
+        {
+            neurons[i] = (char)miningData[i];
+        }
+    }
 
-            if (skipTicksMap[tick] & candidateSkipTickMaskBits)
+    unsigned int computeOutputScore(const char* neurons)
+    {
+        const char* outputNeurons = neurons + dataLength + numberOfHiddenNeurons;
+        unsigned int score = 0;
+        unsigned int i = 0;
+        for (; i + 32 <= dataLength; i += 32)
+        {
+            char expectedValues[32];
+            for (unsigned int j = 0; j < 32; j++)
             {
-                curCachedNeurons[tick] = (oldNeuronValue == neurons.input[neuronIndex]);
+                expectedValues[j] = (char)miningData[i + j];
             }
+            const __m256i matches = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(outputNeurons + i)), _mm256_loadu_si256((const __m256i*)expectedValues));
+            score += _mm_popcnt_u32((unsigned int)_mm256_movemask_epi8(matches));
         }
-
-        unsigned int score = 0;
-        for (unsigned int i = 0; i < dataLength; i++)
+        for (; i < dataLength; i++)
         {
-            if (miningData[i] == neurons.input[dataLength + numberOfHiddenNeurons + i])
+            if (miningData[i] == outputNeurons[i])
             {
                 score++;
             }
@@ -518,80 +528,92 @@ struct ScoreFunction
         return score;
     }
 
-    void computeSkipTicks(const unsigned char* poolRandom2Buffer, long long* skipTicks, unsigned char* skipTicksMap, long long* ticksNumbers)
+    // Choose the candidate ticks to skip in the optimization steps. Equivalent to a partial Fisher-Yates shuffle of
+    // all tick numbers, but only the few replaced tick numbers are stored.
+    void computeSkipTicks(const unsigned char* poolRandom2Buffer, computeBuffer& cb)
     {
+        long long* skipTicks = cb._skipTicks;
         long long tailTick = maxDuration - 1;
-        for (long long tick = 0; tick < maxDuration; tick++)
-        {
-            ticksNumbers[tick] = tick;
-        }
-        setMem(skipTicksMap, maxDuration, 0);
+        unsigned int replacedCount = 0;
 
         unsigned int random2XValOpt = randomXOpStart;
-        for (long long l = 0; l < numberOfOptimizationSteps - 1; l++)
+        for (long long l = 0; l < candidateSkipTicksCount; l++)
         {
             const unsigned int poolIdx = random2XValOpt & (RANDOM2_POOL_ACTUAL_SIZE - 1);
             const unsigned long long poolValue = *((unsigned long long*) & poolRandom2Buffer[poolIdx]);
 
             // Randomly choose a tick to skip for the next round and avoid duplicated pick already chosen one
             long long randomTick = poolValue % (maxDuration - l);
-            skipTicks[l] = ticksNumbers[randomTick];
-            skipTicksMap[skipTicks[l]] |= candidateSkipTickMaskBits;
+            long long tailTickNumber = tailTick;
+            unsigned int randomTickReplacedIdx = replacedCount;
+            skipTicks[l] = randomTick;
+            for (unsigned int i = 0; i < replacedCount; i++)
+            {
+                if (cb._replacedTickPositions[i] == randomTick)
+                {
+                    skipTicks[l] = cb._replacedTickNumbers[i];
+                    randomTickReplacedIdx = i;
+                }
+                if (cb._replacedTickPositions[i] == tailTick)
+                {
+                    tailTickNumber = cb._replacedTickNumbers[i];
+                }
+            }
 
             // Replace the chosen tick position with current tail to make sure if this possiton is chosen again
             // the skipTick is still not duplicated with previous ones.
-            ticksNumbers[randomTick] = ticksNumbers[tailTick];
+            cb._replacedTickPositions[randomTickReplacedIdx] = randomTick;
+            cb._replacedTickNumbers[randomTickReplacedIdx] = tailTickNumber;
+            if (randomTickReplacedIdx == replacedCount)
+            {
+                replacedCount++;
+            }
             tailTick--;
 
             random2XValOpt = random2XValOpt * 1664525 + 1013904223;
         }
-    }
-
-    unsigned int computeSkipTicksNeurons(const PoolSynapseData* pPoolSynapseTick, const unsigned char* skipTicksMap, unsigned char* curCachedNeurons, computeBuffer::Neuron& neurons)
-    {
-        // Reset neuron values
-        setMem(neurons.input, sizeof(neurons.input[0]) * allNeuronsCount, 0);
-        for (int i = 0; i < dataLength; i++)
-        {
-            neurons.input[i] = (char)miningData[i];
-        }
 
-        // Compute
-        for (long long tick = 0; tick < maxDuration; tick++)
+        // Sort candidates by tick (skip ticks are unique)
+        for (unsigned int l = 0; l < candidateSkipTicksCount; l++)
         {
-            // Tick not on the list, accumulate as normal
-            PoolSynapseData data = pPoolSynapseTick[tick];
-            unsigned int neuronIndex = data.neuronIndex;
-            unsigned int supplierNeuronIndex = (data.supplierIndexWithSign >> 1);
-            unsigned int sign = (data.supplierIndexWithSign & 1U);
-
-            char nnV = neurons.input[supplierNeuronIndex];
-            nnV = sign ? nnV : -nnV;
-
-            char oldNeuronValue = neurons.input[neuronIndex];
-            neurons.input[neuronIndex] += nnV;
-            clampNeuron(neurons.input[neuronIndex]);
-
-            if (skipTicksMap[tick] & candidateSkipTickMaskBits)
+            unsigned int position = 0;
+            for (unsigned int k = 0; k < candidateSkipTicksCount; k++)
             {
-                curCachedNeurons[tick] = (oldNeuronValue == neurons.input[neuronIndex]);
-                if (skipTicksMap[tick] & skippedTickMaskBits)
-                {
-                    neurons.input[neuronIndex] = oldNeuronValue;
-                }
+                position += (skipTicks[k] < skipTicks[l]) ? 1 : 0;
             }
+            cb._sortedSkipTickPositions[l] = position;
+            cb._sortedSkipTicks[position] = skipTicks[l];
+            cb._skippedTicks[position] = 0;
         }
+    }
 
-        // Calculate the score
-        unsigned int currentScore = 0;
-        for (unsigned int i = 0; i < dataLength; i++)
+    // Compute neurons from beginTick to the end, starting with the current neuron values. beginTick must be 0 or the
+    // candidate tick at position firstCandidate. For each candidate tick from firstCandidate on, the neuron values
+    // before the tick are saved to neuronSnapshots and if the tick did not change the neuron value to cachedNeurons.
+    unsigned int computeNeurons(computeBuffer& cb, long long beginTick, unsigned int firstCandidate, unsigned char* cachedNeurons, char (*neuronSnapshots)[allNeuronsCount])
+    {
+        const PoolSynapseData* pPoolSynapseTick = cb._poolSynapseTickData;
+        char* neurons = cb._neurons.input;
+        long long tick = beginTick;
+        for (unsigned int k = firstCandidate; k < candidateSkipTicksCount; k++)
         {
-            if (miningData[i] == neurons.input[dataLength + numberOfHiddenNeurons + i])
+            const long long candidateTick = cb._sortedSkipTicks[k];
+            computeNeuronTicks(pPoolSynapseTick, tick, candidateTick, neurons);
+            copyMem(neuronSnapshots[k], neurons, allNeuronsCount);
+
+            const unsigned int neuronIndex = pPoolSynapseTick[candidateTick].neuronIndex;
+            const char oldNeuronValue = neurons[neuronIndex];
+            computeNeuronTicks(pPoolSynapseTick, candidateTick, candidateTick + 1, neurons);
+            cachedNeurons[k] = (oldNeuronValue == neurons[neuronIndex]);
+            if (cb._skippedTicks[k])
             {
-                currentScore++;
+                neurons[neuronIndex] = oldNeuronValue;
             }
+            tick = candidateTick + 1;
         }
-        return currentScore;
+        computeNeuronTicks(pPoolSynapseTick, tick, maxDuration, neurons);
+
+        return computeOutputScore(neurons);
     }
 
     // Compute score
@@ -602,11 +624,6 @@ struct ScoreFunction
         computeBuffer& cb = _computeBuffer[solutionBufIdx];
         PoolSynapseData* pPoolSynapseTick = cb._poolSynapseTickData;
         auto& neurons = cb._neurons;
-        auto* prvCachedNeurons = cb._prvCachedNeurons;
-        auto* curCachedNeurons = cb._curCachedNeurons;
-
-        setMem(prvCachedNeurons, sizeof(prvCachedNeurons[0]) * maxDuration, 0);
-        setMem(curCachedNeurons, sizeof(curCachedNeurons[0]) * maxDuration, 0);
 
         //generateSynapse(cb, solutionBufIdx, publicKey, nonce);
         cb.k12.initState(&publicKey.m256i_u64[0], &nonce.m256i_u64[0], cb._poolRandom2Buffer);
@@ -617,43 +634,41 @@ struct ScoreFunction
 
         // Next run for optimization steps
         // Generate a list of possible skip ticks
-        computeSkipTicks(cb._poolRandom2Buffer, cb._skipTicks, cb._skipTicksMap, cb._ticksNumbers);
+        computeSkipTicks(cb._poolRandom2Buffer, cb);
 
-        // First run to get the score of fulll 
-        unsigned int score = computeFullNeurons(pPoolSynapseTick, cb._skipTicksMap, prvCachedNeurons, neurons);
+        // First run to get the score of fulll
+        initNeurons(neurons.input);
+        unsigned int score = computeNeurons(cb, 0, 0, cb._prvCachedNeurons, cb._prvNeuronSnapshots);
 
-        // Run the optimization steps
-        for (long long l = 0; l < numberOfOptimizationSteps - 1; l++)
+        // Run the optimization steps. A run only differs from the last accepted run from the newly skipped tick on,
+        // so it is resumed from the neuron values saved before this tick.
+        for (long long l = 0; l < candidateSkipTicksCount; l++)
         {
             const long long skipTick = cb._skipTicks[l];
-            cb._skipTicksMap[skipTick] |= skippedTickMaskBits;
+            const unsigned int position = cb._sortedSkipTickPositions[l];
+            cb._skippedTicks[position] = 1;
 
-            if (prvCachedNeurons[skipTick])
+            if (cb._prvCachedNeurons[position])
             {
                 continue;
             }
 
-            // reset map
-            for (long long k = 0; k < numberOfOptimizationSteps - 1; k++)
-            {
-                curCachedNeurons[cb._skipTicks[k]] = 0;
-            }
-
-            unsigned int currentScore = computeSkipTicksNeurons(pPoolSynapseTick, cb._skipTicksMap, curCachedNeurons, neurons);
+            copyMem(neurons.input, cb._prvNeuronSnapshots[position], allNeuronsCount);
+            unsigned int currentScore = computeNeurons(cb, skipTick, position, cb._curCachedNeurons, cb._curNeuronSnapshots);
 
             // Check if this tick is good to skip
             if (currentScore >= score)
             {
                 score = currentScore;
 
-                // Swap
-                unsigned char* tmp = prvCachedNeurons;
-                prvCachedNeurons = curCachedNeurons;
-                curCachedNeurons = tmp;
+                // Keep data of this run from the skipped tick on
+                const unsigned int changedCount = (unsigned int)(candidateSkipTicksCount - position);
+                copyMem(&cb._prvCachedNeurons[position], &cb._curCachedNeurons[position], changedCount);
+                copyMem(cb._prvNeuronSnapshots[position], cb._curNeuronSnapshots[position], changedCount * allNeuronsCount);
             }
             else // Make score worse, reset it
             {
-                cb._skipTicksMap[skipTick] &= clearSkippedTickMaskBits;
+                cb._skippedTicks[position] = 0;
             }
         }
         return score;
@@ -699,88 +714,126 @@ struct ScoreFunction
 #endif
 
     // Multithreaded solutions verification:
-    // This module mainly serve tick processor in qubic core node, thus the queue size is limited at NUMBER_OF_TRANSACTIONS_PER_TICK 
-    // for future use for somewhere else, you can only increase the size.
-
-    volatile char taskQueueLock = 0;
-    struct {
-        m256i publicKey[NUMBER_OF_TRANSACTIONS_PER_TICK];
-        m256i miningSeed[NUMBER_OF_TRANSACTIONS_PER_TICK];
-        m256i nonce[NUMBER_OF_TRANSACTIONS_PER_TICK];
-    } taskQueue;
-    unsigned int _nTask;
-    unsigned int _nProcessing;
-    unsigned int _nFinished;
-    bool _nIsTaskQueueReady;
+    // Tasks are distributed round-robin to one deque per solution buffer. Each processor takes tasks from the deque of
+    // its solution buffer first and steals from the other deques when its own is empty. Each deque has capacity for
+    // NUMBER_OF_TRANSACTIONS_PER_TICK tasks. If all deques are full, the task is dropped and counted.
+
+    struct ScoreTask
+    {
+        m256i publicKey;
+        m256i miningSeed;
+        m256i nonce;
+    };
+
+    static constexpr unsigned int taskDequeCapacity = NUMBER_OF_TRANSACTIONS_PER_TICK;
+
+    struct TaskDeque
+    {
+        // Ring buffer of tasks. The owner takes the newest task (at end - 1), others steal the oldest (at begin).
+        ScoreTask tasks[taskDequeCapacity];
+        volatile unsigned int begin;
+        volatile unsigned int end;
+        volatile char lock;
+    } taskDeques[solutionBufferCount];
+
+    unsigned int _nextTaskDeque;
+    volatile long _nTask;
+    volatile long _nFinished;
+    volatile long long _nStolenTasks;
+    volatile long long _nDroppedTasks;
+    volatile bool _nIsTaskQueueReady;
 
     void resetTaskQueue()
     {
-        ACQUIRE(taskQueueLock);
+        for (unsigned int i = 0; i < solutionBufferCount; i++)
+        {
+            ACQUIRE(taskDeques[i].lock);
+            taskDeques[i].begin = 0;
+            taskDeques[i].end = 0;
+            RELEASE(taskDeques[i].lock);
+        }
+        _nextTaskDeque = 0;
         _nTask = 0;
-        _nProcessing = 0;
         _nFinished = 0;
         _nIsTaskQueueReady = false;
-        RELEASE(taskQueueLock);
     }
 
-    // add task to the queue
-    // queue size is limited at NUMBER_OF_TRANSACTIONS_PER_TICK 
-    void addTask(m256i publicKey, m256i miningSeed, m256i nonce)
+    // add task to the queue (called by one thread only, before or while processing the queue)
+    // return false if the task is dropped because the queue is full
+    bool addTask(m256i publicKey, m256i miningSeed, m256i nonce)
     {
-        ACQUIRE(taskQueueLock);
-        if (_nTask < NUMBER_OF_TRANSACTIONS_PER_TICK)
+        for (unsigned int i = 0; i < solutionBufferCount; i++)
         {
-            unsigned int index = _nTask++;
-            taskQueue.publicKey[index] = publicKey;
-            taskQueue.miningSeed[index] = miningSeed;
-            taskQueue.nonce[index] = nonce;
+            TaskDeque& deque = taskDeques[_nextTaskDeque];
+            _nextTaskDeque = (_nextTaskDeque + 1) % solutionBufferCount;
+
+            ACQUIRE(deque.lock);
+            if (deque.end - deque.begin < taskDequeCapacity)
+            {
+                ScoreTask& task = deque.tasks[deque.end % taskDequeCapacity];
+                task.publicKey = publicKey;
+                task.miningSeed = miningSeed;
+                task.nonce = nonce;
+                deque.end++;
+                _InterlockedIncrement(&_nTask);
+                RELEASE(deque.lock);
+                return true;
+            }
+            RELEASE(deque.lock);
         }
-        RELEASE(taskQueueLock);
+        _InterlockedIncrement64(&_nDroppedTasks);
+        return false;
     }
 
     void startProcessTaskQueue()
     {
-        ACQUIRE(taskQueueLock);
         _nIsTaskQueueReady = true;
-        RELEASE(taskQueueLock);
     }
 
     void stopProcessTaskQueue()
     {
-        ACQUIRE(taskQueueLock);
         _nIsTaskQueueReady = false;
-        RELEASE(taskQueueLock);
     }
 
     // get a task, can call on any thread
-    bool getTask(m256i* publicKey, m256i* miningSeed, m256i* nonce)
+    bool getTask(unsigned long long processorNumber, m256i* publicKey, m256i* miningSeed, m256i* nonce)
     {
         if (!_nIsTaskQueueReady)
         {
             return false;
         }
-        bool result = false;
-        ACQUIRE(taskQueueLock);
-        if (_nProcessing < _nTask)
-        {
-            unsigned int index = _nProcessing++;
-            *publicKey = taskQueue.publicKey[index];
-            *miningSeed = taskQueue.miningSeed[index];
-            *nonce = taskQueue.nonce[index];
-            result = true;
-        }
-        else
+
+        const unsigned int ownDequeIndex = (unsigned int)(processorNumber % solutionBufferCount);
+        for (unsigned int i = 0; i < solutionBufferCount; i++)
         {
-            result = false;
+            TaskDeque& deque = taskDeques[(ownDequeIndex + i) % solutionBufferCount];
+            if (deque.end == deque.begin)
+            {
+                continue;
+            }
+
+            ACQUIRE(deque.lock);
+            if (deque.end != deque.begin)
+            {
+                const ScoreTask& task = (i == 0) ? deque.tasks[--deque.end % taskDequeCapacity] : deque.tasks[deque.begin++ % taskDequeCapacity];
+                *publicKey = task.publicKey;
+                *miningSeed = task.miningSeed;
+                *nonce = task.nonce;
+                RELEASE(deque.lock);
+                if (i != 0)
+                {
+                    _InterlockedIncrement64(&_nStolenTasks);
+                }
+                return true;
+            }
+            RELEASE(deque.lock);
         }
-        RELEASE(taskQueueLock);
-        return result;
+        return false;
     }
+
     void finishTask()
     {
-        ACQUIRE(taskQueueLock);
-        _nFinished++;
-        RELEASE(taskQueueLock);
+        _InterlockedIncrement(&_nFinished);
     }
 
     bool isTaskQueueProcessed()
@@ -788,12 +841,24 @@ struct ScoreFunction
         return _nFinished == _nTask;
     }
 
+    // Number of tasks taken from the deque of another solution buffer (total since start)
+    long long getNumberOfStolenTasks() const
+    {
+        return _nStolenTasks;
+    }
+
+    // Number of tasks dropped because the queue was full (total since start)
+    long long getNumberOfDroppedTasks() const
+    {
+        return _nDroppedTasks;
+    }
+
     void tryProcessSolution(unsigned long long processorNumber)
     {
         m256i publicKey;
         m256i miningSeed;
         m256i nonce;
-        bool res = this->getTask(&publicKey, &miningSeed, &nonce);
+        bool res = this->getTask(processorNumber, &publicKey, &miningSeed, &nonce);
         if (res)
         {
             (*this)(processorNumber, publicKey, miningSeed, nonce);
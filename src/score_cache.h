@@ -9,11 +9,14 @@
 
 #include "kangaroo_twelve.h"
 
-/// Cache storing scores for pairs of publicKey and nonce (hash map)
-template <unsigned int size, unsigned int collisionRetries = 20>
+/// Cache storing scores for pairs of publicKey and nonce (hash map).
+/// The entries are split into shards of consecutive entries with separate locks, so processors accessing different
+/// parts of the cache do not block each other. The entries are stored in one array, which is saved/loaded as a whole.
+template <unsigned int size, unsigned int collisionRetries = 20, unsigned int shardCount = 64>
 class ScoreCache
 {
     static_assert(collisionRetries < size, "Number of fetch retries in case of collision is too big!");
+    static_assert(shardCount > 0 && shardCount <= size, "Number of shards must be between 1 and size!");
 public:
 
     /// Init cache
@@ -25,12 +28,15 @@ public:
     /// Reset all cache entries
     void reset()
     {
-        ACQUIRE(lock);
+        acquireAllShards();
         setMem((unsigned char*)cache, sizeof(cache), 0);
-        hits = 0;
-        misses = 0;
-        collisions = 0;
-        RELEASE(lock);
+        for (unsigned int i = 0; i < shardCount; ++i)
+        {
+            shards[i].hits = 0;
+            shards[i].misses = 0;
+            shards[i].collisions = 0;
+        }
+        releaseAllShards();
     }
 
     /// Return maximum number of entries that can be stored in cache
@@ -60,14 +66,24 @@ public:
     {
         int retVal;
         unsigned int tryFetchIdx = cacheIndex % capacity();
-        ACQUIRE(lock);
+        unsigned int lockedShard = shardIndex(tryFetchIdx);
+        ACQUIRE(shards[lockedShard].lock);
         for (unsigned int i = 0; i < collisionRetries; ++i)
         {
+            // retries may continue in the next shard
+            const unsigned int shard = shardIndex(tryFetchIdx);
+            if (shard != lockedShard)
+            {
+                RELEASE(shards[lockedShard].lock);
+                lockedShard = shard;
+                ACQUIRE(shards[lockedShard].lock);
+            }
+
             const m256i& cachedPublicKey = cache[tryFetchIdx].publicKey;
             if (isZero(cachedPublicKey))
             {
                 // miss: data not available in cache yet (entry is empty)
-                misses++;
+                shards[lockedShard].misses++;
                 retVal = SCORE_CACHE_MISS;
                 break;
             }
@@ -77,7 +93,7 @@ public:
             if (cachedPublicKey == publicKey && cachedMiningSeed == miningSeed && cachedNonce == nonce)
             {
                 // hit: data available in cache -> return score
-                hits++;
+                shards[lockedShard].hits++;
                 retVal = cache[tryFetchIdx].score;
                 break;
             }
@@ -86,16 +102,16 @@ public:
             retVal = SCORE_CACHE_COLLISION;
             tryFetchIdx = (tryFetchIdx + 1) % capacity();
         }
-        RELEASE(lock);
 
         if (retVal == SCORE_CACHE_COLLISION)
         {
-            collisions++;
+            shards[lockedShard].collisions++;
         }
         else
         {
             cacheIndex = tryFetchIdx;
         }
+        RELEASE(shards[lockedShard].lock);
         return retVal;
     }
 
@@ -103,12 +119,13 @@ public:
     void addEntry(const m256i& publicKey, const m256i& miningSeed, const m256i& nonce, unsigned int cacheIndex, int score)
     {
         cacheIndex %= capacity();
-        ACQUIRE(lock);
+        Shard& shard = shards[shardIndex(cacheIndex)];
+        ACQUIRE(shard.lock);
         cache[cacheIndex].publicKey = publicKey;
         cache[cacheIndex].miningSeed = miningSeed;
         cache[cacheIndex].nonce = nonce;
         cache[cacheIndex].score = score;
-        RELEASE(lock);
+        RELEASE(shard.lock);
     }
 
     /// Save score cache to file
@@ -117,9 +134,9 @@ public:
         logToConsole(L"Saving score cache file...");
 
         const unsigned long long beginningTick = __rdtsc();
-        ACQUIRE(lock);
+        acquireAllShards();
         long long savedSize = ::save(filename, sizeof(cache), (unsigned char*)&cache, directory);
-        RELEASE(lock);
+        releaseAllShards();
         if (savedSize == sizeof(cache))
         {
             setNumber(message, savedSize, TRUE);
@@ -136,9 +153,9 @@ public:
         bool success = true;
         logToConsole(L"Loading score cache...");
         reset();
-        ACQUIRE(lock);
+        acquireAllShards();
         long long loadedSize = ::load(filename, sizeof(cache), (unsigned char*)cache, directory);
-        RELEASE(lock);
+        releaseAllShards();
         if (loadedSize != sizeof(cache))
         {
             if (loadedSize == -1)
@@ -165,18 +182,33 @@ public:
     // Return number of hits (data available in cache when fetched)
     unsigned int hitCount() const
     {
+        unsigned int hits = 0;
+        for (unsigned int i = 0; i < shardCount; ++i)
+        {
+            hits += shards[i].hits;
+        }
         return hits;
     }
 
     // Return number of misses (data not in cache yet)
     unsigned int missCount() const
     {
+        unsigned int misses = 0;
+        for (unsigned int i = 0; i < shardCount; ++i)
+        {
+            misses += shards[i].misses;
+        }
         return misses;
     }
 
     // Return number of collisions (other data is mapped to same index)
     unsigned int collisionCount() const
     {
+        unsigned int collisions = 0;
+        for (unsigned int i = 0; i < shardCount; ++i)
+        {
+            collisions += shards[i].collisions;
+        }
         return collisions;
     }
 
@@ -192,11 +224,43 @@ private:
     // cache entries (set zero or load from a file on init)
     CacheEntry cache[size];
 
-    // lock to prevent race conditions on parallel access
-    volatile char lock = 0;
+    static constexpr unsigned int entriesPerShard = (size + shardCount - 1) / shardCount;
 
-    // statistics of hits, misses, and collisions
-    unsigned int hits = 0;
-    unsigned int misses = 0;
-    unsigned int collisions = 0;
+    struct Shard
+    {
+        // lock to prevent race conditions on parallel access to the entries of the shard
+        volatile char lock;
+
+        // statistics of hits, misses, and collisions (counted in the shard of the last entry checked)
+        unsigned int hits;
+        unsigned int misses;
+        unsigned int collisions;
+
+        // avoid false sharing between shards
+        char padding[64 - 4 * sizeof(unsigned int)];
+    };
+
+    Shard shards[shardCount] = {};
+
+    static unsigned int shardIndex(unsigned int cacheIndex)
+    {
+        return cacheIndex / entriesPerShard;
+    }
+
+    // lock all shards (in ascending order, while tryFetching() and addEntry() hold one lock at most)
+    void acquireAllShards()
+    {
+        for (unsigned int i = 0; i < shardCount; ++i)
+        {
+            ACQUIRE(shards[i].lock);
+        }
+    }
+
+    void releaseAllShards()
+    {
+        for (unsigned int i = 0; i < shardCount; ++i)
+        {
+            RELEASE(shards[i].lock);
+        }
+    }
 };
@@ -6,6 +6,9 @@
 #include "platform/file_io.h"
 #include "platform/time_stamp_counter.h"
 #include "platform/memory.h"
+#include "platform/parallel_job.h"
+#include "platform/copy_on_write_snapshot.h"
+#include "platform/delta_snapshot.h"
 
 #include "network_messages/entity.h"
 
@@ -16,7 +19,12 @@
 #include "kangaroo_twelve.h"
 #include "common_buffers.h"
 
+// Lock for writing to spectrum (lookups with spectrumIndex() do not need it)
 GLOBAL_VAR_DECL volatile char spectrumLock GLOBAL_VAR_INIT(0);
+
+// Version of the hash map layout, that is the public keys stored in the spectrum slots. It is odd while a writer
+// inserts an entity or reorganizes the hash map, which lets spectrumIndex() detect concurrent layout changes and retry.
+GLOBAL_VAR_DECL volatile long long spectrumLayoutVersion GLOBAL_VAR_INIT(0);
 GLOBAL_VAR_DECL ::Entity* spectrum GLOBAL_VAR_INIT(nullptr);
 GLOBAL_VAR_DECL struct SpectrumInfo {
     unsigned int numberOfEntities = 0;  // Number of entities in the spectrum hash map, may include entries with balance == 0
@@ -32,6 +40,165 @@ static constexpr unsigned long long spectrumDigestsSizeInByte = (SPECTRUM_CAPACI
 
 GLOBAL_VAR_DECL unsigned long long spectrumReorgTotalExecutionTicks GLOBAL_VAR_INIT(0);
 
+// Journal of spectrum indices changed since the last update of spectrumDigests (may contain duplicates).
+// If more changes happen than fit into the journal, the next update falls back to scanning the whole spectrum.
+static constexpr unsigned int SPECTRUM_CHANGE_JOURNAL_CAPACITY = 1 << 20;
+GLOBAL_VAR_DECL unsigned int spectrumChangeJournal[SPECTRUM_CHANGE_JOURNAL_CAPACITY];
+GLOBAL_VAR_DECL unsigned int spectrumChangeJournalSize GLOBAL_VAR_INIT(0);
+GLOBAL_VAR_DECL bool spectrumChangeJournalOverflow GLOBAL_VAR_INIT(false);
+
+// Bit flags used during update of spectrumDigests (all zero before and after update)
+GLOBAL_VAR_DECL unsigned long long spectrumChangeFlags[SPECTRUM_CAPACITY / (sizeof(unsigned long long) * 8)];
+
+GLOBAL_VAR_DECL unsigned long long spectrumDigestUpdateTotalExecutionTicks GLOBAL_VAR_INIT(0);
+GLOBAL_VAR_DECL unsigned long long spectrumDigestUpdateFullScanCount GLOBAL_VAR_INIT(0);
+
+// Spectrum entries changed since the spectrum file has been saved the last time (for saving deltas)
+GLOBAL_VAR_DECL DeltaSnapshot<::Entity, SPECTRUM_CAPACITY> spectrumDeltaSnapshot;
+
+
+// Mark begin of layout change, acquire no lock (caller needs to hold spectrumLock)
+static void beginSpectrumLayoutChange()
+{
+    // interlocked operation is full memory barrier, so readers see odd version before slots change
+    _InterlockedIncrement64(&spectrumLayoutVersion);
+}
+
+// Mark end of layout change, acquire no lock (caller needs to hold spectrumLock)
+static void endSpectrumLayoutChange()
+{
+    _InterlockedIncrement64(&spectrumLayoutVersion);
+}
+
+// Record change of spectrum entry, acquire no lock (caller needs to hold spectrumLock)
+static void journalSpectrumChange(unsigned int index)
+{
+    if (spectrumChangeJournalSize < SPECTRUM_CHANGE_JOURNAL_CAPACITY)
+    {
+        spectrumChangeJournal[spectrumChangeJournalSize++] = index;
+    }
+    else
+    {
+        spectrumChangeJournalOverflow = true;
+    }
+    spectrumDeltaSnapshot.markChanged(index);
+}
+
+// Discard journaled changes, for example because spectrumDigests have been recomputed completely
+static void resetSpectrumChangeJournal()
+{
+    spectrumChangeJournalSize = 0;
+    spectrumChangeJournalOverflow = false;
+}
+
+// Update spectrumDigests for all entities with transfers in the current tick by scanning the whole spectrum
+// (expensive). Acquire no lock (caller needs to hold spectrumLock).
+static void updateSpectrumDigestsFullScan()
+{
+    KangarooTwelve64To32Batch batch;
+    unsigned int digestIndex;
+    for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
+    {
+        if (spectrum[digestIndex].latestIncomingTransferTick == system.tick || spectrum[digestIndex].latestOutgoingTransferTick == system.tick)
+        {
+            nodeStateSnapshot.beforeWrite(&spectrumDigests[digestIndex], sizeof(m256i));
+            batch.add(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
+            spectrumChangeFlags[digestIndex >> 6] |= (1ULL << (digestIndex & 63));
+        }
+    }
+    batch.flush();
+    unsigned int previousLevelBeginning = 0;
+    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
+    while (numberOfLeafs > 1)
+    {
+        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
+        {
+            if (spectrumChangeFlags[i >> 6] & (3ULL << (i & 63)))
+            {
+                nodeStateSnapshot.beforeWrite(&spectrumDigests[digestIndex], sizeof(m256i));
+                batch.add(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex]);
+                spectrumChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
+                spectrumChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
+            }
+            digestIndex++;
+        }
+        batch.flush();
+        previousLevelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
+    }
+    spectrumChangeFlags[0] = 0;
+
+    resetSpectrumChangeJournal();
+}
+
+// Update spectrumDigests for all entities in the change journal, only walking the touched paths of the tree.
+// Falls back to full scan if the journal has overflown. Acquire no lock (caller needs to hold spectrumLock).
+static void updateSpectrumDigests()
+{
+    const unsigned long long startTick = __rdtsc();
+
+    if (spectrumChangeJournalOverflow)
+    {
+        updateSpectrumDigestsFullScan();
+        spectrumDigestUpdateFullScanCount++;
+        spectrumDigestUpdateTotalExecutionTicks += __rdtsc() - startTick;
+        return;
+    }
+
+    // Hash changed leafs, removing duplicates from the journal (flags are used to detect duplicates)
+    KangarooTwelve64To32Batch batch;
+    unsigned int* changedNodes = spectrumChangeJournal;
+    unsigned int numberOfChangedNodes = 0;
+    for (unsigned int i = 0; i < spectrumChangeJournalSize; i++)
+    {
+        const unsigned int index = spectrumChangeJournal[i];
+        if (!(spectrumChangeFlags[index >> 6] & (1ULL << (index & 63))))
+        {
+            spectrumChangeFlags[index >> 6] |= (1ULL << (index & 63));
+            nodeStateSnapshot.beforeWrite(&spectrumDigests[index], sizeof(m256i));
+            batch.add(&spectrum[index], &spectrumDigests[index]);
+            changedNodes[numberOfChangedNodes++] = index;
+        }
+    }
+    batch.flush();
+    for (unsigned int i = 0; i < numberOfChangedNodes; i++)
+    {
+        spectrumChangeFlags[changedNodes[i] >> 6] = 0;
+    }
+
+    // Walk up the tree level by level, hashing each changed parent once
+    unsigned int previousLevelBeginning = 0;
+    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
+    while (numberOfLeafs > 1)
+    {
+        const unsigned int levelBeginning = previousLevelBeginning + numberOfLeafs;
+        unsigned int numberOfChangedParents = 0;
+        for (unsigned int i = 0; i < numberOfChangedNodes; i++)
+        {
+            const unsigned int parent = changedNodes[i] >> 1;
+            if (!(spectrumChangeFlags[parent >> 6] & (1ULL << (parent & 63))))
+            {
+                spectrumChangeFlags[parent >> 6] |= (1ULL << (parent & 63));
+                nodeStateSnapshot.beforeWrite(&spectrumDigests[levelBeginning + parent], sizeof(m256i));
+                batch.add(&spectrumDigests[previousLevelBeginning + (parent << 1)], &spectrumDigests[levelBeginning + parent]);
+                changedNodes[numberOfChangedParents++] = parent;
+            }
+        }
+        batch.flush();
+        for (unsigned int i = 0; i < numberOfChangedParents; i++)
+        {
+            spectrumChangeFlags[changedNodes[i] >> 6] = 0;
+        }
+        numberOfChangedNodes = numberOfChangedParents;
+        previousLevelBeginning = levelBeginning;
+        numberOfLeafs >>= 1;
+    }
+
+    resetSpectrumChangeJournal();
+
+    spectrumDigestUpdateTotalExecutionTicks += __rdtsc() - startTick;
+}
+
 
 // Update SpectrumInfo data (exensive, because it iterates the whole spectrum), acquire no lock
 static void updateSpectrumInfo(SpectrumInfo& si = spectrumInfo)
@@ -139,14 +306,31 @@ private:
     DustBurning* buf;
 };
 
-// Clean up spectrum hash map, removing all entities with balance 0. Updates spectrumInfo.
-static void reorganizeSpectrum()
+// Number of tasks of parallel spectrum reorganization (fixed, independent of the number of processors)
+static constexpr unsigned int SPECTRUM_REORG_TASKS = 64;
+static_assert(SPECTRUM_CAPACITY % SPECTRUM_REORG_TASKS == 0, "SPECTRUM_CAPACITY must be multiple of SPECTRUM_REORG_TASKS");
+
+// Data shared by the tasks of parallel spectrum reorganization
+GLOBAL_VAR_DECL struct SpectrumReorgJobData
 {
-    unsigned long long spectrumReorgStartTick = __rdtsc();
+    // Source index ranges [rangeBeginning[i], rangeBeginning[i + 1]) of rebuild tasks. Each range starts with an
+    // empty slot, so hash map collision chains never cross range borders (except for the chain wrapping around
+    // the end of the spectrum, which is handled by the last task together with [0, firstEmptyIndex)).
+    unsigned int rangeBeginning[SPECTRUM_REORG_TASKS + 1];
+    unsigned int firstEmptyIndex;
+
+    // Current tree level processed by digest tasks
+    unsigned int levelInputBeginning, levelOutputBeginning, levelOutputCount;
 
+    // Partial results of spectrum info tasks
+    SpectrumInfo spectrumInfo[SPECTRUM_REORG_TASKS];
+} spectrumReorgJobData;
+
+// Insert entities with balance > 0 from spectrum[beginIndex, endIndex) into reorgBuffer in order of index
+static void insertIntoReorgSpectrum(unsigned int beginIndex, unsigned int endIndex)
+{
     ::Entity* reorgSpectrum = (::Entity*)reorgBuffer;
-    setMem(reorgSpectrum, SPECTRUM_CAPACITY * sizeof(::Entity), 0);
-    for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
+    for (unsigned int i = beginIndex; i < endIndex; i++)
     {
         if (spectrum[i].incomingAmount - spectrum[i].outgoingAmount)
         {
@@ -165,62 +349,230 @@ static void reorganizeSpectrum()
             }
         }
     }
-    copyMem(spectrum, reorgSpectrum, SPECTRUM_CAPACITY * sizeof(::Entity));
+}
 
-    unsigned int digestIndex;
-    for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
+// Task of ParallelJob: rebuild part of hash map in reorgBuffer. Results equal sequential insertion in order of index,
+// because each task only writes to its own range (collision chains end before the next range).
+static void reorganizeSpectrumRebuildTask(void*, unsigned int taskIndex)
+{
+    ::Entity* reorgSpectrum = (::Entity*)reorgBuffer;
+    const unsigned int beginIndex = spectrumReorgJobData.rangeBeginning[taskIndex];
+    const unsigned int endIndex = spectrumReorgJobData.rangeBeginning[taskIndex + 1];
+    setMem(&reorgSpectrum[beginIndex], (endIndex - beginIndex) * sizeof(::Entity), 0);
+    if (taskIndex == SPECTRUM_REORG_TASKS - 1)
     {
-        KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
+        // Collision chain wrapping around the end of the spectrum is inserted first in sequential order
+        const unsigned int firstEmptyIndex = spectrumReorgJobData.firstEmptyIndex;
+        setMem(reorgSpectrum, firstEmptyIndex * sizeof(::Entity), 0);
+        insertIntoReorgSpectrum(0, firstEmptyIndex);
     }
+    insertIntoReorgSpectrum(beginIndex, endIndex);
+}
+
+// Task of ParallelJob: copy part of reorgBuffer to spectrum, compute leaf digests and spectrum info of the part
+static void reorganizeSpectrumCopyAndHashTask(void*, unsigned int taskIndex)
+{
+    constexpr unsigned int entitiesPerTask = SPECTRUM_CAPACITY / SPECTRUM_REORG_TASKS;
+    const unsigned int beginIndex = taskIndex * entitiesPerTask;
+    copyMem(&spectrum[beginIndex], &((::Entity*)reorgBuffer)[beginIndex], entitiesPerTask * sizeof(::Entity));
+    KangarooTwelve64To32Multiple(&spectrum[beginIndex], &spectrumDigests[beginIndex], entitiesPerTask);
+
+    SpectrumInfo& si = spectrumReorgJobData.spectrumInfo[taskIndex];
+    si.numberOfEntities = 0;
+    si.totalAmount = 0;
+    for (unsigned int i = beginIndex; i < beginIndex + entitiesPerTask; i++)
+    {
+        long long balance = spectrum[i].incomingAmount - spectrum[i].outgoingAmount;
+        if (balance || !isZero(spectrum[i].publicKey))
+        {
+            si.numberOfEntities++;
+            si.totalAmount += balance;
+        }
+    }
+}
+
+// Task of ParallelJob: compute part of the digests of one tree level
+static void reorganizeSpectrumLevelTask(void*, unsigned int taskIndex)
+{
+    const unsigned int digestsPerTask = spectrumReorgJobData.levelOutputCount / SPECTRUM_REORG_TASKS;
+    const unsigned int offset = taskIndex * digestsPerTask;
+    KangarooTwelve64To32Multiple(&spectrumDigests[spectrumReorgJobData.levelInputBeginning + 2 * offset],
+        &spectrumDigests[spectrumReorgJobData.levelOutputBeginning + offset], digestsPerTask);
+}
+
+// Clean up spectrum hash map, removing all entities with balance 0. Updates spectrumInfo and spectrumDigests.
+// Work is split among idle processors via parallelJob, the result does not depend on the number of helpers.
+static void reorganizeSpectrum()
+{
+    unsigned long long spectrumReorgStartTick = __rdtsc();
+
+    // All entities and digests may change
+    nodeStateSnapshot.beforeWrite(spectrum, spectrumSizeInBytes);
+    nodeStateSnapshot.beforeWrite(spectrumDigests, spectrumDigestsSizeInByte);
+    spectrumDeltaSnapshot.markAllChanged();
+
+    beginSpectrumLayoutChange();
+
+    // Split source into ranges starting with empty slots (spectrum is filled at most 75%, so there always is an empty slot)
+    SpectrumReorgJobData& jd = spectrumReorgJobData;
+    jd.firstEmptyIndex = 0;
+    while (!isZero(spectrum[jd.firstEmptyIndex].publicKey))
+    {
+        jd.firstEmptyIndex++;
+    }
+    jd.rangeBeginning[0] = jd.firstEmptyIndex;
+    for (unsigned int task = 1; task < SPECTRUM_REORG_TASKS; task++)
+    {
+        unsigned int index = jd.firstEmptyIndex + (unsigned int)((SPECTRUM_CAPACITY - jd.firstEmptyIndex) * (unsigned long long)task / SPECTRUM_REORG_TASKS);
+        if (index < jd.rangeBeginning[task - 1])
+        {
+            index = jd.rangeBeginning[task - 1];
+        }
+        while (index < SPECTRUM_CAPACITY && !isZero(spectrum[index].publicKey))
+        {
+            index++;
+        }
+        jd.rangeBeginning[task] = index;
+    }
+    jd.rangeBeginning[SPECTRUM_REORG_TASKS] = SPECTRUM_CAPACITY;
+
+    parallelJob.run(reorganizeSpectrumRebuildTask, nullptr, SPECTRUM_REORG_TASKS);
+    parallelJob.run(reorganizeSpectrumCopyAndHashTask, nullptr, SPECTRUM_REORG_TASKS);
+
+    spectrumInfo.numberOfEntities = 0;
+    spectrumInfo.totalAmount = 0;
+    for (unsigned int task = 0; task < SPECTRUM_REORG_TASKS; task++)
+    {
+        spectrumInfo.numberOfEntities += jd.spectrumInfo[task].numberOfEntities;
+        spectrumInfo.totalAmount += jd.spectrumInfo[task].totalAmount;
+    }
+
+    // Compute tree levels, in parallel as long as levels are large enough
+    unsigned int digestIndex = SPECTRUM_CAPACITY;
     unsigned int previousLevelBeginning = 0;
     unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
     while (numberOfLeafs > 1)
     {
-        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
+        if ((numberOfLeafs >> 1) >= SPECTRUM_REORG_TASKS * 256)
+        {
+            jd.levelInputBeginning = previousLevelBeginning;
+            jd.levelOutputBeginning = digestIndex;
+            jd.levelOutputCount = numberOfLeafs >> 1;
+            parallelJob.run(reorganizeSpectrumLevelTask, nullptr, SPECTRUM_REORG_TASKS);
+        }
+        else
         {
-            KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex++]);
+            KangarooTwelve64To32Multiple(&spectrumDigests[previousLevelBeginning], &spectrumDigests[digestIndex], numberOfLeafs >> 1);
         }
+        digestIndex += numberOfLeafs >> 1;
 
         previousLevelBeginning += numberOfLeafs;
         numberOfLeafs >>= 1;
     }
 
-    updateSpectrumInfo();
+    endSpectrumLayoutChange();
+
+    // Indices have changed and all digests are up to date
+    resetSpectrumChangeJournal();
 
     spectrumReorgTotalExecutionTicks += __rdtsc() - spectrumReorgStartTick;
 }
 
-static int spectrumIndex(const m256i& publicKey)
+// Task of ParallelJob: compute leaf digests of one part of the spectrum and the subtree of digests above them
+static void computeSpectrumDigestsTask(void*, unsigned int taskIndex)
 {
-    if (isZero(publicKey))
+    unsigned int digestsPerTask = SPECTRUM_CAPACITY / SPECTRUM_REORG_TASKS;
+    KangarooTwelve64To32Multiple(&spectrum[taskIndex * digestsPerTask], &spectrumDigests[taskIndex * digestsPerTask], digestsPerTask);
+
+    unsigned int levelBeginning = 0;
+    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
+    while (digestsPerTask > 1)
     {
-        return -1;
+        KangarooTwelve64To32Multiple(&spectrumDigests[levelBeginning + taskIndex * digestsPerTask],
+            &spectrumDigests[levelBeginning + numberOfLeafs + taskIndex * (digestsPerTask >> 1)], digestsPerTask >> 1);
+        levelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
+        digestsPerTask >>= 1;
     }
+}
 
-    unsigned int index = publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
+// Start computing all spectrum digests from scratch (after loading the spectrum) with parallelJob. The calling
+// processor can do other work (such as loading files) until it calls finishComputingSpectrumDigests().
+static void startComputingSpectrumDigests()
+{
+    nodeStateSnapshot.beforeWrite(spectrumDigests, spectrumDigestsSizeInByte);
+    parallelJob.start(computeSpectrumDigestsTask, nullptr, SPECTRUM_REORG_TASKS);
+}
 
-    ACQUIRE(spectrumLock);
+// Wait for the tasks started by startComputingSpectrumDigests() and compute the top levels of the digest tree.
+// The result is the same as with sequential hashing.
+static void finishComputingSpectrumDigests()
+{
+    parallelJob.finish();
 
-iteration:
-    if (spectrum[index].publicKey == publicKey)
+    unsigned int previousLevelBeginning = 0;
+    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
+    while (numberOfLeafs > SPECTRUM_REORG_TASKS)
     {
-        RELEASE(spectrumLock);
+        previousLevelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
+    }
+    unsigned int digestIndex = previousLevelBeginning + numberOfLeafs;
+    while (numberOfLeafs > 1)
+    {
+        KangarooTwelve64To32Multiple(&spectrumDigests[previousLevelBeginning], &spectrumDigests[digestIndex], numberOfLeafs >> 1);
+        digestIndex += numberOfLeafs >> 1;
 
-        return index;
+        previousLevelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
     }
-    else
+
+    // All digests are up to date
+    resetSpectrumChangeJournal();
+}
+
+// Return index of entity in spectrum or -1 if not found. Does not acquire spectrumLock, so concurrent lookups do not
+// block each other. Writers may insert entities or reorganize the hash map concurrently, which is detected with
+// spectrumLayoutVersion (lookup is repeated in this case).
+static int spectrumIndex(const m256i& publicKey)
+{
+    if (isZero(publicKey))
     {
-        if (isZero(spectrum[index].publicKey))
-        {
-            RELEASE(spectrumLock);
+        return -1;
+    }
 
-            return -1;
+    while (true)
+    {
+        const long long layoutVersion = spectrumLayoutVersion;
+        if (layoutVersion & 1)
+        {
+            // writer is changing the layout
+            _mm_pause();
+            continue;
         }
-        else
+        _ReadWriteBarrier();
+
+        int result = -1;
+        unsigned int index = publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
+        for (unsigned int probes = 0; probes < SPECTRUM_CAPACITY; probes++)
         {
+            if (spectrum[index].publicKey == publicKey)
+            {
+                result = index;
+                break;
+            }
+            if (isZero(spectrum[index].publicKey))
+            {
+                break;
+            }
             index = (index + 1) & (SPECTRUM_CAPACITY - 1);
+        }
 
-            goto iteration;
+        // x64 does not reorder loads with other loads, so preventing compiler reordering is sufficient
+        _ReadWriteBarrier();
+        if (spectrumLayoutVersion == layoutVersion)
+        {
+            return result;
         }
     }
 }
@@ -251,6 +603,10 @@ static void increaseEnergy(const m256i& publicKey, long long amount)
             DustBurnLogger dbl;
 #endif
 
+            // Burning changes entities all over the spectrum
+            nodeStateSnapshot.beforeWrite(spectrum, spectrumSizeInBytes);
+            spectrumDeltaSnapshot.markAllChanged();
+
             if (dustThresholdBurnAll > 0)
             {
                 // Burn every balance with balance < dustThresholdBurnAll
@@ -305,9 +661,11 @@ static void increaseEnergy(const m256i& publicKey, long long amount)
     iteration:
         if (spectrum[index].publicKey == publicKey)
         {
+            nodeStateSnapshot.beforeWrite(&spectrum[index], sizeof(::Entity));
             spectrum[index].incomingAmount += amount;
             spectrum[index].numberOfIncomingTransfers++;
             spectrum[index].latestIncomingTransferTick = system.tick;
+            journalSpectrumChange(index);
 
             spectrumInfo.totalAmount += amount;
         }
@@ -315,10 +673,14 @@ static void increaseEnergy(const m256i& publicKey, long long amount)
         {
             if (isZero(spectrum[index].publicKey))
             {
+                nodeStateSnapshot.beforeWrite(&spectrum[index], sizeof(::Entity));
+                beginSpectrumLayoutChange();
                 spectrum[index].publicKey = publicKey;
+                endSpectrumLayoutChange();
                 spectrum[index].incomingAmount = amount;
                 spectrum[index].numberOfIncomingTransfers = 1;
                 spectrum[index].latestIncomingTransferTick = system.tick;
+                journalSpectrumChange(index);
 
                 spectrumInfo.numberOfEntities++;
                 spectrumInfo.totalAmount += amount;
@@ -354,9 +716,11 @@ static bool decreaseEnergy(const int index, long long amount)
 
         if (energy(index) >= amount)
         {
+            nodeStateSnapshot.beforeWrite(&spectrum[index], sizeof(::Entity));
             spectrum[index].outgoingAmount += amount;
             spectrum[index].numberOfOutgoingTransfers++;
             spectrum[index].latestOutgoingTransferTick = system.tick;
+            journalSpectrumChange(index);
 
             spectrumInfo.totalAmount -= amount;
 
@@ -375,10 +739,9 @@ static bool decreaseEnergy(const int index, long long amount)
 static bool loadSpectrum(const CHAR16* fileName = SPECTRUM_FILE_NAME, const CHAR16* directory = nullptr)
 {
     logToConsole(L"Loading spectrum file ...");
-    long long loadedSize = load(fileName, SPECTRUM_CAPACITY * sizeof(::Entity), (unsigned char*)spectrum, directory);
-    if (loadedSize != SPECTRUM_CAPACITY * sizeof(::Entity))
+    if (!spectrumDeltaSnapshot.load(fileName, spectrum, directory))
     {
-        logStatusToConsole(L"EFI_FILE_PROTOCOL.Read() reads invalid number of bytes", loadedSize, __LINE__);
+        logToConsole(L"Failed to load spectrum file and its deltas!");
 
         return false;
     }
@@ -393,13 +756,16 @@ static bool saveSpectrum(const CHAR16* fileName = SPECTRUM_FILE_NAME, const CHAR
     const unsigned long long beginningTick = __rdtsc();
 
     ACQUIRE(spectrumLock);
-    long long savedSize = save(fileName, SPECTRUM_CAPACITY * sizeof(::Entity), (unsigned char*)spectrum, directory);
+#if !SAVE_STATE_DELTA_FILES
+    spectrumDeltaSnapshot.markAllChanged();
+#endif
+    long long savedSize = spectrumDeltaSnapshot.save(fileName, spectrum, directory, SAVE_COMPRESSED_STATE_FILES);
     RELEASE(spectrumLock);
 
-    if (savedSize == SPECTRUM_CAPACITY * sizeof(::Entity))
+    if (savedSize >= 0)
     {
         setNumber(message, savedSize, TRUE);
-        appendText(message, L" bytes of the spectrum data are saved (");
+        appendText(message, (savedSize == SPECTRUM_CAPACITY * sizeof(::Entity)) ? L" bytes of the spectrum data are saved (" : L" bytes of the spectrum delta are saved (");
         appendNumber(message, (__rdtsc() - beginningTick) * 1000000 / frequency, TRUE);
         appendText(message, L" microseconds).");
         logToConsole(message);
@@ -416,6 +782,8 @@ static bool initSpectrum()
         logToConsole(L"Failed to allocate spectrum memory!");
         return false;
     }
+    setMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), 0);
+    resetSpectrumChangeJournal();
 
     return true;
 }
@@ -137,7 +137,7 @@ private:
     bool saveTickData(unsigned long long nTick, CHAR16* directory = NULL)
     {
         long long totalWriteSize = nTick * sizeof(TickData);
-        auto sz = saveLargeFile(SNAPSHOT_TICK_DATA_FILE_NAME, totalWriteSize, (unsigned char*)tickDataPtr, directory);
+        auto sz = saveLargeFile(SNAPSHOT_TICK_DATA_FILE_NAME, totalWriteSize, (unsigned char*)tickDataPtr, directory, true, SAVE_COMPRESSED_STATE_FILES);
         if (sz != totalWriteSize)
         {
             return false;
@@ -147,7 +147,7 @@ private:
     bool saveTicks(unsigned long long nTick, CHAR16* directory = NULL)
     {
         long long totalWriteSize = nTick * sizeof(Tick) * NUMBER_OF_COMPUTORS;
-        auto sz = saveLargeFile(SNAPSHOT_TICKS_FILE_NAME, totalWriteSize, (unsigned char*)ticksPtr, directory);
+        auto sz = saveLargeFile(SNAPSHOT_TICKS_FILE_NAME, totalWriteSize, (unsigned char*)ticksPtr, directory, true, SAVE_COMPRESSED_STATE_FILES);
         if (sz != totalWriteSize)
         {
             return false;
@@ -157,7 +157,7 @@ private:
     bool saveTickTransactionOffsets(unsigned long long nTick, CHAR16* directory = NULL)
     {
         long long totalWriteSize = nTick * sizeof(tickTransactionOffsetsPtr[0]) * NUMBER_OF_TRANSACTIONS_PER_TICK;
-        auto sz = saveLargeFile(SNAPSHOT_TICK_TRANSACTION_OFFSET_FILE_NAME, totalWriteSize, (unsigned char*)tickTransactionOffsetsPtr, directory);
+        auto sz = saveLargeFile(SNAPSHOT_TICK_TRANSACTION_OFFSET_FILE_NAME, totalWriteSize, (unsigned char*)tickTransactionOffsetsPtr, directory, true, SAVE_COMPRESSED_STATE_FILES);
         if (sz != totalWriteSize)
         {
             return false;
@@ -197,7 +197,7 @@ private:
         // saving from the first tx of from tick to the last tx of (totick)
         long long totalWriteSize = toPtr;
         unsigned char* ptr = tickTransactionsPtr;
-        auto sz = saveLargeFile(SNAPSHOT_TRANSACTIONS_FILE_NAME, totalWriteSize, (unsigned char*)ptr, directory);
+        auto sz = saveLargeFile(SNAPSHOT_TRANSACTIONS_FILE_NAME, totalWriteSize, (unsigned char*)ptr, directory, true, SAVE_COMPRESSED_STATE_FILES);
         if (sz != totalWriteSize)
         {
             outTotalTransactionSize = -1;
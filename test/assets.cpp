@@ -11,6 +11,13 @@
 
 #include "test_util.h"
 
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
 
 class AssetsTest : public AssetStorage
 {
@@ -134,6 +141,60 @@ public:
 
             issuanceIdx = indexLists.nextIdx[issuanceIdx];
         }
+
+        // check that each record is in the entity list of its public key exactly once and lists have no other elements
+        std::vector<unsigned char> entityListElementCount(ASSETS_CAPACITY, 0);
+        unsigned long long entityListElementTotal = 0;
+        for (unsigned int slot = 0; slot < ASSETS_CAPACITY; slot++)
+        {
+            unsigned int recordIdx = indexLists.entityRecordsFirstIdx[slot];
+            while (recordIdx != NO_ASSET_INDEX)
+            {
+                ASSERT_LT(recordIdx, ASSETS_CAPACITY);
+                EXPECT_NE(assets[recordIdx].varStruct.issuance.type, EMPTY);
+                EXPECT_EQ(IndexLists::entitySlot(assets[recordIdx].varStruct.issuance.publicKey), slot);
+                ASSERT_EQ(entityListElementCount[recordIdx], 0);
+                ++entityListElementCount[recordIdx];
+                ++entityListElementTotal;
+                recordIdx = indexLists.entityRecordsNextIdx[recordIdx];
+            }
+        }
+        unsigned long long recordTotal = 0;
+        for (unsigned int index = 0; index < ASSETS_CAPACITY; index++)
+        {
+            if (assets[index].varStruct.issuance.type != EMPTY)
+            {
+                EXPECT_EQ(entityListElementCount[index], 1);
+                ++recordTotal;
+            }
+        }
+        EXPECT_EQ(entityListElementTotal, recordTotal);
+    }
+
+    // Return indices of records of given type and public key found with the entity index
+    static std::set<unsigned int> getEntityRecords(const m256i& publicKey, unsigned char type)
+    {
+        std::set<unsigned int> records;
+        unsigned int recordIdx = indexLists.entityRecordsFirstIdx[IndexLists::entitySlot(publicKey)];
+        while (recordIdx != NO_ASSET_INDEX)
+        {
+            if (assets[recordIdx].varStruct.issuance.type == type && assets[recordIdx].varStruct.issuance.publicKey == publicKey)
+                records.insert(recordIdx);
+            recordIdx = indexLists.entityRecordsNextIdx[recordIdx];
+        }
+        return records;
+    }
+
+    // Return indices of records of given type per public key found by scanning the whole universe
+    static std::map<m256i, std::set<unsigned int>> scanEntityRecords(unsigned char type)
+    {
+        std::map<m256i, std::set<unsigned int>> records;
+        for (unsigned int index = 0; index < ASSETS_CAPACITY; index++)
+        {
+            if (assets[index].varStruct.issuance.type == type)
+                records[assets[index].varStruct.issuance.publicKey].insert(index);
+        }
+        return records;
     }
 };
 
@@ -244,7 +305,7 @@ TEST(TestCoreAssets, AssetIteratorOwnershipAndPossession)
     for (int i = 0; i < issuancesCount; ++i)
     {
         int firstOwnershipIdx = -1, firstPossessionIdx = -1, issuanceIdx = -1;
-        EXPECT_EQ(issueAsset(issuances[i].id.issuer, assetNameFromInt64(issuances[i].id.assetName).c_str(), 0, CONTRACT_ASSET_UNIT_OF_MEASUREMENT,
+        EXPECT_EQ(issueAsset(issuances[i].id.issuer, (const char*)&issuances[i].id.assetName, 0, CONTRACT_ASSET_UNIT_OF_MEASUREMENT,
             issuances[i].numOfShares, issuances[i].managingContract, &issuanceIdx, &firstOwnershipIdx, &firstPossessionIdx), issuances[i].numOfShares);
         issuances[i].universeIdx = issuanceIdx;
 
@@ -411,6 +472,213 @@ TEST(TestCoreAssets, AssetIteratorOwnershipAndPossession)
     test.checkAssetsConsistency();
 }
 
+TEST(TestCoreAssets, EntityIndex)
+{
+    AssetsTest test;
+    test.clearUniverse();
+
+    // Entities 1 and 2 map to the same slot of the entity index
+    const id issuer(1, 2, 3, 4);
+    const id entities[] = { id(1, 5, 6, 7), id(1 + ASSETS_CAPACITY, 5, 6, 7), id(100, 5, 6, 7), id(ASSETS_CAPACITY - 1, 1, 1, 1) };
+    constexpr int entityCount = sizeof(entities) / sizeof(entities[0]);
+    EXPECT_EQ(AssetStorage::IndexLists::entitySlot(entities[0]), AssetStorage::IndexLists::entitySlot(entities[1]));
+
+    auto checkEntities = [&]()
+    {
+        test.checkAssetsConsistency();
+        for (unsigned char type : { ISSUANCE, OWNERSHIP, POSSESSION })
+        {
+            auto records = test.scanEntityRecords(type);
+            for (const auto& entity : { issuer, entities[0], entities[1], entities[2], entities[3] })
+            {
+                EXPECT_EQ(test.getEntityRecords(entity, type), records[entity]);
+            }
+        }
+    };
+
+    // Issue assets and transfer shares to entities
+    const unsigned long long assetNames[] = { assetNameFromString("AAA"), assetNameFromString("BBB"), assetNameFromString("CCC") };
+    for (int i = 0; i < 3; ++i)
+    {
+        int issuanceIdx, ownershipIdx, possessionIdx;
+        EXPECT_EQ(issueAsset(issuer, (const char*)&assetNames[i], 0, CONTRACT_ASSET_UNIT_OF_MEASUREMENT, 1000, 1, &issuanceIdx, &ownershipIdx, &possessionIdx), 1000);
+        for (int j = 0; j < entityCount; ++j)
+        {
+            int destOwnershipIdx, destPossessionIdx;
+            EXPECT_TRUE(transferShareOwnershipAndPossession(ownershipIdx, possessionIdx, entities[j], 10 * (j + 1), &destOwnershipIdx, &destPossessionIdx, false));
+        }
+        checkEntities();
+    }
+    EXPECT_EQ(test.getEntityRecords(issuer, ISSUANCE).size(), 3);
+    EXPECT_EQ(test.getEntityRecords(entities[1], OWNERSHIP).size(), 3);
+    EXPECT_EQ(test.getEntityRecords(entities[1], POSSESSION).size(), 3);
+    EXPECT_EQ(test.getEntityRecords(entities[1], ISSUANCE).size(), 0);
+
+    // Transfer all shares of entity 0 to entity 2 (leaves records with 0 shares until end of epoch)
+    {
+        AssetIssuanceId issuanceId(issuer, assetNameFromString("AAA"));
+        AssetPossessionIterator iter(issuanceId, AssetOwnershipSelect::byOwner(entities[0]), AssetPossessionSelect::byPossessor(entities[0]));
+        ASSERT_FALSE(iter.reachedEnd());
+        int destOwnershipIdx, destPossessionIdx;
+        EXPECT_TRUE(transferShareOwnershipAndPossession(iter.ownershipIndex(), iter.possessionIndex(), entities[2], 10, &destOwnershipIdx, &destPossessionIdx, false));
+        checkEntities();
+    }
+
+    // Records without shares are removed and hash map is reorganized
+    assetsEndEpoch();
+    checkEntities();
+    EXPECT_EQ(test.getEntityRecords(entities[0], OWNERSHIP).size(), 2);
+    EXPECT_EQ(test.getEntityRecords(entities[0], POSSESSION).size(), 2);
+    EXPECT_EQ(test.getEntityRecords(entities[1], OWNERSHIP).size(), 3);
+
+    // Reload: loadUniverse() rebuilds the index from the loaded records
+    as.indexLists.reset();
+    as.indexLists.rebuild();
+    checkEntities();
+    EXPECT_EQ(test.getEntityRecords(entities[2], POSSESSION).size(), 3);
+}
+
+TEST(TestCoreAssets, ParallelReadersAndWriters)
+{
+    AssetsTest test;
+    test.clearUniverse();
+
+    // Each writer transfers shares between the entities of its own issuance
+    constexpr int writerCount = 2;
+    constexpr int readerCount = 3;
+    constexpr int entityCount = 4;
+    constexpr long long totalShares = 1000000;
+    constexpr int transfersPerWriter = 1000;
+    AssetIssuanceId issuanceIds[writerCount];
+    int ownershipIdx[writerCount][entityCount], possessionIdx[writerCount][entityCount];
+    long long shares[writerCount][entityCount];
+    for (int w = 0; w < writerCount; ++w)
+    {
+        issuanceIds[w] = AssetIssuanceId(id(w + 1, 2, 3, 4), assetNameFromString("TEST"));
+        int issuanceIdx;
+        EXPECT_EQ(issueAsset(issuanceIds[w].issuer, (const char*)&issuanceIds[w].assetName, 0, CONTRACT_ASSET_UNIT_OF_MEASUREMENT, totalShares, 1,
+            &issuanceIdx, &ownershipIdx[w][0], &possessionIdx[w][0]), totalShares);
+        shares[w][0] = totalShares;
+        for (int e = 1; e < entityCount; ++e)
+        {
+            EXPECT_TRUE(transferShareOwnershipAndPossession(ownershipIdx[w][0], possessionIdx[w][0], id(w + 1, e, 0, 0), 1000, &ownershipIdx[w][e], &possessionIdx[w][e], true));
+            shares[w][0] -= 1000;
+            shares[w][e] = 1000;
+        }
+    }
+
+    std::atomic<int> writersRunning = writerCount;
+    std::atomic<unsigned long long> totalReads = 0;
+    std::vector<std::thread> threads;
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (int w = 0; w < writerCount; ++w)
+    {
+        threads.emplace_back([&, w]()
+            {
+                std::mt19937_64 gen64(w);
+                for (int i = 0; i < transfersPerWriter; ++i)
+                {
+                    const int src = gen64() % entityCount;
+                    const int dst = (src + 1 + gen64() % (entityCount - 1)) % entityCount;
+                    if (!shares[w][src])
+                        continue;
+                    const long long amount = 1 + gen64() % shares[w][src];
+                    int dstOwnershipIdx, dstPossessionIdx;
+                    EXPECT_TRUE(transferShareOwnershipAndPossession(ownershipIdx[w][src], possessionIdx[w][src], assets[ownershipIdx[w][dst]].varStruct.ownership.publicKey, amount,
+                        &dstOwnershipIdx, &dstPossessionIdx, true));
+                    EXPECT_EQ(dstOwnershipIdx, ownershipIdx[w][dst]);
+                    EXPECT_EQ(dstPossessionIdx, possessionIdx[w][dst]);
+                    shares[w][src] -= amount;
+                    shares[w][dst] += amount;
+                    std::this_thread::yield();
+                }
+                --writersRunning;
+            });
+    }
+    for (int r = 0; r < readerCount; ++r)
+    {
+        threads.emplace_back([&, r]()
+            {
+                // Shares are moved between records while writing, so the totals are only correct with locking
+                unsigned long long reads = 0;
+                do
+                {
+                    const int w = reads % writerCount;
+                    EXPECT_EQ(numberOfShares(issuanceIds[w]), totalShares);
+                    EXPECT_EQ(numberOfShares(issuanceIds[w], AssetOwnershipSelect::any(), AssetPossessionSelect::byManagingContract(1)), totalShares);
+                    ++reads;
+                    std::this_thread::yield();
+                } while (writersRunning);
+                totalReads += reads;
+            });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    std::cout << writerCount * transfersPerWriter << " transfers and " << totalReads << " reads by "
+        << writerCount << " writers and " << readerCount << " readers in "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count() << " ms" << std::endl;
+
+    for (int w = 0; w < writerCount; ++w)
+    {
+        for (int e = 0; e < entityCount; ++e)
+        {
+            EXPECT_EQ(numberOfPossessedShares(issuanceIds[w].assetName, issuanceIds[w].issuer, assets[ownershipIdx[w][e]].varStruct.ownership.publicKey,
+                assets[ownershipIdx[w][e]].varStruct.ownership.publicKey, 1, 1), shares[w][e]);
+        }
+    }
+    test.checkAssetsConsistency();
+}
+
+TEST(TestCoreAssets, ParallelStartupDigestsEqualSequential)
+{
+    AssetsTest test;
+    test.clearUniverse();
+    std::mt19937_64 gen64(42);
+    for (int i = 0; i < 100000; i++)
+    {
+        unsigned long long* asset = (unsigned long long*)&assets[gen64() % ASSETS_CAPACITY];
+        for (unsigned int j = 0; j < sizeof(Asset) / 8; j++)
+            asset[j] = gen64();
+    }
+
+    // Reference: sequential hashing of all assets
+    setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0xFF);
+    m256i referenceDigest;
+    getUniverseDigest(referenceDigest);
+    std::vector<m256i> referenceDigests(assetDigests, assetDigests + (ASSETS_CAPACITY * 2 - 1));
+
+    // Parallel computation with helpers while main thread does other work
+    setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0xFF);
+    memset(assetDigests, 0, assetDigestsSizeInBytes);
+    volatile bool stopHelpers = false;
+    std::vector<std::thread> helpers;
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        helpers.emplace_back([&stopHelpers]()
+            {
+                while (!stopHelpers)
+                {
+                    if (!parallelJob.tryHelp())
+                        std::this_thread::yield();
+                }
+            });
+    }
+    startComputingUniverseDigests();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    m256i digest;
+    finishComputingUniverseDigests(digest);
+    stopHelpers = true;
+    for (auto& helper : helpers)
+        helper.join();
+
+    EXPECT_EQ(digest, referenceDigest);
+    EXPECT_EQ(memcmp(assetDigests, referenceDigests.data(), assetDigestsSizeInBytes), 0);
+    for (unsigned int i = 0; i < ASSETS_CAPACITY / 64; i++)
+        EXPECT_EQ(assetChangeFlags[i], 0ull);
+}
+
 /*
 TODO test
 - end epoch
@@ -0,0 +1,186 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/platform/file_io.h"
+#include "../src/network_messages/entity.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+
+// Writer / reader for compressStream() / decompressStream() keeping the compressed file in memory
+struct VectorWriter
+{
+    std::vector<unsigned char> data;
+
+    bool write(unsigned long long size, const unsigned char* buffer)
+    {
+        data.insert(data.end(), buffer, buffer + size);
+        return true;
+    }
+};
+
+struct VectorReader
+{
+    const std::vector<unsigned char>& data;
+    unsigned long long offset;
+
+    bool read(unsigned long long size, unsigned char* buffer)
+    {
+        if (size > data.size() - offset)
+            return false;
+        memcpy(buffer, data.data() + offset, size);
+        offset += size;
+        return true;
+    }
+};
+
+static std::vector<unsigned char> compress(const std::vector<unsigned char>& data)
+{
+    const BufferDataSource dataSource = { data.data() };
+    VectorWriter writer;
+    EXPECT_TRUE(compressStream(dataSource, data.size(), writer));
+    return writer.data;
+}
+
+static bool decompress(const std::vector<unsigned char>& compressed, std::vector<unsigned char>& data)
+{
+    VectorReader reader = { compressed, 0 };
+    CompressedFileHeader header;
+    return reader.read(sizeof(header), (unsigned char*)&header)
+        && isCompressedFileHeader(header, data.size())
+        && decompressStream(reader, data.size(), data.data())
+        && reader.offset == compressed.size();
+}
+
+static void expectRoundTrip(const std::vector<unsigned char>& data)
+{
+    const std::vector<unsigned char> compressed = compress(data);
+    const unsigned long long blockCount = (data.size() + COMPRESSION_BLOCK_SIZE - 1) / COMPRESSION_BLOCK_SIZE;
+    EXPECT_LE(compressed.size(), sizeof(CompressedFileHeader) + data.size() + blockCount * sizeof(unsigned int));
+    std::vector<unsigned char> decompressed(data.size(), 0xcd);
+    EXPECT_TRUE(decompress(compressed, decompressed));
+    EXPECT_TRUE(decompressed == data);
+}
+
+TEST(TestCoreBlockCompression, RoundTripPatterns)
+{
+    std::mt19937_64 gen64(42);
+
+    // Empty, all zero, incompressible, and sizes that aren't a multiple of the block size
+    expectRoundTrip(std::vector<unsigned char>());
+    expectRoundTrip(std::vector<unsigned char>(3 * COMPRESSION_BLOCK_SIZE + 5, 0));
+    std::vector<unsigned char> data(2 * COMPRESSION_BLOCK_SIZE + 1000);
+    for (auto& byte : data)
+        byte = (unsigned char)gen64();
+    expectRoundTrip(data);
+
+    // Random mix of zero runs of all lengths (including runs crossing block boundaries) and literals
+    for (int i = 0; i < 20; i++)
+    {
+        data.assign(1 + gen64() % (4 * COMPRESSION_BLOCK_SIZE), 0);
+        for (unsigned long long offset = 0; offset < data.size(); )
+        {
+            const unsigned long long length = 1 + gen64() % ((i & 1) ? 20 : 5000);
+            if (gen64() & 1)
+            {
+                for (unsigned long long j = offset; j < offset + length && j < data.size(); j++)
+                    data[j] = (unsigned char)(1 + gen64() % 255);
+            }
+            offset += length;
+        }
+        expectRoundTrip(data);
+    }
+}
+
+TEST(TestCoreBlockCompression, InvalidDataIsRejected)
+{
+    std::vector<unsigned char> data(COMPRESSION_BLOCK_SIZE + 100, 0);
+    data[10] = 1;
+    data[COMPRESSION_BLOCK_SIZE + 50] = 2;
+    std::vector<unsigned char> compressed = compress(data);
+    std::vector<unsigned char> decompressed(data.size());
+    EXPECT_TRUE(decompress(compressed, decompressed));
+
+    // Truncated
+    std::vector<unsigned char> truncated(compressed.begin(), compressed.end() - 1);
+    EXPECT_FALSE(decompress(truncated, decompressed));
+
+    // Wrong size
+    std::vector<unsigned char> wrongSize(data.size() + 1);
+    EXPECT_FALSE(decompress(compressed, wrongSize));
+
+    // Compressed file with wrong size isn't loaded as raw file
+    VectorReader reader = { compressed, 0 };
+    EXPECT_TRUE(loadFromReader(reader, decompressed.size(), decompressed.data()));
+    EXPECT_TRUE(decompressed == data);
+    reader.offset = 0;
+    EXPECT_FALSE(loadFromReader(reader, wrongSize.size(), wrongSize.data()));
+
+    // Zero run exceeding block
+    const unsigned char payload[] = { 0, 0xff, 0xff, 0x7f };
+    unsigned char block[COMPRESSION_BLOCK_SIZE];
+    EXPECT_FALSE(decompressBlock(sizeof(payload), payload, block, COMPRESSION_BLOCK_SIZE));
+    EXPECT_FALSE(decompressBlock(COMPRESSED_BLOCK_STORED_FLAG | 10, payload, block, 11));
+}
+
+TEST(TestCoreBlockCompression, RealisticSparseSpectrum)
+{
+    // Spectrum hash map with the same fill ratio as the mainnet spectrum (about 4% of the slots used), at 1/16 of
+    // SPECTRUM_CAPACITY to keep the test fast
+    constexpr unsigned int capacity = 1 << 20;
+    std::mt19937_64 gen64(1234);
+    std::vector<unsigned char> data(capacity * sizeof(::Entity), 0);
+    ::Entity* spectrum = (::Entity*)data.data();
+    for (unsigned int i = 0; i < capacity / 25; i++)
+    {
+        ::Entity& entity = spectrum[gen64() % capacity];
+        for (int j = 0; j < 4; j++)
+            entity.publicKey.m256i_u64[j] = gen64();
+        entity.incomingAmount = gen64() % 100000000000000ULL;
+        entity.outgoingAmount = gen64() % (entity.incomingAmount + 1);
+        entity.numberOfIncomingTransfers = (unsigned int)(gen64() % 1000);
+        entity.numberOfOutgoingTransfers = (unsigned int)(gen64() % 100);
+        entity.latestIncomingTransferTick = 17000000 + (unsigned int)(gen64() % 1000000);
+        entity.latestOutgoingTransferTick = entity.numberOfOutgoingTransfers ? 17000000 + (unsigned int)(gen64() % 1000000) : 0;
+    }
+
+    auto saveBegin = std::chrono::high_resolution_clock::now();
+    const std::vector<unsigned char> compressed = compress(data);
+    auto saveEnd = std::chrono::high_resolution_clock::now();
+    std::vector<unsigned char> decompressed(data.size());
+    EXPECT_TRUE(decompress(compressed, decompressed));
+    auto loadEnd = std::chrono::high_resolution_clock::now();
+    EXPECT_TRUE(decompressed == data);
+
+    const double ratio = double(data.size()) / compressed.size();
+    const auto saveMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(saveEnd - saveBegin).count();
+    const auto loadMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(loadEnd - saveEnd).count();
+    std::cout << "Sparse spectrum: " << data.size() << " bytes compressed to " << compressed.size() << " bytes (ratio "
+        << ratio << "), compression " << saveMicroseconds << " us (" << data.size() / (saveMicroseconds + 1) << " MB/s), "
+        << "decompression " << loadMicroseconds << " us (" << data.size() / (loadMicroseconds + 1) << " MB/s)" << std::endl;
+    EXPECT_GT(ratio, 10.0);
+
+    // load() detects compressed and raw files
+    const char* testFileName = "block_compression_test.tmp";
+    for (int compressedFile = 0; compressedFile < 2; compressedFile++)
+    {
+        FILE* file = fopen(testFileName, "wb");
+        ASSERT_NE(file, nullptr);
+        const std::vector<unsigned char>& content = compressedFile ? compressed : data;
+        EXPECT_EQ(fwrite(content.data(), 1, content.size(), file), content.size());
+        fclose(file);
+
+        std::fill(decompressed.begin(), decompressed.end(), 0xcd);
+        auto loadFileBegin = std::chrono::high_resolution_clock::now();
+        EXPECT_EQ(load(L"block_compression_test.tmp", data.size(), decompressed.data()), (long long)data.size());
+        auto loadFileEnd = std::chrono::high_resolution_clock::now();
+        EXPECT_TRUE(decompressed == data);
+        std::cout << "load() of " << (compressedFile ? "compressed" : "raw") << " file: "
+            << std::chrono::duration_cast<std::chrono::microseconds>(loadFileEnd - loadFileBegin).count() << " us" << std::endl;
+    }
+    remove(testFileName);
+}
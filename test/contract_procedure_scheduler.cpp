@@ -0,0 +1,185 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/contract_core/contract_procedure_scheduler.h"
+
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+static constexpr unsigned int testContractCount = 12;
+static constexpr unsigned int testSlotCount = 4;
+
+typedef ContractProcedureScheduler<testSlotCount, testContractCount> TestScheduler;
+
+struct TestInvocation
+{
+    unsigned int contractIndex;
+    unsigned long long input;
+    unsigned int workIterations;
+};
+
+// Procedure of isolated contract: only changes own state, result depends on order of invocations of same contract
+static void runIsolatedProcedure(unsigned long long* states, const TestInvocation& invocation)
+{
+    unsigned long long state = states[invocation.contractIndex];
+    for (unsigned int i = 0; i < invocation.workIterations; i++)
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    states[invocation.contractIndex] = state ^ invocation.input;
+}
+
+// Procedure of other contract: reads the states of all other contracts
+static void runOtherProcedure(unsigned long long* states, const TestInvocation& invocation)
+{
+    unsigned long long sum = invocation.input;
+    for (unsigned int i = 0; i < testContractCount; i++)
+        sum = sum * 31 + states[i];
+    states[invocation.contractIndex] = sum;
+}
+
+static bool isIsolatedTestContract(unsigned int contractIndex)
+{
+    return contractIndex % 3 != 0;
+}
+
+static void testParallelExecution(unsigned int slotCount, unsigned long long seed)
+{
+    std::mt19937_64 gen64(seed);
+    std::vector<TestInvocation> invocations(512);
+    for (auto& invocation : invocations)
+    {
+        invocation.contractIndex = 1 + gen64() % (testContractCount - 1);
+        invocation.input = gen64();
+        invocation.workIterations = gen64() % 3000;
+    }
+
+    // Reference: run all invocations in order
+    unsigned long long expectedStates[testContractCount] = { 0 };
+    for (const auto& invocation : invocations)
+    {
+        if (isIsolatedTestContract(invocation.contractIndex))
+            runIsolatedProcedure(expectedStates, invocation);
+        else
+            runOtherProcedure(expectedStates, invocation);
+    }
+
+    TestScheduler* scheduler = new TestScheduler;
+    setMem(scheduler, sizeof(*scheduler), 0);
+    scheduler->init(slotCount);
+    for (unsigned int i = 0; i < testContractCount; i++)
+    {
+        if (isIsolatedTestContract(i))
+            scheduler->setIsolated(i);
+    }
+
+    // Contract processors of slots (run by main loop in the node)
+    unsigned long long states[testContractCount] = { 0 };
+    std::atomic<bool> stop = false;
+    std::vector<std::thread> contractProcessors;
+    for (unsigned int slot = 0; slot < slotCount; slot++)
+    {
+        contractProcessors.emplace_back([&, slot]()
+            {
+                while (!stop)
+                {
+                    if (scheduler->getState(slot) != TestScheduler::REQUESTED)
+                    {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    scheduler->setRunning(slot);
+                    const TestInvocation* invocation = (const TestInvocation*)scheduler->getTask(slot);
+                    EXPECT_EQ(invocation->contractIndex, scheduler->getContractIndex(slot));
+                    runIsolatedProcedure(states, *invocation);
+                    scheduler->finish(slot);
+                }
+            });
+    }
+
+    // Tick processor
+    unsigned long long numberOfIsolatedInvocations = 0;
+    for (const auto& invocation : invocations)
+    {
+        if (scheduler->canRunInParallel(invocation.contractIndex))
+        {
+            while (scheduler->tryStart(invocation.contractIndex, &invocation) < 0)
+                std::this_thread::yield();
+            numberOfIsolatedInvocations++;
+        }
+        else
+        {
+            scheduler->waitUntilIdle();
+            if (isIsolatedTestContract(invocation.contractIndex))
+                runIsolatedProcedure(states, invocation);
+            else
+                runOtherProcedure(states, invocation);
+        }
+    }
+    scheduler->waitUntilIdle();
+    EXPECT_TRUE(scheduler->isIdle());
+
+    stop = true;
+    for (auto& thread : contractProcessors)
+        thread.join();
+
+    for (unsigned int i = 0; i < testContractCount; i++)
+        EXPECT_EQ(states[i], expectedStates[i]);
+
+    EXPECT_EQ(scheduler->getNumberOfParallelInvocations(), (slotCount) ? numberOfIsolatedInvocations : 0);
+    EXPECT_LE(scheduler->getMaxRunningInvocations(), slotCount);
+    if (slotCount)
+        EXPECT_GE(scheduler->getMaxRunningInvocations(), 1u);
+
+    delete scheduler;
+}
+
+TEST(TestCoreContractProcedureScheduler, SameResultAsSequentialExecution)
+{
+    testParallelExecution(0, 1);
+    testParallelExecution(1, 2);
+    testParallelExecution(2, 3);
+    testParallelExecution(testSlotCount, 4);
+    testParallelExecution(testSlotCount, 5);
+}
+
+TEST(TestCoreContractProcedureScheduler, ConflictsAndFreeSlots)
+{
+    TestScheduler* scheduler = new TestScheduler;
+    setMem(scheduler, sizeof(*scheduler), 0);
+    EXPECT_FALSE(scheduler->canRunInParallel(1));
+
+    scheduler->init(2);
+    scheduler->setIsolated(1);
+    scheduler->setIsolated(2);
+    scheduler->setIsolated(3);
+    EXPECT_FALSE(scheduler->isIsolated(0));
+    EXPECT_TRUE(scheduler->canRunInParallel(1));
+    EXPECT_FALSE(scheduler->canRunInParallel(4));
+    EXPECT_TRUE(scheduler->isIdle());
+
+    const int task = 0;
+    EXPECT_EQ(scheduler->tryStart(1, &task), 0);
+    EXPECT_FALSE(scheduler->isIdle());
+
+    // Same contract has to wait, other contract gets next slot
+    EXPECT_EQ(scheduler->tryStart(1, &task), -1);
+    EXPECT_EQ(scheduler->tryStart(2, &task), 1);
+    EXPECT_EQ(scheduler->getState(1), TestScheduler::REQUESTED);
+
+    // All slots busy
+    EXPECT_EQ(scheduler->tryStart(3, &task), -1);
+    scheduler->setRunning(0);
+    scheduler->finish(0);
+    EXPECT_EQ(scheduler->tryStart(1, &task), 0);
+    EXPECT_EQ(scheduler->getMaxRunningInvocations(), 2u);
+
+    scheduler->finish(0);
+    scheduler->finish(1);
+    EXPECT_TRUE(scheduler->isIdle());
+    EXPECT_EQ(scheduler->getNumberOfParallelInvocations(), 3u);
+
+    delete scheduler;
+}
@@ -0,0 +1,141 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/contract_core/contract_state_digest.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+
+// Reference implementation of the definition: K12 of pages, Merkle tree padded with zero leafs
+static m256i referencePagedDigest(const std::vector<unsigned char>& state)
+{
+    std::vector<m256i> level;
+    for (unsigned long long offset = 0; offset < state.size(); offset += PagedStateDigest::pageSize)
+    {
+        const unsigned long long size = std::min<unsigned long long>(PagedStateDigest::pageSize, state.size() - offset);
+        m256i leaf;
+        KangarooTwelve(state.data() + offset, (unsigned int)size, &leaf, 32);
+        level.push_back(leaf);
+    }
+    while (level.size() & (level.size() - 1))
+        level.push_back(m256i::zero());
+    while (level.size() > 1)
+    {
+        std::vector<m256i> parents(level.size() / 2);
+        for (unsigned long long i = 0; i < parents.size(); i++)
+            KangarooTwelve64To32(&level[2 * i], &parents[i]);
+        level = parents;
+    }
+    return level[0];
+}
+
+static void testPagedStateDigest(unsigned long long stateSize, unsigned long long seed)
+{
+    std::mt19937_64 gen64(seed);
+    std::vector<unsigned char> state(stateSize);
+    for (auto& byte : state)
+        byte = (unsigned char)gen64();
+
+    PagedStateDigest pagedDigest;
+    ASSERT_TRUE(pagedDigest.init(stateSize));
+    EXPECT_EQ(pagedDigest.getPageCount(), (stateSize + PagedStateDigest::pageSize - 1) / PagedStateDigest::pageSize);
+
+    m256i digest;
+    pagedDigest.getDigest(state.data(), digest);
+    EXPECT_EQ(digest, referencePagedDigest(state));
+
+    // Same digest without buffers
+    m256i digestFromScratch;
+    PagedStateDigest::computeDigest(state.data(), stateSize, digestFromScratch);
+    EXPECT_EQ(digestFromScratch, digest);
+    if (stateSize <= PagedStateDigest::pageSize)
+    {
+        // Same as digest of whole state
+        m256i fullDigest;
+        KangarooTwelve(state.data(), (unsigned int)stateSize, &fullDigest, 32);
+        EXPECT_EQ(digest, fullDigest);
+    }
+
+    // No change -> no page rehashed
+    unsigned long long rehashedPages = pagedDigest.getNumberOfRehashedPages();
+    m256i digest2;
+    pagedDigest.getDigest(state.data(), digest2);
+    EXPECT_EQ(digest2, digest);
+    EXPECT_EQ(pagedDigest.getNumberOfRehashedPages(), rehashedPages);
+
+    for (int round = 0; round < 20; round++)
+    {
+        // Change a few bytes (including first and last byte) or restore previous value
+        const unsigned int numberOfChanges = 1 + gen64() % 5;
+        for (unsigned int i = 0; i < numberOfChanges; i++)
+        {
+            unsigned long long pos = gen64() % stateSize;
+            if (round == 3)
+                pos = 0;
+            if (round == 4)
+                pos = stateSize - 1;
+            state[pos]++;
+        }
+
+        rehashedPages = pagedDigest.getNumberOfRehashedPages();
+        pagedDigest.getDigest(state.data(), digest);
+        EXPECT_EQ(digest, referencePagedDigest(state));
+        EXPECT_LE(pagedDigest.getNumberOfRehashedPages() - rehashedPages, numberOfChanges);
+        EXPECT_GE(pagedDigest.getNumberOfRehashedPages() - rehashedPages, 1);
+    }
+
+    // Full recompute gives same result
+    m256i digestBefore = digest;
+    pagedDigest.invalidate();
+    pagedDigest.getDigest(state.data(), digest);
+    EXPECT_EQ(digest, digestBefore);
+
+    pagedDigest.deinit();
+}
+
+TEST(TestCoreContractStateDigest, MatchesDefinition)
+{
+    testPagedStateDigest(1, 1);
+    testPagedStateDigest(100, 2);
+    testPagedStateDigest(PagedStateDigest::pageSize, 3);
+    testPagedStateDigest(PagedStateDigest::pageSize + 1, 4);
+    testPagedStateDigest(3 * PagedStateDigest::pageSize + 17, 5);
+    testPagedStateDigest(64 * PagedStateDigest::pageSize, 6);
+    testPagedStateDigest(200 * PagedStateDigest::pageSize - 5, 7);
+}
+
+TEST(TestCoreContractStateDigest, PerformanceFewChanges)
+{
+    constexpr unsigned long long stateSize = 256ULL * 1024 * 1024;
+    std::vector<unsigned char> state(stateSize, 0);
+    std::mt19937_64 gen64(42);
+    for (unsigned long long i = 0; i < stateSize; i += 8)
+        *(unsigned long long*)&state[i] = gen64();
+
+    PagedStateDigest pagedDigest;
+    ASSERT_TRUE(pagedDigest.init(stateSize));
+    m256i digest;
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    m256i fullDigest;
+    KangarooTwelve(state.data(), (unsigned int)stateSize, &fullDigest, 32);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    pagedDigest.getDigest(state.data(), digest);
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    // Typical tick: a few entries of the state changed
+    for (int i = 0; i < 10; i++)
+        state[gen64() % stateSize]++;
+    pagedDigest.getDigest(state.data(), digest);
+    auto t3 = std::chrono::high_resolution_clock::now();
+
+    std::cout << "State of " << stateSize / (1024 * 1024) << " MB: K12 of whole state "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count() << " ms, first paged digest "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << " ms, paged digest after 10 changes "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(t3 - t2).count() << " ms" << std::endl;
+
+    pagedDigest.deinit();
+}
@@ -0,0 +1,184 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/platform/copy_on_write_snapshot.h"
+
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+// Mutate two regions (the second one not page-aligned and with partial last page) with random writes of random size,
+// both before the snapshot is read completely and afterwards. The snapshot must exactly match the state at the
+// cut-over and the live regions must contain all writes.
+static void testSnapshotWithConcurrentWrites(unsigned long long shadowPageCount, unsigned long long seed)
+{
+    constexpr unsigned long long pageSize = CopyOnWriteSnapshot::pageSize;
+    const unsigned long long regionSizes[2] = { 256 * pageSize, 100 * pageSize + 1234 };
+    std::vector<unsigned char> memory[2];
+    std::mt19937_64 gen64(seed);
+    for (int r = 0; r < 2; r++)
+    {
+        memory[r].resize(regionSizes[r] + 7);
+        for (auto& byte : memory[r])
+            byte = (unsigned char)gen64();
+    }
+    unsigned char* regionData[2] = { memory[0].data(), memory[1].data() + 7 };
+
+    CopyOnWriteSnapshot snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+    EXPECT_TRUE(snapshot.init(1000, shadowPageCount));
+
+    // Writes to inactive snapshot are ignored
+    snapshot.beforeWrite(regionData[0], 100);
+    EXPECT_EQ(snapshot.getNumberOfCopiedPages(), 0u);
+
+    snapshot.reset();
+    int regionIndices[2];
+    for (int r = 0; r < 2; r++)
+        regionIndices[r] = snapshot.addRegion(regionData[r], regionSizes[r]);
+    EXPECT_EQ(regionIndices[0], 0);
+    EXPECT_EQ(regionIndices[1], 1);
+    EXPECT_EQ(snapshot.getNumberOfPages(), 357u);
+
+    // Cut-over
+    std::vector<unsigned char> expectedSnapshot[2];
+    for (int r = 0; r < 2; r++)
+        expectedSnapshot[r].assign(regionData[r], regionData[r] + regionSizes[r]);
+    snapshot.activate();
+    EXPECT_TRUE(snapshot.isActive());
+
+    // Writer thread changes the regions and records the expected live state
+    std::vector<unsigned char> expectedLive[2] = { expectedSnapshot[0], expectedSnapshot[1] };
+    std::atomic<bool> readerDone = false;
+    std::thread writer([&]()
+        {
+            std::mt19937_64 writerGen64(seed + 1);
+            for (unsigned int i = 0; i < 20000 || !readerDone; i++)
+            {
+                const int r = writerGen64() & 1;
+                const unsigned long long size = 1 + writerGen64() % 100;
+                const unsigned long long offset = writerGen64() % (regionSizes[r] - size + 1);
+                const unsigned char value = (unsigned char)writerGen64();
+                snapshot.beforeWrite(regionData[r] + offset, size);
+                memset(regionData[r] + offset, value, size);
+                memset(expectedLive[r].data() + offset, value, size);
+                if (i % 64 == 0)
+                    std::this_thread::yield();
+            }
+        });
+
+    // Read snapshot in chunks like saveFromDataSource() does
+    std::vector<unsigned char> snapshotData[2];
+    for (int r = 0; r < 2; r++)
+    {
+        snapshotData[r].resize(regionSizes[r]);
+        const CopyOnWriteSnapshot::RegionDataSource dataSource = { &snapshot, (unsigned int)regionIndices[r] };
+        for (unsigned long long offset = 0; offset < regionSizes[r]; offset += 8 * pageSize)
+        {
+            const unsigned long long size = std::min(8 * pageSize, regionSizes[r] - offset);
+            dataSource.read(offset, size, snapshotData[r].data() + offset);
+            std::this_thread::yield();
+        }
+    }
+    readerDone = true;
+    writer.join();
+    snapshot.deactivate();
+    EXPECT_FALSE(snapshot.isActive());
+
+    for (int r = 0; r < 2; r++)
+    {
+        EXPECT_TRUE(snapshotData[r] == expectedSnapshot[r]);
+        EXPECT_EQ(memcmp(regionData[r], expectedLive[r].data(), regionSizes[r]), 0);
+    }
+    EXPECT_LE(snapshot.getNumberOfCopiedPages(), shadowPageCount);
+    std::cout << "Shadow pages: " << shadowPageCount << ", pages copied on write: " << snapshot.getNumberOfCopiedPages()
+        << ", writer waits: " << snapshot.getNumberOfWaits() << std::endl;
+
+    snapshot.deinit();
+}
+
+TEST(TestCoreCopyOnWriteSnapshot, SnapshotReflectsCutOver)
+{
+    // Enough shadow pages for all pages
+    testSnapshotWithConcurrentWrites(400, 42);
+
+    // Shadow pages run out, so the writer has to wait for the reader
+    testSnapshotWithConcurrentWrites(16, 1234);
+}
+
+// Several writers race with the reader for the same page while the single shadow page is used up, so writers
+// frequently hand pages back to the reader (COPYING -> UNCHANGED) while the reader waits for them.
+TEST(TestCoreCopyOnWriteSnapshot, ShadowPoolExhaustedWithConcurrentWriters)
+{
+    constexpr unsigned long long pageSize = CopyOnWriteSnapshot::pageSize;
+    constexpr unsigned long long regionPages = 512;
+    constexpr unsigned int writerCount = 3;
+    for (unsigned long long seed = 0; seed < 20; seed++)
+    {
+        std::mt19937_64 gen64(seed);
+        std::vector<unsigned char> region(regionPages * pageSize);
+        for (auto& byte : region)
+            byte = (unsigned char)gen64();
+
+        CopyOnWriteSnapshot snapshot;
+        memset(&snapshot, 0, sizeof(snapshot));
+        EXPECT_TRUE(snapshot.init(regionPages, 1));
+        snapshot.reset();
+        const int regionIndex = snapshot.addRegion(region.data(), region.size());
+        const std::vector<unsigned char> expectedSnapshot = region;
+        snapshot.activate();
+
+        // Writers change the page the reader is about to read (each writer its own bytes of the page)
+        std::atomic<unsigned long long> readerPage = 0;
+        std::atomic<bool> readerDone = false;
+        std::vector<std::thread> writers;
+        for (unsigned int w = 0; w < writerCount; w++)
+        {
+            writers.emplace_back([&, w]()
+                {
+                    std::mt19937_64 writerGen64(seed * writerCount + w + 1000);
+                    while (!readerDone)
+                    {
+                        const unsigned long long page = readerPage + writerGen64() % 2;
+                        if (page >= regionPages)
+                            continue;
+                        const unsigned long long offset = page * pageSize + (writerGen64() % (pageSize / writerCount)) * writerCount + w;
+                        snapshot.beforeWrite(region.data() + offset, 1);
+                        region[offset] ^= 0x5a;
+                    }
+                });
+        }
+
+        std::vector<unsigned char> snapshotData(region.size());
+        const CopyOnWriteSnapshot::RegionDataSource dataSource = { &snapshot, (unsigned int)regionIndex };
+        for (unsigned long long page = 0; page < regionPages; page++)
+        {
+            readerPage = page;
+            dataSource.read(page * pageSize, pageSize, snapshotData.data() + page * pageSize);
+        }
+        readerDone = true;
+        for (auto& writer : writers)
+            writer.join();
+        snapshot.deactivate();
+
+        EXPECT_TRUE(snapshotData == expectedSnapshot);
+        EXPECT_LE(snapshot.getNumberOfCopiedPages(), 1u);
+        snapshot.deinit();
+    }
+}
+
+TEST(TestCoreCopyOnWriteSnapshot, TooManyPages)
+{
+    CopyOnWriteSnapshot snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+    EXPECT_TRUE(snapshot.init(10, 1));
+    std::vector<unsigned char> memory(11 * CopyOnWriteSnapshot::pageSize);
+    EXPECT_EQ(snapshot.addRegion(memory.data(), 6 * CopyOnWriteSnapshot::pageSize), 0);
+    EXPECT_EQ(snapshot.addRegion(memory.data(), 5 * CopyOnWriteSnapshot::pageSize + 1), -1);
+    EXPECT_EQ(snapshot.addRegion(memory.data(), 4 * CopyOnWriteSnapshot::pageSize), 1);
+    EXPECT_EQ(snapshot.getNumberOfPages(), 10u);
+    snapshot.deinit();
+}
@@ -0,0 +1,121 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/platform/delta_snapshot.h"
+#include "../src/network_messages/entity.h"
+
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+
+
+static constexpr unsigned int testCapacity = 1 << 16;
+typedef DeltaSnapshot<::Entity, testCapacity> TestDeltaSnapshot;
+
+// Serialize delta in chunks like saveFromDataSource() does
+static std::vector<unsigned char> serializeDelta(TestDeltaSnapshot& deltaSnapshot, const ::Entity* records, unsigned long long chunkSize)
+{
+    std::vector<unsigned char> delta(deltaSnapshot.getDeltaSize());
+    const TestDeltaSnapshot::DeltaDataSource dataSource = { &deltaSnapshot, records };
+    for (unsigned long long offset = 0; offset < delta.size(); offset += chunkSize)
+    {
+        const unsigned long long size = std::min(chunkSize, delta.size() - offset);
+        dataSource.read(offset, size, delta.data() + offset);
+    }
+    return delta;
+}
+
+static void randomizeEntity(::Entity& entity, std::mt19937_64& gen64)
+{
+    unsigned char* bytes = (unsigned char*)&entity;
+    for (unsigned int i = 0; i < sizeof(::Entity); i++)
+        bytes[i] = (unsigned char)gen64();
+}
+
+TEST(TestCoreDeltaSnapshot, RoundTripAfterRandomMutations)
+{
+    std::mt19937_64 gen64(42);
+    std::unique_ptr<TestDeltaSnapshot> deltaSnapshot(new TestDeltaSnapshot());
+
+    std::vector<::Entity> live(testCapacity);
+    for (auto& entity : live)
+        randomizeEntity(entity, gen64);
+
+    // Base file
+    const std::vector<::Entity> base = live;
+    EXPECT_TRUE(deltaSnapshot->isFullSaveRequired(L"spectrum.000", nullptr));
+    deltaSnapshot->setBaseline(L"spectrum.000", nullptr, 0);
+
+    std::vector<std::vector<unsigned char>> deltas;
+    for (unsigned int round = 0; round < TestDeltaSnapshot::maxDeltaCount; round++)
+    {
+        // Random mutations, some of them changing the same record several times
+        std::map<unsigned int, bool> changedIndices;
+        const unsigned int mutations = (unsigned int)(gen64() % 3000);
+        for (unsigned int i = 0; i < mutations; i++)
+        {
+            const unsigned int index = (i % 4 == 3 && !changedIndices.empty()) ? changedIndices.begin()->first : (unsigned int)(gen64() % testCapacity);
+            randomizeEntity(live[index], gen64);
+            deltaSnapshot->markChanged(index);
+            changedIndices[index] = true;
+        }
+        EXPECT_EQ(deltaSnapshot->getNumberOfChangedRecords(), changedIndices.size());
+        EXPECT_FALSE(deltaSnapshot->isFullSaveRequired(L"spectrum.000", nullptr));
+
+        const unsigned long long chunkSize = (round & 1) ? WRITING_CHUNK_SIZE : 1 + gen64() % 1000;
+        deltas.push_back(serializeDelta(*deltaSnapshot, live.data(), chunkSize));
+        EXPECT_EQ(deltas.back().size(), sizeof(TestDeltaSnapshot::DeltaFileHeader) + changedIndices.size() * TestDeltaSnapshot::entrySize);
+        deltaSnapshot->setBaseline(L"spectrum.000", nullptr, round + 1);
+        EXPECT_EQ(deltaSnapshot->getNumberOfChangedRecords(), 0u);
+
+        // Replay base and all deltas
+        std::vector<::Entity> loaded = base;
+        for (unsigned int sequence = 1; sequence <= deltas.size(); sequence++)
+        {
+            const auto& delta = deltas[sequence - 1];
+            EXPECT_TRUE(TestDeltaSnapshot::applyDelta(delta.data(), delta.size(), sequence, loaded.data()));
+        }
+        EXPECT_EQ(memcmp(loaded.data(), live.data(), testCapacity * sizeof(::Entity)), 0);
+    }
+
+    // Chain is full -> compaction
+    EXPECT_EQ(deltaSnapshot->getNumberOfDeltas(), TestDeltaSnapshot::maxDeltaCount);
+    EXPECT_TRUE(deltaSnapshot->isFullSaveRequired(L"spectrum.000", nullptr));
+
+    // Deltas applied out of order or corrupted are rejected
+    std::vector<::Entity> loaded = base;
+    EXPECT_FALSE(TestDeltaSnapshot::applyDelta(deltas[1].data(), deltas[1].size(), 1, loaded.data()));
+    EXPECT_FALSE(TestDeltaSnapshot::applyDelta(deltas[0].data(), deltas[0].size() - 1, 1, loaded.data()));
+    std::vector<unsigned char> invalidIndex = deltas[0];
+    ASSERT_GT(invalidIndex.size(), sizeof(TestDeltaSnapshot::DeltaFileHeader));
+    *(unsigned int*)(invalidIndex.data() + sizeof(TestDeltaSnapshot::DeltaFileHeader)) = testCapacity;
+    EXPECT_FALSE(TestDeltaSnapshot::applyDelta(invalidIndex.data(), invalidIndex.size(), 1, loaded.data()));
+}
+
+TEST(TestCoreDeltaSnapshot, FullSaveRequired)
+{
+    std::unique_ptr<TestDeltaSnapshot> deltaSnapshot(new TestDeltaSnapshot());
+
+    // No baseline yet
+    EXPECT_TRUE(deltaSnapshot->isFullSaveRequired(L"spectrum.000", nullptr));
+
+    deltaSnapshot->setBaseline(L"spectrum.000", L"ep", 3);
+    EXPECT_FALSE(deltaSnapshot->isFullSaveRequired(L"spectrum.000", L"ep"));
+    EXPECT_TRUE(deltaSnapshot->isFullSaveRequired(L"spectrum.000", nullptr));
+    EXPECT_TRUE(deltaSnapshot->isFullSaveRequired(L"spectrum.001", L"ep"));
+
+    // Too many changed records
+    for (unsigned int i = 0; i < testCapacity / TestDeltaSnapshot::maxChangedRecordsDivisor; i++)
+        deltaSnapshot->markChanged(i * 3);
+    EXPECT_FALSE(deltaSnapshot->isFullSaveRequired(L"spectrum.000", L"ep"));
+    deltaSnapshot->markChanged(1);
+    EXPECT_TRUE(deltaSnapshot->isFullSaveRequired(L"spectrum.000", L"ep"));
+
+    // Whole table changed
+    deltaSnapshot->setBaseline(L"spectrum.000", nullptr, 0);
+    EXPECT_FALSE(deltaSnapshot->isFullSaveRequired(L"spectrum.000", nullptr));
+    deltaSnapshot->markAllChanged();
+    EXPECT_TRUE(deltaSnapshot->isFullSaveRequired(L"spectrum.000", nullptr));
+}
@@ -0,0 +1,109 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/network_core/duplicate_filter.h"
+
+#include <random>
+#include <vector>
+
+
+typedef DuplicateFilter<24> TestDuplicateFilter;
+
+TEST(TestCoreDuplicateFilter, SuppressAcrossGenerationBoundary)
+{
+    constexpr unsigned int generationLength = 8192;
+    TestDuplicateFilter filter;
+    ASSERT_TRUE(filter.init(8 * generationLength, generationLength));
+
+    std::mt19937_64 gen64(42);
+    std::vector<unsigned long long> ids(3 * generationLength);
+    for (auto& id : ids)
+        id = gen64();
+
+    // Fill generation 0 and half of generation 1
+    for (unsigned int i = 0; i < generationLength + generationLength / 2; i++)
+    {
+        EXPECT_FALSE(filter.contains(ids[i]));
+        filter.insert(ids[i]);
+        EXPECT_TRUE(filter.contains(ids[i]));
+    }
+    EXPECT_EQ(filter.getGeneration(), 1u);
+
+    // Duplicates of both generations are suppressed right after the swap
+    for (unsigned int i = 0; i < generationLength + generationLength / 2; i++)
+        EXPECT_TRUE(filter.contains(ids[i]));
+
+    // Complete generation 1 and 2 -> IDs of generation 0 and 1 expire without clearing the table
+    for (unsigned int i = generationLength + generationLength / 2; i < 3 * generationLength; i++)
+        filter.insert(ids[i]);
+    EXPECT_EQ(filter.getGeneration(), 3u);
+    unsigned int remaining = 0;
+    for (unsigned int i = 0; i < 2 * generationLength; i++)
+        remaining += filter.contains(ids[i]);
+    EXPECT_EQ(remaining, 0u);
+    for (unsigned int i = 2 * generationLength; i < 3 * generationLength; i++)
+        EXPECT_TRUE(filter.contains(ids[i]));
+
+    // Expired ID can be inserted again
+    filter.insert(ids[0]);
+    EXPECT_TRUE(filter.contains(ids[0]));
+
+    // Re-inserting a live ID moves it into the current generation
+    filter.insert(ids[2 * generationLength]);
+    for (unsigned int i = 0; i < generationLength; i++)
+        filter.insert(gen64());
+    EXPECT_EQ(filter.getGeneration(), 4u);
+    EXPECT_TRUE(filter.contains(ids[2 * generationLength]));
+    EXPECT_FALSE(filter.contains(ids[2 * generationLength + 1]));
+
+    EXPECT_EQ(filter.getNumberOfEvictions(), 0u);
+    filter.deinit();
+}
+
+TEST(TestCoreDuplicateFilter, FalsePositiveRate)
+{
+    // Measure false positives with ID streams over many generations and compare with expected rate
+    constexpr unsigned int generationLength = 65536;
+    for (unsigned long long capacity : { 524288ULL, 1048576ULL })
+    {
+        TestDuplicateFilter filter;
+        ASSERT_TRUE(filter.init(capacity, generationLength));
+
+        std::mt19937_64 gen64(capacity);
+        unsigned long long falsePositives = 0, expectedFalsePositivesPerBillion = 0;
+        constexpr unsigned int lookups = 3000000;
+        for (unsigned int i = 0; i < lookups; i++)
+        {
+            const unsigned long long id = gen64();
+            if (filter.contains(id))
+                falsePositives++;
+            else
+                filter.insert(id);
+            expectedFalsePositivesPerBillion += filter.getExpectedFalsePositivesPerBillion();
+        }
+        expectedFalsePositivesPerBillion /= lookups;
+        const unsigned long long measuredFalsePositivesPerBillion = falsePositives * 1000000000ULL / lookups;
+        std::cout << "Capacity " << capacity << " slots: " << falsePositives << " false positives in " << lookups
+            << " lookups (" << measuredFalsePositivesPerBillion << " per billion, expected " << expectedFalsePositivesPerBillion
+            << "), " << filter.getNumberOfEvictions() << " evictions" << std::endl;
+
+        EXPECT_GT(expectedFalsePositivesPerBillion, 0u);
+        EXPECT_LT(measuredFalsePositivesPerBillion, 3 * expectedFalsePositivesPerBillion + 1000);
+        filter.deinit();
+    }
+
+    // Less fingerprint bits -> more false positives
+    DuplicateFilter<12> coarseFilter;
+    ASSERT_TRUE(coarseFilter.init(65536, 16384));
+    std::mt19937_64 gen64(7);
+    for (unsigned int i = 0; i < 32768; i++)
+        coarseFilter.insert(gen64());
+    unsigned int falsePositives = 0;
+    for (unsigned int i = 0; i < 100000; i++)
+        falsePositives += coarseFilter.contains(gen64());
+    const unsigned long long expected = coarseFilter.getExpectedFalsePositivesPerBillion() * 100000 / 1000000000ULL;
+    EXPECT_GT(falsePositives, expected / 2);
+    EXPECT_LT(falsePositives, expected * 2);
+    coarseFilter.deinit();
+}
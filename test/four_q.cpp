@@ -0,0 +1,277 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/four_q.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+
+struct SignedMessage
+{
+    m256i publicKey;
+    m256i digest;
+    unsigned char signature[64];
+};
+
+// Generate keys and signed messages (message i is signed by key i % numberOfKeys)
+static std::vector<SignedMessage> generateSignedMessages(unsigned int numberOfKeys, unsigned int numberOfMessages, unsigned long long seed)
+{
+    std::mt19937_64 gen64(seed);
+    std::vector<m256i> subseeds(numberOfKeys), publicKeys(numberOfKeys);
+    for (unsigned int i = 0; i < numberOfKeys; i++)
+    {
+        unsigned char seedChars[55];
+        for (unsigned int j = 0; j < 55; j++)
+            seedChars[j] = 'a' + gen64() % 26;
+        m256i privateKey;
+        EXPECT_TRUE(getSubseed(seedChars, subseeds[i].m256i_u8));
+        getPrivateKey(subseeds[i].m256i_u8, privateKey.m256i_u8);
+        getPublicKey(privateKey.m256i_u8, publicKeys[i].m256i_u8);
+    }
+
+    std::vector<SignedMessage> messages(numberOfMessages);
+    for (unsigned int i = 0; i < numberOfMessages; i++)
+    {
+        const unsigned int keyIdx = i % numberOfKeys;
+        messages[i].publicKey = publicKeys[keyIdx];
+        messages[i].digest = m256i(gen64(), gen64(), gen64(), gen64());
+        sign(subseeds[keyIdx].m256i_u8, publicKeys[keyIdx].m256i_u8, messages[i].digest.m256i_u8, messages[i].signature);
+    }
+    return messages;
+}
+
+TEST(TestCoreFourQ, VerificationKeyCacheEqualsVerify)
+{
+    std::vector<SignedMessage> messages = generateSignedMessages(10, 100, 42);
+    verificationKeyCache.reset();
+
+    for (unsigned int run = 0; run < 2; run++)
+    {
+        for (auto& msg : messages)
+        {
+            // valid signature
+            EXPECT_TRUE(verify(msg.publicKey.m256i_u8, msg.digest.m256i_u8, msg.signature));
+            EXPECT_TRUE(verificationKeyCache.verify(msg.publicKey.m256i_u8, msg.digest.m256i_u8, msg.signature));
+
+            // other digest
+            m256i otherDigest = msg.digest;
+            otherDigest.m256i_u8[5] ^= 0x10;
+            EXPECT_FALSE(verify(msg.publicKey.m256i_u8, otherDigest.m256i_u8, msg.signature));
+            EXPECT_FALSE(verificationKeyCache.verify(msg.publicKey.m256i_u8, otherDigest.m256i_u8, msg.signature));
+
+            // modified signature
+            unsigned char otherSignature[64];
+            copyMem(otherSignature, msg.signature, 64);
+            otherSignature[40] ^= 1;
+            EXPECT_FALSE(verify(msg.publicKey.m256i_u8, msg.digest.m256i_u8, otherSignature));
+            EXPECT_FALSE(verificationKeyCache.verify(msg.publicKey.m256i_u8, msg.digest.m256i_u8, otherSignature));
+            otherSignature[63] = 1;
+            EXPECT_FALSE(verificationKeyCache.verify(msg.publicKey.m256i_u8, msg.digest.m256i_u8, otherSignature));
+        }
+        EXPECT_EQ(verificationKeyCache.size(), 10);
+    }
+
+    // Invalid public keys are rejected and not cached
+    m256i invalidPublicKey = messages[0].publicKey;
+    invalidPublicKey.m256i_u8[15] |= 0x80;
+    EXPECT_FALSE(verify(invalidPublicKey.m256i_u8, messages[0].digest.m256i_u8, messages[0].signature));
+    EXPECT_FALSE(verificationKeyCache.verify(invalidPublicKey.m256i_u8, messages[0].digest.m256i_u8, messages[0].signature));
+    EXPECT_FALSE(verificationKeyCache.contains(invalidPublicKey));
+    EXPECT_TRUE(verificationKeyCache.contains(messages[0].publicKey));
+
+    verificationKeyCache.reset();
+    EXPECT_EQ(verificationKeyCache.size(), 0);
+    EXPECT_FALSE(verificationKeyCache.contains(messages[0].publicKey));
+}
+
+TEST(TestCoreFourQ, VerificationKeyCacheFull)
+{
+    const unsigned int numberOfKeys = FourQVerificationKeyCache::maxNumberOfEntries + 10;
+    std::vector<SignedMessage> messages = generateSignedMessages(numberOfKeys, numberOfKeys, 123);
+    verificationKeyCache.reset();
+    for (auto& msg : messages)
+    {
+        EXPECT_TRUE(verificationKeyCache.verify(msg.publicKey.m256i_u8, msg.digest.m256i_u8, msg.signature));
+    }
+    EXPECT_EQ(verificationKeyCache.size(), FourQVerificationKeyCache::maxNumberOfEntries);
+
+    // Keys that did not fit are still verified correctly
+    for (auto& msg : messages)
+    {
+        EXPECT_TRUE(verificationKeyCache.verify(msg.publicKey.m256i_u8, msg.digest.m256i_u8, msg.signature));
+        msg.digest.m256i_u8[0] ^= 1;
+        EXPECT_FALSE(verificationKeyCache.verify(msg.publicKey.m256i_u8, msg.digest.m256i_u8, msg.signature));
+    }
+    verificationKeyCache.reset();
+}
+
+TEST(TestCoreFourQ, PerformanceVerifyWithKeyCache)
+{
+    // Computor keys signing many messages (such as ticks) in an epoch
+    constexpr unsigned int numberOfMessages = 676 * 4;
+    std::vector<SignedMessage> messages = generateSignedMessages(676, numberOfMessages, 7);
+    verificationKeyCache.reset();
+
+    unsigned int validCount = 0;
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for (auto& msg : messages)
+        validCount += verify(msg.publicKey.m256i_u8, msg.digest.m256i_u8, msg.signature);
+    auto durationMicroSecNoCache = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime);
+    EXPECT_EQ(validCount, numberOfMessages);
+
+    // Fill cache (first signature of each computor in the epoch)
+    for (unsigned int i = 0; i < 676; i++)
+        EXPECT_TRUE(verificationKeyCache.verify(messages[i].publicKey.m256i_u8, messages[i].digest.m256i_u8, messages[i].signature));
+
+    validCount = 0;
+    startTime = std::chrono::high_resolution_clock::now();
+    for (auto& msg : messages)
+        validCount += verificationKeyCache.verify(msg.publicKey.m256i_u8, msg.digest.m256i_u8, msg.signature);
+    auto durationMicroSecCache = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime);
+    EXPECT_EQ(validCount, numberOfMessages);
+
+    std::cout << "verify() without cache: " << numberOfMessages * 1000000ull / durationMicroSecNoCache.count() << " verifications per second" << std::endl;
+    std::cout << "verify() with cache:    " << numberOfMessages * 1000000ull / durationMicroSecCache.count() << " verifications per second" << std::endl;
+
+    verificationKeyCache.reset();
+}
+
+// Work memory of verifyBatch() (too large for the stack of the processors in the node)
+static FourQBatchVerificationBuffer batchVerificationBuffer;
+
+static void checkVerifyBatch(const std::vector<SignedMessage>& messages, const std::vector<bool>& expected)
+{
+    std::vector<const unsigned char*> publicKeys, digests, signatures;
+    for (auto& msg : messages)
+    {
+        publicKeys.push_back(msg.publicKey.m256i_u8);
+        digests.push_back(msg.digest.m256i_u8);
+        signatures.push_back(msg.signature);
+    }
+
+    bool results[256];
+    ASSERT_LE(messages.size(), 256);
+    setMem(results, sizeof(results), 0);
+    const bool allValid = verifyBatch(publicKeys.data(), digests.data(), signatures.data(), (unsigned int)messages.size(), results, batchVerificationBuffer);
+
+    bool expectedAllValid = true;
+    for (unsigned int i = 0; i < messages.size(); i++)
+    {
+        EXPECT_EQ(results[i], expected[i]) << "signature " << i;
+        EXPECT_EQ(results[i], verify(publicKeys[i], digests[i], signatures[i])) << "signature " << i;
+        expectedAllValid &= expected[i];
+    }
+    EXPECT_EQ(allValid, expectedAllValid);
+}
+
+TEST(TestCoreFourQ, VerifyBatchAllValid)
+{
+    for (unsigned int count : { 0, 1, 2, 31, 32, 33, 100 })
+    {
+        std::vector<SignedMessage> messages = generateSignedMessages(7, count, 1000 + count);
+        checkVerifyBatch(messages, std::vector<bool>(count, true));
+    }
+
+    // Combined check accepts valid groups without falling back to individual verification
+    std::vector<SignedMessage> messages = generateSignedMessages(5, FOURQ_BATCH_VERIFY_MAX_SIZE, 5);
+    std::vector<const unsigned char*> publicKeys, digests, signatures;
+    for (auto& msg : messages)
+    {
+        publicKeys.push_back(msg.publicKey.m256i_u8);
+        digests.push_back(msg.digest.m256i_u8);
+        signatures.push_back(msg.signature);
+    }
+    for (unsigned int count = 1; count <= FOURQ_BATCH_VERIFY_MAX_SIZE; count++)
+        EXPECT_TRUE(verifyBatchCombined(publicKeys.data(), digests.data(), signatures.data(), count, batchVerificationBuffer));
+    messages[3].signature[33] ^= 2;
+    EXPECT_FALSE(verifyBatchCombined(publicKeys.data(), digests.data(), signatures.data(), FOURQ_BATCH_VERIFY_MAX_SIZE, batchVerificationBuffer));
+}
+
+TEST(TestCoreFourQ, VerifyBatchOneInvalid)
+{
+    constexpr unsigned int count = 70;
+    std::vector<SignedMessage> messages = generateSignedMessages(10, count, 77);
+    for (unsigned int invalidIdx : { 0u, 31u, 32u, 45u, count - 1 })
+    {
+        for (unsigned int variant = 0; variant < 4; variant++)
+        {
+            std::vector<SignedMessage> modified = messages;
+            SignedMessage& msg = modified[invalidIdx];
+            switch (variant)
+            {
+            case 0: msg.digest.m256i_u8[3] ^= 0x20; break;      // other message
+            case 1: msg.signature[40] ^= 1; break;              // modified s
+            case 2: msg.signature[2] ^= 4; break;               // modified R
+            case 3: msg.publicKey = modified[(invalidIdx + 1) % count].publicKey; break; // other signer
+            }
+            std::vector<bool> expected(count, true);
+            expected[invalidIdx] = false;
+            checkVerifyBatch(modified, expected);
+        }
+    }
+}
+
+TEST(TestCoreFourQ, VerifyBatchMixed)
+{
+    constexpr unsigned int count = 200;
+    std::vector<SignedMessage> messages = generateSignedMessages(20, count, 4242);
+    std::mt19937_64 gen64(99);
+    std::vector<bool> expected(count, true);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        switch (gen64() % 8)
+        {
+        case 0: messages[i].digest.m256i_u8[gen64() % 32] ^= 1; expected[i] = false; break;
+        case 1: messages[i].signature[32 + gen64() % 28] ^= 0x80; expected[i] = false; break;
+        case 2: messages[i].signature[63] = 1; expected[i] = false; break;      // s out of range
+        case 3: messages[i].publicKey.m256i_u8[15] |= 0x80; expected[i] = false; break; // invalid key encoding
+        default: break;
+        }
+    }
+    checkVerifyBatch(messages, expected);
+
+    // Batch of only invalid signatures
+    std::vector<SignedMessage> invalidMessages(messages.begin(), messages.begin() + 40);
+    for (auto& msg : invalidMessages)
+        msg.digest.m256i_u8[0] ^= 0xff;
+    checkVerifyBatch(invalidMessages, std::vector<bool>(40, false));
+}
+
+TEST(TestCoreFourQ, PerformanceVerifyBatch)
+{
+    constexpr unsigned int numberOfMessages = 256;
+    std::vector<SignedMessage> messages = generateSignedMessages(64, numberOfMessages, 8);
+    std::vector<const unsigned char*> publicKeys, digests, signatures;
+    for (auto& msg : messages)
+    {
+        publicKeys.push_back(msg.publicKey.m256i_u8);
+        digests.push_back(msg.digest.m256i_u8);
+        signatures.push_back(msg.signature);
+    }
+
+    unsigned int validCount = 0;
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for (unsigned int i = 0; i < numberOfMessages; i++)
+        validCount += verify(publicKeys[i], digests[i], signatures[i]);
+    auto durationMicroSecSingle = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime);
+    EXPECT_EQ(validCount, numberOfMessages);
+
+    bool results[numberOfMessages];
+    startTime = std::chrono::high_resolution_clock::now();
+    EXPECT_TRUE(verifyBatch(publicKeys.data(), digests.data(), signatures.data(), numberOfMessages, results, batchVerificationBuffer));
+    auto durationMicroSecBatch = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime);
+
+    // One invalid signature per batch group requires verifying the group individually
+    messages[5].digest.m256i_u8[0] ^= 1;
+    startTime = std::chrono::high_resolution_clock::now();
+    EXPECT_FALSE(verifyBatch(publicKeys.data(), digests.data(), signatures.data(), numberOfMessages, results, batchVerificationBuffer));
+    auto durationMicroSecBatchInvalid = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime);
+    EXPECT_FALSE(results[5]);
+
+    std::cout << "verify():                          " << numberOfMessages * 1000000ull / durationMicroSecSingle.count() << " verifications per second" << std::endl;
+    std::cout << "verifyBatch(), all valid:          " << numberOfMessages * 1000000ull / durationMicroSecBatch.count() << " verifications per second" << std::endl;
+    std::cout << "verifyBatch(), one invalid in 256: " << numberOfMessages * 1000000ull / durationMicroSecBatchInvalid.count() << " verifications per second" << std::endl;
+}
@@ -0,0 +1,263 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/platform/incremental_file_writer.h"
+
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+
+// File names are ASCII, so the mocked file system uses char strings as paths
+static std::string toPath(const CHAR16* directory, const CHAR16* fileName)
+{
+    std::string path;
+    for (const CHAR16* c = directory; c && *c; c++)
+        path += (char)*c;
+    if (directory)
+        path += '/';
+    for (const CHAR16* c = fileName; *c; c++)
+        path += (char)*c;
+    return path;
+}
+
+// Mocked file layer keeping the files in memory, optionally failing after a number of writes
+struct MockFileSystem
+{
+    std::map<std::string, std::vector<unsigned char>> files;
+    int openFiles = 0;
+    unsigned long long writeCalls = 0;
+    unsigned long long failingWriteCall = ~0ULL;
+};
+static MockFileSystem mockFileSystem;
+
+struct MockFileWriter
+{
+    std::vector<unsigned char>* file;
+
+    bool open(const CHAR16* fileName, const CHAR16* directory)
+    {
+        file = &mockFileSystem.files[toPath(directory, fileName)];
+        file->clear();
+        mockFileSystem.openFiles++;
+        return true;
+    }
+
+    bool write(unsigned long long size, const unsigned char* buffer)
+    {
+        if (mockFileSystem.writeCalls++ == mockFileSystem.failingWriteCall)
+            return false;
+        file->insert(file->end(), buffer, buffer + size);
+        return true;
+    }
+
+    void close()
+    {
+        mockFileSystem.openFiles--;
+        file = nullptr;
+    }
+};
+
+static constexpr unsigned int testMaxFiles = 8;
+typedef IncrementalFileWriter<MockFileWriter, BufferDataSource, testMaxFiles> TestIncrementalFileWriter;
+
+// Reference for compressed files: what saveCompressedFromDataSource() writes in one go
+struct VectorWriter
+{
+    std::vector<unsigned char> data;
+
+    bool write(unsigned long long size, const unsigned char* buffer)
+    {
+        data.insert(data.end(), buffer, buffer + size);
+        return true;
+    }
+};
+
+static std::vector<unsigned char> compressInOneGo(const std::vector<unsigned char>& data)
+{
+    const BufferDataSource dataSource = { data.data() };
+    VectorWriter writer;
+    EXPECT_TRUE(compressStream(dataSource, data.size(), writer));
+    return writer.data;
+}
+
+struct TestFile
+{
+    CHAR16 name[16];
+    bool inDirectory;
+    bool compressed;
+    std::vector<unsigned char> data;
+};
+
+static std::vector<TestFile> createTestFiles()
+{
+    std::mt19937_64 gen64(42);
+    std::vector<TestFile> testFiles(6);
+    const unsigned long long sizes[] = { 0, 1, WRITING_CHUNK_SIZE, 3 * COMPRESSION_BLOCK_SIZE + 123, 5000000, 777777 };
+    for (unsigned int i = 0; i < testFiles.size(); i++)
+    {
+        TestFile& testFile = testFiles[i];
+        setText(testFile.name, L"file.000");
+        testFile.name[7] = CHAR16('0' + i);
+        testFile.inDirectory = (i % 3 != 0);
+        testFile.compressed = (i % 2 != 0);
+
+        // Sparse data (like the spectrum), so compression is effective
+        testFile.data.assign(sizes[i], 0);
+        for (auto& byte : testFile.data)
+        {
+            if (gen64() % 16 == 0)
+                byte = (unsigned char)gen64();
+        }
+    }
+    return testFiles;
+}
+
+static void expectFilesWritten(const std::vector<TestFile>& testFiles)
+{
+    for (const auto& testFile : testFiles)
+    {
+        const std::string path = toPath(testFile.inDirectory ? (const CHAR16*)L"ep123" : nullptr, testFile.name);
+        ASSERT_TRUE(mockFileSystem.files.count(path));
+        const std::vector<unsigned char>& written = mockFileSystem.files[path];
+        if (testFile.compressed)
+        {
+            EXPECT_TRUE(written == compressInOneGo(testFile.data));
+
+            // Readable like files written by saveCompressed()
+            std::vector<unsigned char> decompressed(testFile.data.size(), 0xcd);
+            ASSERT_GE(written.size(), sizeof(CompressedFileHeader));
+            EXPECT_TRUE(isCompressedFileHeader(*(const CompressedFileHeader*)written.data(), testFile.data.size()));
+            unsigned long long readOffset = sizeof(CompressedFileHeader);
+            struct
+            {
+                const std::vector<unsigned char>& data;
+                unsigned long long& offset;
+                bool read(unsigned long long size, unsigned char* buffer)
+                {
+                    if (size > data.size() - offset)
+                        return false;
+                    memcpy(buffer, data.data() + offset, size);
+                    offset += size;
+                    return true;
+                }
+            } reader = { written, readOffset };
+            EXPECT_TRUE(decompressStream(reader, testFile.data.size(), decompressed.data()));
+            EXPECT_TRUE(decompressed == testFile.data);
+        }
+        else
+        {
+            EXPECT_TRUE(written == testFile.data);
+        }
+    }
+}
+
+TEST(TestCoreIncrementalFileWriter, ChunkedWritesProduceIdenticalFiles)
+{
+    const std::vector<TestFile> testFiles = createTestFiles();
+    std::unique_ptr<TestIncrementalFileWriter> writer(new TestIncrementalFileWriter());
+    writer->reset();
+
+    // Minimal budget (one chunk per step), small budget, and budget large enough for writing everything in one step
+    const unsigned long long budgets[] = { 0, 100000, ~0ULL };
+    for (unsigned long long maxTicks : budgets)
+    {
+        mockFileSystem = MockFileSystem();
+        writer->reset();
+
+        unsigned long long expectedChunks = 0;
+        unsigned long long totalSize = 0;
+        for (const auto& testFile : testFiles)
+        {
+            const BufferDataSource dataSource = { testFile.data.data() };
+            EXPECT_TRUE(writer->add(testFile.name, testFile.inDirectory ? (const CHAR16*)L"ep123" : nullptr,
+                testFile.data.size(), dataSource, testFile.compressed));
+            const unsigned long long chunkSize = testFile.compressed ? COMPRESSION_BLOCK_SIZE : WRITING_CHUNK_SIZE;
+            expectedChunks += testFile.data.size() ? (testFile.data.size() + chunkSize - 1) / chunkSize : 1;
+            totalSize += testFile.data.size();
+        }
+        EXPECT_TRUE(writer->isBusy());
+
+        // Main loop: one step per iteration, data of other files may be used between steps
+        unsigned long long steps = 0;
+        while (writer->isBusy())
+        {
+            EXPECT_TRUE(writer->step(maxTicks));
+            EXPECT_LE(mockFileSystem.openFiles, 1);
+            steps++;
+        }
+        EXPECT_EQ(mockFileSystem.openFiles, 0);
+        EXPECT_FALSE(writer->hasFailed());
+        EXPECT_EQ(writer->getNumberOfSteps(), steps);
+        EXPECT_EQ(writer->getNumberOfWrittenFiles(), testFiles.size());
+        EXPECT_EQ(writer->getNumberOfWrittenBytes(), totalSize);
+        if (maxTicks == 0)
+            EXPECT_EQ(steps, expectedChunks);
+        if (maxTicks == ~0ULL)
+            EXPECT_EQ(steps, 1ull);
+
+        expectFilesWritten(testFiles);
+
+        // Nothing left to do
+        EXPECT_TRUE(writer->step(maxTicks));
+        EXPECT_EQ(writer->getNumberOfSteps(), steps);
+    }
+}
+
+TEST(TestCoreIncrementalFileWriter, WriteErrorDropsQueue)
+{
+    const std::vector<TestFile> testFiles = createTestFiles();
+    std::unique_ptr<TestIncrementalFileWriter> writer(new TestIncrementalFileWriter());
+    writer->reset();
+    mockFileSystem = MockFileSystem();
+    mockFileSystem.failingWriteCall = 5;
+
+    for (const auto& testFile : testFiles)
+    {
+        const BufferDataSource dataSource = { testFile.data.data() };
+        EXPECT_TRUE(writer->add(testFile.name, nullptr, testFile.data.size(), dataSource, testFile.compressed));
+    }
+
+    unsigned int failedSteps = 0;
+    while (writer->isBusy())
+    {
+        if (!writer->step(0))
+            failedSteps++;
+    }
+    EXPECT_EQ(failedSteps, 1u);
+    EXPECT_TRUE(writer->hasFailed());
+    EXPECT_FALSE(writer->step(0));
+    EXPECT_EQ(writer->getNumberOfWrittenFiles(), 0u);
+    EXPECT_EQ(mockFileSystem.openFiles, 0);
+
+    // Reset allows writing again
+    writer->reset();
+    EXPECT_FALSE(writer->hasFailed());
+    EXPECT_FALSE(writer->isBusy());
+}
+
+TEST(TestCoreIncrementalFileWriter, QueueLimits)
+{
+    std::unique_ptr<TestIncrementalFileWriter> writer(new TestIncrementalFileWriter());
+    writer->reset();
+    const unsigned char data[1] = { 1 };
+    const BufferDataSource dataSource = { data };
+
+    // Name too long
+    std::vector<CHAR16> longName(TestIncrementalFileWriter::maxNameLength + 1, CHAR16('a'));
+    longName.back() = 0;
+    EXPECT_FALSE(writer->add(longName.data(), nullptr, 1, dataSource));
+    longName[TestIncrementalFileWriter::maxNameLength - 1] = 0;
+    EXPECT_TRUE(writer->add(longName.data(), nullptr, 1, dataSource));
+
+    // Queue full
+    for (unsigned int i = 1; i < testMaxFiles; i++)
+        EXPECT_TRUE(writer->add((const CHAR16*)L"file", nullptr, 1, dataSource));
+    EXPECT_FALSE(writer->add((const CHAR16*)L"file", nullptr, 1, dataSource));
+
+    writer->reset();
+    EXPECT_FALSE(writer->isBusy());
+}
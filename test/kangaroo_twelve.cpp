@@ -35,3 +35,95 @@ TEST(TestCoreK12, PerformanceDigest32Of1GB)
 
     delete [] inputPtr;
 }
+
+static void fillRandom(unsigned char* buffer, size_t size)
+{
+    for (size_t i = 0; i < size; i += 8)
+    {
+        unsigned long long val;
+        _rdrand64_step(&val);
+        memcpy(buffer + i, &val, (size - i < 8) ? size - i : 8);
+    }
+}
+
+TEST(TestCoreK12, Digest64To32MultiLaneEqualsScalar)
+{
+    constexpr unsigned int count = 1000;
+    unsigned char* input = new unsigned char[count * 64];
+    unsigned char* expected = new unsigned char[count * 32];
+    unsigned char* output = new unsigned char[count * 32];
+    fillRandom(input, count * 64);
+    for (unsigned int i = 0; i < count; ++i)
+        KangarooTwelve64To32(input + i * 64, expected + i * 32);
+
+    // x4 and x8 with non-consecutive inputs and outputs (reversed order)
+    const void* inputs[8];
+    void* outputs[8];
+    memset(output, 0, count * 32);
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        inputs[i] = input + (3 - i) * 64;
+        outputs[i] = output + (3 - i) * 32;
+    }
+    KangarooTwelve64To32x4(inputs, outputs);
+    EXPECT_EQ(memcmp(output, expected, 4 * 32), 0);
+
+    memset(output, 0, count * 32);
+    for (unsigned int i = 0; i < 8; ++i)
+    {
+        inputs[i] = input + (7 - i) * 64;
+        outputs[i] = output + (7 - i) * 32;
+    }
+    KangarooTwelve64To32x8(inputs, outputs);
+    EXPECT_EQ(memcmp(output, expected, 8 * 32), 0);
+
+    // consecutive blocks, including counts that are not a multiple of 4 or 8
+    for (unsigned int n : { 0u, 1u, 3u, 4u, 5u, 7u, 8u, 13u, 100u, count })
+    {
+        memset(output, 0, count * 32);
+        KangarooTwelve64To32Multiple(input, output, n);
+        EXPECT_EQ(memcmp(output, expected, n * 32), 0);
+        for (unsigned int i = n * 32; i < count * 32; ++i)
+            EXPECT_EQ(output[i], 0);
+    }
+
+    // batch of jobs added one by one
+    for (unsigned int n : { 1u, 6u, 8u, 21u, count })
+    {
+        memset(output, 0, count * 32);
+        KangarooTwelve64To32Batch batch;
+        for (unsigned int i = 0; i < n; ++i)
+            batch.add(input + i * 64, output + i * 32);
+        batch.flush();
+        EXPECT_EQ(batch.count, 0);
+        EXPECT_EQ(memcmp(output, expected, n * 32), 0);
+    }
+
+    delete[] input;
+    delete[] expected;
+    delete[] output;
+}
+
+TEST(TestCoreK12, PerformanceDigest64To32MultiLane)
+{
+    // number of 64 byte inputs, like the leafs of a tree with 2M leafs
+    constexpr size_t count = 2 * 1024 * 1024;
+    unsigned char* input = new unsigned char[count * 64];
+    unsigned char* output = new unsigned char[count * 32];
+    fillRandom(input, count * 64);
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < count; ++i)
+        KangarooTwelve64To32(input + i * 64, output + i * 32);
+    auto scalarMicroSec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    startTime = std::chrono::high_resolution_clock::now();
+    KangarooTwelve64To32Multiple(input, output, count);
+    auto multiLaneMicroSec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    std::cout << "K12 64 to 32 bytes: scalar " << double(count) / scalarMicroSec << " M hashes/sec, multi-lane "
+        << double(count) / multiLaneMicroSec << " M hashes/sec (speed-up " << double(scalarMicroSec) / multiLaneMicroSec << ")" << std::endl;
+
+    delete[] input;
+    delete[] output;
+}
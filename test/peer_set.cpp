@@ -0,0 +1,159 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/network_core/peer_set.h"
+
+#include <chrono>
+#include <random>
+#include <set>
+#include <vector>
+
+
+static constexpr unsigned int testPeerCount = 96;
+static constexpr unsigned int testDisseminationMultiplier = 6;
+
+typedef PeerIndexSet<testPeerCount> TestPeerSet;
+
+static void checkSet(const TestPeerSet& set, const std::set<unsigned int>& reference)
+{
+    EXPECT_EQ(set.size(), reference.size());
+    for (unsigned int i = 0; i < testPeerCount; i++)
+        EXPECT_EQ(set.contains(i), reference.count(i) == 1);
+}
+
+TEST(TestCorePeerSet, AddRemoveSelect)
+{
+    TestPeerSet set;
+    set.reset();
+    std::set<unsigned int> reference;
+    checkSet(set, reference);
+    unsigned short selected[testPeerCount];
+    EXPECT_EQ(set.selectRandom(selected, testDisseminationMultiplier), 0u);
+
+    std::mt19937_64 gen64(1);
+    for (unsigned int round = 0; round < 2000; round++)
+    {
+        const unsigned int peerIndex = gen64() % testPeerCount;
+        const bool isMember = gen64() % 3 != 0;
+        set.update(peerIndex, isMember);
+        if (isMember)
+            reference.insert(peerIndex);
+        else
+            reference.erase(peerIndex);
+
+        if (round % 50 == 0)
+        {
+            checkSet(set, reference);
+
+            // Selected peers are distinct members, the set isn't changed by selecting
+            const unsigned int count = set.selectRandom(selected, testDisseminationMultiplier);
+            EXPECT_EQ(count, std::min<unsigned int>(testDisseminationMultiplier, (unsigned int)reference.size()));
+            std::set<unsigned int> selectedSet(selected, selected + count);
+            EXPECT_EQ(selectedSet.size(), count);
+            for (unsigned int peer : selectedSet)
+                EXPECT_EQ(reference.count(peer), 1u);
+            checkSet(set, reference);
+            if (reference.size())
+                EXPECT_EQ(reference.count(set.getRandom()), 1u);
+        }
+    }
+
+    // Selection is roughly uniform
+    set.reset();
+    for (unsigned int i = 0; i < 20; i++)
+        set.add(i * 4);
+    std::vector<unsigned int> selectionCounts(testPeerCount, 0);
+    for (unsigned int round = 0; round < 20000; round++)
+    {
+        const unsigned int count = set.selectRandom(selected, testDisseminationMultiplier);
+        EXPECT_EQ(count, testDisseminationMultiplier);
+        for (unsigned int k = 0; k < count; k++)
+            selectionCounts[selected[k]]++;
+    }
+    for (unsigned int i = 0; i < testPeerCount; i++)
+    {
+        if (i % 4 || i >= 80)
+        {
+            EXPECT_EQ(selectionCounts[i], 0u);
+        }
+        else
+        {
+            // Expected 20000 * 6 / 20 = 6000 selections
+            EXPECT_GT(selectionCounts[i], 5000u);
+            EXPECT_LT(selectionCounts[i], 7000u);
+        }
+    }
+}
+
+// Minimal peer for measuring dissemination throughput
+struct TestPeer
+{
+    bool isConnected;
+    bool exchangedPublicPeers;
+    unsigned int dataToTransmitSize;
+    unsigned char dataToTransmit[65536];
+};
+
+static void pushToTestPeer(TestPeer& peer, const unsigned char* message, unsigned int size)
+{
+    if (peer.dataToTransmitSize + size > sizeof(peer.dataToTransmit))
+        peer.dataToTransmitSize = 0; // simulate transmission
+    memcpy(&peer.dataToTransmit[peer.dataToTransmitSize], message, size);
+    peer.dataToTransmitSize += size;
+}
+
+TEST(TestCorePeerSet, DisseminationThroughput)
+{
+    std::vector<TestPeer> peers(testPeerCount);
+    TestPeerSet set;
+    set.reset();
+    for (unsigned int i = 0; i < testPeerCount; i++)
+    {
+        peers[i].isConnected = (i % 5 != 0);
+        peers[i].exchangedPublicPeers = (i % 7 != 0);
+        peers[i].dataToTransmitSize = 0;
+        set.update(i, peers[i].isConnected && peers[i].exchangedPublicPeers);
+    }
+    unsigned char message[200];
+    for (unsigned int i = 0; i < sizeof(message); i++)
+        message[i] = (unsigned char)i;
+
+    constexpr unsigned int messageCount = 1000000;
+
+    // Previous implementation: build list of suitable peers for each message
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (unsigned int m = 0; m < messageCount; m++)
+    {
+        unsigned short suitablePeerIndices[testPeerCount];
+        unsigned short numberOfSuitablePeers = 0;
+        for (unsigned int i = 0; i < testPeerCount; i++)
+        {
+            if (peers[i].isConnected && peers[i].exchangedPublicPeers)
+                suitablePeerIndices[numberOfSuitablePeers++] = i;
+        }
+        unsigned short numberOfRemainingSuitablePeers = testDisseminationMultiplier;
+        while (numberOfRemainingSuitablePeers-- && numberOfSuitablePeers)
+        {
+            const unsigned short index = random(numberOfSuitablePeers);
+            pushToTestPeer(peers[suitablePeerIndices[index]], message, sizeof(message));
+            suitablePeerIndices[index] = suitablePeerIndices[--numberOfSuitablePeers];
+        }
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    // Incrementally maintained set and batched push
+    for (unsigned int m = 0; m < messageCount; m++)
+    {
+        unsigned short selectedPeerIndices[testDisseminationMultiplier];
+        const unsigned int numberOfSelectedPeers = set.selectRandom(selectedPeerIndices, testDisseminationMultiplier);
+        for (unsigned int k = 0; k < numberOfSelectedPeers; k++)
+            pushToTestPeer(peers[selectedPeerIndices[k]], message, sizeof(message));
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    const double scanSeconds = std::chrono::duration<double>(t1 - t0).count();
+    const double setSeconds = std::chrono::duration<double>(t2 - t1).count();
+    std::cout << "Disseminated messages per second (to " << testDisseminationMultiplier << " of " << set.size() << " suitable peers): "
+        << messageCount / scanSeconds / 1e6 << " M with scan of all peers, " << messageCount / setSeconds / 1e6 << " M with peer set" << std::endl;
+}
@@ -0,0 +1,196 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/pending_transaction_index.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+
+static const unsigned int initialTick = 1000;
+
+struct PendingTransactionIndexTest
+{
+    PendingTransactionIndex index;
+    std::vector<unsigned int> slotTicks;  // reference
+    std::vector<unsigned int> slotBuffer;
+    std::mt19937_64 gen64;
+
+    PendingTransactionIndexTest() : slotTicks(PendingTransactionIndex::slotCount, 0), slotBuffer(PendingTransactionIndex::slotCount), gen64(42)
+    {
+        EXPECT_TRUE(index.init());
+        index.beginEpoch(initialTick);
+    }
+
+    ~PendingTransactionIndexTest()
+    {
+        index.deinit();
+    }
+
+    void set(unsigned int slot, unsigned int tick)
+    {
+        index.set(slot, tick);
+        slotTicks[slot] = (tick >= initialTick && tick < initialTick + PendingTransactionIndex::tickCount) ? tick : 0;
+    }
+
+    void checkTick(unsigned int tick)
+    {
+        std::vector<unsigned int> expected;
+        for (unsigned int slot = 0; slot < PendingTransactionIndex::slotCount; slot++)
+        {
+            if (slotTicks[slot] == tick)
+                expected.push_back(slot);
+        }
+
+        const unsigned int n = index.getSlots(tick, slotBuffer.data(), PendingTransactionIndex::slotCount);
+        std::vector<unsigned int> slots(slotBuffer.begin(), slotBuffer.begin() + n);
+        std::sort(slots.begin(), slots.end());
+        EXPECT_EQ(slots, expected);
+        EXPECT_EQ(index.count(tick), expected.size());
+    }
+};
+
+TEST(TestCorePendingTransactionIndex, SetReplaceRemove)
+{
+    PendingTransactionIndexTest test;
+
+    // Fill some slots of computors and entities
+    for (unsigned int i = 0; i < 10000; i++)
+    {
+        const unsigned int slot = (i % 2) ? test.gen64() % PendingTransactionIndex::computorSlotCount : PendingTransactionIndex::entitySlot(test.gen64() % SPECTRUM_CAPACITY);
+        test.set(slot, initialTick + 1 + test.gen64() % 20);
+    }
+    for (unsigned int tick = initialTick; tick < initialTick + 25; tick++)
+        test.checkTick(tick);
+    EXPECT_EQ(test.index.countFromTick(initialTick + 11), (unsigned long long)std::count_if(test.slotTicks.begin(), test.slotTicks.end(), [](unsigned int t) { return t >= initialTick + 11; }));
+
+    // Replace transactions in slots with transactions of later ticks and remove some
+    for (unsigned int slot = 0; slot < PendingTransactionIndex::slotCount; slot++)
+    {
+        if (test.slotTicks[slot] && test.gen64() % 2)
+        {
+            if (test.gen64() % 4)
+                test.set(slot, test.slotTicks[slot] + 1 + test.gen64() % 5);
+            else
+            {
+                test.index.remove(slot);
+                test.slotTicks[slot] = 0;
+            }
+        }
+    }
+    // Ticks out of the epoch are not indexed
+    test.set(0, initialTick + PendingTransactionIndex::tickCount);
+    test.set(1, initialTick - 1);
+    for (unsigned int tick = initialTick; tick < initialTick + 30; tick++)
+        test.checkTick(tick);
+    EXPECT_EQ(test.index.count(initialTick - 1), 0);
+    EXPECT_EQ(test.index.count(initialTick + PendingTransactionIndex::tickCount), 0);
+
+    // New epoch removes all
+    test.index.beginEpoch(initialTick);
+    std::fill(test.slotTicks.begin(), test.slotTicks.end(), 0);
+    EXPECT_EQ(test.index.countFromTick(0), 0);
+    for (unsigned int tick = initialTick; tick < initialTick + 30; tick++)
+        test.checkTick(tick);
+}
+
+TEST(TestCorePendingTransactionIndex, TransactionDigestLookup)
+{
+    constexpr unsigned int digestCount = 1024;
+    std::mt19937_64 gen64(123);
+    static m256i digests[digestCount];
+    unsigned long long unknownFlags[digestCount / 64];
+    for (unsigned int i = 0; i < digestCount; i++)
+    {
+        digests[i] = m256i(gen64(), gen64(), gen64(), gen64());
+    }
+    // Duplicate digests and digests with same hash table position
+    digests[10] = digests[500];
+    digests[11] = digests[12];
+    digests[11].m256i_u64[3] ^= 1;
+    for (unsigned int k = 0; k < digestCount / 64; k++)
+        unknownFlags[k] = gen64() | (1ULL << 10) | (1ULL << 11) | (1ULL << 12);
+    unknownFlags[500 >> 6] |= 1ULL << (500 & 63);
+
+    static TransactionDigestLookup<digestCount> lookup;
+    lookup.build(digests, unknownFlags);
+    for (unsigned int i = 0; i < digestCount; i++)
+    {
+        // Reference: first unknown index with matching digest
+        int expected = -1;
+        for (unsigned int j = 0; j < digestCount; j++)
+        {
+            if ((unknownFlags[j >> 6] & (1ULL << (j & 63))) && digests[j] == digests[i])
+            {
+                expected = j;
+                break;
+            }
+        }
+        EXPECT_EQ(lookup.find(digests[i]), expected);
+    }
+    EXPECT_EQ(lookup.find(m256i(1, 2, 3, 4)), -1);
+
+    // Digests that are not flagged anymore are not found
+    EXPECT_EQ(lookup.find(digests[500]), 10);
+    unknownFlags[0] &= ~(1ULL << 10);
+    EXPECT_EQ(lookup.find(digests[500]), 500);
+    unknownFlags[500 >> 6] &= ~(1ULL << (500 & 63));
+    EXPECT_EQ(lookup.find(digests[500]), -1);
+}
+
+// Per tick cost of finding the pending transactions of a tick and looking up their digests
+static void benchmarkPerTickCost(unsigned int numberOfPendingTransactions)
+{
+    PendingTransactionIndexTest test;
+    constexpr unsigned int tickSpread = 20;
+    constexpr unsigned int digestCount = 1024;
+
+    std::vector<m256i> slotDigests(PendingTransactionIndex::slotCount);
+    for (unsigned int i = 0; i < numberOfPendingTransactions; i++)
+    {
+        const unsigned int slot = test.gen64() % PendingTransactionIndex::slotCount;
+        slotDigests[slot] = m256i(test.gen64(), test.gen64(), test.gen64(), test.gen64());
+        test.index.set(slot, initialTick + 1 + i % tickSpread);
+    }
+
+    static m256i tickDigests[digestCount];
+    unsigned long long unknownFlags[digestCount / 64];
+    static TransactionDigestLookup<digestCount> lookup;
+
+    unsigned long long matchCount = 0;
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for (unsigned int tick = initialTick + 1; tick <= initialTick + tickSpread; tick++)
+    {
+        const unsigned int n = test.index.getSlots(tick, test.slotBuffer.data(), PendingTransactionIndex::slotCount);
+
+        // Tick leader chooses some of the pending transactions, other nodes look them up by digest
+        for (unsigned int j = 0; j < digestCount; j++)
+            tickDigests[j] = (n) ? slotDigests[test.slotBuffer[test.gen64() % n]] : m256i::zero();
+        setMem(unknownFlags, sizeof(unknownFlags), 0xff);
+        lookup.build(tickDigests, unknownFlags);
+        for (unsigned int k = 0; k < n; k++)
+        {
+            const int j = lookup.find(slotDigests[test.slotBuffer[k]]);
+            if (j >= 0)
+            {
+                unknownFlags[j >> 6] &= ~(1ULL << (j & 63));
+                ++matchCount;
+            }
+        }
+    }
+    auto durationMicroSec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime);
+    EXPECT_GT(matchCount, 0);
+
+    // (previous implementation read the transaction of each of the PendingTransactionIndex::slotCount slots per tick)
+    std::cout << numberOfPendingTransactions << " pending transactions (" << numberOfPendingTransactions / tickSpread << " per tick): "
+        << durationMicroSec.count() / tickSpread << " microseconds per tick" << std::endl;
+}
+
+TEST(TestCorePendingTransactionIndex, PerformancePerTick)
+{
+    benchmarkPerTickCost(1000);
+    benchmarkPerTickCost(1000000);
+}
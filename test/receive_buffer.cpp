@@ -0,0 +1,178 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/network_core/receive_buffer.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+
+// Stream of framed messages with sizes in [minSize, maxSize], dejavu is the message index
+static std::vector<unsigned char> createMessageStream(unsigned int messageCount, unsigned int minSize, unsigned int maxSize, unsigned long long seed)
+{
+    std::mt19937_64 gen64(seed);
+    std::vector<unsigned char> stream;
+    for (unsigned int i = 0; i < messageCount; i++)
+    {
+        const unsigned int size = minSize + gen64() % (maxSize - minSize + 1);
+        const unsigned long long offset = stream.size();
+        stream.resize(offset + size);
+        RequestResponseHeader* header = (RequestResponseHeader*)&stream[offset];
+        header->checkAndSetSize(size);
+        header->setType((unsigned char)i);
+        header->setDejavu(i);
+        for (unsigned int j = sizeof(RequestResponseHeader); j < size; j++)
+            stream[offset + j] = (unsigned char)(i + j);
+    }
+    return stream;
+}
+
+static bool checkMessage(const RequestResponseHeader* header, unsigned int expectedIndex)
+{
+    if (header->dejavu() != expectedIndex || header->type() != (unsigned char)expectedIndex)
+        return false;
+    const unsigned char* payload = (const unsigned char*)header;
+    for (unsigned int j = sizeof(RequestResponseHeader); j < header->size(); j++)
+    {
+        if (payload[j] != (unsigned char)(expectedIndex + j))
+            return false;
+    }
+    return true;
+}
+
+// Feed stream in chunks of up to maxChunkSize like TCP receive does (limited by free space at end of buffer)
+// and parse it in place. Return number of correct messages.
+static unsigned int receiveAndParse(const std::vector<unsigned char>& stream, unsigned char* buffer, unsigned int bufferSize,
+    unsigned int maxChunkSize, unsigned long long seed)
+{
+    std::mt19937_64 gen64(seed);
+    unsigned int readOffset = 0, writeOffset = 0;
+    unsigned long long streamOffset = 0;
+    unsigned int messageIndex = 0;
+    while (streamOffset < stream.size())
+    {
+        // receive
+        EXPECT_LT(writeOffset, bufferSize);
+        unsigned long long chunkSize = 1 + gen64() % maxChunkSize;
+        chunkSize = std::min<unsigned long long>(chunkSize, bufferSize - writeOffset);
+        chunkSize = std::min<unsigned long long>(chunkSize, stream.size() - streamOffset);
+        memcpy(buffer + writeOffset, &stream[streamOffset], chunkSize);
+        writeOffset += (unsigned int)chunkSize;
+        streamOffset += chunkSize;
+
+        // parse
+        bool invalidHeader = false;
+        const RequestResponseHeader* header;
+        while (header = getReceivedMessage(buffer, readOffset, writeOffset, invalidHeader))
+        {
+            if (checkMessage(header, messageIndex))
+                messageIndex++;
+            readOffset += header->size();
+        }
+        EXPECT_FALSE(invalidHeader);
+        writeOffset = compactReceiveBuffer(buffer, bufferSize, readOffset, writeOffset);
+        EXPECT_LE(readOffset, writeOffset);
+    }
+    EXPECT_EQ(readOffset, 0u);
+    EXPECT_EQ(writeOffset, 0u);
+    return messageIndex;
+}
+
+// Previous implementation: move rest of buffer to the front after each message
+static unsigned int receiveAndParseWithMove(const std::vector<unsigned char>& stream, unsigned char* buffer, unsigned int bufferSize,
+    unsigned int maxChunkSize, unsigned long long seed)
+{
+    std::mt19937_64 gen64(seed);
+    unsigned int writeOffset = 0;
+    unsigned long long streamOffset = 0;
+    unsigned int messageIndex = 0;
+    while (streamOffset < stream.size())
+    {
+        unsigned long long chunkSize = 1 + gen64() % maxChunkSize;
+        chunkSize = std::min<unsigned long long>(chunkSize, bufferSize - writeOffset);
+        chunkSize = std::min<unsigned long long>(chunkSize, stream.size() - streamOffset);
+        memcpy(buffer + writeOffset, &stream[streamOffset], chunkSize);
+        writeOffset += (unsigned int)chunkSize;
+        streamOffset += chunkSize;
+
+        while (writeOffset >= sizeof(RequestResponseHeader) && writeOffset >= ((RequestResponseHeader*)buffer)->size())
+        {
+            const unsigned int size = ((RequestResponseHeader*)buffer)->size();
+            if (checkMessage((RequestResponseHeader*)buffer, messageIndex))
+                messageIndex++;
+            memmove(buffer, buffer + size, writeOffset -= size);
+        }
+    }
+    return messageIndex;
+}
+
+TEST(TestCoreReceiveBuffer, ParseInPlaceAndCompact)
+{
+    // Small buffer to compact often, messages of up to half of the buffer size
+    constexpr unsigned int bufferSize = 4096;
+    std::vector<unsigned char> buffer(bufferSize);
+    for (unsigned int maxChunkSize : { 1u, 7u, 100u, 1000u, bufferSize })
+    {
+        const std::vector<unsigned char> stream = createMessageStream(5000, sizeof(RequestResponseHeader), bufferSize / 2, maxChunkSize);
+        numberOfReceiveBufferCompactions = 0;
+        EXPECT_EQ(receiveAndParse(stream, buffer.data(), bufferSize, maxChunkSize, maxChunkSize), 5000u);
+        EXPECT_LE(numberOfReceiveBufferCompactedBytes, stream.size());
+    }
+
+    // Incomplete message that doesn't fit behind read offset is moved to the front
+    std::vector<unsigned char> stream = createMessageStream(2, 1000, 1000, 0);
+    RequestResponseHeader* secondHeader = (RequestResponseHeader*)&stream[1000];
+    secondHeader->checkAndSetSize(3500);
+    memcpy(buffer.data(), stream.data(), 1100);
+    bool invalidHeader = false;
+    unsigned int readOffset = 0;
+    const RequestResponseHeader* header = getReceivedMessage(buffer.data(), readOffset, 1100, invalidHeader);
+    ASSERT_NE(header, nullptr);
+    EXPECT_TRUE(checkMessage(header, 0));
+    readOffset += header->size();
+    EXPECT_EQ(getReceivedMessage(buffer.data(), readOffset, 1100, invalidHeader), nullptr);
+    numberOfReceiveBufferCompactions = 0;
+    EXPECT_EQ(compactReceiveBuffer(buffer.data(), bufferSize, readOffset, 1100), 100u);
+    EXPECT_EQ(readOffset, 0u);
+    EXPECT_EQ(numberOfReceiveBufferCompactions, 1u);
+    EXPECT_EQ(((RequestResponseHeader*)buffer.data())->size(), 3500u);
+
+    // Incomplete message that fits behind read offset stays in place
+    readOffset = 1000;
+    secondHeader->checkAndSetSize(2000);
+    memcpy(buffer.data(), stream.data(), 1100);
+    EXPECT_EQ(compactReceiveBuffer(buffer.data(), bufferSize, readOffset, 1100), 1100u);
+    EXPECT_EQ(readOffset, 1000u);
+    EXPECT_EQ(numberOfReceiveBufferCompactions, 1u);
+
+    // Invalid header
+    ((RequestResponseHeader*)buffer.data())->checkAndSetSize(sizeof(RequestResponseHeader) - 1);
+    EXPECT_EQ(getReceivedMessage(buffer.data(), 0, 1100, invalidHeader), nullptr);
+    EXPECT_TRUE(invalidHeader);
+}
+
+TEST(TestCoreReceiveBuffer, ParseThroughput)
+{
+    // Bursts of many small messages in a buffer of the size used for peers
+    constexpr unsigned int bufferSize = 33554432;
+    constexpr unsigned int maxChunkSize = 1 << 20;
+    std::vector<unsigned char> buffer(bufferSize);
+    const std::vector<unsigned char> stream = createMessageStream(200000, sizeof(RequestResponseHeader), 128, 42);
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    EXPECT_EQ(receiveAndParse(stream, buffer.data(), bufferSize, maxChunkSize, 1), 200000u);
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    // Previous implementation is much slower, so only measure with part of the stream
+    const std::vector<unsigned char> shortStream(stream.begin(), stream.begin() + stream.size() / 20);
+    EXPECT_GT(receiveAndParseWithMove(shortStream, buffer.data(), bufferSize, maxChunkSize, 1), 9000u);
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    const double parseInPlaceSeconds = std::chrono::duration<double>(t1 - t0).count();
+    const double moveSeconds = std::chrono::duration<double>(t2 - t1).count();
+    std::cout << "Parsing in place: " << stream.size() / parseInPlaceSeconds / 1e6 << " MB/s, "
+        << 200000 / parseInPlaceSeconds / 1e6 << " M messages/s. Moving after each message: "
+        << shortStream.size() / moveSeconds / 1e6 << " MB/s." << std::endl;
+}
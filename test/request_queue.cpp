@@ -0,0 +1,215 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/network_core/request_queue.h"
+
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+static constexpr unsigned int testMaxRequestSize = 1024;
+
+// Request with size in [sizeof(header), maxSize], dejavu is the producer index, payload encodes sequence number
+static void createTestRequest(std::vector<unsigned char>& request, unsigned int producer, unsigned int sequence, unsigned int maxSize, std::mt19937_64& gen64)
+{
+    const unsigned int size = (unsigned int)(sizeof(RequestResponseHeader) + 4 + gen64() % (maxSize - sizeof(RequestResponseHeader) - 3));
+    request.resize(size);
+    RequestResponseHeader* header = (RequestResponseHeader*)request.data();
+    header->checkAndSetSize(size);
+    header->setType((unsigned char)sequence);
+    header->setDejavu(producer);
+    *(unsigned int*)(header + 1) = sequence;
+    for (unsigned int j = sizeof(RequestResponseHeader) + 4; j < size; j++)
+        request[j] = (unsigned char)(sequence + j);
+}
+
+static bool checkTestRequest(const RequestResponseHeader* header, unsigned int& producer, unsigned int& sequence)
+{
+    producer = header->dejavu();
+    sequence = *(const unsigned int*)(header + 1);
+    if (header->type() != (unsigned char)sequence)
+        return false;
+    const unsigned char* payload = (const unsigned char*)header;
+    for (unsigned int j = sizeof(RequestResponseHeader) + 4; j < header->size(); j++)
+    {
+        if (payload[j] != (unsigned char)(sequence + j))
+            return false;
+    }
+    return true;
+}
+
+TEST(TestCoreRequestQueue, FillDrainAndWrap)
+{
+    RequestQueue* queue = new RequestQueue;
+    constexpr unsigned int bufferSize = 16384;
+    std::vector<unsigned char> buffer(bufferSize);
+    queue->init(buffer.data(), bufferSize, testMaxRequestSize);
+    EXPECT_EQ(queue->depth(), 0u);
+    EXPECT_EQ(queue->bufferUsage(), 0u);
+
+    unsigned int pos;
+    EXPECT_FALSE(queue->tryDequeue(pos));
+
+    // Fill buffer until requests are dropped
+    std::mt19937_64 gen64(1);
+    std::vector<unsigned char> request;
+    unsigned int enqueued = 0;
+    while (1)
+    {
+        createTestRequest(request, 7, enqueued, 200, gen64);
+        if (!queue->tryEnqueue((void*)7, (RequestResponseHeader*)request.data()))
+            break;
+        enqueued++;
+    }
+    EXPECT_GT(enqueued, 0u);
+    EXPECT_EQ(queue->depth(), enqueued);
+    EXPECT_EQ(queue->getNumberOfDroppedRequests(), 1);
+    EXPECT_LE(queue->bufferUsage(), bufferSize);
+
+    // Drain in order
+    for (unsigned int i = 0; i < enqueued; i++)
+    {
+        ASSERT_TRUE(queue->tryDequeue(pos));
+        EXPECT_EQ(pos, i);
+        unsigned int producer, sequence;
+        EXPECT_TRUE(checkTestRequest(queue->getRequest(pos), producer, sequence));
+        EXPECT_EQ(producer, 7u);
+        EXPECT_EQ(sequence, i);
+        EXPECT_EQ(queue->getPeer(pos), (void*)7);
+        queue->release(pos);
+    }
+    EXPECT_FALSE(queue->tryDequeue(pos));
+    EXPECT_EQ(queue->depth(), 0u);
+    EXPECT_EQ(queue->bufferUsage(), 0u);
+
+    // Many rounds through buffer and element array with few requests in the queue
+    unsigned int dequeued = enqueued;
+    for (unsigned int i = 0; i < 3 * RequestQueue::length; i++)
+    {
+        createTestRequest(request, 1, enqueued, testMaxRequestSize, gen64);
+        ASSERT_TRUE(queue->tryEnqueue(nullptr, (RequestResponseHeader*)request.data()));
+        enqueued++;
+        if (i % 3 != 0)
+        {
+            ASSERT_TRUE(queue->tryDequeue(pos));
+            unsigned int producer, sequence;
+            EXPECT_TRUE(checkTestRequest(queue->getRequest(pos), producer, sequence));
+            EXPECT_EQ(sequence, dequeued);
+            queue->release(pos);
+            dequeued++;
+        }
+        else if (queue->depth() > 8)
+        {
+            while (queue->tryDequeue(pos))
+            {
+                queue->release(pos);
+                dequeued++;
+            }
+        }
+    }
+    EXPECT_EQ(queue->getNumberOfEnqueuedRequests(), (long long)enqueued);
+    EXPECT_EQ(queue->getNumberOfDroppedRequests(), 1);
+
+    delete queue;
+}
+
+TEST(TestCoreRequestQueue, FullElementArray)
+{
+    RequestQueue* queue = new RequestQueue;
+    std::vector<unsigned char> buffer(RequestQueue::length * 16 + testMaxRequestSize * 2);
+    queue->init(buffer.data(), (unsigned int)buffer.size(), testMaxRequestSize);
+
+    RequestResponseHeader header;
+    header.checkAndSetSize(sizeof(header));
+    header.setType(0);
+    for (unsigned int i = 0; i < RequestQueue::length; i++)
+        ASSERT_TRUE(queue->tryEnqueue(nullptr, &header));
+    EXPECT_FALSE(queue->tryEnqueue(nullptr, &header));
+    EXPECT_EQ(queue->depth(), RequestQueue::length);
+
+    // Element is only reused after it has been released
+    unsigned int pos;
+    ASSERT_TRUE(queue->tryDequeue(pos));
+    EXPECT_FALSE(queue->tryEnqueue(nullptr, &header));
+    queue->release(pos);
+    EXPECT_TRUE(queue->tryEnqueue(nullptr, &header));
+    EXPECT_EQ(queue->getNumberOfDroppedRequests(), 2);
+
+    delete queue;
+}
+
+TEST(TestCoreRequestQueue, MultiProducerMultiConsumer)
+{
+    RequestQueue* queue = new RequestQueue;
+    constexpr unsigned int bufferSize = 1 << 20;
+    std::vector<unsigned char> buffer(bufferSize);
+    queue->init(buffer.data(), bufferSize, testMaxRequestSize);
+
+    constexpr unsigned int producerCount = 3, consumerCount = 3, requestsPerProducer = 20000;
+    std::vector<unsigned int> lastSequence(producerCount * consumerCount, 0);
+    std::atomic<unsigned int> receivedCount = 0, corruptCount = 0, reorderedCount = 0;
+    std::atomic<bool> stop = false;
+
+    std::vector<std::thread> threads;
+    for (unsigned int c = 0; c < consumerCount; c++)
+    {
+        threads.emplace_back([&, c]()
+            {
+                std::vector<unsigned int> nextSequence(producerCount, 0);
+                while (!stop || queue->depth())
+                {
+                    unsigned int pos;
+                    if (!queue->tryDequeue(pos))
+                    {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    unsigned int producer, sequence;
+                    if (!checkTestRequest(queue->getRequest(pos), producer, sequence) || producer >= producerCount)
+                    {
+                        corruptCount++;
+                    }
+                    else
+                    {
+                        // Requests of one producer are dequeued in order
+                        if (sequence < nextSequence[producer])
+                            reorderedCount++;
+                        nextSequence[producer] = sequence + 1;
+                    }
+                    queue->release(pos);
+                    receivedCount++;
+                }
+            });
+    }
+    for (unsigned int p = 0; p < producerCount; p++)
+    {
+        threads.emplace_back([&, p]()
+            {
+                std::mt19937_64 gen64(p);
+                std::vector<unsigned char> request;
+                for (unsigned int i = 0; i < requestsPerProducer; i++)
+                {
+                    createTestRequest(request, p, i, testMaxRequestSize, gen64);
+                    while (!queue->tryEnqueue(nullptr, (RequestResponseHeader*)request.data()))
+                        std::this_thread::yield();
+                }
+            });
+    }
+    for (unsigned int p = 0; p < producerCount; p++)
+        threads[consumerCount + p].join();
+    stop = true;
+    for (unsigned int c = 0; c < consumerCount; c++)
+        threads[c].join();
+
+    EXPECT_EQ(receivedCount, producerCount * requestsPerProducer);
+    EXPECT_EQ(corruptCount, 0u);
+    EXPECT_EQ(reorderedCount, 0u);
+    EXPECT_EQ(queue->getNumberOfEnqueuedRequests(), (long long)(producerCount * requestsPerProducer));
+    EXPECT_EQ(queue->depth(), 0u);
+    EXPECT_EQ(queue->bufferUsage(), 0u);
+
+    delete queue;
+}
@@ -16,6 +16,7 @@
 
 #include "utils.h"
 
+#include <atomic>
 #include <chrono>
 #include <fstream>
 #include <filesystem>
@@ -297,3 +298,117 @@ TEST(TestQubicScoreFunction, CommonTests)
 {
     runCommonTests();
 }
+
+// Throughput of the score function with the settings of the node, on one thread
+TEST(TestQubicScoreFunction, PerformanceSolutionsPerSecond)
+{
+    constexpr unsigned long long numberOfSamples = 8;
+    auto sampleString = readCSV(COMMON_TEST_SAMPLES_FILE_NAME);
+    ASSERT_GE(sampleString.size(), numberOfSamples);
+
+    auto pScore = std::make_unique<ScoreFunction<DATA_LENGTH, NUMBER_OF_HIDDEN_NEURONS, NUMBER_OF_NEIGHBOR_NEURONS, MAX_DURATION, NUMBER_OF_OPTIMIZATION_STEPS, 1>>();
+    pScore->initMemory();
+    int x = 0;
+    top_of_stack = (unsigned long long)(&x);
+
+    unsigned long long totalMicroSec = 0;
+    for (unsigned long long i = 0; i < numberOfSamples; ++i)
+    {
+        m256i miningSeed = hexToByte(sampleString[i][0], 32);
+        m256i publicKey = hexToByte(sampleString[i][1], 32);
+        m256i nonce = hexToByte(sampleString[i][2], 32);
+        pScore->initMiningData(miningSeed);
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        unsigned int score = (*pScore)(0, publicKey, miningSeed, nonce);
+        totalMicroSec += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - t0).count();
+        EXPECT_TRUE(pScore->isValidScore(score));
+    }
+
+    std::cout << "NEURON " << NUMBER_OF_HIDDEN_NEURONS << ", NEIGHBOR " << NUMBER_OF_NEIGHBOR_NEURONS
+        << ", DURATIONS " << MAX_DURATION << ", OPT_STEPS " << NUMBER_OF_OPTIMIZATION_STEPS << ": "
+        << numberOfSamples * 1000000.0 / totalMicroSec << " solutions per second" << std::endl;
+}
+
+// Tasks added while several processors take and steal them must be processed exactly once
+TEST(TestQubicScoreFunction, TaskQueueMultiThreaded)
+{
+    constexpr unsigned long long solutionBufferCount = 4;
+    constexpr unsigned int numberOfThreads = 6;
+    typedef ScoreFunction<kDataLength, kSettings[0][NR_NEURONS], kSettings[0][NR_NEIGHBOR_NEURONS], kSettings[0][DURATIONS], kSettings[0][NR_OPTIMIZATION_STEPS], solutionBufferCount> ScoreType;
+    constexpr unsigned int queueCapacity = solutionBufferCount * ScoreType::taskDequeCapacity;
+    auto pScore = std::make_unique<ScoreType>();
+
+    for (unsigned int round = 0; round < 3; ++round)
+    {
+        // Tasks beyond the capacity of all deques are dropped if nothing is processed yet
+        const unsigned int numberOfTasks = (round == 0) ? queueCapacity + 10 : queueCapacity / round;
+        const long long droppedBefore = pScore->getNumberOfDroppedTasks();
+        std::vector<std::atomic<unsigned int>> processCount(numberOfTasks);
+        for (auto& count : processCount)
+            count = 0;
+
+        pScore->resetTaskQueue();
+        std::atomic<unsigned int> numberOfAddedTasks = 0;
+        auto addTasks = [&]()
+            {
+                for (unsigned int id = 0; id < numberOfTasks; ++id)
+                {
+                    if (pScore->addTask(m256i(id, 0, 0, 0), m256i(1, 2, 3, 4), m256i(id, round, 0, 0)))
+                        ++numberOfAddedTasks;
+                }
+            };
+        if (round == 0)
+        {
+            addTasks();
+            EXPECT_EQ(numberOfAddedTasks, queueCapacity);
+            EXPECT_EQ(pScore->getNumberOfDroppedTasks() - droppedBefore, 10);
+        }
+        pScore->startProcessTaskQueue();
+
+        std::atomic<bool> allAdded = (round == 0);
+        std::vector<std::thread> threads;
+        for (unsigned int t = 0; t < numberOfThreads; ++t)
+        {
+            threads.emplace_back([&, t]()
+                {
+                    m256i publicKey, miningSeed, nonce;
+                    while (!allAdded || !pScore->isTaskQueueProcessed())
+                    {
+                        if (pScore->getTask(t, &publicKey, &miningSeed, &nonce))
+                        {
+                            EXPECT_EQ(publicKey.m256i_u64[0], nonce.m256i_u64[0]);
+                            EXPECT_EQ(nonce.m256i_u64[1], round);
+                            ASSERT_LT(nonce.m256i_u64[0], numberOfTasks);
+                            ++processCount[nonce.m256i_u64[0]];
+                            pScore->finishTask();
+                        }
+                    }
+                });
+        }
+
+        // Add tasks while processing (the tick processor adds all tasks before processing, but this is more demanding)
+        if (round != 0)
+        {
+            addTasks();
+            allAdded = true;
+        }
+        for (auto& thread : threads)
+            thread.join();
+        pScore->stopProcessTaskQueue();
+
+        unsigned int numberOfProcessedTasks = 0;
+        for (unsigned int id = 0; id < numberOfTasks; ++id)
+        {
+            EXPECT_LE(processCount[id], 1);
+            numberOfProcessedTasks += processCount[id];
+        }
+        EXPECT_EQ(numberOfProcessedTasks, numberOfAddedTasks);
+        if (round != 0)
+        {
+            EXPECT_EQ(numberOfProcessedTasks, numberOfTasks);
+            EXPECT_EQ(pScore->getNumberOfDroppedTasks(), droppedBefore);
+        }
+    }
+    std::cout << pScore->getNumberOfStolenTasks() << " tasks stolen, " << pScore->getNumberOfDroppedTasks() << " tasks dropped" << std::endl;
+}
@@ -4,7 +4,11 @@
 
 #include "../src/score_cache.h"
 
+#include <chrono>
+#include <memory>
 #include <random>
+#include <thread>
+#include <vector>
 
 
 template <unsigned int cacheCapacity>
@@ -199,3 +203,87 @@ TEST(TestQubicScoreCache, RandomSeeds80pctFilled) {
     testCacheRandomSeeds<200000>(80);     // non-prime number as cache size
     testCacheRandomSeeds<199999>(80);     // prime number as cache size
 }
+
+// Processors concurrently looking up scores and adding entries on miss. Each thread fetches its entries twice,
+// so the second pass checks that no entry has been corrupted by concurrent access.
+template <unsigned int shardCount>
+void testConcurrentAccess(unsigned int numberOfThreads)
+{
+    constexpr unsigned int cacheCapacity = 200000;
+    constexpr unsigned int entriesPerThread = 20000;
+    constexpr unsigned int repetitions = 10;
+    typedef ScoreCache<cacheCapacity, 20, shardCount> CacheType;
+    std::unique_ptr<CacheType> cache(new CacheType());
+
+    struct Entry
+    {
+        m256i publicKey;
+        m256i nonce;
+        unsigned int cacheIndex;
+        int score;
+    };
+    const m256i miningSeed(1, 2, 3, 4);
+    std::vector<std::vector<Entry>> entries(numberOfThreads);
+    for (unsigned int t = 0; t < numberOfThreads; ++t)
+    {
+        std::mt19937_64 gen64(t);
+        entries[t].resize(entriesPerThread);
+        for (auto& entry : entries[t])
+        {
+            entry.publicKey = m256i(gen64(), gen64(), gen64(), gen64());
+            entry.nonce = m256i(gen64(), gen64(), gen64(), gen64());
+            entry.cacheIndex = cache->getCacheIndex(entry.publicKey, miningSeed, entry.nonce);
+            entry.score = gen64() % 1000;
+        }
+    }
+
+    std::vector<unsigned int> wrongScores(numberOfThreads, 0);
+    std::vector<std::thread> threads;
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for (unsigned int t = 0; t < numberOfThreads; ++t)
+    {
+        threads.emplace_back([&, t]()
+            {
+                for (unsigned int r = 0; r < repetitions; ++r)
+                {
+                    for (const auto& entry : entries[t])
+                    {
+                        unsigned int idx = entry.cacheIndex;
+                        int fetchedScore = cache->tryFetching(entry.publicKey, miningSeed, entry.nonce, idx);
+                        if (fetchedScore == cache->SCORE_CACHE_MISS || (fetchedScore == cache->SCORE_CACHE_COLLISION && r == 0))
+                        {
+                            cache->addEntry(entry.publicKey, miningSeed, entry.nonce, idx, entry.score);
+                        }
+                        else if (fetchedScore >= cache->MIN_VALID_SCORE && fetchedScore != entry.score)
+                        {
+                            ++wrongScores[t];
+                        }
+                    }
+                }
+            });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    auto durationMicroSec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    for (unsigned int t = 0; t < numberOfThreads; ++t)
+    {
+        EXPECT_EQ(wrongScores[t], 0);
+    }
+    const unsigned long long fetchCount = (unsigned long long)numberOfThreads * entriesPerThread * repetitions;
+    EXPECT_EQ(fetchCount, (unsigned long long)cache->hitCount() + cache->missCount() + cache->collisionCount());
+    EXPECT_GT(cache->hitCount(), 0);
+
+    std::cout << numberOfThreads << " threads, " << shardCount << " shards: " << fetchCount * 1000000 / (durationMicroSec + 1)
+        << " fetches per second (hits " << cache->hitCount() << ", misses " << cache->missCount()
+        << ", collisions " << cache->collisionCount() << ")" << std::endl;
+}
+
+TEST(TestQubicScoreCache, ConcurrentAccess) {
+    testConcurrentAccess<1>(16);     // single lock
+    testConcurrentAccess<64>(16);
+    testConcurrentAccess<64>(12);
+    testConcurrentAccess<256>(16);
+}
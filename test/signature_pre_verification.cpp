@@ -0,0 +1,168 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/network_core/signature_pre_verification.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+// Mocked request queue with fixed-size requests
+struct TestRequest
+{
+    RequestResponseHeader header;
+    unsigned long long id;
+};
+
+static constexpr unsigned char signedType = 1;
+static constexpr unsigned char unsignedType = 2;
+
+static TestRequest testQueue[SignaturePreVerifier::queueLength];
+static volatile unsigned short testQueueHead = 0, testQueueTail = 0;
+static SignaturePreVerifier testPreVerifier;
+static std::atomic<unsigned long long> numberOfChecks;
+
+static RequestResponseHeader* getTestRequest(unsigned short elementIndex)
+{
+    return &testQueue[elementIndex].header;
+}
+
+// Requests with id divisible by 3 have invalid signature
+static bool checkTestSignature(RequestResponseHeader* header, m256i& publicKey, bool& valid)
+{
+    ++numberOfChecks;
+    if (header->type() != signedType)
+        return false;
+    const TestRequest* request = (const TestRequest*)header;
+    publicKey = m256i(request->id, 0, 0, 0);
+    valid = (request->id % 3) != 0;
+    return true;
+}
+
+static void enqueueTestRequest(unsigned long long id)
+{
+    TestRequest& request = testQueue[testQueueHead];
+    request.header.setSize<sizeof(TestRequest)>();
+    request.header.setType((id % 4) ? signedType : unsignedType);
+    request.id = id;
+    std::atomic_thread_fence(std::memory_order_release);
+    testQueueHead++;
+}
+
+// Dequeue request at tail and check pre-verification result. Returns id of request.
+static unsigned long long dequeueTestRequest(PreVerifiedSignature& preVerifiedSignature)
+{
+    const unsigned short elementIndex = testQueueTail;
+    testPreVerifier.takeElement(elementIndex, preVerifiedSignature);
+    const unsigned long long id = testQueue[elementIndex].id;
+    if (preVerifiedSignature.state != PreVerifiedSignature::notVerified)
+    {
+        EXPECT_EQ(testQueue[elementIndex].header.type(), signedType);
+        EXPECT_TRUE(preVerifiedSignature.isVerifiedWith(m256i(id, 0, 0, 0)));
+        EXPECT_FALSE(preVerifiedSignature.isVerifiedWith(m256i(id + 1, 0, 0, 0)));
+        EXPECT_EQ(preVerifiedSignature.isValid(), (id % 3) != 0);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    testQueueTail++;
+    testPreVerifier.releaseElement(elementIndex);
+    return id;
+}
+
+static void resetTestQueue()
+{
+    testQueueHead = 0;
+    testQueueTail = 0;
+    testPreVerifier.reset();
+    numberOfChecks = 0;
+}
+
+TEST(TestCoreSignaturePreVerification, SingleThreaded)
+{
+    resetTestQueue();
+
+    // Nothing to do on empty queue and if only the next element to be dequeued is queued
+    EXPECT_EQ(testPreVerifier.tryPreVerify(testQueueTail, testQueueHead, getTestRequest, checkTestSignature, 10), 0);
+    enqueueTestRequest(0);
+    EXPECT_EQ(testPreVerifier.tryPreVerify(testQueueTail, testQueueHead, getTestRequest, checkTestSignature, 10), 0);
+
+    for (unsigned long long id = 1; id < 10; id++)
+        enqueueTestRequest(id);
+    EXPECT_EQ(testPreVerifier.tryPreVerify(testQueueTail, testQueueHead, getTestRequest, checkTestSignature, 5), 5);
+    EXPECT_EQ(testPreVerifier.queueDepth(testQueueTail, testQueueHead), 6);
+    EXPECT_EQ(testPreVerifier.getNumberOfVerifiedRequests(), 4); // element 4 is unsigned
+    EXPECT_EQ(testPreVerifier.getNumberOfInvalidRequests(), 1);  // element 3
+
+    PreVerifiedSignature preVerifiedSignature;
+    for (unsigned long long id = 0; id < 10; id++)
+    {
+        EXPECT_EQ(dequeueTestRequest(preVerifiedSignature), id);
+        const bool expectVerified = id >= 1 && id <= 5 && (id % 4);
+        EXPECT_EQ(preVerifiedSignature.state != PreVerifiedSignature::notVerified, expectVerified);
+    }
+    EXPECT_EQ(testPreVerifier.getNumberOfUsedResults(), 4);
+    EXPECT_EQ(testPreVerifier.queueDepth(testQueueTail, testQueueHead), 0);
+
+    // Cursor that fell behind the tail restarts after the tail
+    for (unsigned long long id = 10; id < 20; id++)
+        enqueueTestRequest(id);
+    EXPECT_EQ(testPreVerifier.tryPreVerify(testQueueTail, testQueueHead, getTestRequest, checkTestSignature, 100), 9);
+    for (unsigned long long id = 10; id < 20; id++)
+    {
+        EXPECT_EQ(dequeueTestRequest(preVerifiedSignature), id);
+        EXPECT_EQ(preVerifiedSignature.state != PreVerifiedSignature::notVerified, id > 10 && (id % 4));
+    }
+}
+
+TEST(TestCoreSignaturePreVerification, ConcurrentPreVerificationAndProcessing)
+{
+    resetTestQueue();
+
+    // More requests than queue elements, so indices wrap around several times
+    constexpr unsigned long long numberOfRequests = 300000;
+    constexpr unsigned int numberOfPreVerifiers = 3;
+    std::atomic<bool> stop = false;
+
+    std::thread producer([&]()
+        {
+            for (unsigned long long id = 0; id < numberOfRequests; id++)
+            {
+                while ((unsigned short)(testQueueHead + 1) == testQueueTail)
+                    _mm_pause();
+                enqueueTestRequest(id);
+            }
+        });
+
+    std::vector<std::thread> preVerifiers;
+    for (unsigned int i = 0; i < numberOfPreVerifiers; i++)
+    {
+        preVerifiers.emplace_back([&]()
+            {
+                while (!stop)
+                {
+                    if (!testPreVerifier.tryPreVerify(testQueueTail, testQueueHead, getTestRequest, checkTestSignature, 4))
+                        _mm_pause();
+                }
+            });
+    }
+
+    // Consumer processes requests in order
+    PreVerifiedSignature preVerifiedSignature;
+    for (unsigned long long id = 0; id < numberOfRequests; id++)
+    {
+        while (testQueueTail == testQueueHead)
+            _mm_pause();
+        EXPECT_EQ(dequeueTestRequest(preVerifiedSignature), id);
+    }
+
+    stop = true;
+    producer.join();
+    for (auto& thread : preVerifiers)
+        thread.join();
+
+    EXPECT_EQ(testPreVerifier.getNumberOfUsedResults(), testPreVerifier.getNumberOfVerifiedRequests());
+    EXPECT_GE(numberOfChecks.load(), (unsigned long long)testPreVerifier.getNumberOfVerifiedRequests());
+    std::cout << testPreVerifier.getNumberOfVerifiedRequests() << " of " << numberOfRequests << " requests pre-verified, "
+        << testPreVerifier.getNumberOfUsedResults() << " results used, " << testPreVerifier.getNumberOfWaits() << " waits" << std::endl;
+}
@@ -24,8 +24,11 @@
 
 #include "../src/spectrum.h"
 
+#include <atomic>
 #include <chrono>
 #include <random>
+#include <thread>
+#include <vector>
 
 static bool transfer(const m256i& src, const m256i& dst, long long amount)
 {
@@ -416,3 +419,332 @@ TEST(TestCoreSpectrum, AntiDustEdgeCaseHugeBinZeroBalance)
     test.afterAntiDust();
 }
 
+// Compute complete spectrum digest tree from scratch (reference for checking incremental update)
+static void computeSpectrumDigestsFromScratch(m256i* digests)
+{
+    unsigned int digestIndex;
+    for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
+    {
+        KangarooTwelve64To32(&spectrum[digestIndex], &digests[digestIndex]);
+    }
+    unsigned int previousLevelBeginning = 0;
+    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
+    while (numberOfLeafs > 1)
+    {
+        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
+        {
+            KangarooTwelve64To32(&digests[previousLevelBeginning + i], &digests[digestIndex++]);
+        }
+        previousLevelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
+    }
+}
+
+static void checkSpectrumDigestsMatchFromScratch()
+{
+    // reorgBuffer is large enough to hold the complete digest tree
+    m256i* referenceDigests = (m256i*)reorgBuffer;
+    computeSpectrumDigestsFromScratch(referenceDigests);
+    EXPECT_EQ(spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1], referenceDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1]);
+    EXPECT_EQ(memcmp(spectrumDigests, referenceDigests, spectrumDigestsSizeInByte), 0);
+}
+
+TEST(TestCoreSpectrum, IncrementalDigestUpdate)
+{
+    SpectrumTest test;
+    std::vector<m256i> ids;
+    for (int i = 0; i < 10000; i++)
+    {
+        ids.push_back(m256i::randomValue());
+        increaseEnergy(ids.back(), 1000000llu + i);
+    }
+
+    // Reorganization computes complete digest tree and resets change journal
+    reorganizeSpectrum();
+    EXPECT_EQ(spectrumChangeJournalSize, 0);
+    checkSpectrumDigestsMatchFromScratch();
+
+    // Update based on change journal is identical to complete recomputation
+    for (int tick = 0; tick < 2; tick++)
+    {
+        ++system.tick;
+        for (int i = 0; i < 1000; i++)
+        {
+            // only initial entities are used as source, because they have enough balance
+            const m256i src = ids[test.rnd64() % 10000];
+            if (test.rnd64() % 4 == 0)
+            {
+                // new entity
+                ids.push_back(m256i::randomValue());
+                EXPECT_TRUE(transfer(src, ids.back(), 10));
+            }
+            else
+            {
+                EXPECT_TRUE(transfer(src, ids[test.rnd64() % ids.size()], 1));
+            }
+        }
+        EXPECT_GT(spectrumChangeJournalSize, 0);
+        updateSpectrumDigests();
+        EXPECT_EQ(spectrumChangeJournalSize, 0);
+        checkSpectrumDigestsMatchFromScratch();
+    }
+
+    // Full scan path gives the same result
+    ++system.tick;
+    for (int i = 0; i < 1000; i++)
+    {
+        EXPECT_TRUE(transfer(ids[test.rnd64() % 10000], ids[test.rnd64() % ids.size()], 1));
+    }
+    updateSpectrumDigestsFullScan();
+    checkSpectrumDigestsMatchFromScratch();
+
+    // Overflow of change journal falls back to full scan
+    ++system.tick;
+    const unsigned long long fullScanCountBefore = spectrumDigestUpdateFullScanCount;
+    for (unsigned int i = 0; i <= SPECTRUM_CHANGE_JOURNAL_CAPACITY; i++)
+    {
+        EXPECT_TRUE(transfer(ids[i % 10000], ids[(i + 1) % ids.size()], 1));
+    }
+    EXPECT_TRUE(spectrumChangeJournalOverflow);
+    updateSpectrumDigests();
+    EXPECT_FALSE(spectrumChangeJournalOverflow);
+    EXPECT_EQ(spectrumDigestUpdateFullScanCount, fullScanCountBefore + 1);
+    checkSpectrumDigestsMatchFromScratch();
+}
+
+// Fill spectrum deterministically, including entities with balance 0 and a collision chain wrapping around the end
+static void fillSpectrumForReorgTest(unsigned long long seed)
+{
+    std::mt19937_64 gen64(seed);
+    memset(spectrum, 0, spectrumSizeInBytes);
+    updateSpectrumInfo();
+    for (unsigned int i = 0; i < SPECTRUM_CAPACITY / 8; i++)
+    {
+        m256i publicKey(gen64(), gen64(), gen64(), gen64());
+        if (i % 1000 == 0)
+        {
+            // hash map index close to end of spectrum
+            publicKey.m256i_u32[0] = SPECTRUM_CAPACITY - 1 - (i % 7);
+        }
+        long long amount = 1 + gen64() % 1000000;
+        increaseEnergy(publicKey, amount);
+        if (gen64() % 3 == 0)
+        {
+            decreaseEnergy(spectrumIndex(publicKey), amount);
+        }
+    }
+    EXPECT_FALSE(isZero(spectrum[SPECTRUM_CAPACITY - 1].publicKey));
+    EXPECT_FALSE(isZero(spectrum[0].publicKey));
+}
+
+// Single-threaded reorganization as implemented before parallelization (reference)
+static void reorganizeSpectrumSingleThreaded(::Entity* reorgSpectrum, SpectrumInfo& info)
+{
+    setMem(reorgSpectrum, SPECTRUM_CAPACITY * sizeof(::Entity), 0);
+    for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
+    {
+        if (spectrum[i].incomingAmount - spectrum[i].outgoingAmount)
+        {
+            unsigned int index = spectrum[i].publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
+            while (!isZero(reorgSpectrum[index].publicKey))
+            {
+                index = (index + 1) & (SPECTRUM_CAPACITY - 1);
+            }
+            copyMem(&reorgSpectrum[index], &spectrum[i], sizeof(::Entity));
+        }
+    }
+
+    info.numberOfEntities = 0;
+    info.totalAmount = 0;
+    for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
+    {
+        long long balance = reorgSpectrum[i].incomingAmount - reorgSpectrum[i].outgoingAmount;
+        if (balance || !isZero(reorgSpectrum[i].publicKey))
+        {
+            info.numberOfEntities++;
+            info.totalAmount += balance;
+        }
+    }
+}
+
+static void testParallelReorganizeSpectrum(unsigned int helperCount)
+{
+    EXPECT_TRUE(initSpectrum());
+    EXPECT_TRUE(initCommonBuffers());
+    EXPECT_TRUE(logger.initLogging());
+
+    // Compute reference result with single-threaded implementation
+    fillSpectrumForReorgTest(42);
+    SpectrumInfo referenceInfo;
+    reorganizeSpectrumSingleThreaded((::Entity*)reorgBuffer, referenceInfo);
+    m256i referenceSpectrumHash;
+    KangarooTwelve(reorgBuffer, spectrumSizeInBytes, &referenceSpectrumHash, sizeof(referenceSpectrumHash));
+
+    // Run parallel implementation with helper threads
+    fillSpectrumForReorgTest(42);
+    volatile bool stopHelpers = false;
+    std::vector<std::thread> helpers;
+    for (unsigned int i = 0; i < helperCount; i++)
+    {
+        helpers.emplace_back([&stopHelpers]()
+            {
+                while (!stopHelpers)
+                {
+                    if (!parallelJob.tryHelp())
+                        std::this_thread::yield();
+                }
+            });
+    }
+    auto startTime = std::chrono::high_resolution_clock::now();
+    reorganizeSpectrum();
+    auto durationMilliSec = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - startTime);
+    stopHelpers = true;
+    for (auto& helper : helpers)
+        helper.join();
+    std::cout << "reorganizeSpectrum() with " << helperCount << " helper threads took " << durationMilliSec.count() << " ms" << std::endl;
+
+    // Result has to be identical
+    m256i spectrumHash;
+    KangarooTwelve(spectrum, spectrumSizeInBytes, &spectrumHash, sizeof(spectrumHash));
+    EXPECT_EQ(spectrumHash, referenceSpectrumHash);
+    EXPECT_EQ(spectrumInfo.numberOfEntities, referenceInfo.numberOfEntities);
+    EXPECT_EQ(spectrumInfo.totalAmount, referenceInfo.totalAmount);
+    checkSpectrumDigestsMatchFromScratch();
+
+    logger.deinitLogging();
+    deinitSpectrum();
+    deinitCommonBuffers();
+}
+
+TEST(TestCoreSpectrum, ParallelReorganizeEqualsSingleThreaded)
+{
+    testParallelReorganizeSpectrum(0);
+    testParallelReorganizeSpectrum(3);
+}
+
+TEST(TestCoreSpectrum, ParallelStartupDigestsEqualFromScratch)
+{
+    EXPECT_TRUE(initSpectrum());
+    EXPECT_TRUE(initCommonBuffers());
+    EXPECT_TRUE(logger.initLogging());
+
+    fillSpectrumForReorgTest(7);
+    memset(spectrumDigests, 0, spectrumDigestsSizeInByte);
+
+    // Main thread does other work between start and finish (as while loading the next file at startup)
+    volatile bool stopHelpers = false;
+    std::vector<std::thread> helpers;
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        helpers.emplace_back([&stopHelpers]()
+            {
+                while (!stopHelpers)
+                {
+                    if (!parallelJob.tryHelp())
+                        std::this_thread::yield();
+                }
+            });
+    }
+    startComputingSpectrumDigests();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    finishComputingSpectrumDigests();
+    stopHelpers = true;
+    for (auto& helper : helpers)
+        helper.join();
+
+    EXPECT_EQ(spectrumChangeJournalSize, 0);
+    checkSpectrumDigestsMatchFromScratch();
+
+    logger.deinitLogging();
+    deinitSpectrum();
+    deinitCommonBuffers();
+}
+
+TEST(TestCoreSpectrum, ConcurrentLookupsDuringEnergyUpdates)
+{
+    SpectrumTest test;
+
+    // Entities existing from the beginning (must always be found)
+    std::vector<m256i> existingIds;
+    for (int i = 0; i < 100000; i++)
+    {
+        existingIds.push_back(m256i(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64()));
+        increaseEnergy(existingIds.back(), 1000000llu + i);
+    }
+
+    // Ids inserted concurrently by writer and ids never inserted (must never be found)
+    std::vector<m256i> newIds, missingIds;
+    for (int i = 0; i < 200000; i++)
+    {
+        newIds.push_back(m256i(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64()));
+        missingIds.push_back(m256i(test.rnd64(), test.rnd64(), test.rnd64(), test.rnd64()));
+    }
+
+    std::atomic<bool> stopReaders = false;
+    std::atomic<unsigned long long> lookupCount = 0;
+    std::atomic<unsigned long long> errorCount = 0;
+    auto reader = [&](unsigned long long seed)
+        {
+            std::mt19937_64 gen64(seed);
+            while (!stopReaders)
+            {
+                const m256i& existingId = existingIds[gen64() % existingIds.size()];
+                const long long layoutVersion = spectrumLayoutVersion;
+                const int index = spectrumIndex(existingId);
+                const m256i slotId = (index >= 0) ? spectrum[index].publicKey : m256i::zero();
+                // slot content can only be checked if layout has not changed (indices change in reorganization)
+                if (index < 0 || (!(layoutVersion & 1) && layoutVersion == spectrumLayoutVersion && slotId != existingId))
+                    ++errorCount;
+                if (spectrumIndex(missingIds[gen64() % missingIds.size()]) >= 0)
+                    ++errorCount;
+                lookupCount += 2;
+            }
+        };
+    std::vector<std::thread> readers;
+    for (unsigned long long i = 0; i < 4; i++)
+        readers.emplace_back(reader, test.rnd64());
+
+    // Writer: insert new entities, change balances, and reorganize hash map
+    for (unsigned int i = 0; i < newIds.size(); i++)
+    {
+        increaseEnergy(newIds[i], 1 + i);
+        decreaseEnergy(spectrumIndex(existingIds[i % existingIds.size()]), 1);
+        if (i == newIds.size() / 2)
+        {
+            // remove half of the new entities
+            for (unsigned int j = 0; j < i; j += 2)
+                decreaseEnergy(spectrumIndex(newIds[j]), 1 + j);
+            reorganizeSpectrum();
+        }
+    }
+
+    stopReaders = true;
+    for (auto& thread : readers)
+        thread.join();
+
+    EXPECT_EQ(errorCount, 0);
+    EXPECT_GT(lookupCount, 0);
+    std::cout << lookupCount << " concurrent lookups" << std::endl;
+
+    // Check final state after concurrent operations
+    for (unsigned int i = 0; i < newIds.size(); i++)
+    {
+        const int index = spectrumIndex(newIds[i]);
+        if (i < newIds.size() / 2 && i % 2 == 0)
+        {
+            EXPECT_LT(index, 0);
+        }
+        else
+        {
+            EXPECT_GE(index, 0);
+            EXPECT_EQ(energy(index), 1 + i);
+        }
+    }
+    for (unsigned int i = 0; i < existingIds.size(); i++)
+    {
+        const int index = spectrumIndex(existingIds[i]);
+        EXPECT_GE(index, 0);
+        EXPECT_EQ(energy(index), 1000000ll + i - 2);
+    }
+    EXPECT_EQ(checkAndGetInfo().numberOfEntities, existingIds.size() + newIds.size() * 3 / 4);
+}